@@ -17,6 +17,8 @@
 #include "draw_utils.h"
 #include "tree_leaf.h"
 #include <set>
+#include <fstream>
+#include <chrono>
 
 #ifdef _WIN32 // wglew.h seems to be Windows only
 #include <GL/wglew.h> // for wglSwapIntervalEXT
@@ -74,7 +76,7 @@ bool enable_model3d_custom_mipmaps(1), flatten_tt_mesh_under_models(0), show_map
 bool enable_dpart_shadows(0), enable_tt_model_reflect(1), enable_tt_model_indir(0), auto_calc_tt_model_zvals(0), use_model_lod_blocks(0), enable_translocator(0), enable_grass_fire(0);
 bool disable_model_textures(0), start_in_inf_terrain(0), allow_shader_invariants(1), config_unlimited_weapons(0), disable_tt_water_reflect(0), allow_model3d_quads(1);
 bool enable_timing_profiler(0), fast_transparent_spheres(0), force_ref_cmap_update(0), use_instanced_pine_trees(0), enable_postproc_recolor(0), draw_building_interiors(0);
-bool toggle_room_light(0), merge_model_objects(0), display_frame_time(0), reverse_3ds_vert_winding_order(1), disable_dlights(0);
+bool toggle_room_light(0), merge_model_objects(0), display_frame_time(0), reverse_3ds_vert_winding_order(1), disable_dlights(0), use_wide_cobj_bvh(1), use_cobj_bvh_refit(1), benchmark_vertex_dedup(0), parallel_obj_file_load(0), async_tile_gen(0), benchmark_cpu_noise(0), parallel_ped_update(0), parallel_uobj_update(0), parallel_smiley_paths(0), headless_mode(0), compress_model3d_files(0), model3d_drop_tangents(0), cpu_texture_compress(0);
 int xoff(0), yoff(0), xoff2(0), yoff2(0), rand_gen_index(0), mesh_rgen_index(0), camera_change(1), camera_in_air(0), auto_time_adv(0);
 int animate(1), animate2(1), draw_model(0), init_x(STARTING_INIT_X), fire_key(0), do_run(0), init_num_balls(-1), change_wmode_frame(0);
 int game_mode(0), map_mode(0), load_hmv(0), load_coll_objs(1), read_landscape(0), screen_reset(0), mesh_seed(0), rgen_seed(1);
@@ -92,7 +94,7 @@ int enable_fsource(0), run_forward(0), advanced(0), dynamic_mesh_scroll(0);
 int read_snow_file(0), write_snow_file(0), mesh_detail_tex(NOISE_TEX);
 int read_light_files[NUM_LIGHTING_TYPES] = {0}, write_light_files[NUM_LIGHTING_TYPES] = {0};
 unsigned num_snowflakes(0), create_voxel_landscape(0), hmap_filter_width(0), num_dynam_parts(100), snow_coverage_resolution(2), num_birds_per_tile(2), num_fish_per_tile(15);
-unsigned erosion_iters(0), erosion_iters_tt(0), video_framerate(60), num_video_threads(0), skybox_tid(0);
+unsigned erosion_iters(0), erosion_iters_tt(0), video_framerate(60), num_video_threads(0), skybox_tid(0), headless_benchmark_ticks(0);
 float NEAR_CLIP(DEF_NEAR_CLIP), FAR_CLIP(DEF_FAR_CLIP), system_max_orbit(1.0), sky_occlude_scale(0.0), tree_slope_thresh(5.0), mouse_sensitivity(1.0), tt_grass_scale_factor(1.0);
 float water_plane_z(0.0), base_gravity(1.0), crater_depth(1.0), crater_radius(1.0), disabled_mesh_z(FAR_CLIP), vegetation(1.0), atmosphere(1.0), biome_x_offset(0.0);
 float mesh_file_scale(1.0), mesh_file_tz(0.0), speed_mult(1.0), mesh_z_cutoff(-FAR_CLIP), relh_adj_tex(0.0), dodgeball_metalness(1.0), ray_step_size_mult(1.0);
@@ -106,7 +108,7 @@ float model_hemi_lighting_scale(0.5), pine_tree_radius_scale(1.0);
 float light_int_scale[NUM_LIGHTING_TYPES] = {1.0, 1.0, 1.0, 1.0, 1.0}, first_ray_weight[NUM_LIGHTING_TYPES] = {1.0, 1.0, 1.0, 1.0, 1.0};
 double camera_zh(0.0);
 point mesh_origin(all_zeros), camera_pos(all_zeros), cube_map_center(all_zeros);
-string user_text, cobjs_out_fn, sphere_materials_fn, hmap_out_fn, skybox_cube_map_name, coll_damage_name;
+string user_text, cobjs_out_fn, scene_cache_dir, sphere_materials_fn, hmap_out_fn, skybox_cube_map_name, coll_damage_name, zone_profile_trace_fn, headless_benchmark_fn;
 colorRGB ambient_lighting_scale(1,1,1), mesh_color_scale(1,1,1);
 colorRGBA bkg_color, flower_color(ALPHA0);
 set<unsigned char> keys, keyset;
@@ -1591,8 +1593,9 @@ std::string const config_dir("scene_config");
 FILE *open_config_file(string const &filename) {
 
 	FILE *fp(fopen(filename.c_str(), "r"));
-	if (fp != nullptr) return fp; // found in run dir
-	if (open_file(fp, (config_dir + "/" + filename).c_str(), "input configuration file")) return fp; // found in config dir
+	if (fp != nullptr) {register_scene_input_file(filename); return fp;} // found in run dir
+	string const fn(config_dir + "/" + filename);
+	if (open_file(fp, fn.c_str(), "input configuration file")) {register_scene_input_file(fn); return fp;} // found in config dir
 	return nullptr; // failed
 }
 
@@ -1621,6 +1624,18 @@ int load_config(string const &config_file) {
 	kwmb.add("use_dense_voxels", use_dense_voxels);
 	kwmb.add("use_voxel_cobjs", use_voxel_cobjs);
 	kwmb.add("mt_cobj_tree_build", mt_cobj_tree_build);
+	kwmb.add("use_wide_cobj_bvh", use_wide_cobj_bvh);
+	kwmb.add("use_cobj_bvh_refit", use_cobj_bvh_refit);
+	kwmb.add("benchmark_vertex_dedup", benchmark_vertex_dedup);
+	kwmb.add("parallel_obj_file_load", parallel_obj_file_load);
+	kwmb.add("async_tile_gen", async_tile_gen);
+	kwmb.add("benchmark_cpu_noise", benchmark_cpu_noise);
+	kwmb.add("parallel_ped_update", parallel_ped_update);
+	kwmb.add("parallel_uobj_update", parallel_uobj_update);
+	kwmb.add("parallel_smiley_paths", parallel_smiley_paths);
+	kwmb.add("compress_model3d_files", compress_model3d_files);
+	kwmb.add("model3d_drop_tangents", model3d_drop_tangents);
+	kwmb.add("cpu_texture_compress", cpu_texture_compress);
 	kwmb.add("global_lighting_update", global_lighting_update);
 	kwmb.add("lighting_update_offline", lighting_update_offline);
 	kwmb.add("two_sided_lighting", two_sided_lighting);
@@ -1726,6 +1741,7 @@ int load_config(string const &config_file) {
 	kwmu.add("grass_density", grass_density);
 	kwmu.add("max_unique_trees", max_unique_trees);
 	kwmu.add("shadow_map_sz", shadow_map_sz);
+	kwmu.add("headless_benchmark_ticks", headless_benchmark_ticks);
 	kwmu.add("max_ray_bounces", MAX_RAY_BOUNCES);
 	kwmu.add("num_test_snowflakes", num_snowflakes);
 	kwmu.add("hmap_filter_width", hmap_filter_width);
@@ -1834,6 +1850,7 @@ int load_config(string const &config_file) {
 
 	kw_to_val_map_t<string> kwms(error);
 	kwms.add("cobjs_out_filename", cobjs_out_fn);
+	kwms.add("scene_cache_dir",    scene_cache_dir);
 	kwms.add("coll_damage_name",   coll_damage_name);
 	kwms.add("read_hmap_modmap_filename",  read_hmap_modmap_fn);
 	kwms.add("write_hmap_modmap_filename", write_hmap_modmap_fn);
@@ -1843,6 +1860,8 @@ int load_config(string const &config_file) {
 	kwms.add("sphere_materials_fn", sphere_materials_fn);
 	kwms.add("write_heightmap_png", hmap_out_fn);
 	kwms.add("skybox_cube_map", skybox_cube_map_name);
+	kwms.add("zone_profile_trace_fn", zone_profile_trace_fn);
+	kwms.add("headless_benchmark_fn", headless_benchmark_fn);
 
 	while (read_str(fp, strc)) { // slow but should be OK: these ones require special handling
 		string const str(strc);
@@ -2184,10 +2203,89 @@ void init_debug_callback() {
 }
 
 
+class headless_benchmark_t {
+
+	vector<pair<string, double>> phases; // {name, ms}
+	std::chrono::steady_clock::time_point phase_start;
+
+public:
+	headless_benchmark_t() : phase_start(std::chrono::steady_clock::now()) {}
+
+	void end_phase(string const &name) {
+		auto const now(std::chrono::steady_clock::now());
+		phases.emplace_back(name, 1000.0*std::chrono::duration<double>(now - phase_start).count());
+		phase_start = now;
+	}
+	void write_results(string const &fn) const { // one "benchmark_phase,<name>,<ms>" line per phase to stdout, and "<name>,<ms>" lines to fn if nonempty
+		double total(0.0);
+		for (auto i = phases.begin(); i != phases.end(); ++i) {cout << "benchmark_phase," << i->first << "," << i->second << endl; total += i->second;}
+		cout << "benchmark_phase,Total," << total << endl;
+		if (fn.empty()) return;
+		std::ofstream out(fn);
+
+		if (!out.good()) {
+			cerr << "Error: Failed to open headless benchmark results file " << fn << " for writing" << endl;
+			return;
+		}
+		out << "phase,ms" << endl;
+		for (auto i = phases.begin(); i != phases.end(); ++i) {out << i->first << "," << i->second << endl;}
+		out << "Total," << total << endl;
+	}
+};
+
+// generates the scene and runs headless_benchmark_ticks simulation ticks without a window or GL context, timing each phase
+void run_headless_benchmark() {
+
+	cout << "Running headless benchmark for " << headless_benchmark_ticks << " ticks" << endl;
+	headless_mode = 1;
+	if (enable_timing_profiler) {toggle_timing_profiler();}
+	headless_benchmark_t bench;
+	load_textures(); // CPU image decode and generation only; textures are uploaded on first use
+	bench.end_phase("Texture Load");
+
+	if (universe_only) {
+		cout << "Headless benchmark doesn't support universe mode" << endl;
+	}
+	else {
+		reset_planet_defaults(); // set atmosphere and vegetation
+		init_objects();
+		alloc_matrices();
+		t_trees.resize(num_trees);
+		init_models();
+		init_terrain_mesh();
+		init_lights();
+		bench.end_phase("Scene Init");
+		gen_scene(1, (world_mode == WMODE_GROUND), 0, 0, 0);
+		gen_snow_coverage();
+		if (enable_grass_fire) {init_ground_fire();}
+		create_object_groups();
+		init_game_state();
+		if (game_mode) {gamemode_rand_appear();}
+		bench.end_phase("Scene Gen");
+
+		if (world_mode == WMODE_INF_TERRAIN) {
+			init_tiled_terrain_hmap_and_buildings(); // and cities
+			bench.end_phase("Buildings and Cities");
+			unsigned const num_tiles(gen_tiled_terrain_tiles_cpu_benchmark());
+			bench.end_phase("Terrain Tiles");
+			cout << "Generated " << num_tiles << " terrain tiles" << endl;
+		}
+		get_landscape_texture_color(0, 0); // force creation of the cached_ls_colors vector in the master thread (before build_lightmap())
+		build_lightmap(1);
+		bench.end_phase("Lighting");
+		for (unsigned i = 0; i < headless_benchmark_ticks; ++i) {headless_sim_tick();}
+		bench.end_phase("Simulation");
+	}
+	bench.write_results(headless_benchmark_fn);
+	if (enable_timing_profiler) {timing_profiler_stats();} // print stats for zones added during the benchmark
+}
+
+
 int main(int argc, char** argv) {
 
 	cout << "Starting 3DWorld" << endl;
-	if (argc == 2) {read_ueventlist(argv[1]);}
+	bool const headless(argc >= 2 && strcmp(argv[1], "-headless") == 0); // "-headless [config_file]"
+	if (argc == 2 && !headless) {read_ueventlist(argv[1]);}
 	int rs(1);
 	if      (srand_param == 1) {rs = GET_TIME_MS();}
 	else if (srand_param != 0) {rs = srand_param;}
@@ -2195,8 +2293,14 @@ int main(int argc, char** argv) {
 	create_sin_table();
 	set_scene_constants();
 	load_texture_names(); // needs to be before config file load
-	load_top_level_config(defaults_file);
+	load_top_level_config((headless && argc >= 3) ? argv[2] : defaults_file);
 	gen_gauss_rand_arr(); // after reading seed from config file
+	if (headless && headless_benchmark_ticks == 0) {headless_benchmark_ticks = 100;} // default if not set in the config file
+
+	if (headless_benchmark_ticks > 0) {
+		run_headless_benchmark();
+		return 0;
+	}
 	cout << "Loading."; cout.flush();
 	
  	// Initialize GLUT
@@ -2248,6 +2352,7 @@ int main(int argc, char** argv) {
 		t_trees.resize(num_trees);
 		init_models();
 		init_terrain_mesh();
+		if (benchmark_cpu_noise) {run_cpu_noise_benchmark();}
 		init_lights();
 		check_gl_error(7774);
 		gen_scene(1, (world_mode == WMODE_GROUND), 0, 0, 0);
@@ -974,13 +974,14 @@ public:
 	int width, height, ncolors, bump_tid, alpha_tid;
 	float anisotropy, mipmap_alpha_weight;
 	std::string name;
+	std::string cpu_cache_fn; // texture cache file for the CPU compressed mipmap chain, if any
 
 protected:
 	unsigned char *data, *orig_data, *colored_data, *mm_data;
 	unsigned tid;
 	colorRGBA color;
 	vector<unsigned> mm_offsets;
-	enum {DEFER_TYPE_NONE=0, DEFER_TYPE_DDS, NUM_DEFER_TYPE};
+	enum {DEFER_TYPE_NONE=0, DEFER_TYPE_DDS, DEFER_TYPE_CPU_CACHE, NUM_DEFER_TYPE};
 
 	void maybe_swap_rb(unsigned char *ptr) const;
 
@@ -1006,6 +1007,12 @@ public:
 	void merge_in_alpha_channel(texture_t const &at);
 	void build_mipmaps();
 	void create_custom_mipmaps();
+	void calc_next_mipmap_level(unsigned char const *idata, vector<unsigned char> &odata, unsigned w, unsigned h, color_wrapper const &cw) const;
+	bool upload_cpu_compressed();
+	std::string get_cpu_compressed_cache_fn(texture_t const *const alpha_src, bool alpha_in_red_comp, bool is_bump) const;
+	bool try_load_cpu_compressed_cache(texture_t const *const alpha_src=nullptr, bool alpha_in_red_comp=0, bool is_bump=0);
+	template<typename R> bool read_cpu_cache_header(R &reader);
+	bool upload_cpu_compressed_cache();
 	unsigned char const *get_mipmap_data(unsigned level) const;
 	void set_to_color(colorRGBA const &c);
 	void maybe_assign_normal_map_tid(int nm_tid) {if (nm_tid >= 0 && bump_tid < 0) {bump_tid = nm_tid;}}
@@ -1057,6 +1064,7 @@ public:
 	bool is_allocated() const {return (data != nullptr);}
 	bool defer_load()   const {return (defer_load_type != DEFER_TYPE_NONE);}
 	bool is_loaded()    const {return (is_allocated() || defer_load());}
+	bool is_cpu_cache_only() const {return (defer_load_type == DEFER_TYPE_CPU_CACHE && !is_allocated());} // read from the texture cache and not decoded
 	colorRGBA get_avg_color() const {return color;}
 	unsigned char *get_data() {assert(data); return data;}
 	unsigned char const *get_data() const {assert(data); return data;}
@@ -1341,6 +1349,7 @@ class  shape3d;
 struct color_tid_vol;
 class  vert_coll_detector;
 struct cobj_query_callback;
+struct line_query_packet_t;
 struct user_waypt_t;
 class  voxel_model;
 
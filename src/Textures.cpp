@@ -199,7 +199,7 @@ float def_tex_aniso(2.0);
 unsigned char *landscape0 = NULL;
 
 
-extern bool mesh_difuse_tex_comp, water_is_lava, invert_bump_maps;
+extern bool mesh_difuse_tex_comp, water_is_lava, invert_bump_maps, headless_mode;
 extern unsigned smoke_tid, dl_tid, elem_tid, gb_tid, reflection_tid, room_mirror_ref_tid, depth_tid, empty_smap_tid, frame_buffer_RGB_tid, skybox_tid, skybox_cube_tid, univ_reflection_tid;
 extern int world_mode, read_landscape, default_ground_tex, xoff2, yoff2, DISABLE_WATER;
 extern int scrolling, dx_scroll, dy_scroll, display_mode, iticks, universe_only, window_width, window_height;
@@ -299,7 +299,7 @@ void load_textures() {
 	}
 	textures[TREE_HEMI_TEX].set_color_alpha_to_one();
 	textures_inited = 1;
-
+	if (headless_mode) return; // no GL context
 	glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &max_tius);
 	glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &max_ctius);
 	cout << "max TIUs: " << max_tius << ", max combined TIUs: " << max_ctius << endl;
@@ -338,7 +338,7 @@ int get_texture_by_name(string const &name, bool is_normal_map, bool invert_y, i
 	// type format width height wrap_mir ncolors use_mipmaps name [invert_y=0 [do_compress=1 [anisotropy=1.0 [mipmap_alpha_weight=1.0 [normal_map=0]]]]]
 	texture_t new_tex(0, 7, 0, 0, wrap_mir, 3, 1, name, invert_y, (def_tex_compress && !is_normal_map), ((aniso > 0.0) ? aniso : def_tex_aniso), 1.0, is_normal_map);
 
-	if (textures_inited) {
+	if (textures_inited && !new_tex.try_load_cpu_compressed_cache()) { // not in the texture cache
 		new_tex.load(tid);
 		new_tex.init();
 	}
@@ -533,14 +533,17 @@ void texture_t::do_gl_init(bool free_after_upload) {
 	}
 	//cout << "bind texture " << name << " size " << width << "x" << height << endl;
 	//RESET_TIME;
-	setup_texture(tid, (use_mipmaps != 0 && !defer_load()), wrap, wrap, mirror, mirror, 0, anisotropy);
+	setup_texture(tid, (use_mipmaps != 0 && (!defer_load() || defer_load_type == DEFER_TYPE_CPU_CACHE)), wrap, wrap, mirror, mirror, 0, anisotropy);
 	if (defer_load()) {deferred_load_and_bind();} // FIXME: mipmaps?
-	else {
+
+	if (!defer_load()) { // Note: deferred_load_and_bind() may fall back to decoding the source image if the texture cache can't be read
 		assert(is_allocated());
 		assert(width > 0 && height > 0);
-		glTexImage2D(GL_TEXTURE_2D, 0, calc_internal_format(), width, height, 0, calc_format(), get_data_format(), data);
-		if (use_mipmaps == 1 || use_mipmaps == 2) {gen_mipmaps();}
-		if (use_mipmaps == 3 || use_mipmaps == 4) {create_custom_mipmaps();}
+		if (!upload_cpu_compressed()) { // not compressed on the CPU or read from the texture cache
+			glTexImage2D(GL_TEXTURE_2D, 0, calc_internal_format(), width, height, 0, calc_format(), get_data_format(), data);
+			if (use_mipmaps == 1 || use_mipmaps == 2) {gen_mipmaps();}
+			if (use_mipmaps == 3 || use_mipmaps == 4) {create_custom_mipmaps();}
+		}
 	}
 	//assert(glIsTexture(tid)); // for some reason this check is slow
 	if (free_after_upload) {free_client_mem();}
@@ -556,6 +559,7 @@ void texture_t::upload_cube_map_face(unsigned ix) {
 
 void texture_t::calc_color() { // incorrect in is_16_bit_gray mode
 
+	if (is_cpu_cache_only()) return; // color was read from the texture cache
 	if (defer_load() && !is_allocated()) {color = WHITE; return;} // texture not loaded - this is the best we can do
 	assert(is_allocated());
 	float colors[4] = {0.0}, weight(0.0);
@@ -918,6 +922,51 @@ void texture_t::make_normal_map() {
 }
 
 
+// averages 2x2 texels of the w x h level in idata to create the next smaller level in odata; uses custom alpha for use_mipmaps 3 and 4
+void texture_t::calc_next_mipmap_level(unsigned char const *idata, vector<unsigned char> &odata, unsigned w, unsigned h, color_wrapper const &cw) const {
+
+	unsigned const w1(max(w,    1U)), h1(max(h,    1U));
+	unsigned const w2(max(w>>1, 1U)), h2(max(h>>1, 1U));
+	unsigned const xinc((w2 < w1) ? ncolors : 0), yinc((h2 < h1) ? ncolors*w1 : 0);
+	bool const custom_alpha(ncolors == 4 && (use_mipmaps == 3 || use_mipmaps == 4));
+	odata.resize(ncolors*w2*h2);
+
+	for (unsigned y = 0; y < h2; ++y) {
+		for (unsigned x = 0; x < w2; ++x) {
+			unsigned const ix1(ncolors*(y*w2+x)), ix2(ncolors*((y<<1)*w1+(x<<1)));
+
+			if (!custom_alpha) {
+				for (int n = 0; n < ncolors; ++n) {
+					odata[ix1+n] = (unsigned char)(((unsigned)idata[ix2+n] + idata[ix2+xinc+n] + idata[ix2+yinc+n] + idata[ix2+yinc+xinc+n]) >> 2);
+				}
+			}
+			else { // custom alpha mipmaps
+				unsigned const a1(idata[ix2+3]), a2(idata[ix2+xinc+3]), a3(idata[ix2+yinc+3]), a4(idata[ix2+yinc+xinc+3]);
+				unsigned const a_sum(a1 + a2 + a3 + a4);
+
+				if (a_sum == 0) { // fully transparent
+					if (use_mipmaps == 4) {UNROLL_3X(odata[ix1+i_] = cw.c[i_];)} // use average texture color
+					else { // color is average of all 4 values
+						UNROLL_3X(odata[ix1+i_] = (unsigned char)(((unsigned)idata[ix2+i_] + idata[ix2+xinc+i_] + idata[ix2+yinc+i_] + idata[ix2+yinc+xinc+i_]) / 4);)
+					}
+					odata[ix1+3] = 0;
+				}
+				else { // pre-multiplied and normalized colors
+					if (use_mipmaps == 4) {
+						unsigned const a_cw(1020 - a_sum); // use average texture color for transparent pixels
+						UNROLL_3X(odata[ix1+i_] = (unsigned char)((a1*idata[ix2+i_] + a2*idata[ix2+xinc+i_] + a3*idata[ix2+yinc+i_] + a4*idata[ix2+yinc+xinc+i_] + a_cw*cw.c[i_]) / 1020);)
+					}
+					else {
+						UNROLL_3X(odata[ix1+i_] = (unsigned char)((a1*idata[ix2+i_] + a2*idata[ix2+xinc+i_] + a3*idata[ix2+yinc+i_] + a4*idata[ix2+yinc+xinc+i_]) / a_sum);)
+					}
+					odata[ix1+3] = min(255U, min(max(max(a1, a2), max(a3, a4)), unsigned(mipmap_alpha_weight*a_sum)));
+				}
+			}
+		} // for x
+	} // for y
+}
+
+
 void texture_t::create_custom_mipmaps() {
 
 	assert(is_allocated());
@@ -929,48 +978,9 @@ void texture_t::create_custom_mipmaps() {
 	color_wrapper cw; cw.set_c4(color);
 
 	for (unsigned w = width, h = height, level = 1; w > 1 || h > 1; w >>= 1, h >>= 1, ++level) {
-		unsigned const w1(max(w,    1U)), h1(max(h,    1U));
-		unsigned const w2(max(w>>1, 1U)), h2(max(h>>1, 1U));
-		unsigned const xinc((w2 < w1) ? ncolors : 0), yinc((h2 < h1) ? ncolors*w1 : 0);
-		odata.resize(ncolors*w2*h2);
-
-		for (unsigned y = 0; y < h2; ++y) {
-			for (unsigned x = 0; x < w2; ++x) {
-				unsigned const ix1(ncolors*(y*w2+x)), ix2(ncolors*((y<<1)*w1+(x<<1)));
-
-				if (ncolors == 1) {
-					odata[ix1] = (unsigned char)(((unsigned)idata[ix2] + idata[ix2+xinc] + idata[ix2+yinc] + idata[ix2+yinc+xinc]) >> 2);
-				}
-				else if (ncolors == 3) {
-					UNROLL_3X(odata[ix1+i_] = (unsigned char)(((unsigned)idata[ix2+i_] + idata[ix2+xinc+i_] + idata[ix2+yinc+i_] + idata[ix2+yinc+xinc+i_]) >> 2);)
-				}
-				else { // custom alpha mipmaps
-					assert(ncolors == 4);
-					unsigned const a1(idata[ix2+3]), a2(idata[ix2+xinc+3]), a3(idata[ix2+yinc+3]), a4(idata[ix2+yinc+xinc+3]);
-					unsigned const a_sum(a1 + a2 + a3 + a4);
-
-					if (a_sum == 0) { // fully transparent
-						if (use_mipmaps == 4) {UNROLL_3X(odata[ix1+i_] = cw.c[i_];)} // use average texture color
-						else { // color is average of all 4 values
-							UNROLL_3X(odata[ix1+i_] = (unsigned char)(((unsigned)idata[ix2+i_] + idata[ix2+xinc+i_] + idata[ix2+yinc+i_] + idata[ix2+yinc+xinc+i_]) / 4);)
-						}
-						odata[ix1+3] = 0;
-					}
-					else { // pre-multiplied and normalized colors
-						if (use_mipmaps == 4) {
-							unsigned const a_cw(1020 - a_sum); // use average texture color for transparent pixels
-							UNROLL_3X(odata[ix1+i_] = (unsigned char)((a1*idata[ix2+i_] + a2*idata[ix2+xinc+i_] + a3*idata[ix2+yinc+i_] + a4*idata[ix2+yinc+xinc+i_] + a_cw*cw.c[i_]) / 1020);)
-						}
-						else {
-							UNROLL_3X(odata[ix1+i_] = (unsigned char)((a1*idata[ix2+i_] + a2*idata[ix2+xinc+i_] + a3*idata[ix2+yinc+i_] + a4*idata[ix2+yinc+xinc+i_]) / a_sum);)
-						}
-						odata[ix1+3] = min(255U, min(max(max(a1, a2), max(a3, a4)), unsigned(mipmap_alpha_weight*a_sum)));
-					}
-				}
-			} // for x
-		} // for y
+		calc_next_mipmap_level(&idata.front(), odata, w, h, cw);
 		glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // needed for mipmap levels where width*ncolors is not aligned
-		glTexImage2D(GL_TEXTURE_2D, level, calc_internal_format(), w2, h2, 0, format, get_data_format(), &odata.front());
+		glTexImage2D(GL_TEXTURE_2D, level, calc_internal_format(), max(w>>1, 1U), max(h>>1, 1U), 0, format, get_data_format(), &odata.front());
 		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 		idata.swap(odata);
 	} // for w
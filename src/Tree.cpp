@@ -12,6 +12,7 @@
 #include "sinf.h"
 #include "cobj_bsp_tree.h"
 #include "draw_utils.h"
+#include "binary_file_io.h"
 
 float const BURN_RADIUS      = 0.2;
 float const BURN_DAMAGE      = 80.0;
@@ -33,6 +34,9 @@ int const TLEAF_START_TUID   = 8; // trees use texture units 8-12
 bool const FORCE_TREE_TYPE   = 1;
 unsigned const CYLINS_PER_ROOT     = 3;
 unsigned const TREE_BILLBOARD_SIZE = 256;
+unsigned const LEAF_BEND_BLOCK_SZ  = 256; // leaves per SoA wind update block, which is also the unit of parallel work
+unsigned const TREE_DATA_CACHE_VERSION = 1; // increment when tree generation or tree_data_t file format changes
+unsigned const TREE_DATA_CACHE_MAGIC   = 0x44543344; // "D3TD"
 
 
 // bark_tex, leaf_tex, branch_size, branch_radius, leaf_size, leaf_x_ar, height_scale, branch_break_off, branch_tscale, branch_color_var, bush_prob, barkc, leafc
@@ -44,9 +48,9 @@ tree_type tree_types[NUM_TREE_TYPES] = { // not const - config file can override
 	tree_type(BARK6_TEX, PAPAYA_TEX,   1.0, 1.0, 1.0, 1.00, 2.0, 2.0, 0.5, 0.1,  0.0, colorRGBA(0.7, 0.6,  0.5,  1.0), WHITE)
 };
 
-vector<tree_cylin >   tree_builder_t::cylin_cache;
-vector<tree_branch>   tree_builder_t::branch_cache;
-vector<tree_branch *> tree_builder_t::branch_ptr_cache;
+thread_local vector<tree_cylin >   tree_builder_t::cylin_cache;
+thread_local vector<tree_branch>   tree_builder_t::branch_cache;
+thread_local vector<tree_branch *> tree_builder_t::branch_ptr_cache;
 
 
 // tree_mode: 0 = no trees, 1 = large only, 2 = small only, 3 = both large and small
@@ -68,6 +72,7 @@ extern int xoff2, yoff2, rand_gen_index, game_mode, leaf_color_changed, scrollin
 extern unsigned smoke_tid;
 extern float zmin, zmax, zmax_est, zbottom, water_plane_z, tree_scale, temperature, fticks, vegetation, tree_density_thresh, tree_slope_thresh;
 extern double sim_ticks;
+extern string scene_cache_dir;
 extern vector3d wind;
 extern lightning_t l_strike;
 extern coll_obj_group coll_objects;
@@ -341,11 +346,7 @@ void tree_cont_t::draw_branches_and_leaves(shader_t &s, tree_lod_render_t &lod_r
 		}
 		tree_data_t::post_leaf_draw();
 
-		if (!tt_shadow_mode) {
-			int const num_to_update(to_update_leaves.size());
-	#pragma omp parallel for num_threads(max(1, min(4, num_to_update))) schedule(static) if (num_to_update > 1)
-			for (int i = 0; i < num_to_update; ++i) {to_update_leaves[i]->update_leaf_orients_wind();}
-		}
+		if (!tt_shadow_mode) {tree::update_leaf_orients_wind_all(to_update_leaves);}
 	}
 }
 
@@ -1177,20 +1178,52 @@ bool tree_data_t::leaf_draw_setup(bool no_leaf_reset) {
 }
 
 
-void tree_data_t::bend_leaf(unsigned i, float angle) { // Note: slow
+void tree_data_t::bend_leaf(unsigned i, float angle) {
+	bend_leaves(i, i+1, &angle, nullptr);
+	mark_leaf_range_changed(i, i+1);
+}
 
-	assert(i < leaves.size());
-	tree_leaf const &l(leaves[i]);
-	vector3d const orig_dir(l.pts[1] - l.pts[0]); // vector from base to tip
-	vector3d const new_dir(orig_dir*COSF(angle) + l.norm*(orig_dir.mag()*SINF(angle))); // s=orig_dir.get_norm(), t=l.norm
-	vector3d const delta(new_dir - orig_dir);
-	vector3d const normal(cross_product(new_dir, (l.pts[3] - l.pts[0])).get_norm());
-	unsigned const ix(i<<2);
-	leaf_data[ix+1].v = l.pts[1] + delta;
-	leaf_data[ix+2].v = l.pts[2] + delta;
-	norm_comp nc; nc.set_norm_no_clamp(normal); // already normalized, no need to clamp
-	UNROLL_4X(leaf_data[i_+ix].set_norm(nc);) // similar to update_normal_for_leaf()
-	mark_leaf_changed(i);
+// bends leaves [start, end) by angles[i-start], skipping leaves with a zero bend_mask entry if bend_mask is non-null;
+// leaf vectors are gathered into SoA arrays so that the math loop can be vectorized;
+// doesn't mark leaves as changed, so it can be called on disjoint ranges from multiple threads
+void tree_data_t::bend_leaves(unsigned start, unsigned end, float const *angles, unsigned char const *bend_mask) {
+
+	assert(start <= end && end <= leaves.size());
+	unsigned const num(end - start);
+	assert(num <= LEAF_BEND_BLOCK_SZ);
+	float dir[3][LEAF_BEND_BLOCK_SZ], norm[3][LEAF_BEND_BLOCK_SZ], side[3][LEAF_BEND_BLOCK_SZ], cos_a[LEAF_BEND_BLOCK_SZ], sin_a[LEAF_BEND_BLOCK_SZ];
+
+	for (unsigned n = 0; n < num; ++n) { // gather
+		tree_leaf const &l(leaves[start+n]);
+		UNROLL_3X(dir[i_][n] = l.pts[1][i_] - l.pts[0][i_]; norm[i_][n] = l.norm[i_]; side[i_][n] = l.pts[3][i_] - l.pts[0][i_];) // dir is the vector from base to tip
+		cos_a[n] = COSF(angles[n]); // table lookups
+		sin_a[n] = SINF(angles[n]);
+	}
+	for (unsigned n = 0; n < num; ++n) { // dir becomes the tip delta and norm becomes the new leaf normal
+		float const dmag(sqrt(dir[0][n]*dir[0][n] + dir[1][n]*dir[1][n] + dir[2][n]*dir[2][n])), nscale(dmag*sin_a[n]);
+		float const ndx(dir[0][n]*cos_a[n] + norm[0][n]*nscale), ndy(dir[1][n]*cos_a[n] + norm[1][n]*nscale), ndz(dir[2][n]*cos_a[n] + norm[2][n]*nscale); // new dir
+		float const cx(ndy*side[2][n] - ndz*side[1][n]), cy(ndz*side[0][n] - ndx*side[2][n]), cz(ndx*side[1][n] - ndy*side[0][n]); // cross_product(new_dir, side)
+		float const cmag(sqrt(cx*cx + cy*cy + cz*cz)), cscale((cmag < TOLERANCE) ? 1.0f : 1.0f/cmag); // same as vector3d::get_norm()
+		dir [0][n] = ndx - dir[0][n]; dir [1][n] = ndy - dir[1][n]; dir [2][n] = ndz - dir[2][n];
+		norm[0][n] = cx*cscale;       norm[1][n] = cy*cscale;       norm[2][n] = cz*cscale;
+	}
+	for (unsigned n = 0; n < num; ++n) { // scatter
+		if (bend_mask && !bend_mask[n]) continue;
+		tree_leaf const &l(leaves[start+n]);
+		vector3d const delta(dir[0][n], dir[1][n], dir[2][n]);
+		unsigned const ix((start+n) << 2);
+		leaf_data[ix+1].v = l.pts[1] + delta;
+		leaf_data[ix+2].v = l.pts[2] + delta;
+		norm_comp nc; nc.set_norm_no_clamp(vector3d(norm[0][n], norm[1][n], norm[2][n])); // already normalized, no need to clamp
+		UNROLL_4X(leaf_data[i_+ix].set_norm(nc);) // similar to update_normal_for_leaf()
+	}
+}
+
+void tree_data_t::mark_leaf_range_changed(unsigned start, unsigned end) {
+
+	if (start >= end) return;
+	mark_leaf_changed(start);
+	mark_leaf_changed(end-1);
 	reset_leaves = 1; // do we want to update the normals as well?
 }
 
@@ -1203,44 +1236,84 @@ bool tree_data_t::check_if_needs_updated() {
 }
 
 
-void tree::update_leaf_orients_wind() { // leaves move in wind (somewhat slow)
-
-	tree_data_t &td(tdata());
-	vector<tree_leaf> const &leaves(td.get_leaves());
-	rand_gen_t rgen;
-	rgen.set_state(frame_counter, leaves.size());
-	bool const priv_data(td_is_private());
-	bool const heal_pass(priv_data && LEAF_HEAL_RATE > 0 && world_mode == WMODE_GROUND && (rgen.rand()&7) == 0); // only update healed color every 8 frames
-	int last_xpos(0), last_ypos(0);
-	vector3d local_wind(zero_vector);
-
-	for (unsigned i = 0; i < leaves.size(); ++i) { // process leaf wind and collisions
-		point p0(leaves[i].pts[0]);
-		if (priv_data) {p0 += tree_center;}
-		int const xpos(get_xpos(p0.x)), ypos(get_ypos(p0.y));
-			
-		// Note: should check for similar z-value, but z is usually similar within the leaves of a single tree
-		if (i == 0 || xpos != last_xpos || ypos != last_ypos) {
-			local_wind = get_local_wind(xpos, ypos, p0.z, !priv_data); // slow
-			last_xpos  = xpos;
-			last_ypos  = ypos;
-		}
-		if (local_wind != zero_vector) {
-			float const angle(PI_TWO*max(-1.0f, min(1.0f, dot_product(local_wind, leaves[i].norm)))); // not physically correct, but it looks good
-			td.bend_leaf(i, angle);
-		}
-		if (heal_pass && (rgen.rand()&63) == 0) { // leaf heals every 64 frames
-			short &lcolor(td.get_leaves()[i].lcolor); // non-const, can't use <leaves>
-
-			if (lcolor > 0 && lcolor < 1000) { // partially damaged
-				lcolor = min(1000, (lcolor + int(LEAF_HEAL_RATE*fticks)));
-				copy_color(i);
-			}
-		}
-	} // for i
-	leaf_orients_valid = 1;
-}
-
+// processes leaves [start, end) of this tree; returns true if any leaves were bent; doesn't mark leaves as changed
+bool tree::update_leaf_orients_wind(unsigned start, unsigned end) { // leaves move in wind
+
+	tree_data_t &td(tdata());
+	vector<tree_leaf> const &leaves(td.get_leaves());
+	assert(start <= end && end <= leaves.size());
+	rand_gen_t rgen;
+	rgen.set_state((frame_counter + start), leaves.size()); // seeded per block so that blocks are independent
+	bool const priv_data(td_is_private());
+	bool const heal_pass(priv_data && LEAF_HEAL_RATE > 0 && world_mode == WMODE_GROUND && (frame_counter&7) == 0); // only update healed color every 8 frames
+	int last_xpos(0), last_ypos(0);
+	vector3d local_wind(zero_vector);
+	float angles[LEAF_BEND_BLOCK_SZ];
+	unsigned char bend_mask[LEAF_BEND_BLOCK_SZ];
+	bool any_bent(0);
+
+	for (unsigned i = start; i < end; ++i) { // process leaf wind and collisions
+		point p0(leaves[i].pts[0]);
+		if (priv_data) {p0 += tree_center;}
+		int const xpos(get_xpos(p0.x)), ypos(get_ypos(p0.y));
+			
+		// Note: should check for similar z-value, but z is usually similar within the leaves of a single tree
+		if (i == start || xpos != last_xpos || ypos != last_ypos) {
+			local_wind = get_local_wind(xpos, ypos, p0.z, !priv_data); // slow
+			last_xpos  = xpos;
+			last_ypos  = ypos;
+		}
+		bool const bend(local_wind != zero_vector);
+		angles   [i-start] = (bend ? PI_TWO*max(-1.0f, min(1.0f, dot_product(local_wind, leaves[i].norm))) : 0.0f); // not physically correct, but it looks good
+		bend_mask[i-start] = bend;
+		any_bent |= bend;
+
+		if (heal_pass && (rgen.rand()&63) == 0) { // leaf heals every 64 frames
+			short &lcolor(td.get_leaves()[i].lcolor); // non-const, can't use <leaves>
+
+			if (lcolor > 0 && lcolor < 1000) { // partially damaged
+				lcolor = min(1000, (lcolor + int(LEAF_HEAL_RATE*fticks)));
+				copy_color(i, 1); // no_mark_changed=1; the caller marks the whole range
+				any_bent = 1;
+			}
+		}
+	} // for i
+	if (any_bent) {td.bend_leaves(start, end, angles, bend_mask);}
+	return any_bent;
+}
+
+// updates leaf wind for all trees in blocks of leaves, so that work is balanced across all threads rather than split per tree
+void tree::update_leaf_orients_wind_all(vector<tree *> &trees) {
+
+	struct leaf_block_t {
+		tree *t;
+		unsigned start, end;
+		leaf_block_t(tree *t_, unsigned s, unsigned e) : t(t_), start(s), end(e) {}
+	};
+	vector<leaf_block_t> blocks;
+	vector<tree *> uniq_trees;
+	set<tree_data_t const *> seen_tds;
+
+	for (auto i = trees.begin(); i != trees.end(); ++i) {
+		(*i)->leaf_orients_valid = 1;
+		// trees that share tree data would write the same leaves; since shared tree leaves don't depend on tree position, only update one of them
+		if (!(*i)->td_is_private() && !seen_tds.insert(&(*i)->tdata()).second) continue;
+		uniq_trees.push_back(*i);
+		unsigned const nleaves((*i)->tdata().get_leaves().size());
+		for (unsigned s = 0; s < nleaves; s += LEAF_BEND_BLOCK_SZ) {blocks.emplace_back(*i, s, min(nleaves, s+LEAF_BEND_BLOCK_SZ));}
+	}
+	if (blocks.empty()) return;
+	vector<unsigned char> block_changed(blocks.size(), 0);
+
+#pragma omp parallel for schedule(dynamic,4) if (blocks.size() > 1)
+	for (int b = 0; b < (int)blocks.size(); ++b) {
+		block_changed[b] = blocks[b].t->update_leaf_orients_wind(blocks[b].start, blocks[b].end);
+	}
+	for (unsigned b = 0; b < blocks.size(); ++b) { // serial: mark changed ranges
+		if (block_changed[b]) {blocks[b].t->tdata().mark_leaf_range_changed(blocks[b].start, blocks[b].end);}
+	}
+}
+
 void tree::update_leaf_orients_all(vector<tree *> &to_update_leaves) {
 
 	tree_data_t &td(tdata());
@@ -2137,18 +2210,23 @@ void tree_cont_t::gen_deterministic(int x1, int y1, int x2, int y2, float vegeta
 	//cout << TXT(mod_num_trees) << TXT(size()) << endl;
 }
 
-void tree_cont_t::add_new_tree(rand_gen_t &rgen, int &ttype) {
+void tree_cont_t::add_new_tree(rand_gen_t &rgen, int &ttype, bool allow_bushes) {
 
 	push_back(tree());
 	if (shared_tree_data.empty()) return; // no fixed ID
+	unsigned const num_slots(shared_tree_data.size());
 	int tree_id(-1);
 
 	if (ttype >= 0) {
-		unsigned const num_per_type(max(1U, (unsigned)shared_tree_data.size()/NUM_TREE_TYPES));
-		tree_id = min(unsigned((((rgen.rseed1 >> 7) + rgen.rseed2) % num_per_type) + ttype*num_per_type), (unsigned)shared_tree_data.size()-1);
+		unsigned const num_per_type(max(1U, num_slots/NUM_TREE_TYPES)), range_start(ttype*num_per_type);
+		tree_id = min(unsigned((((rgen.rseed1 >> 7) + rgen.rseed2) % num_per_type) + range_start), num_slots-1);
+		// the last type also gets any leftover slots (same layout as tree_data_manager_t::gen_all_tree_data())
+		unsigned const range_end((ttype == NUM_TREE_TYPES-1) ? num_slots : min(range_start + num_per_type, num_slots));
+		if (!allow_bushes && range_start < range_end) {tree_id = shared_tree_data.find_non_bush_slot(tree_id, range_start, range_end);}
 	}
 	else {
-		tree_id = (rgen.rseed2 % shared_tree_data.size());
+		tree_id = (rgen.rseed2 % num_slots);
+		if (!allow_bushes) {tree_id = shared_tree_data.find_non_bush_slot(tree_id, 0, num_slots);}
 		ttype   = tree_id % NUM_TREE_TYPES;
 	}
 	if (shared_tree_data[tree_id].is_created()) {ttype = shared_tree_data[tree_id].get_tree_type();} // in case there weren't enough generated to get the requested type
@@ -2186,7 +2264,7 @@ void tree_cont_t::gen_trees_tt_within_radius(int x1, int y1, int x2, int y2, poi
 				if (!bounds.contains_pt_xy(pos)) continue; // tree not within this tile
 				int ttype(t->type);
 				if (ttype >= 0) {ttype %= NUM_TREE_TYPES;} // make sure it maps to a valid tree type if specified
-				add_new_tree(rgen, ttype);
+				add_new_tree(rgen, ttype, 0); // no bushes
 				back().gen_tree(pos, int(t->size), ttype, 1, 1, 0, rgen, 1.0, 1.0, 1.0, tree_4th_branches, 0); // Note: can't be user placed + instanced; no bushes
 			} // for t
 		} // for b
@@ -2251,7 +2329,7 @@ void tree_cont_t::gen_trees_tt_within_radius(int x1, int y1, int x2, int y2, poi
 			if (mesh_dz < 0.0 || mesh_dz > 1.0) {
 				if (!adjust_tree_zval(pos, 0, ttype, 0, cur_tile)) continue; // create_bush=0
 			}
-			add_new_tree(rgen, ttype);
+			add_new_tree(rgen, ttype, 1); // allow bushes
 			back().gen_tree(pos, 0, ttype, 0, 1, 0, rgen, 1.0, 1.0, 1.0, tree_4th_branches, 1); // allow bushes
 		} // for j
 	} // for i
@@ -2346,12 +2424,140 @@ void tree_data_manager_t::ensure_init() {
 
 	if (max_unique_trees > 0 && empty()) {
 		resize(max_unique_trees);
+		all_generated = 0;
 	}
 	else if (tree_scale != last_tree_scale || rand_gen_index != last_rgi) {
 		for (iterator i = begin(); i != end(); ++i) {i->clear_data();}
+		all_generated = 0;
 	}
 	last_tree_scale = tree_scale;
 	last_rgi        = rand_gen_index;
+	if (!all_generated) {gen_all_tree_data();}
+}
+
+bool tree_data_t::write_to_file(binary_file_writer &writer) const {
+
+	float const vals[12] = {base_radius, sphere_radius, sphere_center_zoff, br_scale, b_tex_scale, lr_z_cent, lr_x, lr_y, lr_z, br_x, br_y, br_z};
+	return (writer.write_val(tree_type) && writer.write_val(has_4th_branches) && writer.write_val(base_color) && writer.write(vals, sizeof(float), 12) &&
+		writer.write_val(leaves_bcube) && writer.write_val(branches_bcube) && writer.write_vector(all_cylins) && writer.write_vector(leaves));
+}
+
+bool tree_data_t::read_from_file(binary_file_reader &reader) {
+
+	float vals[12] = {0};
+	if (!reader.read_val(tree_type) || !reader.read_val(has_4th_branches) || !reader.read_val(base_color) || !reader.read(vals, sizeof(float), 12) ||
+		!reader.read_val(leaves_bcube) || !reader.read_val(branches_bcube) || !reader.read_vector(all_cylins, (1U << 24)) || !reader.read_vector(leaves, (1U << 24))) return 0;
+	if (tree_type < 0 || tree_type >= NUM_TREE_TYPES || all_cylins.empty()) return 0;
+	base_radius = vals[0]; sphere_radius = vals[1]; sphere_center_zoff = vals[2]; br_scale = vals[3]; b_tex_scale = vals[4];
+	lr_z_cent   = vals[5]; lr_x = vals[6]; lr_y = vals[7]; lr_z = vals[8]; br_x = vals[9]; br_y = vals[10]; br_z = vals[11];
+	leaf_data.clear();
+	clear_vbo_ixs();
+	return 1;
+}
+
+// the key covers the per-tree RNG state and every global that affects gen_tree_data()
+uint64_t get_tree_data_cache_key(rand_gen_t const &rgen, int type, int size, bool create_bush) {
+
+	hash_fnv1a_t hash;
+	hash.add_val(TREE_DATA_CACHE_VERSION);
+	hash.add_val(rgen.rseed1);
+	hash.add_val(rgen.rseed2);
+	hash.add_val(type);
+	hash.add_val(size);
+	hash.add_val(create_bush);
+	hash.add_val(tree_4th_branches);
+	hash.add_val(gen_tree_roots);
+	float const params[7] = {tree_scale, nleaves_scale, branch_radius_scale, tree_height_scale, tree_deadness, tree_dead_prob, get_default_tree_depth()};
+	hash.add(params, sizeof(params));
+
+	for (unsigned i = 0; i < NUM_TREE_TYPES; ++i) { // hash each field rather than the raw struct so that padding bytes aren't included
+		tree_type const &tt(tree_types[i]);
+		float const fvals[9] = {tt.branch_size, tt.branch_radius, tt.leaf_size, tt.leaf_x_ar, tt.height_scale, tt.branch_break_off, tt.branch_tscale, tt.branch_color_var, tt.bush_prob};
+		float const cvals[8] = {tt.barkc.R, tt.barkc.G, tt.barkc.B, tt.barkc.A, tt.leafc.R, tt.leafc.G, tt.leafc.B, tt.leafc.A};
+		hash.add_val(tt.bark_tex);
+		hash.add_val(tt.leaf_tex);
+		hash.add(fvals, sizeof(fvals));
+		hash.add(cvals, sizeof(cvals));
+	}
+	return hash.get();
+}
+
+bool read_tree_data_cache(string const &fn, uint64_t key, tree_data_t &td) {
+
+	binary_file_reader reader;
+	if (!reader.open(fn, 1)) return 0; // quiet=1: no cache file, not an error
+	unsigned magic(0), version(0);
+	uint64_t file_key(0);
+
+	if (!reader.read_val(magic) || !reader.read_val(version) || !reader.read_val(file_key) ||
+		magic != TREE_DATA_CACHE_MAGIC || version != TREE_DATA_CACHE_VERSION || file_key != key || !td.read_from_file(reader))
+	{
+		std::cerr << "Error reading tree data cache file " << fn << "; ignoring it" << endl;
+		td.clear_data();
+		return 0;
+	}
+	return 1;
+}
+
+void write_tree_data_cache(string const &fn, uint64_t key, tree_data_t const &td) {
+
+	binary_file_writer writer;
+	if (!writer.open(fn)) return;
+
+	if (!writer.write_val(TREE_DATA_CACHE_MAGIC) || !writer.write_val(TREE_DATA_CACHE_VERSION) || !writer.write_val(key) || !td.write_to_file(writer)) {
+		std::cerr << "Error writing tree data cache file " << fn << endl;
+	}
+}
+
+// generates all shared trees up front rather than from whichever tree first binds to each one;
+// each tree is seeded from its index, so the result doesn't depend on thread count or generation order;
+// slots are generated with the same args as the procedural tree path (size=0, bushes allowed), and placed trees (size=0, no bushes) skip bush slots
+void tree_data_manager_t::gen_all_tree_data() {
+
+	all_generated = 1;
+	slot_is_bush.clear();
+	if (empty()) return;
+	timer_t timer("Gen Shared Tree Data");
+	int const size_arg(0); // placed and procedural trees both use size=0
+	unsigned const num_per_type(max(1U, (unsigned)size()/NUM_TREE_TYPES)); // same type layout as tree_cont_t::add_new_tree()
+	unsigned num_cached(0);
+	slot_is_bush.resize(size(), 0);
+
+#pragma omp parallel for schedule(dynamic,1) reduction(+:num_cached)
+	for (int i = 0; i < (int)size(); ++i) {
+		tree_data_t &td(operator[](i));
+		if (td.is_created()) continue;
+		rand_gen_t rgen;
+		rgen.rseed1 = 805306457*(i + 1) + 100663319*rand_gen_index;
+		rgen.rseed2 = 6291469  *(i + 1) + 1572869  *rand_gen_index;
+		rgen.rand_mix();
+		int type(min(int(i/num_per_type), NUM_TREE_TYPES-1));
+		bool const create_bush(rgen.rand_probability(tree_types[type].bush_prob));
+		if (create_bush) {type = (type + 1) % NUM_TREE_TYPES;} // mix up the tree types so that bushes stand out from trees (same as tree::gen_tree())
+		slot_is_bush[i] = create_bush;
+		uint64_t const key(!scene_cache_dir.empty() ? get_tree_data_cache_key(rgen, type, size_arg, create_bush) : 0);
+		string const fn(key ? get_scene_cache_filename("tree_data_", key) : string());
+		if (!fn.empty() && read_tree_data_cache(fn, key, td)) {++num_cached; continue;}
+		tree_type const &treetype(tree_types[type]);
+		td.gen_tree_data(type, size_arg, get_default_tree_depth(), treetype.height_scale, treetype.branch_radius, 1.0, treetype.branch_break_off, tree_4th_branches, NULL, create_bush, rgen);
+		if (!fn.empty()) {write_tree_data_cache(fn, key, td);}
+	} // for i
+	if (num_cached > 0) {cout << "Read " << num_cached << " of " << size() << " shared trees from the tree data cache" << endl;}
+}
+
+// returns the first slot starting at tree_id and wrapping within [range_start, range_end) that isn't a bush, or tree_id if they're all bushes
+int tree_data_manager_t::find_non_bush_slot(int tree_id, unsigned range_start, unsigned range_end) const {
+
+	if (slot_is_bush.size() != size()) return tree_id; // not generated up front
+	assert(range_start < range_end && range_end <= size());
+	assert((unsigned)tree_id >= range_start && (unsigned)tree_id < range_end);
+	unsigned const num(range_end - range_start);
+
+	for (unsigned n = 0; n < num; ++n) {
+		unsigned const ix(range_start + (tree_id - range_start + n) % num);
+		if (!slot_is_bush[ix]) return ix;
+	}
+	return tree_id; // no non-bush slots for this type
 }
 
 void tree_data_manager_t::clear_context() {
@@ -28,7 +28,7 @@ unsigned owner_counts[NUM_ALIGNMENT] = {0};
 float resource_counts[NUM_ALIGNMENT] = {0.0};
 
 
-extern bool claim_planet, water_is_lava, no_shift_universe;
+extern bool claim_planet, water_is_lava, no_shift_universe, parallel_uobj_update;
 extern int uxyz[], window_width, window_height, do_run, fire_key, display_mode, DISABLE_WATER, frame_counter;
 extern unsigned NUM_THREADS;
 extern float zmax, zmin, fticks, univ_temp, temperature, atmosphere, vegetation, base_gravity, urm_static;
@@ -63,8 +63,10 @@ void add_player_ship_engine_light();
 
 #ifdef _OPENMP
 int omp_get_thread_num_3dw() {return omp_get_thread_num();} // where does this belong?
+int omp_get_max_threads_3dw() {return omp_get_max_threads();}
 #else
 int omp_get_thread_num_3dw() {return 0;}
+int omp_get_max_threads_3dw() {return 1;}
 #endif
 
 void init_universe_display() {
@@ -290,7 +292,8 @@ void draw_universe(bool static_only, bool skip_closest, bool no_move, int no_dis
 	// disable multiple threads when the player is away from the starting galaxy center to avoid crashing when allocating/freeing galaxies, systems, and clusters
 	bool const near_init_galaxy(dist_less_than(get_player_pos2(), universe_origin, GALAXY_MIN_SIZE));
 
-	if (inited && !static_only && NUM_THREADS > 1 && !(display_mode & 0x40) && near_init_galaxy) {
+	// parallel_uobj_update uses all threads inside process_ships(), which would only get one thread if nested here
+	if (inited && !static_only && NUM_THREADS > 1 && !(display_mode & 0x40) && near_init_galaxy && !parallel_uobj_update) {
 		// is this legal when a query object that tries to access a planet/moon/star through clobj as the uobject is being deleted?
 		#pragma omp parallel num_threads(2)
 		{
@@ -642,6 +645,8 @@ void draw_universe_sun_flare() {
 
 void send_warning_message(string const &msg) {
 
+	uobj_cmd_buffer_t *const cmds(get_deferred_uobj_cmds());
+	if (cmds) {cmds->add_warning(msg); return;} // sent at the next sync point
 	static int last_warning_tfticks(0);
 	
 	if ((tfticks - last_warning_tfticks) > 5.0*TICKS_PER_SECOND) {
@@ -27,7 +27,7 @@ vector<point> app_spots;
 vector<od_data> oddatav; // used as a temporary
 
 
-extern bool has_wpt_goal, use_waypoint_app_spots, enable_init_shields, smileys_chase_player, enable_translocator, keep_keycards_on_death;
+extern bool has_wpt_goal, parallel_smiley_paths, use_waypoint_app_spots, enable_init_shields, smileys_chase_player, enable_translocator, keep_keycards_on_death;
 extern int iticks, num_smileys, free_for_all, teams, frame_counter, display_mode;
 extern int DISABLE_WATER, xoff, yoff, world_mode, spectate, camera_reset, camera_mode, following, game_mode;
 extern int recreated, mesh_scale_change, UNLIMITED_WEAPONS, camera_coll_id, init_num_balls;
@@ -396,6 +396,69 @@ void player_state::check_cand_waypoint(point const &pos, point const &avoid_dir,
 }
 
 
+wpt_goal player_state::get_waypoint_goal(int smiley_id, int last_target_visible, int last_target_type) const {
+
+	wpt_goal goal;
+
+	// mode: 0: none, 1: user wpt, 2: placed item wpt, 3: goal wpt, 4: wpt index, 5: closest wpt, 6: closest visible wpt, 7: goal pos (new wpt)
+	if (smileys_chase_player) {
+		goal = wpt_goal(6, 0, get_camera_pos()-point(0.0, 0.0, camera_zh)); // closest wpt visible to camera
+	}
+	else {
+		goal = wpt_goal((has_wpt_goal ? 3 : 2), 0, all_zeros); // mode, wpt, goal_pos
+	}
+	if (last_target_visible && last_target_type != 3 && goal.mode <= 2) { // have a previous enemy/item target and no real goal
+		goal.mode = 6; // closest visible waypoint
+		goal.pos  = target_pos; // should still be valid
+	}
+	if (goal.mode <= 2) { // add waypoint to a team member engaging an enemy
+		for (int i = 0; i < num_smileys; ++i) { // what about camera/player (CAMERA_ID)?
+			if (i == smiley_id || !same_team(i, smiley_id)) continue;
+			player_state const &ss(sstates[i]);
+			if (!ss.target_visible || ss.target_type != 1 || ss.target == NO_SOURCE) continue;
+			goal.mode = 6;
+			goal.pos  = ss.target_pos;
+		}
+	}
+	return goal;
+}
+
+
+// run the A* searches of all smileys that have reached their current waypoint in parallel, before the serial smiley update;
+// find_nearest_obj() uses the result if its query is unchanged, for example if no teammate has since changed targets
+void plan_smiley_waypoint_paths() {
+
+	if (!parallel_smiley_paths || sstates == nullptr || num_smileys <= 1 || waypoints.empty()) return;
+	obj_group const &objg(obj_groups[coll_id[SMILEY]]);
+	float const sradius(object_types[SMILEY].radius);
+	static vector<wpt_path_query_t> queries;
+	static vector<unsigned> query_ids;
+	queries.clear();
+	query_ids.clear();
+
+	for (int i = 0; i < num_smileys; ++i) {
+		player_state &ss(sstates[i]);
+		ss.planned_path_frame = -1;
+		int const curw(ss.last_waypoint);
+		if (curw < 0) continue; // not on a waypoint path
+		assert((unsigned)curw < waypoints.size());
+		dwobject const &obj(objg.get_obj(i));
+		if (obj.disabled() || !dist_less_than(waypoints[curw].pos, obj.pos, sradius) || waypoints[curw].next_wpts.empty()) continue;
+		wpt_goal const goal(ss.get_waypoint_goal(i, ss.target_visible, ss.target_type));
+		if (goal.mode == 7 || !goal.is_reachable()) continue; // mode 7 adds a temp waypoint, which can't be done in parallel
+		queries.push_back(wpt_path_query_t(curw, goal));
+		query_ids.push_back(i);
+	}
+	find_optimal_next_waypoints(queries);
+
+	for (unsigned i = 0; i < queries.size(); ++i) {
+		player_state &ss(sstates[query_ids[i]]);
+		ss.planned_path       = queries[i];
+		ss.planned_path_frame = frame_counter;
+	}
+}
+
+
 void player_state::mark_waypoint_reached(int curw, int smiley_id) {
 
 	waypts_used.insert(curw); // insert as the last used waypoint and remove from consideration
@@ -422,28 +485,8 @@ int player_state::find_nearest_obj(point const &pos, pos_dir_up const &pdu, poin
 		if (type == WAYPOINT) { // process waypoints
 			int curw(last_waypoint);
 			int ignore_w(-1);
-			wpt_goal goal;
+			wpt_goal const goal(get_waypoint_goal(smiley_id, last_target_visible, last_target_type));
 
-			// mode: 0: none, 1: user wpt, 2: placed item wpt, 3: goal wpt, 4: wpt index, 5: closest wpt, 6: closest visible wpt, 7: goal pos (new wpt)
-			if (smileys_chase_player) {
-				goal = wpt_goal(6, 0, get_camera_pos()-point(0.0, 0.0, camera_zh)); // closest wpt visible to camera
-			}
-			else {
-				goal = wpt_goal((has_wpt_goal ? 3 : 2), 0, all_zeros); // mode, wpt, goal_pos
-			}
-			if (last_target_visible && last_target_type != 3 && goal.mode <= 2) { // have a previous enemy/item target and no real goal
-				goal.mode = 6; // closest visible waypoint
-				goal.pos  = target_pos; // should still be valid
-			}
-			if (goal.mode <= 2) { // add waypoint to a team member engaging an enemy
-				for (int i = 0; i < num_smileys; ++i) { // what about camera/player (CAMERA_ID)?
-					if (i == smiley_id || !same_team(i, smiley_id)) continue;
-					player_state const &ss(sstates[i]);
-					if (!ss.target_visible || ss.target_type != 1 || ss.target == NO_SOURCE) continue;
-					goal.mode = 6;
-					goal.pos  = ss.target_pos;
-				}
-			}
 			if (curw >= 0) { // currently targeting a waypoint
 				assert((unsigned)curw < waypoints.size());
 
@@ -459,7 +502,13 @@ int player_state::find_nearest_obj(point const &pos, pos_dir_up const &pdu, poin
 						}
 #endif
 						// FIXME: skip path waypoints that are in unreachable[1]?
-						curw = next_path_wpt = find_optimal_next_waypoint(curw, goal, wps_used); // can return -1
+						if (planned_path_frame == frame_counter && planned_path.cur == (unsigned)curw && planned_path.goal == goal) {
+							curw = next_path_wpt = planned_path.next_wpt; // use the path from plan_smiley_waypoint_paths() if the query is the same
+						}
+						else {
+							curw = next_path_wpt = find_optimal_next_waypoint(curw, goal, wps_used); // can return -1
+						}
+						planned_path_frame = -1;
 
 						for (unsigned i = 0; i < next.size(); ++i) {
 							check_cand_waypoint(pos, avoid_dir, smiley_id, next[i], curw, dmult, pdu, 1, 0.0);
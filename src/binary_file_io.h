@@ -17,11 +17,11 @@ public:
 	binary_file_io() : fp(nullptr), gzf(nullptr) {}
 	~binary_file_io() {close();}
 
-	bool open(string const &filename, char const *const mode, string const &purpose) {
+	bool open(string const &filename, char const *const mode, string const &purpose, bool quiet=0) { // quiet: a missing file isn't an error
 		if (filename.empty()) return 0;
 		if (is_gz_file(filename)) {gzf = gzopen(filename.c_str(), mode);} else {fp = fopen(filename.c_str(), mode);}
 		if (is_valid()) return 1;
-		std::cerr << "Failed to open file " << filename << " for " << purpose << ".";
+		if (!quiet) {std::cerr << "Failed to open file " << filename << " for " << purpose << ".";}
 		return 0;
 	}
 	bool is_valid() const {return (fp || gzf);}
@@ -43,7 +43,7 @@ public:
 };
 
 struct binary_file_reader : public binary_file_io {
-	bool open(string const &filename) {return binary_file_io::open(filename, "rb", "reading");}
+	bool open(string const &filename, bool quiet=0) {return binary_file_io::open(filename, "rb", "reading", quiet);}
 
 	bool read(void *ptr, size_t sz, size_t count) {
 		if      (fp ) {return (fread (ptr, sz, count, fp) == count);}
@@ -51,6 +51,14 @@ struct binary_file_reader : public binary_file_io {
 		else {assert(0);} // no file opened
 		return 0;
 	}
+	template<typename T> bool read_val(T &val) {return read(&val, sizeof(T), 1);}
+
+	template<typename T> bool read_vector(vector<T> &v, size_t max_sz) { // T must be POD; max_sz is a sanity check
+		size_t sz(0);
+		if (!read_val(sz) || sz > max_sz) return 0;
+		v.resize(sz);
+		return (sz == 0 || read(v.data(), sizeof(T), sz));
+	}
 };
 struct binary_file_writer : public binary_file_io {
 	bool open(string const &filename) {return binary_file_io::open(filename, "wb", "writing");}
@@ -61,5 +69,66 @@ struct binary_file_writer : public binary_file_io {
 		else {assert(0);} // no file opened
 		return 0;
 	}
+	template<typename T> bool write_val(T const &val) {return write(&val, sizeof(T), 1);}
+
+	template<typename T> bool write_vector(vector<T> const &v) { // T must be POD
+		size_t const sz(v.size());
+		return (write_val(sz) && (sz == 0 || write(v.data(), sizeof(T), sz)));
+	}
+};
+
+struct binary_mem_reader { // same interface as binary_file_reader, but reads from a block of memory such as a mapped file
+	uint8_t const *pos, *end;
+
+	binary_mem_reader(void const *data, size_t sz) : pos((uint8_t const *)data), end((uint8_t const *)data + sz) {}
+	size_t bytes_left() const {return size_t(end - pos);}
+
+	bool read(void *ptr, size_t sz, size_t count) {
+		size_t const nbytes(sz*count);
+		if (nbytes > bytes_left()) return 0; // truncated
+		memcpy(ptr, pos, nbytes);
+		pos += nbytes;
+		return 1;
+	}
+	template<typename T> bool read_val(T &val) {return read(&val, sizeof(T), 1);}
+
+	template<typename T> bool read_vector(vector<T> &v, size_t max_sz) { // T must be POD; max_sz is a sanity check
+		size_t sz(0);
+		if (!read_val(sz) || sz > max_sz || sz > bytes_left()/sizeof(T)) return 0;
+		v.resize(sz);
+		return (sz == 0 || read(v.data(), sizeof(T), sz));
+	}
+	uint8_t const *skip(size_t nbytes) { // returns a pointer to the next nbytes without copying them, or nullptr if truncated
+		if (nbytes > bytes_left()) return nullptr;
+		uint8_t const *const ret(pos);
+		pos += nbytes;
+		return ret;
+	}
+};
+
+class mapped_file_t { // read-only memory mapped file; reads the whole file into memory on platforms without mmap
+	void *addr;
+	size_t sz;
+	vector<uint8_t> buf;
+public:
+	mapped_file_t() : addr(nullptr), sz(0) {}
+	~mapped_file_t() {close();}
+	bool open(string const &filename); // returns false if the file doesn't exist; doesn't print an error
+	void close();
+	uint8_t const *data() const {return (addr ? (uint8_t const *)addr : buf.data());}
+	size_t size() const {return sz;}
+};
+
+class hash_fnv1a_t { // 64-bit FNV-1a hash, used to generate keys for cache files
+	uint64_t hash;
+public:
+	hash_fnv1a_t() : hash(14695981039346656037ULL) {}
+
+	void add(void const *data, size_t sz) {
+		for (size_t i = 0; i < sz; ++i) {hash ^= ((uint8_t const *)data)[i]; hash *= 1099511628211ULL;}
+	}
+	template<typename T> void add_val(T const &val) {add(&val, sizeof(T));}
+	void add_str(string const &str) {add_val(str.size()); add(str.data(), str.size());}
+	uint64_t get() const {return hash;}
 };
 
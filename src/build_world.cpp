@@ -13,8 +13,15 @@
 #include "subdiv.h"
 #include "player_state.h"
 #include "file_utils.h"
+#include "binary_file_io.h"
 #include "openal_wrap.h"
 #include <fstream>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 
 bool const MORE_COLL_TSTEPS       = 1; // slow
@@ -58,7 +65,7 @@ extern double camera_zh;
 extern point cpos2, orig_camera, orig_cdir;
 extern unsigned create_voxel_landscape, scene_smap_vbo_invalid, num_dynam_parts, max_num_mat_spheres, init_item_counts[];
 extern obj_type object_types[];
-extern string cobjs_out_fn;
+extern string cobjs_out_fn, scene_cache_dir;
 extern coll_obj_group coll_objects;
 extern cobj_groups_t cobj_groups;
 extern cobj_draw_groups cdraw_groups;
@@ -390,6 +397,7 @@ void process_groups() {
 		if (reflective) {cp.metalness = dodgeball_metalness; cp.tscale = 0.0; cp.color = WHITE; cp.spec_color = WHITE; cp.shine = 100.0;} // reflective metal sphere
 		size_t const iter_count((large_radius || type == MAT_SPHERE || app_rate > 0) ? max_objs : objg.end_id); // optimization to use end_id when valid
 		bool defer_remove_cobj(0);
+		if (type == SMILEY) {plan_smiley_waypoint_paths();}
 
 		for (size_t jj = 0; jj < iter_count; ++jj) {
 			unsigned const j(unsigned((type == SMILEY) ? (jj + scounter)%max_objs : jj)); // handle smiley permutation
@@ -841,14 +849,205 @@ void coll_obj_group::finalize() {
 }
 
 
+// *** binary cache of finalized cobjs and the static BVH ***
+
+// Note: this caches the output of coll_obj_group::finalize() and the static cobj BVH, not the scene file parse;
+// the scene files are still read each run because they also create lights, platforms, models, cobj groups, and other state
+// that cobjs refer to by index; the keys are built from the names and modification times of the config, scene, and model files
+
+
+unsigned const COBJS_CACHE_VERSION = 2; // increment when the cobj fields or finalize() processing changes
+unsigned const CACHE_FILE_MAGIC    = 0x43573344; // "D3WC"
+
+vector<string> scene_input_files; // config, scene, and model files read so far, in read order
+
+void register_scene_input_file(string const &fn) {scene_input_files.push_back(fn);}
+
+uint64_t get_file_mtime(string const &fn) { // returns 0 if the file doesn't exist
+	struct stat st;
+	return ((stat(fn.c_str(), &st) == 0) ? (uint64_t)st.st_mtime : 0);
+}
+
+// hash of the names and modification times of all files read so far; changes if any scene input file is edited
+uint64_t get_scene_files_key() {
+
+	hash_fnv1a_t hash;
+	hash.add_val(scene_input_files.size());
+
+	for (auto i = scene_input_files.begin(); i != scene_input_files.end(); ++i) {
+		hash.add_str(*i);
+		hash.add_val(get_file_mtime(*i));
+	}
+	return hash.get();
+}
+
+#ifdef _WIN32
+bool mapped_file_t::open(string const &filename) { // no mmap; read the whole file
+	close();
+	FILE *fp(fopen(filename.c_str(), "rb"));
+	if (fp == nullptr) return 0;
+	fseek(fp, 0, SEEK_END);
+	long const len(ftell(fp));
+	fseek(fp, 0, SEEK_SET);
+
+	if (len > 0) {
+		buf.resize(len);
+		if (fread(buf.data(), 1, len, fp) != size_t(len)) {buf.clear();} // read error; treat as empty
+	}
+	checked_fclose(fp);
+	sz = buf.size();
+	return 1;
+}
+void mapped_file_t::close() {
+	vector<uint8_t>().swap(buf);
+	sz = 0;
+}
+#else
+bool mapped_file_t::open(string const &filename) {
+	close();
+	int const fd(::open(filename.c_str(), O_RDONLY));
+	if (fd < 0) return 0;
+	struct stat st;
+
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		void *const ptr(mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+		if (ptr != MAP_FAILED) {addr = ptr; sz = st.st_size;}
+	}
+	::close(fd); // the mapping stays valid after the file is closed
+	return 1;
+}
+void mapped_file_t::close() {
+	if (addr) {munmap(addr, sz); addr = nullptr;}
+	vector<uint8_t>().swap(buf);
+	sz = 0;
+}
+#endif
+
+// returns the cache filename for this key, or an empty string if the cache is disabled
+string get_scene_cache_filename(char const *const prefix, uint64_t key, char const *const ext) {
+
+	if (scene_cache_dir.empty()) return string();
+	char key_str[24] = {0};
+	sprintf(key_str, "%016llx", (unsigned long long)key);
+	return (scene_cache_dir + "/" + prefix + key_str + ext);
+}
+
+// visits the serialized fields of a cobj; occluders and coll_func are not included and must be empty
+template<typename F> void visit_cobj_fields(coll_obj &c, F &f) {
+
+	f(c.d); f(c.type); f(c.destroy); f(c.status); f(c.last_coll); f(c.coll_type); f(c.fixed); f(c.is_billboard); f(c.falling);
+	f((obj_layer &)c.cp); f(c.cp.cf_index); f(c.cp.surfs); f(c.cp.flags); f(c.cp.destroy_prob);
+	f(c.radius); f(c.radius2); f(c.thickness); f(c.volume); f(c.v_fall); f(c.counter); f(c.id);
+	f(c.platform_id); f(c.group_id); f(c.cgroup_id); f(c.dgroup_id); f(c.waypt_id); f(c.npoints);
+	f(c.points); f(c.norm); f(c.texture_offset);
+}
+
+struct cobj_packer_t {
+	vector<uint8_t> buf;
+	template<typename T> void operator()(T const &val) {uint8_t const *const ptr((uint8_t const *)&val); buf.insert(buf.end(), ptr, ptr+sizeof(T));}
+	void add(coll_obj const &c) {visit_cobj_fields(const_cast<coll_obj &>(c), *this);}
+};
+
+struct cobj_unpacker_t {
+	uint8_t const *ptr;
+	cobj_unpacker_t(uint8_t const *const ptr_) : ptr(ptr_) {}
+	template<typename T> void operator()(T &val) {memcpy(&val, ptr, sizeof(T)); ptr += sizeof(T);}
+	void get(coll_obj &c) {visit_cobj_fields(c, *this);}
+};
+
+unsigned get_cobj_record_size() {
+	cobj_packer_t packer;
+	packer.add(coll_obj());
+	return packer.buf.size();
+}
+
+bool can_cache_cobjs(coll_obj_group const &cobjs) {
+
+	for (auto i = cobjs.begin(); i != cobjs.end(); ++i) {
+		if (i->cp.coll_func != nullptr || !i->occluders.empty()) return 0;
+	}
+	return 1;
+}
+
+// the key is built from the scene input files and the options that affect finalize(); the cobj count is a cheap sanity check
+uint64_t get_cobjs_cache_key(coll_obj_group const &cobjs) {
+
+	hash_fnv1a_t hash;
+	hash.add_val(COBJS_CACHE_VERSION);
+	hash.add_val(preproc_cube_cobjs);
+	hash.add_val(X_SCENE_SIZE);
+	hash.add_val(get_scene_files_key());
+	hash.add_val(cobjs.size());
+	return hash.get();
+}
+
+bool read_cobjs_cache(string const &fn, uint64_t key, coll_obj_group &cobjs) {
+
+	RESET_TIME;
+	mapped_file_t file;
+	if (!file.open(fn)) return 0; // no cache file, not an error
+	binary_mem_reader reader(file.data(), file.size());
+	unsigned magic(0), version(0), rec_size(0);
+	uint64_t file_key(0);
+	size_t data_sz(0);
+	uint8_t const *data(nullptr);
+
+	if (!reader.read_val(magic) || !reader.read_val(version) || !reader.read_val(file_key) || !reader.read_val(rec_size) ||
+		magic != CACHE_FILE_MAGIC || version != COBJS_CACHE_VERSION || file_key != key || rec_size != get_cobj_record_size() ||
+		!reader.read_val(data_sz) || (data_sz % rec_size) != 0 || !(data = reader.skip(data_sz)))
+	{
+		cerr << "Error reading scene cache file " << fn << "; ignoring it" << endl;
+		return 0;
+	}
+	unsigned const num(data_sz/rec_size);
+	cobj_unpacker_t unpacker(data); // unpack directly from the mapped file
+	cobjs.clear();
+	cobjs.resize(num);
+	for (unsigned i = 0; i < num; ++i) {unpacker.get(cobjs[i]);}
+	assert(unpacker.ptr == data + data_sz);
+	cout << "Read " << num << " finalized cobjs from scene cache file " << fn << endl;
+	PRINT_TIME("Read Cobjs Cache");
+	return 1;
+}
+
+void write_cobjs_cache(string const &fn, uint64_t key, coll_obj_group const &cobjs) {
+
+	binary_file_writer writer;
+	if (!writer.open(fn)) return;
+	cobj_packer_t packer;
+	packer.buf.reserve(cobjs.size()*get_cobj_record_size());
+	for (auto i = cobjs.begin(); i != cobjs.end(); ++i) {packer.add(*i);}
+
+	if (!writer.write_val(CACHE_FILE_MAGIC) || !writer.write_val(COBJS_CACHE_VERSION) || !writer.write_val(key) ||
+		!writer.write_val(get_cobj_record_size()) || !writer.write_vector(packer.buf))
+	{
+		cerr << "Error writing scene cache file " << fn << endl;
+		return;
+	}
+	cout << "Wrote " << cobjs.size() << " finalized cobjs to scene cache file " << fn << endl;
+}
+
+// same as cobjs.finalize(), but uses the result from an earlier run with identical cobjs if the scene cache is enabled
+void finalize_cobjs_cached(coll_obj_group &cobjs) {
+
+	if (scene_cache_dir.empty() || !can_cache_cobjs(cobjs)) {cobjs.finalize(); return;}
+	uint64_t const key(get_cobjs_cache_key(cobjs));
+	string const fn(get_scene_cache_filename("cobjs_", key));
+	if (read_cobjs_cache(fn, key, cobjs)) return;
+	cobjs.finalize();
+	write_cobjs_cache(fn, key, cobjs);
+}
+
+
 void add_all_coll_objects(const char *filename, bool re_add) {
 
 	static int init(0);
+	bool const first_call(!init);
 
 	if (!init) {
 		if (load_coll_objs) {
 			if (!read_coll_objects(filename)) {exit(1);}
-			fixed_cobjs.finalize();
+			finalize_cobjs_cached(fixed_cobjs);
 			bool const has_voxel_cobjs(gen_voxels_from_cobjs(fixed_cobjs));
 			unsigned const ncobjs(fixed_cobjs.size());
 			RESET_TIME;
@@ -883,7 +1082,7 @@ void add_all_coll_objects(const char *filename, bool re_add) {
 	bool const verbose(!scrolling);
 	if (verbose) {cobj_stats();}
 	pre_rt_bvh_build_hook(); // required for light ray tracing so that BVH nodes are properly expanded
-	build_cobj_tree(0, verbose);
+	build_cobj_tree(0, verbose, first_call); // only use the scene cache on the initial build
 	post_rt_bvh_build_hook(); // required for light ray tracing (unexpand cobjs but leave BVH nodes expanded)
 	check_contained_cube_sides();
 	flag_cobjs_indoors_outdoors();
@@ -1203,6 +1402,7 @@ int read_coll_obj_file(const char *coll_obj_file, geom_xform_t xf, coll_obj cobj
 	assert(coll_obj_file != NULL);
 	FILE *fp;
 	if (!open_file(fp, coll_obj_file, "collision object")) return 0;
+	register_scene_input_file(coll_obj_file);
 	char str[MAX_CHARS] = {0};
 	unsigned line_num(1), npoints(0), indir_dlight_ix(0), prev_light_ix_start(0);
 	int end(0), use_z(0), use_vel(0), ivals[3];
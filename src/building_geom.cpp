@@ -344,11 +344,20 @@ bool building_t::check_sphere_coll_interior(point &pos, point const &p_last, vec
 			if (!is_u || c->dir == 0) {min_eq(pos[!c->dim], (c->d[!c->dim][1] - xy_radius));}
 			had_coll = on_stairs = 1;
 		} // for c
-		for (auto c = objs.begin(); c != objs.end(); ++c) { // check for other objects to collide with
-			if (c->no_coll()) continue;
-			if (c->type == TYPE_BLOCKER) continue; // skip blockers because they only block other objects, not the player
-			if (c->type == TYPE_CHAIR || c->type == TYPE_TCAN) continue; // skip chair and trashcan collisions because they can be in the way and block the path in some rooms
-			if (c->type == TYPE_CUBICLE) continue; // skip cubicle collisions because they have their own colliders
+		// skip blockers because they only block other objects, not the player;
+		// skip chair and trashcan collisions because they can be in the way and block the path in some rooms;
+		// skip cubicle collisions because they have their own colliders
+		uint64_t const skip_types(get_room_obj_type_mask(TYPE_BLOCKER) | get_room_obj_type_mask(TYPE_CHAIR) | get_room_obj_type_mask(TYPE_TCAN) | get_room_obj_type_mask(TYPE_CUBICLE));
+		cube_t query(pos);
+		query.union_with_pt(p_last);
+		query.expand_by_xy(2.0*xy_radius); // conservative, since pos can be pushed by earlier collisions
+		query.z1() -= (radius + floor_spacing); // cylinders are extended upward by their radius
+		query.z2() += (2.0*radius + camera_zh); // cubes are extended downward by camera_zh
+		static thread_local vector<unsigned> cand_ixs;
+		interior->room_geom->get_cand_objs(query, cand_ixs, skip_types, 1); // skip_nocoll=1
+
+		for (auto ix = cand_ixs.begin(); ix != cand_ixs.end(); ++ix) { // check for other objects to collide with
+			auto const c(objs.begin() + *ix);
 
 			if (c->type == TYPE_ELEVATOR) { // special handling for elevators
 				if (!c->contains_pt_xy(pos)) continue;
@@ -546,10 +546,16 @@ void building_interior_t::get_avoid_cubes(vect_cube_t &avoid, float z1, float z2
 	add_bcube_if_overlaps_zval(stairwells, avoid, z1, z2); // clearance not required
 	add_bcube_if_overlaps_zval(elevators,  avoid, z1, z2); // clearance not required
 	if (!room_geom) return; // no room objects
+	// these object types are not collided with by people
+	uint64_t const skip_types(get_room_obj_type_mask(TYPE_ELEVATOR) | get_room_obj_type_mask(TYPE_STAIR) | get_room_obj_type_mask(TYPE_LIGHT) | get_room_obj_type_mask(TYPE_BLOCKER));
+	cube_t query(room_geom->obj_index.bcube); // all objects in XY
+	query.z1() = z1; query.z2() = z2;
+	static thread_local vector<unsigned> cand_ixs;
+	room_geom->get_cand_objs(query, cand_ixs, skip_types, 1); // skip_nocoll=1
 
-	for (auto c = room_geom->objs.begin(); c != (room_geom->objs.begin() + room_geom->stairs_start); ++c) {
-		if (c->no_coll() || c->type == TYPE_ELEVATOR || c->type == TYPE_STAIR || c->type == TYPE_LIGHT || c->type == TYPE_BLOCKER) continue; // the object types are not collided with by people
-		if (c->z1() < z2 && c->z2() > z1) {avoid.push_back(*c);}
+	for (auto ix = cand_ixs.begin(); ix != cand_ixs.end() && *ix < room_geom->stairs_start; ++ix) {
+		room_object_t const &c(room_geom->objs[*ix]);
+		if (c.z1() < z2 && c.z2() > z1) {avoid.push_back(c);}
 	}
 }
 
@@ -659,10 +665,11 @@ bool building_t::place_person(point &ppos, float radius, rand_gen_t &rgen) const
 		// Note: people are placed before room geom is generated for all buildings, so this may not work and will have to be handled during room geom placement
 		if (interior->room_geom) { // check placement against room geom objects
 			vector<room_object_t> const &objs(interior->room_geom->objs);
-			auto objs_end(objs.begin() + interior->room_geom->stairs_start); // skip stairs and elevators
+			static thread_local vector<unsigned> cand_ixs;
+			interior->room_geom->get_cand_objs(bcube, cand_ixs);
 
-			for (auto i = objs.begin(); i != objs_end; ++i) {
-				if (i->intersects(bcube)) {bad_place = 1; break;}
+			for (auto ix = cand_ixs.begin(); ix != cand_ixs.end() && *ix < interior->room_geom->stairs_start; ++ix) { // skip stairs and elevators
+				if (objs[*ix].intersects(bcube)) {bad_place = 1; break;}
 			}
 		}
 		if (bad_place) continue;
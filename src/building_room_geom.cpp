@@ -8,11 +8,13 @@
 #include "subdiv.h" // for sd_sphere_d
 #include "profiler.h"
 #include "scenery.h" // for s_plant
+#include <mutex>
 #pragma warning(disable : 26812) // prefer enum class over enum
 
 bool const ADD_BOOK_COVERS = 1;
 bool const ADD_BOOK_TITLES = 1;
 unsigned const MAX_ROOM_GEOM_GEN_PER_FRAME = 1;
+unsigned const BOOK_TITLE_SPLIT_LINE_SZ = 24;
 colorRGBA const WOOD_COLOR(0.9, 0.7, 0.5); // light brown, multiplies wood texture color
 
 object_model_loader_t building_obj_model_loader;
@@ -181,10 +183,10 @@ void rgeom_mat_t::add_disk_to_verts(point const &pos, float radius, bool normal_
 }
 
 void rgeom_mat_t::add_sphere_to_verts(cube_t const &c, colorRGBA const &color) {
-	static vector<vert_norm_tc> verts;
+	static thread_local vector<vert_norm_tc> verts; // thread_local since room geom can be generated on worker threads
 	verts.clear();
-	static sd_sphere_d sd(all_zeros, 1.0, N_SPHERE_DIV); // resed across all calls
-	static sphere_point_norm spn;
+	static thread_local sd_sphere_d sd(all_zeros, 1.0, N_SPHERE_DIV); // resed across all calls
+	static thread_local sphere_point_norm spn;
 	if (!spn.get_points()) {sd.gen_points_norms(spn);} // calculate once and reuse
 	sd.get_quad_points(verts); // could use indexed triangles, but this only returns indexed quads
 	color_wrapper cw;
@@ -195,8 +197,10 @@ void rgeom_mat_t::add_sphere_to_verts(cube_t const &c, colorRGBA const &color) {
 
 class rgeom_alloc_t {
 	deque<rgeom_storage_t> free_list; // one per unique texture ID/material
+	std::mutex mutex;
 public:
 	void alloc(rgeom_storage_t &s) { // attempt to use free_list entry to reuse existing capacity
+		std::lock_guard<std::mutex> lock(mutex);
 		if (free_list.empty()) return; // no pre-alloc
 		//cout << TXT(free_list.size()) << TXT(free_list.back().get_tot_vert_capacity()) << endl;
 
@@ -213,12 +217,13 @@ public:
 	}
 	void free(rgeom_storage_t &s) {
 		s.clear(); // in case the caller didn't clear it
+		std::lock_guard<std::mutex> lock(mutex);
 		free_list.push_back(rgeom_storage_t(s.tex)); // record tex of incoming element
 		s.swap_vectors(free_list.back()); // transfer existing capacity to free list; clear capacity from s
 	}
 };
 
-rgeom_alloc_t rgeom_alloc; // static allocator with free list, shared across all buildings; not thread safe
+rgeom_alloc_t rgeom_alloc; // static allocator with free list, shared across all buildings and room geom worker threads
 
 void rgeom_storage_t::clear() {
 	quad_verts.clear();
@@ -292,6 +297,11 @@ unsigned building_materials_t::count_all_verts() const {
 	for (const_iterator m = begin(); m != end(); ++m) {num_verts += m->get_tot_vert_count();}
 	return num_verts;
 }
+unsigned building_materials_t::get_mem_usage() const { // CPU vertex data that hasn't been sent to the GPU yet + VBO data
+	unsigned mem(0);
+	for (const_iterator m = begin(); m != end(); ++m) {mem += m->rgeom_storage_t::get_mem_usage() + m->get_tot_vert_count()*sizeof(rgeom_storage_t::vertex_t) + m->num_ixs*sizeof(unsigned);}
+	return mem;
+}
 rgeom_mat_t &building_materials_t::get_material(tid_nm_pair_t const &tex, bool inc_shadows) {
 	// for now we do a simple linear search because there shouldn't be too many unique materials
 	for (iterator m = begin(); m != end(); ++m) {
@@ -484,7 +494,16 @@ void building_room_geom_t::add_closet(room_object_t const &c, tid_nm_pair_t cons
 	}
 }
 
-int get_crate_tid(room_object_t const &c) {return get_texture_by_name((c.obj_id & 1) ? "crate2.jpg" : "crate.jpg");}
+// texture IDs are looked up once on the main thread by preload_room_geom_assets(); worker threads only read the cached values,
+// since texture_name_map isn't safe to search while the main thread may be adding textures to it
+int get_cached_tid(int &tid, char const *const name) {
+	if (tid < 0) {tid = get_texture_by_name(name);}
+	if (tid < 0) {tid = WHITE_TEX;} // failed to load texture - use a simple white texture
+	return tid;
+}
+int crate_tids[2] = {-1, -1}, cubicle_tids[2] = {-1, -1}, counter_tid(-1), plant_dirt_tid(-1);
+
+int get_crate_tid(room_object_t const &c) {bool const v(c.obj_id & 1); return get_cached_tid(crate_tids[v], (v ? "crate2.jpg" : "crate.jpg"));}
 
 void building_room_geom_t::add_crate(room_object_t const &c) {
 	// Note: draw as "small", not because crates are small, but because they're only added to windowless rooms and can't be easily seen from outside a building
@@ -543,7 +562,7 @@ void building_room_geom_t::add_shelves(room_object_t const &c, float tscale) {
 	// add crates on the shelves
 	rand_gen_t rgen;
 	rgen.set_state(c.room_id+1, c.obj_id+123);
-	static vect_cube_t cubes;
+	static thread_local vect_cube_t cubes;
 
 	for (unsigned s = 0; s < num_shelves; ++s) {
 		cube_t const &S(shelves[s]);
@@ -720,7 +739,7 @@ void building_room_geom_t::add_book_title(string const &title, cube_t const &tit
 	column_dir[hdim] = (cdir ? -1.0 : 1.0); // along book height
 	line_dir  [tdim] = (ldir ? -1.0 : 1.0); // along book thickness
 	normal    [wdim] = (wdir ? -1.0 : 1.0); // along book width
-	static vector<vert_tc_t> verts;
+	static thread_local vector<vert_tc_t> verts;
 	verts.clear();
 	gen_text_verts(verts, all_zeros, title, 1.0, column_dir, line_dir, 1); // use_quads=1 (could cache this for c.obj_id + dim/dir bits)
 	assert(!verts.empty());
@@ -795,8 +814,7 @@ void building_room_geom_t::add_book(room_object_t const &c, bool inc_lg, bool in
 	bool const add_spine_title(c.obj_id & 7); // 7/8 of the time
 
 	if (ADD_BOOK_TITLES && inc_sm && !no_title && (!upright || add_spine_title)) {
-		unsigned const SPLIT_LINE_SZ = 24;
-		string const &title(gen_book_title(c.obj_id, nullptr, SPLIT_LINE_SZ)); // select our title text
+		string const &title(gen_book_title(c.obj_id, nullptr, BOOK_TITLE_SPLIT_LINE_SZ)); // select our title text
 		if (title.empty()) return; // no title
 		colorRGBA text_color(BLACK);
 		for (unsigned i = 0; i < 3; ++i) {text_color[i] = ((c.color[i] > 0.5) ? 0.0 : 1.0);} // invert + saturate to contrast with book cover
@@ -1116,7 +1134,7 @@ void building_room_geom_t::add_br_stall(room_object_t const &c) {
 	mat.add_cube_to_verts(door,   color, tex_origin);
 }
 
-int get_cubicle_tid(room_object_t const &c) {return get_texture_by_name((c.obj_id & 1) ? "carpet/carpet1.jpg" : "carpet/carpet2.jpg");} // select from one of 2 textures
+int get_cubicle_tid(room_object_t const &c) {bool const v(c.obj_id & 1); return get_cached_tid(cubicle_tids[v], (v ? "carpet/carpet1.jpg" : "carpet/carpet2.jpg"));} // select from one of 2 textures
 
 void building_room_geom_t::add_cubicle(room_object_t const &c, float tscale) {
 	rgeom_mat_t &mat(get_material(tid_nm_pair_t(get_cubicle_tid(c), tscale), 1));
@@ -1171,9 +1189,11 @@ void building_room_geom_t::add_cubicle(room_object_t const &c, float tscale) {
 
 class sign_helper_t {
 	map<string, unsigned> txt_to_id;
-	vector<string> text;
+	deque<string> text; // deque so that references returned by get_text() stay valid when text is added
+	mutable std::mutex mutex; // signs can be added and drawn from room geom worker threads
 public:
 	unsigned register_text(string const &t) {
+		std::lock_guard<std::mutex> lock(mutex);
 		auto it(txt_to_id.find(t));
 		if (it != txt_to_id.end()) return it->second; // found
 		unsigned const id(text.size());
@@ -1183,6 +1203,7 @@ public:
 		return id;
 	}
 	string const &get_text(unsigned id) const {
+		std::lock_guard<std::mutex> lock(mutex);
 		assert(id < text.size());
 		return text[id];
 	}
@@ -1206,7 +1227,7 @@ void building_room_geom_t::add_sign(room_object_t const &c, bool inc_back, bool
 	bool const ldir(c.dim ^ c.dir);
 	col_dir[!c.dim] = (ldir  ? 1.0 : -1.0);
 	normal [ c.dim] = (c.dir ? 1.0 : -1.0);
-	static vector<vert_tc_t> verts;
+	static thread_local vector<vert_tc_t> verts;
 	verts.clear();
 	string const &text(sign_helper.get_text(c.obj_id));
 	assert(!text.empty());
@@ -1231,7 +1252,7 @@ void building_room_geom_t::add_sign(room_object_t const &c, bool inc_back, bool
 	}
 }
 
-int get_counter_tid() {return get_texture_by_name("marble2.jpg");}
+int get_counter_tid() {return get_cached_tid(counter_tid, "marble2.jpg");}
 
 void building_room_geom_t::add_counter(room_object_t const &c, float tscale) { // for kitchens
 	float const dz(c.dz()), depth(c.get_sz_dim(c.dim)), dir_sign(c.dir ? 1.0 : -1.0);
@@ -1259,7 +1280,7 @@ void building_room_geom_t::add_counter(room_object_t const &c, float tscale) { /
 		faucet2.z1()  = faucet1.z2();
 		faucet2.z2() += 0.035*dz;
 		faucet2.d[c.dim][c.dir] += dir_sign*0.28*sdepth;
-		static vect_cube_t cubes;
+		static thread_local vect_cube_t cubes;
 		cubes.clear();
 		subtract_cube_from_cube(top, sink, cubes);
 		for (auto i = cubes.begin(); i != cubes.end(); ++i) {top_mat.add_cube_to_verts(*i, top_color, tex_origin);} // should always be 4 cubes
@@ -1398,6 +1419,8 @@ void building_room_geom_t::add_tv_picture(room_object_t const &c) {
 	get_material(tex).add_cube_to_verts(screen, WHITE, c.get_llc(), skip_faces, !c.dim, !(c.dim ^ c.dir));
 }
 
+int get_plant_dirt_tid() {return get_cached_tid(plant_dirt_tid, "rock2.png");}
+
 void building_room_geom_t::add_potted_plant(room_object_t const &c, bool inc_pot, bool inc_plant) {
 	float const plant_diameter(0.5f*(c.dx() + c.dy())), stem_radius(0.035*plant_diameter);
 	float const pot_height(max(0.6*plant_diameter, 0.3*c.dz())), pot_top(c.z1() + pot_height), dirt_level(pot_top - 0.15*pot_height);
@@ -1409,14 +1432,14 @@ void building_room_geom_t::add_potted_plant(room_object_t const &c, bool inc_pot
 		float const pot_radius(0.4*plant_diameter);
 		get_material(untex_shad_mat, 1).add_cylin_to_verts(point(cx, cy, c.z1()), point(cx, cy, pot_top), 0.65*pot_radius, pot_radius, apply_light_color(c), 0, 0, 1, 0);
 		// draw dirt in the pot as a disk
-		rgeom_mat_t &dirt_mat(get_material(tid_nm_pair_t(get_texture_by_name("rock2.png")), 1)); // use dirt texture
+		rgeom_mat_t &dirt_mat(get_material(tid_nm_pair_t(get_plant_dirt_tid()), 1)); // use dirt texture
 		dirt_mat.add_disk_to_verts(base_pos, 0.947*pot_radius, 0, apply_light_color(c, WHITE));
 	}
 	if (inc_plant) {
 		// draw plant leaves
 		s_plant plant;
 		plant.create_no_verts(base_pos, (c.z2() - base_pos.z), stem_radius, c.obj_id, 0, 1); // land_plants_only=1
-		static vector<vert_norm_comp> points;
+		static thread_local vector<vert_norm_comp> points;
 		points.clear();
 		plant.create_leaf_points(points, 10.0); // plant_scale=10.0 seems to work well
 		auto &leaf_verts(mats_plants.get_material(tid_nm_pair_t(plant.get_leaf_tid()), 1).quad_verts);
@@ -1433,6 +1456,7 @@ void building_room_geom_t::clear() {
 	clear_materials();
 	objs.clear();
 	light_bcubes.clear();
+	obj_index.clear();
 	has_elevators = 0;
 }
 void building_room_geom_t::clear_materials() { // can be called to update textures, lighting state, etc.
@@ -1441,6 +1465,7 @@ void building_room_geom_t::clear_materials() { // can be called to update textur
 	mats_dynamic.clear();
 	mats_lights.clear();
 	mats_plants.clear();
+	verts_prefetched = 0;
 }
 void building_room_geom_t::clear_static_vbos() { // used to clear pictures
 	mats_static.clear();
@@ -1483,7 +1508,118 @@ colorRGBA room_object_t::get_color() const {
 	return color; // Note: probably should always set color so that we can return it here
 }
 
-void building_room_geom_t::create_static_vbos(tid_nm_pair_t const &wall_tex) {
+unsigned building_room_geom_t::get_mem_usage() const {
+	return (objs.capacity()*sizeof(room_object_t) + mats_static.get_mem_usage() + mats_small.get_mem_usage() +
+		mats_dynamic.get_mem_usage() + mats_lights.get_mem_usage() + mats_plants.get_mem_usage() + obj_index.get_mem_usage());
+}
+
+// returns the indices of objects that may intersect c in increasing order; callers must still test the objects themselves
+void building_room_geom_t::get_cand_objs(cube_t const &c, vector<unsigned> &ixs, uint64_t skip_types_mask, bool skip_nocoll) const {
+	assert(obj_index.is_valid_for(objs)); // must be built after objects are added
+	obj_index.get_objs_in_cube(c, ixs, skip_types_mask, skip_nocoll);
+}
+
+void room_obj_index_t::clear() {
+	num_objs = 0;
+	floor_start.clear();
+	for (unsigned d = 0; d < 3; ++d) {UNROLL_2X(qbounds[d][i_].clear();)}
+	flags.clear();
+	types.clear();
+	obj_ixs.clear();
+	dyn_ixs.clear();
+}
+unsigned room_obj_index_t::get_floor_ix(float z) const {
+	assert(floor_start.size() > 1);
+	if (z <= bcube.z1()) return 0;
+	return min(unsigned(floor_start.size() - 2), unsigned((z - bcube.z1())/floor_spacing));
+}
+void room_obj_index_t::quantize_cube(cube_t const &c, uint16_t q[3][2]) const {
+	for (unsigned d = 0; d < 3; ++d) { // round outward; clamping is monotonic, so cubes that overlap still overlap after quantization
+		q[d][0] = (uint16_t)max(0.0f, min(65535.0f, floor((c.d[d][0] - bcube.d[d][0])*qscale[d])));
+		q[d][1] = (uint16_t)max(0.0f, min(65535.0f, ceil ((c.d[d][1] - bcube.d[d][0])*qscale[d])));
+	}
+}
+
+void room_obj_index_t::build(vector<room_object_t> const &objs, cube_t const &bcube_, float floor_spacing_) {
+	static_assert(NUM_TYPES <= 64, "room object types must fit in a 64-bit mask");
+	assert(floor_spacing_ > 0.0);
+	clear();
+	bcube         = bcube_;
+	floor_spacing = floor_spacing_;
+	num_objs      = objs.size();
+	UNROLL_3X(qscale[i_] = ((bcube.d[i_][1] > bcube.d[i_][0]) ? 65535.0f/(bcube.d[i_][1] - bcube.d[i_][0]) : 0.0f);)
+	unsigned const num_floors(max(1U, unsigned(ceil(bcube.dz()/floor_spacing))));
+	floor_start.resize(num_floors+1, 0);
+	vector<pair<unsigned, unsigned>> obj_floors(objs.size()); // {first, last} floor, or {1, 0} for dynamic objects
+
+	for (unsigned i = 0; i < objs.size(); ++i) { // first pass: count entries per floor
+		room_object_t const &c(objs[i]);
+		if (c.type == TYPE_ELEVATOR) {dyn_ixs.push_back(i); obj_floors[i] = make_pair(1U, 0U); continue;} // elevator cars move in z
+		obj_floors[i] = make_pair(get_floor_ix(c.z1()), get_floor_ix(c.z2()));
+		for (unsigned f = obj_floors[i].first; f <= obj_floors[i].second; ++f) {++floor_start[f+1];}
+	}
+	for (unsigned f = 0; f < num_floors; ++f) {floor_start[f+1] += floor_start[f];} // convert counts to start indices
+	unsigned const num_entries(floor_start.back());
+	for (unsigned d = 0; d < 3; ++d) {UNROLL_2X(qbounds[d][i_].resize(num_entries);)}
+	flags  .resize(num_entries);
+	types  .resize(num_entries);
+	obj_ixs.resize(num_entries);
+	vector<unsigned> next_entry(floor_start.begin(), floor_start.end()-1);
+
+	for (unsigned i = 0; i < objs.size(); ++i) { // second pass: fill in entries; each floor's entries are in object order
+		room_object_t const &c(objs[i]);
+		uint16_t q[3][2];
+		quantize_cube(c, q);
+
+		for (unsigned f = obj_floors[i].first; f <= obj_floors[i].second; ++f) {
+			unsigned const e(next_entry[f]++);
+			for (unsigned d = 0; d < 3; ++d) {UNROLL_2X(qbounds[d][i_][e] = q[d][i_];)}
+			flags  [e] = c.flags;
+			types  [e] = (uint8_t)c.type;
+			obj_ixs[e] = i;
+		}
+	} // for i
+}
+
+void room_obj_index_t::get_objs_in_cube(cube_t const &c, vector<unsigned> &ixs, uint64_t skip_types_mask, bool skip_nocoll) const {
+	ixs.clear();
+	bool need_sort(0);
+
+	if (!floor_start.empty()) {
+		uint16_t q[3][2];
+		quantize_cube(c, q);
+		unsigned const f1(get_floor_ix(c.z1())), f2(get_floor_ix(c.z2()));
+		need_sort = (f2 > f1); // objects spanning floors may be added more than once
+
+		for (unsigned f = f1; f <= f2; ++f) {
+			for (unsigned e = floor_start[f]; e < floor_start[f+1]; ++e) {
+				if (qbounds[0][0][e] > q[0][1] || qbounds[0][1][e] < q[0][0]) continue;
+				if (qbounds[1][0][e] > q[1][1] || qbounds[1][1][e] < q[1][0]) continue;
+				if (qbounds[2][0][e] > q[2][1] || qbounds[2][1][e] < q[2][0]) continue;
+				if (skip_types_mask & (1ULL << types[e])) continue;
+				if (skip_nocoll && (flags[e] & RO_FLAG_NOCOLL)) continue;
+				ixs.push_back(obj_ixs[e]);
+			}
+		} // for f
+	}
+	if (!dyn_ixs.empty() && !(skip_types_mask & get_room_obj_type_mask(TYPE_ELEVATOR))) { // only elevators are dynamic
+		ixs.insert(ixs.end(), dyn_ixs.begin(), dyn_ixs.end());
+		need_sort = 1;
+	}
+	if (need_sort) { // return in object order so that results match a linear scan over objs
+		sort(ixs.begin(), ixs.end());
+		ixs.erase(unique(ixs.begin(), ixs.end()), ixs.end());
+	}
+}
+
+unsigned room_obj_index_t::get_mem_usage() const {
+	unsigned mem((floor_start.capacity() + obj_ixs.capacity() + dyn_ixs.capacity())*sizeof(unsigned) + flags.capacity()*sizeof(uint16_t) + types.capacity());
+	for (unsigned d = 0; d < 3; ++d) {UNROLL_2X(mem += qbounds[d][i_].capacity()*sizeof(uint16_t);)}
+	return mem;
+}
+
+// Note: the create_*_verts() functions don't make any GL calls and may be called on a worker thread
+void building_room_geom_t::create_static_verts(tid_nm_pair_t const &wall_tex) {
 	//highres_timer_t timer("Gen Room Geom"); // 2.1ms
 	float const tscale(2.0/obj_scale);
 	obj_model_insts.clear();
@@ -1538,11 +1674,8 @@ void building_room_geom_t::create_static_vbos(tid_nm_pair_t const &wall_tex) {
 			//get_material(tid_nm_pair_t()).add_cube_to_verts(*i, WHITE, tex_origin); // for debugging of model bcubes
 		}
 	} // for i
-	// Note: verts are temporary, but cubes are needed for things such as collision detection with the player and ray queries for indir lighting
-	//timer_t timer2("Create VBOs"); // < 2ms
-	mats_static.create_vbos();
 }
-void building_room_geom_t::create_small_static_vbos() {
+void building_room_geom_t::create_small_static_verts() {
 	//highres_timer_t timer("Gen Room Geom Small"); // 1.3ms
 	float const tscale(2.0/obj_scale);
 
@@ -1564,28 +1697,77 @@ void building_room_geom_t::create_small_static_vbos() {
 		default: break;
 		}
 	} // for i
-	mats_small.create_vbos();
-	mats_plants.create_vbos();
 }
-void building_room_geom_t::create_lights_vbos() {
+void building_room_geom_t::create_lights_verts() {
 	//highres_timer_t timer("Gen Room Geom Light"); // 0.3ms
 	float const tscale(2.0/obj_scale);
 
 	for (auto i = objs.begin(); i != objs.end(); ++i) {
 		if (i->is_visible() && i->type == TYPE_LIGHT) {add_light(*i, tscale);}
 	}
-	mats_lights.create_vbos();
 }
-void building_room_geom_t::create_dynamic_vbos() {
-	if (!has_elevators) return; // currently only elevators are dynamic, can skip this step if there are no elevators
-
+void building_room_geom_t::create_dynamic_verts() {
 	for (auto i = objs.begin(); i != objs.end(); ++i) {
 		if (!i->is_visible() || i->type != TYPE_ELEVATOR) continue; // only elevators for now
 		add_elevator(*i, 2.0/obj_scale);
 	}
+}
+void building_room_geom_t::create_all_verts(tid_nm_pair_t const &wall_tex) { // everything but the VBOs, for room geom generated in the background
+	create_static_verts(wall_tex);
+	create_small_static_verts();
+	create_lights_verts();
+	if (has_elevators) {create_dynamic_verts();}
+	verts_prefetched = 1;
+}
+void building_room_geom_t::create_prefetched_vbos() {
+	assert(verts_prefetched);
+	mats_static .create_vbos();
+	mats_small  .create_vbos();
+	mats_plants .create_vbos();
+	mats_lights .create_vbos();
+	mats_dynamic.create_vbos();
+	verts_prefetched = 0;
+}
+
+void building_room_geom_t::create_static_vbos(tid_nm_pair_t const &wall_tex) {
+	create_static_verts(wall_tex);
+	// Note: verts are temporary, but cubes are needed for things such as collision detection with the player and ray queries for indir lighting
+	//timer_t timer2("Create VBOs"); // < 2ms
+	mats_static.create_vbos();
+}
+void building_room_geom_t::create_small_static_vbos() {
+	create_small_static_verts();
+	mats_small.create_vbos();
+	mats_plants.create_vbos();
+}
+void building_room_geom_t::create_lights_vbos() {
+	create_lights_verts();
+	mats_lights.create_vbos();
+}
+void building_room_geom_t::create_dynamic_vbos() {
+	if (!has_elevators) return; // currently only elevators are dynamic, can skip this step if there are no elevators
+	create_dynamic_verts();
 	mats_dynamic.create_vbos();
 }
 
+// get_texture_by_name() and the first book title lookup aren't thread safe, so resolve every texture ID and load everything that room geom
+// generation may look up by name on the main thread before any room geom is generated on worker threads
+void preload_room_geom_assets() {
+	building_obj_model_loader.is_model_valid(OBJ_MODEL_TOILET); // loads all models
+	room_object_t c;
+
+	for (c.obj_id = 0; c.obj_id < 2; ++c.obj_id) { // textures are selected by the low bit of obj_id
+		get_crate_tid  (c);
+		get_cubicle_tid(c);
+	}
+	get_counter_tid();
+	get_plant_dirt_tid();
+	get_rect_panel_tid();
+	get_bath_wind_tid();
+	get_int_door_tid();
+	gen_book_title(0, nullptr, BOOK_TITLE_SPLIT_LINE_SZ); // loads the titles file
+}
+
 struct occlusion_stats_t {
 	unsigned nobj, next, nnear, nvis, ndraw;
 	int last_frame_counter;
@@ -1620,6 +1802,8 @@ void building_room_geom_t::draw(shader_t &s, building_t const &building, occlusi
 		clear_static_vbos(); // user created a new screenshot texture, and this building has pictures - recreate room geom
 		num_pic_tids = num_screenshot_tids;
 	}
+	if (verts_prefetched) {create_prefetched_vbos();} // vertex data was generated in the background, only the upload is left (no limit)
+	last_draw_frame = frame_counter;
 	if (mats_static.empty() && (shadow_only || num_geom_this_frame < MAX_ROOM_GEOM_GEN_PER_FRAME)) { // create static materials if needed
 		create_static_vbos(wall_tex);
 		++num_geom_this_frame;
@@ -901,7 +901,7 @@ bool building_t::add_kitchen_objs(rand_gen_t rgen, room_t const &room, float zva
 		c.z2() = zval + height;
 		cabinet_area.z1() = zval;
 		cabinet_area.z2() = zval + vspace - get_floor_thickness();
-		static vect_cube_t blockers;
+		static thread_local vect_cube_t blockers; // thread_local since room geom can be generated on worker threads
 		gather_room_placement_blockers(cabinet_area, objs_start, blockers, 1, 1); // inc_open_doors=1, ignore_chairs=1
 		bool is_sink(1);
 
@@ -1736,7 +1736,7 @@ void building_t::add_wall_and_door_trim() { // and window trim
 	// Note: depth must be small to avoid object intersections; this applies to the windowsill as well
 	float const window_trim_width(0.75*wall_thickness), window_trim_depth(0.1*wall_thickness), windowsill_depth(0.1*wall_thickness);
 	float const window_offset(0.01*window_vspacing); // must match building_draw_t::add_section()
-	static vect_vnctcc_t wall_quad_verts;
+	static thread_local vect_vnctcc_t wall_quad_verts;
 	wall_quad_verts.clear();
 	get_all_drawn_window_verts_as_quads(wall_quad_verts);
 	assert((wall_quad_verts.size() & 3) == 0); // must be a multiple of 4
@@ -1939,15 +1939,42 @@ void building_t::gen_and_draw_room_geom(shader_t &s, occlusion_checker_t &oc, ve
 	if (is_rotated()) return; // no room geom for rotated buildings
 
 	if (!has_room_geom()) {
-		rand_gen_t rgen;
-		rgen.set_state(building_ix, parts.size()); // set to something canonical per building
 		ped_bcubes.clear();
 		if (ped_ix >= 0) {get_ped_bcubes_for_building(ped_ix, building_ix, ped_bcubes);}
-		gen_room_details(rgen, ped_bcubes, building_ix); // generate so that we can draw it
-		assert(has_room_geom());
+		gen_room_geom(ped_bcubes, building_ix); // generate so that we can draw it
 	}
 	draw_room_geom(s, oc, xlate, building_ix, shadow_only, reflection_pass, inc_small, player_in_building);
 }
+void building_t::gen_room_geom(vect_cube_t const &ped_bcubes, unsigned building_ix) {
+	rand_gen_t rgen;
+	rgen.set_state(building_ix, parts.size()); // set to something canonical per building
+	gen_room_details(rgen, ped_bcubes, building_ix);
+	assert(has_room_geom());
+	interior->room_geom->obj_index.build(interior->room_geom->objs, bcube, get_window_vspace());
+}
+
+// copies everything but room_geom and nav_graph so that room geom can be generated for a copy of a building on another thread
+std::shared_ptr<building_interior_t> building_interior_t::clone_without_room_geom() const {
+	std::shared_ptr<building_interior_t> ret(new building_interior_t);
+	ret->floors     = floors;
+	ret->ceilings   = ceilings;
+	UNROLL_2X(ret->walls[i_] = walls[i_];)
+	ret->stairwells = stairwells;
+	ret->doors      = doors;
+	ret->landings   = landings;
+	ret->rooms      = rooms;
+	ret->elevators  = elevators;
+	ret->exclusion  = exclusion;
+	ret->draw_range = draw_range;
+	ret->top_ceilings_mask = top_ceilings_mask;
+	return ret;
+}
+void building_t::take_room_geom_from(building_t &src) { // src is a copy of this building with room geom generated on another thread
+	assert(interior && src.interior && src.has_room_geom() && !has_room_geom());
+	assert(interior->rooms.size() == src.interior->rooms.size());
+	interior->rooms = src.interior->rooms; // room types and lighting are assigned when room geom is generated
+	interior->room_geom.swap(src.interior->room_geom);
+}
 
 void building_t::clear_room_geom() {
 	if (!has_room_geom()) return;
@@ -135,8 +135,8 @@ struct building_mat_t : public building_tex_params_t {
 
 struct building_params_t {
 
-	bool flatten_mesh, has_normal_map, tex_mirror, tex_inv_y, tt_only, infinite_buildings, dome_roof, onion_roof, enable_people_ai, add_city_interiors;
-	unsigned num_place, num_tries, cur_prob, max_shadow_maps;
+	bool flatten_mesh, has_normal_map, tex_mirror, tex_inv_y, tt_only, infinite_buildings, dome_roof, onion_roof, enable_people_ai, add_city_interiors, prefetch_room_geom;
+	unsigned num_place, num_tries, cur_prob, max_shadow_maps, room_geom_mem_budget; // room_geom_mem_budget is in MB
 	float ao_factor, sec_extra_spacing, player_coll_radius_scale;
 	float window_width, window_height, window_xspace, window_yspace; // windows
 	float wall_split_thresh, max_fp_wind_xscale, max_fp_wind_yscale; // interiors
@@ -147,7 +147,7 @@ struct building_params_t {
 	vector<unsigned> rug_tids, picture_tids, desktop_tids, sheet_tids;
 
 	building_params_t(unsigned num=0) : flatten_mesh(0), has_normal_map(0), tex_mirror(0), tex_inv_y(0), tt_only(0), infinite_buildings(0), dome_roof(0),
-		onion_roof(0), enable_people_ai(0), add_city_interiors(0), num_place(num), num_tries(10), cur_prob(1), max_shadow_maps(32), ao_factor(0.0),
+		onion_roof(0), enable_people_ai(0), add_city_interiors(0), prefetch_room_geom(0), num_place(num), num_tries(10), cur_prob(1), max_shadow_maps(32), room_geom_mem_budget(512), ao_factor(0.0),
 		sec_extra_spacing(0.0), player_coll_radius_scale(1.0), window_width(0.0), window_height(0.0), window_xspace(0.0), window_yspace(0.0),
 		wall_split_thresh(4.0), max_fp_wind_xscale(0.0), max_fp_wind_yscale(0.0), range_translate(zero_vector) {}
 	int get_wrap_mir() const {return (tex_mirror ? 2 : 1);}
@@ -295,6 +295,7 @@ struct rgeom_storage_t {
 	void swap_vectors(rgeom_storage_t &s);
 	void swap(rgeom_storage_t &s);
 	unsigned get_tot_vert_capacity() const {return (quad_verts.capacity() + itri_verts.capacity());}
+	unsigned get_mem_usage() const {return (get_tot_vert_capacity()*sizeof(vertex_t) + indices.capacity()*sizeof(unsigned));}
 };
 
 class rgeom_mat_t : public rgeom_storage_t { // simplified version of building_draw_t::draw_block_t
@@ -327,6 +328,7 @@ public:
 struct building_materials_t : public vector<rgeom_mat_t> {
 	void clear();
 	unsigned count_all_verts() const;
+	unsigned get_mem_usage() const;
 	rgeom_mat_t &get_material(tid_nm_pair_t const &tex, bool inc_shadows);
 	void create_vbos();
 	void draw(shader_t &s, bool shadow_only, bool reflection_pass);
@@ -339,10 +341,38 @@ struct obj_model_inst_t {
 	obj_model_inst_t(unsigned oid, unsigned mid, unsigned f, colorRGBA const &c, vector3d const &d) : obj_id(oid), model_id(mid), flags(f), color(c), dir(d) {}
 };
 
+// compact query index over room objects, built once after the objects are placed; bounds are quantized to 16 bits relative to the building bcube
+// and rounded outward, and are stored SoA along with types and flags so that queries only touch a few bytes per object;
+// entries are bucketed by floor so that queries only visit the floors they overlap; objs remains authoritative for drawing and exact tests
+struct room_obj_index_t {
+	cube_t bcube;
+	float qscale[3], floor_spacing; // qscale: building space => quantized units
+	unsigned num_objs; // size of objs when this was built
+	vector<unsigned> floor_start; // ranges of entries for each floor, size = num_floors+1
+	vector<uint16_t> qbounds[3][2]; // {x,y,z}x{lo,hi}; objects spanning multiple floors have an entry for each floor
+	vector<uint16_t> flags; // copy of object flags when built; only flags that don't change after placement, such as RO_FLAG_NOCOLL, should be tested
+	vector<uint8_t> types;
+	vector<unsigned> obj_ixs; // index into objs for each entry
+	vector<unsigned> dyn_ixs; // objects that can move (elevators) aren't bucketed and are always returned
+
+	room_obj_index_t() : floor_spacing(0.0), num_objs(0) {UNROLL_3X(qscale[i_] = 0.0;)}
+	bool is_valid_for(vector<room_object_t> const &objs) const {return (num_objs == objs.size());}
+	void clear();
+	void build(vector<room_object_t> const &objs, cube_t const &bcube_, float floor_spacing_);
+	void get_objs_in_cube(cube_t const &c, vector<unsigned> &ixs, uint64_t skip_types_mask=0, bool skip_nocoll=0) const;
+	unsigned get_mem_usage() const;
+private:
+	unsigned get_floor_ix(float z) const;
+	void quantize_cube(cube_t const &c, uint16_t q[3][2]) const;
+};
+
+inline uint64_t get_room_obj_type_mask(room_object type) {return (1ULL << type);}
+
 struct building_room_geom_t {
 
-	bool has_elevators, has_pictures, lights_changed;
+	bool has_elevators, has_pictures, lights_changed, verts_prefetched; // verts_prefetched: vertex data was generated on a worker thread, but VBOs haven't been created yet
 	unsigned char num_pic_tids;
+	int last_draw_frame; // used to choose which room geom to free when over the memory budget
 	float obj_scale;
 	unsigned stairs_start; // index of first object of TYPE_STAIR
 	vector3d tex_origin;
@@ -350,8 +380,10 @@ struct building_room_geom_t {
 	vector<obj_model_inst_t> obj_model_insts;
 	building_materials_t mats_static, mats_small, mats_dynamic, mats_lights, mats_plants; // {large static, small static, dynamic, lights, plants} materials
 	vect_cube_t light_bcubes;
+	room_obj_index_t obj_index; // for collision and AI queries
 
-	building_room_geom_t(vector3d const &tex_origin_) : has_elevators(0), has_pictures(0), lights_changed(0), num_pic_tids(0), obj_scale(1.0), stairs_start(0), tex_origin(tex_origin_) {}
+	building_room_geom_t(vector3d const &tex_origin_) : has_elevators(0), has_pictures(0), lights_changed(0), verts_prefetched(0), num_pic_tids(0), last_draw_frame(0),
+		obj_scale(1.0), stairs_start(0), tex_origin(tex_origin_) {}
 	bool empty() const {return objs.empty();}
 	void clear();
 	void clear_materials();
@@ -359,6 +391,8 @@ struct building_room_geom_t {
 	void clear_and_recreate_lights() {lights_changed = 1;} // cache the state and apply the change later in case this is called from a different thread
 	unsigned get_num_verts() const {return (mats_static.count_all_verts() + mats_small.count_all_verts() +
 		mats_dynamic.count_all_verts() + mats_lights.count_all_verts() + mats_plants.count_all_verts());}
+	unsigned get_mem_usage() const;
+	void get_cand_objs(cube_t const &c, vector<unsigned> &ixs, uint64_t skip_types_mask=0, bool skip_nocoll=0) const;
 	rgeom_mat_t &get_material(tid_nm_pair_t const &tex, bool inc_shadows=0, bool dynamic=0, bool small=0);
 	rgeom_mat_t &get_wood_material(float tscale=1.0, bool inc_shadows=1, bool dynamic=0, bool small=0);
 	// Note: these functions are all for drawing objects / adding them to the vertex list
@@ -393,6 +427,12 @@ struct building_room_geom_t {
 	void add_wall_trim(room_object_t const &c);
 	void add_railing(room_object_t const &c);
 	void add_potted_plant(room_object_t const &c, bool inc_pot, bool inc_plant);
+	void create_static_verts(tid_nm_pair_t const &wall_tex);
+	void create_small_static_verts();
+	void create_lights_verts();
+	void create_dynamic_verts();
+	void create_all_verts(tid_nm_pair_t const &wall_tex);
+	void create_prefetched_vbos();
 	void create_static_vbos(tid_nm_pair_t const &wall_tex);
 	void create_small_static_vbos();
 	void create_lights_vbos();
@@ -481,6 +521,7 @@ struct building_interior_t {
 
 	building_interior_t();
 	~building_interior_t();
+	std::shared_ptr<building_interior_t> clone_without_room_geom() const;
 	float get_doorway_width() const;
 	bool is_cube_close_to_doorway(cube_t const &c, cube_t const &room, float dmin=0.0f, bool inc_open=0, bool check_zval=0) const;
 	bool is_blocked_by_stairs_or_elevator(cube_t const &c, float dmin=0.0f, bool elevators_only=0) const;
@@ -605,6 +646,8 @@ struct building_t : public building_geom_t {
 		unsigned rooms_start, bool use_hallway, bool first_part_this_stack, float window_hspacing[2], float window_border);
 	void connect_stacked_parts_with_stairs(rand_gen_t &rgen, cube_t const &part);
 	void gen_room_details(rand_gen_t &rgen, vect_cube_t const &ped_bcubes, unsigned building_ix);
+	void gen_room_geom(vect_cube_t const &ped_bcubes, unsigned building_ix);
+	void take_room_geom_from(building_t &src);
 	void add_stairs_and_elevators(rand_gen_t &rgen);
 	void add_sign_by_door(tquad_with_ix_t const &door, bool outside, std::string const &text, colorRGBA const &color, bool emissive);
 	void add_exterior_door_signs(rand_gen_t &rgen);
@@ -792,6 +835,7 @@ int get_rect_panel_tid();
 int get_bath_wind_tid ();
 int get_int_door_tid  ();
 int get_normal_map_for_bldg_tid(int tid);
+void preload_room_geom_assets();
 unsigned register_sign_text(std::string const &text);
 void setup_building_draw_shader(shader_t &s, float min_alpha, bool enable_indir, bool force_tsl, bool use_texgen);
 // functions in city_gen.cc
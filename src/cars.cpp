@@ -9,6 +9,8 @@
 #include <cfloat> // for FLT_MAX
 
 float const MIN_CAR_STOP_SEP = 0.25; // in units of car lengths
+float const CARS_PER_GRID_CELL = 4.0; // average, used to select the car grid cell size
+unsigned const MAX_CAR_GRID_SZ = 512; // in each dim
 
 extern bool tt_fire_button_down;
 extern int display_mode, game_mode, map_mode, animate2;
@@ -432,6 +434,79 @@ void car_draw_state_t::add_car_headlights(car_t const &car, cube_t &lights_bcube
 }
 
 
+void car_grid_t::build(vector<car_t> const &cars) { // counting sort of car indices by cell
+	clear();
+	if (cars.empty()) return;
+	float max_sz(0.0);
+	bcube = cars.front().bcube;
+
+	for (auto i = cars.begin(); i != cars.end(); ++i) {
+		bcube.union_with_cube(i->bcube);
+		max_sz = max(max_sz, max(i->bcube.dx(), i->bcube.dy()));
+	}
+	max_ext = 0.5*max_sz;
+	float const dx(max(bcube.dx(), TOLERANCE)), dy(max(bcube.dy(), TOLERANCE));
+	float const cell_sz(max(max_sz, sqrt(CARS_PER_GRID_CELL*dx*dy/cars.size()))); // no smaller than a car
+	num[0] = min(MAX_CAR_GRID_SZ, (unsigned(dx/cell_sz) + 1));
+	num[1] = min(MAX_CAR_GRID_SZ, (unsigned(dy/cell_sz) + 1));
+	cell_sz_inv[0] = num[0]/dx;
+	cell_sz_inv[1] = num[1]/dy;
+	cell_start.resize(num[0]*num[1]+1, 0);
+	cell_ids.resize(cars.size());
+
+	for (unsigned i = 0; i < cars.size(); ++i) {
+		point const center(cars[i].bcube.get_cube_center());
+		cell_ids[i] = get_cell_ix(center.y, 1)*num[0] + get_cell_ix(center.x, 0);
+		++cell_start[cell_ids[i]+1];
+	}
+	for (unsigned i = 1; i < cell_start.size(); ++i) {cell_start[i] += cell_start[i-1];} // prefix sum
+	car_ixs.resize(cars.size());
+	vector<unsigned> cell_pos(cell_start.begin(), cell_start.end()-1); // next insert pos for each cell
+	for (unsigned i = 0; i < cars.size(); ++i) {car_ixs[cell_pos[cell_ids[i]]++] = i;} // stable, so each cell is sorted by car index
+}
+
+void car_grid_t::add_cell_cars(unsigned x1, unsigned x2, unsigned y, vector<unsigned> &ixs) const {
+	assert(x1 <= x2 && x2 < num[0] && y < num[1]);
+	unsigned const start(cell_start[y*num[0] + x1]), end(cell_start[y*num[0] + x2 + 1]); // cells in a row are contiguous
+	ixs.insert(ixs.end(), (car_ixs.begin() + start), (car_ixs.begin() + end));
+}
+
+// appends the indices of all cars whose bcubes may intersect c in x/y, sorted by index so that results match iteration over the cars array
+void car_grid_t::get_cars_in_cube(cube_t const &c, vector<unsigned> &ixs) const {
+	if (empty()) return;
+	cube_t query(c);
+	query.expand_by_xy(max_ext);
+	if (!query.intersects_xy(bcube)) return;
+	unsigned const start(ixs.size()), x1(get_cell_ix(query.x1(), 0)), x2(get_cell_ix(query.x2(), 0));
+	for (unsigned y = get_cell_ix(query.y1(), 1); y <= get_cell_ix(query.y2(), 1); ++y) {add_cell_cars(x1, x2, y, ixs);}
+	sort((ixs.begin() + start), ixs.end());
+}
+
+// same as above, but only visits cells near the line rather than all cells in its bounding cube
+void car_grid_t::get_cars_near_line(point const &p1, point const &p2, vector<unsigned> &ixs) const {
+	if (empty()) return;
+	cube_t query(p1, p2);
+	query.expand_by_xy(max_ext);
+	if (!query.intersects_xy(bcube)) return;
+	unsigned const start(ixs.size());
+	float const dx(p2.x - p1.x), dy(p2.y - p1.y);
+
+	for (unsigned y = get_cell_ix(query.y1(), 1); y <= get_cell_ix(query.y2(), 1); ++y) {
+		float t0(0.0), t1(1.0);
+
+		if (fabs(dy) > TOLERANCE) { // clip the line to this row, expanded by max_ext
+			float const ya((get_cell_edge(y, 1) - max_ext - p1.y)/dy), yb((get_cell_edge(y+1, 1) + max_ext - p1.y)/dy);
+			t0 = max(t0, min(ya, yb));
+			t1 = min(t1, max(ya, yb));
+			if (t0 > t1) continue; // line doesn't cross this row (shouldn't happen)
+		}
+		float const xa(p1.x + t0*dx), xb(p1.x + t1*dx);
+		add_cell_cars(get_cell_ix((min(xa, xb) - max_ext), 0), get_cell_ix((max(xa, xb) + max_ext), 0), y, ixs);
+	}
+	sort((ixs.begin() + start), ixs.end());
+}
+
+
 void car_manager_t::remove_destroyed_cars() {
 	remove_destroyed(cars);
 	car_destroyed = 0;
@@ -496,6 +571,7 @@ void car_manager_t::finalize_cars() {
 		i->color_id = ((fixed_color >= 0) ? fixed_color : (rgen.rand() % NUM_CAR_COLORS));
 		assert(i->is_valid());
 	} // for i
+	car_grid.build(cars);
 	cout << "Total Cars: " << cars.size() << endl; // 4000 on the road + 4372 parked + 433 garage (out of 594) = 8805
 }
 
@@ -520,21 +596,15 @@ void car_manager_t::extract_car_data(vector<car_city_vect_t> &cars_by_city) cons
 }
 
 bool car_manager_t::proc_sphere_coll(point &pos, point const &p_last, float radius, vector3d *cnorm) const {
+	if (car_grid.empty()) return 0;
 	vector3d const xlate(get_camera_coord_space_xlate());
-	float const dist(p2p_dist(pos, p_last));
+	cube_t sphere_bc; sphere_bc.set_from_sphere((pos - xlate), radius);
+	vector<unsigned> ixs;
+	car_grid.get_cars_in_cube(sphere_bc, ixs);
 
-	for (auto cb = car_blocks.begin(); cb+1 < car_blocks.end(); ++cb) {
-		cube_t const city_bcube(get_cb_bcube(*cb) + xlate);
-		if (pos.z - radius > city_bcube.z2() + city_params.get_max_car_size().z) continue; // above the cars
-		if (!sphere_cube_intersect_xy(pos, (radius + dist), city_bcube)) continue;
-		cube_t sphere_bc; sphere_bc.set_from_sphere((pos - xlate), radius);
-		unsigned start(0), end(0);
-		get_car_ix_range_for_cube(cb, sphere_bc, start, end);
-
-		for (unsigned c = start; c != end; ++c) {
-			if (cars[c].proc_sphere_coll(pos, p_last, radius, xlate, cnorm)) return 1;
-		}
-	} // for cb
+	for (auto c = ixs.begin(); c != ixs.end(); ++c) {
+		if (cars[*c].proc_sphere_coll(pos, p_last, radius, xlate, cnorm)) return 1;
+	}
 	return 0;
 }
 
@@ -542,25 +612,20 @@ void car_manager_t::destroy_cars_in_radius(point const &pos_in, float radius) {
 	vector3d const xlate(get_camera_coord_space_xlate());
 	point const pos(pos_in - xlate);
 	bool const is_pt(radius == 0.0);
-
-	for (auto cb = car_blocks.begin(); cb+1 < car_blocks.end(); ++cb) {
-		cube_t const city_bcube(get_cb_bcube(*cb));
-		if (pos.z - radius > city_bcube.z2() + city_params.get_max_car_size().z) continue; // above the cars
-		if (is_pt ? !city_bcube.contains_pt_xy(pos) : !sphere_cube_intersect_xy(pos, radius, city_bcube)) continue;
-		unsigned const start(cb->start), end((cb+1)->start); // Note: shouldnt be called frequently enough to need road/parking lot acceleration
-		assert(end <= cars.size() && start <= end);
-
-		for (unsigned c = start; c != end; ++c) {
-			car_t &car(cars[c]);
-
-			if (is_pt ? car.bcube.contains_pt(pos) : dist_less_than(car.get_center(), pos, radius)) { // destroy if within the sphere
-				car.destroy();
-				car_destroyed = 1;
-				// invalidate tile shadow map for destroyed parked cars
-				if (city_params.car_shadows && car.is_parked()) {invalidate_tile_smap_at_pt((car.get_center() + xlate), 0.5*car.get_length());} // radius = length/2
-			}
-		} // for c
-	} // for cb
+	cube_t query; query.set_from_sphere(pos, radius);
+	vector<unsigned> ixs;
+	car_grid.get_cars_in_cube(query, ixs);
+
+	for (auto c = ixs.begin(); c != ixs.end(); ++c) {
+		car_t &car(cars[*c]);
+
+		if (is_pt ? car.bcube.contains_pt(pos) : dist_less_than(car.get_center(), pos, radius)) { // destroy if within the sphere
+			car.destroy();
+			car_destroyed = 1;
+			// invalidate tile shadow map for destroyed parked cars
+			if (city_params.car_shadows && car.is_parked()) {invalidate_tile_smap_at_pt((car.get_center() + xlate), 0.5*car.get_length());} // radius = length/2
+		}
+	} // for c
 }
 
 bool car_manager_t::get_color_at_xy(point const &pos, colorRGBA &color, int int_ret) const { // Note: pos in local TT space
@@ -590,46 +655,32 @@ bool car_manager_t::get_color_at_xy(point const &pos, colorRGBA &color, int int_
 }
 
 car_t const *car_manager_t::get_car_at_pt(point const &pos, bool is_parked) const {
-	for (auto cb = car_blocks.begin(); cb+1 < car_blocks.end(); ++cb) {
-		if (!get_cb_bcube(*cb).contains_pt_xy(pos)) continue; // skip
-		unsigned start(cb->start), end((cb+1)->start);
-		if (!is_parked) {end   = cb->first_parked;} // moving cars only (beginning of range)
-		else            {start = cb->first_parked;} // parked cars only (end of range)
-		if (start > end || end > cars.size()) {cout << TXT(start) << TXT(end) << TXT(cars.size()) << TXT(is_parked) << endl;}
-		assert(start <= end && end <= cars.size());
+	cube_t query; query.set_from_point(pos);
+	vector<unsigned> ixs;
+	car_grid.get_cars_in_cube(query, ixs);
 
-		for (unsigned c = start; c != end; ++c) {
-			if (cars[c].bcube.contains_pt_xy(pos)) {return &cars[c];}
-		}
-	} // for cb
+	for (auto c = ixs.begin(); c != ixs.end(); ++c) {
+		car_t const &car(cars[*c]);
+		if (car.is_parked() == is_parked && car.bcube.contains_pt_xy(pos)) {return &car;}
+	}
 	return nullptr; // no car found
 }
 
 car_t const *car_manager_t::get_car_at(point const &p1, point const &p2) const { // Note: p1/p2 in local TT space
-	for (auto cb = car_blocks.begin(); cb+1 < car_blocks.end(); ++cb) {
-		if (!get_cb_bcube(*cb).line_intersects(p1, p2)) continue; // skip
-		unsigned start(cb->start), end((cb+1)->start);
-		assert(start <= end && end <= cars.size());
+	vector<unsigned> ixs;
+	car_grid.get_cars_near_line(p1, p2, ixs);
 
-		for (unsigned c = start; c != end; ++c) { // Note: includes parked cars
-			if (cars[c].bcube.line_intersects(p1, p2)) {return &cars[c];}
-		}
-	} // for cb
+	for (auto c = ixs.begin(); c != ixs.end(); ++c) { // Note: includes parked cars
+		if (cars[*c].bcube.line_intersects(p1, p2)) {return &cars[*c];}
+	}
 	return nullptr; // no car found
 }
 
 bool car_manager_t::line_intersect_cars(point const &p1, point const &p2, float &t) const { // Note: p1/p2 in local TT space
+	vector<unsigned> ixs;
+	car_grid.get_cars_near_line(p1, p2, ixs);
 	bool ret(0);
-
-	for (auto cb = car_blocks.begin(); cb+1 < car_blocks.end(); ++cb) {
-		if (!get_cb_bcube(*cb).line_intersects(p1, p2)) continue; // skip
-		unsigned start(cb->start), end((cb+1)->start);
-		assert(start <= end && end <= cars.size());
-
-		for (unsigned c = start; c != end; ++c) { // Note: includes parked cars
-			ret |= check_line_clip_update_t(p1, p2, t, cars[c].bcube);
-		}
-	} // for cb
+	for (auto c = ixs.begin(); c != ixs.end(); ++c) {ret |= check_line_clip_update_t(p1, p2, t, cars[*c].bcube);} // Note: includes parked cars
 	return ret;
 }
 
@@ -766,6 +817,8 @@ void car_manager_t::next_frame(ped_manager_t const &ped_manager, float car_speed
 	} // for i
 	if (!saw_parked && !car_blocks.empty()) {car_blocks.back().first_parked = cars.size();} // no parked cars in final city
 	car_blocks.emplace_back(cars.size(), 0); // add terminator
+	car_grid.build(cars); // for finding nearby cars entering cities
+	vector<unsigned> nearby_cars;
 
 	for (auto i = cars.begin(); i != cars.end(); ++i) { // collision detection
 		if (i->is_parked()) continue; // no collisions for parked cars
@@ -780,9 +833,14 @@ void car_manager_t::next_frame(ped_manager_t const &ped_manager, float car_speed
 			j->register_adj_car(*i);
 			if (!dist_xy_less_than(i->get_center(), j->get_center(), max_check_dist)) break;
 		}
-		if (on_conn_road) { // on connector road, check before entering intersection to a city
-			for (auto ix = entering_city.begin(); ix != entering_city.end(); ++ix) {
-				if (*ix != unsigned(i - cars.begin())) {check_collision(*i, cars[*ix]);}
+		if (on_conn_road && !entering_city.empty()) { // on connector road, check before entering intersection to a city
+			cube_t query(i->bcube);
+			query.expand_by_xy(max_check_dist + i->get_length()); // conservative, includes the max separation distance of check_collision()
+			nearby_cars.clear();
+			car_grid.get_cars_in_cube(query, nearby_cars); // sorted, so collisions are checked in the same order as entering_city
+
+			for (auto ix = nearby_cars.begin(); ix != nearby_cars.end(); ++ix) {
+				if (cars[*ix].entering_city && *ix != unsigned(i - cars.begin())) {check_collision(*i, cars[*ix]);}
 			}
 			//++num_on_conn_road;
 		}
@@ -793,6 +851,7 @@ void car_manager_t::next_frame(ped_manager_t const &ped_manager, float car_speed
 		if (!peds_crossing_roads.peds.empty()) {check_car_for_ped_colls(*i);}
 	} // for i
 	update_cars(); // run update logic
+	car_grid.build(cars); // rebuild for queries using the final car positions
 
 	if (map_mode) { // create cars_by_road
 		// cars have moved since the last sort and may no longer be in city/road order, but this algorithm doesn't require that;
@@ -562,6 +562,7 @@ public:
 // forward declarations of some classes
 class city_road_gen_t;
 struct pedestrian_t;
+struct ped_update_state_t;
 class ped_manager_t;
 
 struct ped_city_vect_t {
@@ -570,6 +571,25 @@ struct ped_city_vect_t {
 	void clear();
 };
 
+class car_grid_t { // uniform grid over car centers in x/y for spatial queries; rebuilt from car positions each frame
+
+	cube_t bcube; // union of all car bcubes
+	float cell_sz_inv[2], max_ext; // max_ext = max car half size in x/y, since cars are binned by center
+	unsigned num[2];
+	vector<unsigned> cell_start, car_ixs, cell_ids; // car_ixs is sorted by cell, then by car index; cell_start has one entry per cell + terminator
+
+	unsigned get_cell_ix(float val, unsigned d) const {return min(num[d]-1, unsigned(max(0.0f, (val - bcube.d[d][0])*cell_sz_inv[d])));}
+	float get_cell_edge(unsigned ix, unsigned d) const {return (bcube.d[d][0] + ix/cell_sz_inv[d]);}
+	void add_cell_cars(unsigned x1, unsigned x2, unsigned y, vector<unsigned> &ixs) const;
+public:
+	car_grid_t() : max_ext(0.0) {UNROLL_2X(cell_sz_inv[i_] = 0.0; num[i_] = 0;)}
+	bool empty() const {return car_ixs.empty();}
+	void clear() {cell_start.clear(); car_ixs.clear();}
+	void build(vector<car_t> const &cars);
+	void get_cars_in_cube(cube_t const &c, vector<unsigned> &ixs) const;
+	void get_cars_near_line(point const &p1, point const &p2, vector<unsigned> &ixs) const;
+};
+
 class car_manager_t {
 
 	car_model_loader_t car_model_loader;
@@ -583,6 +603,7 @@ class car_manager_t {
 	vector<car_t> cars;
 	vector<car_block_t> car_blocks, car_blocks_by_road;
 	vector<cube_with_ix_t> cars_by_road;
+	car_grid_t car_grid;
 	ped_city_vect_t peds_crossing_roads;
 	car_draw_state_t dstate;
 	rand_gen_t rgen;
@@ -650,17 +671,16 @@ struct pedestrian_t : public waiting_obj_t {
 	void stop();
 	void go();
 	bool check_for_safe_road_crossing(ped_manager_t const &ped_mgr, cube_t const &plot_bcube, cube_t const &next_plot_bcube, vect_cube_t *dbg_cubes=nullptr) const;
-	bool check_ped_ped_coll_range(vector<pedestrian_t> &peds, unsigned pid, unsigned ped_start, unsigned target_plot, float prox_radius, vector3d &force);
-	bool check_ped_ped_coll(ped_manager_t const &ped_mgr, vector<pedestrian_t> &peds, unsigned pid, float delta_dir);
-	bool check_ped_ped_coll_stopped(vector<pedestrian_t> &peds, unsigned pid);
-	bool check_inside_plot(ped_manager_t &ped_mgr, point const &prev_pos, cube_t const &plot_bcube, cube_t const &next_plot_bcube);
+	bool check_ped_ped_coll(ped_manager_t const &ped_mgr, vector<pedestrian_t> &peds, unsigned pid, float delta_dir, ped_update_state_t *pus=nullptr);
+	bool check_ped_ped_coll_stopped(vector<pedestrian_t> &peds, unsigned pid, unsigned ped_end);
+	bool check_inside_plot(ped_manager_t &ped_mgr, point const &prev_pos, cube_t const &plot_bcube, cube_t const &next_plot_bcube, ped_update_state_t *pus=nullptr);
 	bool check_road_coll(ped_manager_t const &ped_mgr, cube_t const &plot_bcube, cube_t const &next_plot_bcube) const;
-	bool is_valid_pos(vect_cube_t const &colliders, bool &ped_at_dest, ped_manager_t const *const ped_mgr) const;
+	bool is_valid_pos(vect_cube_t const &colliders, bool &ped_at_dest, ped_manager_t const *const ped_mgr, vector<point> *bldg_points=nullptr) const;
 	bool try_place_in_plot(cube_t const &plot_cube, vect_cube_t const &colliders, unsigned plot_id, rand_gen_t &rgen);
 	point get_dest_pos(cube_t const &plot_bcube, cube_t const &next_plot_bcube, ped_manager_t const &ped_mgr) const;
-	bool choose_alt_next_plot(ped_manager_t const &ped_mgr);
+	bool choose_alt_next_plot(ped_manager_t const &ped_mgr, rand_gen_t *rgen=nullptr);
 	void get_avoid_cubes(ped_manager_t const &ped_mgr, vect_cube_t const &colliders, point const &dest_pos, vect_cube_t &avoid) const;
-	void next_frame(ped_manager_t &ped_mgr, vector<pedestrian_t> &peds, unsigned pid, rand_gen_t &rgen, float delta_dir);
+	void next_frame(ped_manager_t &ped_mgr, vector<pedestrian_t> &peds, unsigned pid, rand_gen_t &rgen, float delta_dir, ped_update_state_t *pus=nullptr);
 	void register_at_dest();
 	void destroy() {destroyed = 1;} // that's it, no other effects
 	bool is_close_to_player() const;
@@ -702,6 +722,36 @@ public:
 	unsigned run(point const &pos_, point const &dest_, cube_t const &plot_bcube_, float gap_, point &new_dest);
 };
 
+struct ped_snapshot_t { // ped state at the start of the frame, for reading peds in other plots during the parallel update
+	point pos;
+	vector3d vel;
+	float radius;
+	unsigned plot;
+
+	ped_snapshot_t() : radius(0.0), plot(0) {}
+	ped_snapshot_t(pedestrian_t const &ped) : pos(ped.pos), vel(ped.vel), radius(ped.radius), plot(ped.plot) {}
+};
+
+struct ped_update_state_t { // per-thread state for the parallel ped update; cross-plot side effects are deferred and applied after all plots are updated
+	struct crosswalk_t {
+		point pos;
+		vector3d dir;
+		unsigned city;
+		crosswalk_t(point const &pos_, vector3d const &dir_, unsigned city_) : pos(pos_), dir(dir_), city(city_) {}
+	};
+	rand_gen_t rgen; // reseeded for each plot
+	path_finder_t path_finder;
+	vector<point> bldg_points; // temp buffer for building collisions
+	unsigned ped_start, ped_end; // range of peds in the plot being updated
+	vector<unsigned> new_plot_cities; // cities of peds that moved to their next plot
+	vector<pair<unsigned, unsigned>> ped_colls; // {ped, colliding_ped} for collisions with peds in other plots
+	vector<crosswalk_t> crosswalks;
+
+	ped_update_state_t() : ped_start(0), ped_end(0) {}
+	bool owns_ped(unsigned pid) const {return (pid >= ped_start && pid < ped_end);}
+	void clear_deferred() {new_plot_cities.clear(); ped_colls.clear(); crosswalks.clear();}
+};
+
 class ped_manager_t { // pedestrians
 
 	struct city_ixs_t {
@@ -716,6 +766,8 @@ class ped_manager_t { // pedestrians
 	vector<city_ixs_t> by_city; // first ped/plot index for each city
 	vector<unsigned> by_plot;
 	vector<unsigned char> need_to_sort_city;
+	vector<ped_snapshot_t> peds_snap; // for parallel update
+	vector<ped_update_state_t> update_states; // one per thread
 	vector<car_city_vect_t> cars_by_city;
 	vector<point> bldg_ppl_pos;
 	rand_gen_t rgen;
@@ -731,6 +783,8 @@ class ped_manager_t { // pedestrians
 	void sort_by_city_and_plot();
 	road_isec_t const &get_car_isec(car_base_t const &car) const;
 	void register_ped_new_plot(pedestrian_t const &ped);
+	void register_ped_new_plot(unsigned city);
+	void next_frame_parallel(float delta_dir);
 	int get_road_ix_for_ped_crossing(pedestrian_t const &ped, bool road_dim) const;
 	bool draw_ped(pedestrian_t const &ped, shader_t &s, pos_dir_up const &pdu, vector3d const &xlate, float def_draw_dist, float draw_dist_sq,
 		bool &in_sphere_draw, bool shadow_only, bool is_dlight_shadows, bool enable_animations);
@@ -746,9 +800,10 @@ public:
 	bool check_isec_sphere_coll(pedestrian_t const &ped) const;
 	bool check_streetlight_sphere_coll(pedestrian_t const &ped) const;
 	bool mark_crosswalk_in_use(pedestrian_t const &ped);
+	bool mark_crosswalk_in_use(unsigned city, point const &pos, vector3d const &dir);
 	bool choose_dest_building_or_parked_car(pedestrian_t &ped);
-	unsigned get_next_plot(pedestrian_t &ped, int exclude_plot=-1) const;
-	void move_ped_to_next_plot(pedestrian_t &ped);
+	unsigned get_next_plot(pedestrian_t &ped, int exclude_plot=-1, rand_gen_t *rgen=nullptr) const;
+	void move_ped_to_next_plot(pedestrian_t &ped, ped_update_state_t *pus=nullptr);
 	bool has_nearby_car(pedestrian_t const &ped, bool road_dim, float delta_time, vect_cube_t *dbg_cubes=nullptr) const;
 	bool has_nearby_car_on_road(pedestrian_t const &ped, bool dim, unsigned road_ix, float delta_time, vect_cube_t *dbg_cubes) const;
 	bool has_car_at_pt(point const &pos, unsigned city, bool is_parked) const;
@@ -767,6 +822,7 @@ public:
 	void next_frame();
 	pedestrian_t const *get_ped_at(point const &p1, point const &p2) const;
 	unsigned get_first_ped_at_plot(unsigned plot) const {assert(plot < by_plot.size()); return by_plot[plot];}
+	vector<ped_snapshot_t> const &get_ped_snapshot() const {return peds_snap;}
 	void get_peds_crossing_roads(ped_city_vect_t &pcv) const;
 	void draw(vector3d const &xlate, bool use_dlights, bool shadow_only, bool is_dlight_shadows);
 	void draw_peds_in_building(int first_ped_ix, unsigned bix, shader_t &s, vector3d const &xlate, bool dlight_shadow_only);
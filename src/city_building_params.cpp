@@ -261,6 +261,12 @@ bool parse_buildings_option(FILE *fp) {
 	else if (str == "enable_people_ai") {
 		if (!read_bool(fp, global_building_params.enable_people_ai)) {buildings_file_err(str, error);}
 	}
+	else if (str == "prefetch_room_geom") {
+		if (!read_bool(fp, global_building_params.prefetch_room_geom)) {buildings_file_err(str, error);}
+	}
+	else if (str == "room_geom_mem_budget") {
+		if (!read_uint(fp, global_building_params.room_geom_mem_budget)) {buildings_file_err(str, error);}
+	}
 	// material parameters
 	else if (str == "range_translate") { // x,y only
 		if (!(read_float(fp, global_building_params.range_translate.x) &&
@@ -1883,7 +1883,7 @@ class city_road_gen_t : public road_gen_base_t {
 		vect_cube_t const &get_colliders_for_plot (unsigned global_plot_id) const {return plot_colliders[decode_plot_id(global_plot_id)];}
 
 		// plot = current plot, dest_plot = final destination plot; returns next plot adj to cur plot on path to dest_plot
-		unsigned get_next_plot(unsigned global_plot, unsigned global_dest_plot, int exclude_plot) const {
+		unsigned get_next_plot(unsigned global_plot, unsigned global_dest_plot, int exclude_plot, rand_gen_t *rgen) const {
 			if (global_plot == global_dest_plot) {return global_plot;} // identity, at destination, no change
 			unsigned const plot(decode_plot_id(global_plot)), dest_plot(decode_plot_id(global_dest_plot)); // convert to local space
 			assert(plot < plots.size() && dest_plot < plots.size());
@@ -1906,8 +1906,8 @@ class city_road_gen_t : public road_gen_base_t {
 					dir = (move_dir ? ((dx < 0) ? 0 : 1) : ((dy < 0) ? 2 : 3));	
 				}
 				else { // take a detour in a random direction
-					static rand_gen_t rgen;
-					bool rand_dir(rgen.rand_bool());
+					static rand_gen_t def_rgen; // used when the caller doesn't provide an rgen
+					bool rand_dir((rgen ? *rgen : def_rgen).rand_bool());
 					dir = (move_dir ? (rand_dir ? 0 : 1) : (rand_dir ? 2 : 3));
 					
 					if (plot_xy.get_adj(cur_x, cur_y, dir) < 0) { // that direction's not valid, choose the other one
@@ -2646,7 +2646,9 @@ public:
 		return road_network_t::gen_ped_pos(ped, rgen, road_networks);
 	}
 	cube_t const &get_plot_from_global_id(unsigned city_id, unsigned global_plot_id) const {return get_city(city_id).get_plot_from_global_id(global_plot_id);}
-	unsigned get_next_plot(unsigned city_id, unsigned plot, unsigned dest_plot, int exclude_plot) const {return get_city(city_id).get_next_plot(plot, dest_plot, exclude_plot);}
+	unsigned get_next_plot(unsigned city_id, unsigned plot, unsigned dest_plot, int exclude_plot, rand_gen_t *rgen=nullptr) const {
+		return get_city(city_id).get_next_plot(plot, dest_plot, exclude_plot, rgen);
+	}
 	bool choose_dest_building(unsigned city_id, unsigned &plot, unsigned &building, rand_gen_t &rgen) const {return get_city(city_id).choose_dest_building(plot, building, rgen);}
 	
 	bool update_car_dest(car_t &car) const {
@@ -2766,9 +2768,11 @@ cube_t ped_manager_t::get_expanded_city_plot_bcube_for_peds(unsigned city_ix, un
 vect_cube_t const &ped_manager_t::get_colliders_for_plot(unsigned city_ix, unsigned plot_ix) const {return road_gen.get_colliders_for_plot(city_ix, plot_ix);}
 bool ped_manager_t::gen_ped_pos(pedestrian_t &ped) {return road_gen.gen_ped_pos(ped, rgen);} // Note: non-const because rgen is modified
 
-bool ped_manager_t::mark_crosswalk_in_use(pedestrian_t const &ped) {
-	bool const dim(fabs(ped.dir.y) > fabs(ped.dir.x)), dir(ped.dir[dim] > 0); // something like this?
-	return road_gen.get_city(ped.city).mark_crosswalk_in_use(ped.pos, dim, dir);
+bool ped_manager_t::mark_crosswalk_in_use(pedestrian_t const &ped) {return mark_crosswalk_in_use(ped.city, ped.pos, ped.dir);}
+
+bool ped_manager_t::mark_crosswalk_in_use(unsigned city, point const &pos, vector3d const &dir) {
+	bool const dim(fabs(dir.y) > fabs(dir.x)), pdir(dir[dim] > 0); // something like this?
+	return road_gen.get_city(city).mark_crosswalk_in_use(pos, dim, pdir);
 }
 bool ped_manager_t::check_isec_sphere_coll(pedestrian_t const &ped) const {
 	return road_gen.get_city(ped.city).check_isec_sphere_coll(ped.pos, 0.6*ped.radius); // Note: no xlate is required since peds and city are in the same coord space
@@ -2810,7 +2814,9 @@ void ped_manager_t::choose_new_ped_plot_pos(pedestrian_t &ped) {
 	}
 	choose_dest_building_or_parked_car(ped);
 }
-unsigned ped_manager_t::get_next_plot(pedestrian_t &ped, int exclude_plot) const {return road_gen.get_next_plot(ped.city, ped.plot, ped.dest_plot, exclude_plot);}
+unsigned ped_manager_t::get_next_plot(pedestrian_t &ped, int exclude_plot, rand_gen_t *rgen) const {
+	return road_gen.get_next_plot(ped.city, ped.plot, ped.dest_plot, exclude_plot, rgen);
+}
 
 
 void city_lights_manager_t::add_player_flashlight(float radius_scale) {
@@ -4,14 +4,29 @@
 
 #include "3DWorld.h"
 #include "cobj_bsp_tree.h"
+#include "binary_file_io.h"
+#include <unordered_map>
+#include <unordered_set>
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define USE_SSE_BVH
+#endif
 
-unsigned const MAX_LEAF_SIZE = 2;
-float const POLY_TOLER       = 1.0E-6;
-float const OVERLAP_AMT      = 0.02;
 
+unsigned const MAX_LEAF_SIZE  = 2;
+unsigned const WIDE_LEAF_FLAG = (1U << 31); // marks leaf kid entries in the wide node traversal stack
+float const POLY_TOLER        = 1.0E-6;
+float const OVERLAP_AMT       = 0.02;
+bool const VERIFY_WIDE_BVH    = 0; // compare wide BVH line queries against the reference traversal (slow)
+unsigned const BVH_CACHE_VERSION = 2; // increment when the node layout or build algorithm changes
+float const MAX_REFIT_AREA_RATIO = 1.5; // rebuild rather than refit once the total node area has grown by this much since the last build
+float const MAX_REFIT_COBJ_GROWTH = 1.5; // rebuild rather than splice in CSG fragments once the number of cobjs has grown by this much since the last build
+unsigned const MAX_REFIT_LEAF_SIZE = 8*MAX_LEAF_SIZE; // rebuild rather than splice in CSG fragments if a leaf would grow larger than this
 
-extern bool mt_cobj_tree_build, begin_motion;
+
+extern bool mt_cobj_tree_build, use_wide_cobj_bvh, use_cobj_bvh_refit, begin_motion;
+extern string scene_cache_dir;
 extern int display_mode, frame_counter, cobj_counter;
 extern coll_obj_group coll_objects;
 extern vector<unsigned> falling_cobjs;
@@ -362,6 +377,101 @@ void cobj_tree_sphere_t::get_ids_int_sphere(point const &center, float radius, v
 }
 
 
+// *** cobj_bvh_tree::wide_node_t ***
+
+
+// returns a bit mask of the kids whose bcubes are intersected by the line p1 + t*(p2 - p1) for t in [0, tmax]; fills in the entry t value for each kid
+unsigned cobj_bvh_tree::wide_node_t::get_line_hit_mask(point const &p1, vector3d const &dinv, float tmax, float tnear[4]) const {
+
+	assert(nkids <= 4);
+#ifdef USE_SSE_BVH
+	// Note: dinv is always finite because vector3d::invert() replaces zero components with TOLERANCE, so the t values can't be NaN
+	__m128 tmin_v(_mm_setzero_ps()), tmax_v(_mm_set1_ps(tmax));
+
+	for (unsigned d = 0; d < 3; ++d) {
+		__m128 const p(_mm_set1_ps(p1[d])), di(_mm_set1_ps(dinv[d]));
+		__m128 const t1(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(bmin[d]), p), di)), t2(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(bmax[d]), p), di));
+		tmin_v = _mm_max_ps(_mm_min_ps(t1, t2), tmin_v);
+		tmax_v = _mm_min_ps(_mm_max_ps(t1, t2), tmax_v);
+	}
+	_mm_storeu_ps(tnear, tmin_v);
+	return (_mm_movemask_ps(_mm_cmple_ps(tmin_v, tmax_v)) & ((1U << nkids) - 1));
+#else
+	unsigned mask(0);
+
+	for (unsigned n = 0; n < nkids; ++n) {
+		float t0(0.0), t1(tmax);
+
+		for (unsigned d = 0; d < 3; ++d) {
+			float const ta((bmin[d][n] - p1[d])*dinv[d]), tb((bmax[d][n] - p1[d])*dinv[d]);
+			float const ta2(min(ta, tb)), tb2(max(ta, tb));
+			if (ta2 > t0) {t0 = ta2;}
+			if (tb2 < t1) {t1 = tb2;}
+		}
+		tnear[n] = t0;
+		if (t0 <= t1) {mask |= (1 << n);}
+	}
+	return mask;
+#endif
+}
+
+// returns a bit mask of the kids whose bcubes intersect c; matches the behavior of c.intersects(kid_bcube, toler)
+unsigned cobj_bvh_tree::wide_node_t::get_cube_int_mask(cube_t const &c, float toler) const {
+
+	assert(nkids <= 4);
+#ifdef USE_SSE_BVH
+	__m128 res(_mm_setzero_ps());
+
+	for (unsigned d = 0; d < 3; ++d) {
+		__m128 const lo(_mm_set1_ps(c.d[d][0] + toler)), hi(_mm_set1_ps(c.d[d][1] - toler));
+		__m128 const m(_mm_and_ps(_mm_cmpge_ps(_mm_loadu_ps(bmax[d]), lo), _mm_cmple_ps(_mm_loadu_ps(bmin[d]), hi)));
+		res = ((d == 0) ? m : _mm_and_ps(res, m));
+	}
+	return (_mm_movemask_ps(res) & ((1U << nkids) - 1));
+#else
+	unsigned mask(0);
+
+	for (unsigned n = 0; n < nkids; ++n) {
+		bool inter(1);
+		UNROLL_3X(if (bmax[i_][n] < (c.d[i_][0] + toler) || bmin[i_][n] > (c.d[i_][1] - toler)) {inter = 0;})
+		if (inter) {mask |= (1 << n);}
+	}
+	return mask;
+#endif
+}
+
+cube_t cobj_bvh_tree::wide_node_t::get_bcube() const {
+
+	assert(nkids > 0);
+	cube_t bcube(get_kid_bcube(0));
+	for (unsigned n = 1; n < nkids; ++n) {bcube.union_with_cube(get_kid_bcube(n));}
+	return bcube;
+}
+
+bool cobj_bvh_tree::wide_cube_query_t::next_leaf(unsigned &start, unsigned &end) {
+
+	while (ssz > 0) {
+		unsigned const e(stack[--ssz]);
+
+		if (e & WIDE_LEAF_FLAG) { // leaf kid of an already tested node
+			unsigned const wix((e & ~WIDE_LEAF_FLAG) >> 2), k(e & 3);
+			start = wnodes[wix].kid[k];
+			end   = start + wnodes[wix].num[k];
+			return 1;
+		}
+		wide_node_t const &n(wnodes[e]);
+		unsigned const mask(n.get_cube_int_mask(cube, toler));
+
+		for (unsigned k = n.nkids; k > 0; --k) { // push in reverse order so that kids are visited in order
+			if (!(mask & (1 << (k-1)))) continue;
+			assert(ssz < WIDE_STACK_SZ);
+			stack[ssz++] = (n.is_leaf(k-1) ? (WIDE_LEAF_FLAG | (e << 2) | (k-1)) : n.kid[k-1]);
+		}
+	}
+	return 0;
+}
+
+
 // *** cobj_bvh_tree ***
 
 
@@ -396,6 +506,7 @@ void cobj_bvh_tree::clear() {
 
 	cobj_tree_base::clear();
 	cixs.resize(0);
+	wnodes.resize(0);
 }
 
 
@@ -409,8 +520,8 @@ void cobj_bvh_tree::add_cobjs(bool verbose) {
 
 	if (verbose) {
 		PRINT_TIME(" Cobj Tree Create");
-		cout << "cobjs: " << cobjs->size() << ", leaves: " << cixs.size() << ", nodes: " << nodes.size()
-				<< ", depth: " << max_depth << ", max_leaves: " << max_leaf_count << ", leaf_nodes: " << num_leaf_nodes << endl;
+		cout << "cobjs: " << cobjs->size() << ", leaves: " << cixs.size() << ", nodes: " << nodes.size() << ", wide nodes: " << wnodes.size()
+				<< ", depth: " << max_depth << ", wide depth: " << wide_max_depth << ", max_leaves: " << max_leaf_count << ", leaf_nodes: " << num_leaf_nodes << endl;
 	}
 }
 
@@ -432,12 +543,379 @@ void cobj_bvh_tree::build_tree_from_cixs(bool do_mt_build) {
 		nodes.resize(ptd.get_next_node_ix());
 	}
 	nodes[root].next_node_id = (unsigned)nodes.size();
+	build_wide_nodes();
+	build_area = get_nodes_area();
+	build_num_cobjs = cixs.size();
+	num_refits = 0;
+}
+
+
+// refits the tree in place if it contains the same cobjs as cids, in any order; returns false if the tree must be rebuilt instead
+bool cobj_bvh_tree::refit_if_same_cobjs(vector<unsigned> const &cids) {
+
+	if (!use_cobj_bvh_refit || nodes.empty() || !has_same_cobjs(cids)) return 0;
+	return refit_tree();
+}
+
+// replaces each removed cobj in cixs with the added cobjs that were split from it, then refits the tree; the added cobjs are contained in
+// the bcube of the removed cobj, so this keeps the tree structure valid; returns false if the tree must be rebuilt instead
+bool cobj_bvh_tree::apply_cobj_changes(vector<unsigned> const &removed, vector<pair<unsigned, unsigned> > const &added) {
+
+	if (!use_cobj_bvh_refit || nodes.empty()) return 0;
+	if (removed.empty() && added.empty()) return 1; // nothing to do
+	std::unordered_map<unsigned, vector<unsigned> > repl; // removed cobj => added cobjs that take its place
+	std::unordered_set<unsigned> added_ids;
+	unsigned num_added(0), num_placed(0);
+	for (auto i = removed.begin(); i != removed.end(); ++i) {repl[*i];} // may end up with no replacements
+
+	for (auto i = added.begin(); i != added.end(); ++i) {
+		if (!obj_ok((*cobjs)[i->first])) continue; // not part of this tree
+		auto it(repl.find(i->second));
+		if (it == repl.end() || repl.find(i->first) != repl.end()) return 0; // parent wasn't removed, or a removed cobj was re-added
+		it->second.push_back(i->first);
+		added_ids.insert(i->first);
+		++num_added;
+	}
+	vector<unsigned> new_cixs, new_pos(cixs.size()+1); // new_pos maps old cixs index => new cixs index
+	new_cixs.reserve(cixs.size() + num_added);
+
+	for (unsigned i = 0; i < cixs.size(); ++i) {
+		new_pos[i] = new_cixs.size();
+		if (added_ids.find(cixs[i]) != added_ids.end()) return 0; // reused index of a cobj that's still in the tree; would be duplicated
+		auto it(repl.find(cixs[i]));
+		if (it == repl.end()) {new_cixs.push_back(cixs[i]); continue;} // unchanged
+		new_cixs.insert(new_cixs.end(), it->second.begin(), it->second.end());
+		num_placed += it->second.size();
+	}
+	new_pos[cixs.size()] = new_cixs.size();
+	if (num_placed != num_added) return 0; // some parents aren't in this tree
+	if (new_cixs.size() > MAX_REFIT_COBJ_GROWTH*build_num_cobjs) return 0; // too many fragments since the last build; the tree has degraded too much
+	unsigned const max_leaf_size(max(MAX_REFIT_LEAF_SIZE, max_leaf_count)); // allow leaves as large as the build created
+
+	// leaves that become empty would be treated as interior/unused nodes, and leaves with too many fragments are slow to query,
+	// so check for them before making any changes
+	for (auto n = nodes.begin(); n != nodes.end(); ++n) {
+		if (n->start >= n->end) continue; // not a leaf
+		unsigned const num(new_pos[n->end] - new_pos[n->start]);
+		if (num == 0 || num > max_leaf_size) return 0;
+	}
+	for (auto w = wnodes.begin(); w != wnodes.end(); ++w) {
+		for (unsigned k = 0; k < w->nkids; ++k) {
+			if (!w->is_leaf(k)) continue;
+			unsigned const num(new_pos[w->kid[k] + w->num[k]] - new_pos[w->kid[k]]);
+			if (num == 0 || num > 65535) return 0; // must fit in an unsigned short
+		}
+	}
+	for (auto n = nodes.begin(); n != nodes.end(); ++n) {
+		if (n->start < n->end) {n->start = new_pos[n->start]; n->end = new_pos[n->end];}
+	}
+	for (auto w = wnodes.begin(); w != wnodes.end(); ++w) {
+		for (unsigned k = 0; k < w->nkids; ++k) {
+			if (!w->is_leaf(k)) continue;
+			unsigned const start(new_pos[w->kid[k]]);
+			w->num[k] = (unsigned short)(new_pos[w->kid[k] + w->num[k]] - start);
+			w->kid[k] = start;
+		}
+	}
+	cixs.swap(new_cixs);
+	return refit_tree();
+}
+
+// for trees where the set of cobjs rarely changes but the cobjs move every frame, such as the dynamic cobjs tree
+void cobj_bvh_tree::update_cobjs(bool verbose) {
+
+	if (use_cobj_bvh_refit && !nodes.empty()) {
+		vector<unsigned> cids;
+		cids.swap(cixs); // save the current cixs, which are in tree order
+		create_cixs();
+		cids.swap(cixs);
+		if (refit_if_same_cobjs(cids)) return;
+	}
+	add_cobjs(verbose); // full rebuild
+}
+
+
+// interior nodes have no leaves; the unused nodes at the end of each range in the MT build have start == end but no valid kids
+bool cobj_bvh_tree::is_interior_node(unsigned nix) const {
+
+	tree_node const &n(nodes[nix]);
+	return (n.start == n.end && nix+1 < n.next_node_id && nodes[nix+1].next_node_id > nix+1);
+}
+
+void cobj_bvh_tree::get_node_kids(unsigned nix, vector<unsigned> &kids) const {
+
+	assert(is_interior_node(nix));
+
+	for (unsigned kid = nix+1; kid < nodes[nix].next_node_id; kid = nodes[kid].next_node_id) {
+		assert(nodes[kid].next_node_id > kid);
+		if (nodes[kid].start < nodes[kid].end || is_interior_node(kid)) {kids.push_back(kid);} // skip empty nodes
+	}
+}
+
+// converts a list of sibling nodes into a wide node, collapsing interior nodes with the largest surface area until there are 4 kids
+unsigned cobj_bvh_tree::build_wide_node(vector<unsigned> &kids, unsigned depth, bool &valid) {
+
+	assert(!kids.empty());
+	vector<unsigned> sub_kids;
+
+	while (kids.size() < 4) {
+		int best(-1);
+		float best_area(-1.0);
+
+		for (unsigned i = 0; i < kids.size(); ++i) {
+			if (!is_interior_node(kids[i])) continue;
+			sub_kids.clear();
+			get_node_kids(kids[i], sub_kids);
+			if (kids.size() + sub_kids.size() - 1 > 4) continue; // too many kids
+			float const area(nodes[kids[i]].get_area());
+			if (area > best_area) {best = i; best_area = area;}
+		}
+		if (best < 0) break; // no more interior nodes can be collapsed
+		sub_kids.clear();
+		get_node_kids(kids[best], sub_kids);
+		kids.erase(kids.begin() + best);
+		kids.insert((kids.begin() + best), sub_kids.begin(), sub_kids.end()); // insert in place to preserve traversal order
+	}
+	unsigned const wix(wnodes.size()), nkids(min(4U, (unsigned)kids.size()));
+	wnodes.push_back(wide_node_t());
+	wide_max_depth = max(wide_max_depth, depth);
+
+	// if there are more than 4 kids (8 top level kids in the MT build), split them into up to 4 groups that each become a new wide node
+	for (unsigned n = 0; n < nkids; ++n) {
+		unsigned const gstart(n*kids.size()/nkids), gend((n+1)*kids.size()/nkids);
+		tree_node const &first(nodes[kids[gstart]]);
+		cube_t bcube(first);
+		for (unsigned i = gstart+1; i < gend; ++i) {bcube.union_with_cube(nodes[kids[i]]);}
+		unsigned kid(0), num(0);
+
+		if (gend - gstart > 1) { // group of kids
+			sub_kids.assign(kids.begin()+gstart, kids.begin()+gend);
+			kid = build_wide_node(sub_kids, depth+1, valid);
+		}
+		else if (first.start < first.end) { // leaf
+			kid = first.start;
+			num = first.end - first.start;
+			if (num > 65535) {valid = 0;} // too many cobjs in this leaf to store in 16 bits
+		}
+		else { // interior
+			sub_kids.clear();
+			get_node_kids(kids[gstart], sub_kids);
+			kid = build_wide_node(sub_kids, depth+1, valid); // Note: invalidates references into wnodes
+		}
+		wide_node_t &wn(wnodes[wix]);
+		wn.set_kid_bcube(n, bcube);
+		wn.kid[n] = kid;
+		wn.num[n] = num;
+		wn.nkids  = n+1;
+	}
+	return wix;
+}
+
+// returns false if the tree can't be represented with wide nodes, in which case queries use the reference traversal
+bool cobj_bvh_tree::build_wide_nodes() {
+
+	wnodes.clear();
+	wide_max_depth = 0;
+	if (nodes.empty() || !use_wide_cobj_bvh) return 0;
+	vector<unsigned> kids;
+	if (is_interior_node(0)) {get_node_kids(0, kids);} else {kids.push_back(0);} // root is either interior or a single leaf
+	if (kids.empty()) return 0;
+	bool valid(1);
+	wnodes.reserve(nodes.size()/2);
+	build_wide_node(kids, 0, valid);
+
+	if (!valid || 4*wide_max_depth+4 > WIDE_STACK_SZ || wnodes.size() >= (1U << 29)) { // leaf too large, tree too deep for the traversal stack, or too many nodes
+		cout << "Warning: Can't build wide cobj_bvh_tree nodes; falling back to reference traversal" << endl;
+		vector<wide_node_t>().swap(wnodes);
+		return 0;
+	}
+	wnodes.shrink_to_fit();
+	return 1;
+}
+
+
+// Note: the tree must be rebuilt if the cobjs have changed since it was written
+bool cobj_bvh_tree::write_to_file(binary_file_writer &writer) const {
+	return (writer.write_val(max_depth) && writer.write_val(max_leaf_count) && writer.write_val(num_leaf_nodes) && writer.write_val(wide_max_depth) &&
+		writer.write_vector(nodes) && writer.write_vector(cixs) && writer.write_vector(wnodes));
+}
+
+template<typename R> bool cobj_bvh_tree::read_from_file(R &reader) {
+
+	clear();
+	size_t const max_sz(cobjs->size() + 64); // upper bound on cixs; nodes can be up to 3/2 larger
+
+	if (!reader.read_val(max_depth) || !reader.read_val(max_leaf_count) || !reader.read_val(num_leaf_nodes) || !reader.read_val(wide_max_depth) ||
+		!reader.read_vector(nodes, 2*max_sz) || !reader.read_vector(cixs, max_sz) || !reader.read_vector(wnodes, 2*max_sz))
+	{
+		clear();
+		return 0;
+	}
+	if (!loaded_tree_valid()) {clear(); return 0;}
+	build_area = get_nodes_area();
+	build_num_cobjs = cixs.size();
+	num_refits = 0;
+	return 1;
+}
+
+
+// checks that all indices read from a file are in range, so that a truncated or corrupt file can't cause out-of-bounds accesses during traversal
+bool cobj_bvh_tree::loaded_tree_valid() const {
+
+	if (nodes.empty() || nodes[0].next_node_id != nodes.size() || (!wnodes.empty() && !use_wide_cobj_bvh)) return 0;
+
+	for (auto i = cixs.begin(); i != cixs.end(); ++i) {
+		if (*i >= cobjs->size()) return 0; // invalid cobj index
+	}
+	for (unsigned nix = 0; nix < nodes.size(); ++nix) { // next_node_id must increase, or traversal may loop forever
+		tree_node const &n(nodes[nix]);
+		if (n.start > n.end || n.end > cixs.size() || n.next_node_id <= nix || n.next_node_id > nodes.size()) return 0;
+	}
+	if (wnodes.empty()) return 1;
+	if (wnodes.size() >= (1U << 29)) return 0; // too many nodes for the traversal stack encoding
+	vector<unsigned> depth(wnodes.size(), 0);
+
+	for (unsigned wix = 0; wix < wnodes.size(); ++wix) {
+		wide_node_t const &n(wnodes[wix]);
+		if (n.nkids == 0 || n.nkids > 4) return 0;
+
+		for (unsigned k = 0; k < n.nkids; ++k) {
+			if (n.is_leaf(k)) {
+				if (size_t(n.kid[k]) + n.num[k] > cixs.size()) return 0;
+			}
+			else {
+				if (n.kid[k] <= wix || n.kid[k] >= wnodes.size()) return 0; // kids are always after their parent, which also rules out cycles
+				depth[n.kid[k]] = max(depth[n.kid[k]], depth[wix]+1);
+			}
+		} // for k
+	} // for wix
+	unsigned const max_wide_depth(*max_element(depth.begin(), depth.end()));
+	return (max_wide_depth <= wide_max_depth && 4*wide_max_depth+4 <= WIDE_STACK_SZ); // traversal stack must be large enough
+}
+
+float cobj_bvh_tree::get_nodes_area() const {
+
+	float area(0.0);
+
+	for (unsigned nix = 0; nix < nodes.size(); ++nix) {
+		if (nodes[nix].start < nodes[nix].end || is_interior_node(nix)) {area += nodes[nix].get_area();} // skip unused nodes
+	}
+	return area;
+}
+
+bool cobj_bvh_tree::has_same_cobjs(vector<unsigned> cids) const {
+
+	if (cids.size() != cixs.size()) return 0;
+	vector<unsigned> cur_cids(cixs);
+	sort(cids.begin(), cids.end());
+	sort(cur_cids.begin(), cur_cids.end());
+	return (cids == cur_cids);
+}
+
+// recomputes node bcubes bottom up after the contained cobjs have moved, without changing the tree structure;
+// returns false if the tree quality has degraded enough that it should be rebuilt
+bool cobj_bvh_tree::refit_tree() {
+
+	if (nodes.empty()) return 0;
+
+	// kids always have higher indices than their parents, so iterate in reverse
+	for (unsigned nix = nodes.size(); nix-- > 0;) {
+		tree_node &n(nodes[nix]);
+
+		if (n.start < n.end) { // leaf
+			calc_node_bbox(n);
+		}
+		else if (is_interior_node(nix)) {
+			bool first(1);
+
+			for (unsigned kid = nix+1; kid < n.next_node_id; kid = nodes[kid].next_node_id) {
+				tree_node const &k(nodes[kid]);
+				if (!(k.start < k.end || is_interior_node(kid))) continue; // skip unused nodes
+				if (first) {n.copy_from(k); first = 0;} else {n.union_with_cube(k);}
+			}
+			assert(!first);
+		}
+	}
+	for (unsigned wix = wnodes.size(); wix-- > 0;) { // same for wide nodes
+		wide_node_t &wn(wnodes[wix]);
+
+		for (unsigned k = 0; k < wn.nkids; ++k) {
+			if (wn.is_leaf(k)) {
+				tree_node leaf(wn.kid[k], wn.kid[k]+wn.num[k]);
+				calc_node_bbox(leaf);
+				wn.set_kid_bcube(k, leaf);
+			}
+			else {
+				assert(wn.kid[k] > wix);
+				wn.set_kid_bcube(k, wnodes[wn.kid[k]].get_bcube());
+			}
+		}
+	}
+	++num_refits;
+	return (get_nodes_area() <= MAX_REFIT_AREA_RATIO*build_area);
+}
+
+
+bool cobj_bvh_tree::skip_line_cobj(unsigned i, point const &p1, int ignore_cobj, int test_alpha, float max_alpha,
+	bool skip_non_drawn, bool skip_init_colls, bool skip_movable) const
+{
+	if ((int)cixs[i] == ignore_cobj) return 1;
+	coll_obj const &c(get_cobj(i));
+	if (!obj_ok(c))                  return 1;
+	if (skip_non_drawn  && !c.cp.might_be_drawn())                    return 1;
+	if (skip_movable    && c.is_movable())                            return 1;
+	if (test_alpha == 1 && c.is_semi_trans())                         return 1; // semi-transparent, can see through
+	if (test_alpha == 2 && c.cp.color.alpha <= max_alpha)             return 1; // lower alpha than an earlier object
+	if (test_alpha == 3 && c.cp.color.alpha < MIN_SHADOW_ALPHA)       return 1; // less than min alpha
+	if (skip_init_colls && c.contains_pt(p1) && c.contains_point(p1)) return 1;
+	return 0;
 }
 
 
 // test_alpha: 0 = allow any alpha value, 1 = require alpha = 1.0, 2 = get intersected cobj with max alpha, 3 = require alpha >= MIN_SHADOW_ALPHA
 bool cobj_bvh_tree::check_coll_line(point const &p1, point const &p2, point &cpos, vector3d &cnorm, int &cindex,
 	int ignore_cobj, bool exact, int test_alpha, bool skip_non_drawn, bool skip_init_colls, bool skip_movable) const
+{
+	if (wnodes.empty()) {return check_coll_line_ref(p1, p2, cpos, cnorm, cindex, ignore_cobj, exact, test_alpha, skip_non_drawn, skip_init_colls, skip_movable);}
+	bool const ret(check_coll_line_wide(p1, p2, cpos, cnorm, cindex, ignore_cobj, exact, test_alpha, skip_non_drawn, skip_init_colls, skip_movable));
+
+	if (VERIFY_WIDE_BVH) {
+		point cpos2(cpos);
+		vector3d cnorm2;
+		int cindex2(cindex);
+		bool const ret2(check_coll_line_ref(p1, p2, cpos2, cnorm2, cindex2, ignore_cobj, exact, test_alpha, skip_non_drawn, skip_init_colls, skip_movable));
+
+		// whether there's a hit doesn't depend on traversal order in any mode; the closest hit is only unique in exact mode without max alpha,
+		// while in any-hit (shadow) and max alpha modes the two traversals can return different cobjs, but each must be a valid hit
+		bool valid(ret == ret2);
+		if (valid && ret && exact && test_alpha != 2) {valid = (cpos == cpos2);}
+		if (valid && ret) {valid = is_valid_line_hit(cindex, p1, p2, ignore_cobj, test_alpha, skip_non_drawn, skip_init_colls, skip_movable);}
+
+		if (!valid) {
+			cout << "Error: Wide cobj_bvh_tree line query mismatch: " << TXT(ret) << TXT(ret2) << TXT(cindex) << TXT(cindex2) << TXT(exact) << TXT(test_alpha)
+				 << " p1=" << p1.str() << " p2=" << p2.str() << endl;
+			assert(0);
+		}
+	}
+	return ret;
+}
+
+// used for verification: returns true if cobj cindex is in this tree, passes the query's filters, and intersects the line
+bool cobj_bvh_tree::is_valid_line_hit(int cindex, point const &p1, point const &p2, int ignore_cobj, int test_alpha,
+	bool skip_non_drawn, bool skip_init_colls, bool skip_movable) const
+{
+	auto const it(find(cixs.begin(), cixs.end(), (unsigned)cindex));
+	if (it == cixs.end()) return 0;
+	if (skip_line_cobj(unsigned(it - cixs.begin()), p1, ignore_cobj, (test_alpha == 2 ? 0 : test_alpha), 0.0, skip_non_drawn, skip_init_colls, skip_movable)) return 0;
+	float t(0.0);
+	vector3d cnorm;
+	return (*cobjs)[cindex].line_int_exact(p1, p2, t, cnorm, 0.0, 1.0);
+}
+
+
+// reference traversal of the binary nodes, used when wide nodes are disabled or for verification
+bool cobj_bvh_tree::check_coll_line_ref(point const &p1, point const &p2, point &cpos, vector3d &cnorm, int &cindex,
+	int ignore_cobj, bool exact, int test_alpha, bool skip_non_drawn, bool skip_init_colls, bool skip_movable) const
 {
 	if (nodes.empty()) return 0;
 	bool ret(0);
@@ -452,16 +930,9 @@ bool cobj_bvh_tree::check_coll_line(point const &p1, point const &p2, point &cpo
 		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
 			// Note: we test cobj against the original (unclipped) p1 and p2 so that t is correct
 			// Note: we probably don't need to return cnorm and cpos in inexact mode, but it shouldn't be too expensive to do so
-			if ((int)cixs[i] == ignore_cobj) continue;
+			if (skip_line_cobj(i, p1, ignore_cobj, test_alpha, max_alpha, skip_non_drawn, skip_init_colls, skip_movable)) continue;
 			coll_obj const &c(get_cobj(i));
-			if (!obj_ok(c))                  continue;
-			if (skip_non_drawn  && !c.cp.might_be_drawn())                    continue;
-			if (skip_movable    && c.is_movable())                            continue;
-			if (test_alpha == 1 && c.is_semi_trans())                         continue; // semi-transparent, can see through
-			if (test_alpha == 2 && c.cp.color.alpha <= max_alpha)             continue; // lower alpha than an earlier object
-			if (test_alpha == 3 && c.cp.color.alpha < MIN_SHADOW_ALPHA)       continue; // less than min alpha
-			if (skip_init_colls && c.contains_pt(p1) && c.contains_point(p1)) continue;
-			if (!c.line_int_exact(p1, p2, t, cnorm, tmin, tmax))              continue;
+			if (!c.line_int_exact(p1, p2, t, cnorm, tmin, tmax)) continue;
 			cindex = cixs[i];
 			cpos   = p1 + (p2 - p1)*t;
 			//if (c.type == COLL_POLYGON && dot_product((p2 - p1), c.norm) < 0.0) {} // back-facing polygon test
@@ -477,8 +948,191 @@ bool cobj_bvh_tree::check_coll_line(point const &p1, point const &p2, point &cpo
 }
 
 
+// same as check_coll_line_ref(), but tests 4 kid bcubes at once and visits kids front to back so that tmax shrinks faster
+bool cobj_bvh_tree::check_coll_line_wide(point const &p1, point const &p2, point &cpos, vector3d &cnorm, int &cindex,
+	int ignore_cobj, bool exact, int test_alpha, bool skip_non_drawn, bool skip_init_colls, bool skip_movable) const
+{
+	assert(!wnodes.empty());
+	bool ret(0);
+	float t(0.0), tmax(1.0), max_alpha(0.0);
+	vector3d dinv(p2 - p1);
+	dinv.invert();
+	unsigned stack[WIDE_STACK_SZ], ssz(1);
+	stack[0] = 0; // root
+
+	while (ssz > 0) {
+		wide_node_t const &n(wnodes[stack[--ssz]]);
+		float tnear[4];
+		unsigned const mask(n.get_line_hit_mask(p1, dinv, tmax, tnear));
+		if (mask == 0) continue;
+		unsigned order[4], num_hit(0);
+
+		for (unsigned k = 0; k < n.nkids; ++k) { // insertion sort of hit kids by entry t
+			if (!(mask & (1 << k))) continue;
+			unsigned pos(num_hit++);
+			for (; pos > 0 && tnear[order[pos-1]] > tnear[k]; --pos) {order[pos] = order[pos-1];}
+			order[pos] = k;
+		}
+		for (unsigned o = 0; o < num_hit; ++o) { // check leaves front to back
+			unsigned const k(order[o]);
+			if (!n.is_leaf(k) || tnear[k] > tmax) continue; // Note: tmax may have decreased
+
+			for (unsigned i = n.kid[k], end = n.kid[k] + n.num[k]; i < end; ++i) {
+				if (skip_line_cobj(i, p1, ignore_cobj, test_alpha, max_alpha, skip_non_drawn, skip_init_colls, skip_movable)) continue;
+				coll_obj const &c(get_cobj(i));
+				if (!c.line_int_exact(p1, p2, t, cnorm, 0.0, tmax)) continue;
+				cindex = cixs[i];
+				cpos   = p1 + (p2 - p1)*t;
+				if (!exact && test_alpha != 2) return 1; // return first hit
+				max_alpha = c.cp.color.alpha; // we need all intersections to find the max alpha
+				tmax = t;
+				ret  = 1;
+			}
+		}
+		for (unsigned o = num_hit; o > 0; --o) { // push interior kids back to front so that the closest one is visited next
+			unsigned const k(order[o-1]);
+			if (n.is_leaf(k) || tnear[k] > tmax) continue;
+			assert(ssz < WIDE_STACK_SZ);
+			stack[ssz++] = n.kid[k];
+		}
+	}
+	return ret;
+}
+
+
+// finds the closest hit for each line in lqp, starting from the current lqp.tmax values; all lines share a single traversal of the wide nodes,
+// where each stack entry tracks the subset of lines that may still hit that node; this is much faster than individual queries for coherent lines
+// Note: always exact; test_alpha=2 (max alpha) isn't supported because it requires visiting every hit
+void cobj_bvh_tree::check_coll_line_packet(line_query_packet_t &lqp, int test_alpha, bool skip_non_drawn, bool skip_movable) const {
+
+	assert(test_alpha != 2);
+	if (lqp.empty() || nodes.empty()) return;
+	line_query_packet_t const lqp_orig(VERIFY_WIDE_BVH ? lqp : line_query_packet_t());
+
+	if (wnodes.empty()) { // no wide nodes, fall back to one reference query per line
+		for (unsigned r = 0; r < lqp.num; ++r) {
+			point const &p1(lqp.p1[r]);
+			point const p2(lqp.get_end_pt(r));
+			point cpos;
+			vector3d cnorm;
+			int cindex(-1);
+			if (!check_coll_line_ref(p1, p2, cpos, cnorm, cindex, lqp.ignore_cobj, 1, test_alpha, skip_non_drawn, lqp.skip_init_colls[r], skip_movable)) continue;
+			lqp.register_hit(r, min(lqp.tmax[r], lqp.tmax[r]*p2p_dist(p1, cpos)/p2p_dist(p1, p2)), cnorm, cindex);
+		}
+		return;
+	}
+	float t(0.0);
+	vector3d cnorm, dinv[line_query_packet_t::MAX_LINES];
+	unsigned stack[WIDE_STACK_SZ], smask[WIDE_STACK_SZ], ssz(1); // node index and active lines mask for each stack entry
+
+	for (unsigned r = 0; r < lqp.num; ++r) {
+		dinv[r] = lqp.p2[r] - lqp.p1[r];
+		dinv[r].invert();
+	}
+	stack[0] = 0; // root
+	smask[0] = lqp.get_all_mask();
+
+	while (ssz > 0) {
+		--ssz;
+		wide_node_t const &n(wnodes[stack[ssz]]);
+		unsigned const rmask(smask[ssz]);
+		unsigned kid_rays[4] = {0}; // mask of lines hitting each kid
+		float tnear_min[4] = {0.0}; // min entry t across lines for each kid, used for ordering
+
+		for (unsigned r = 0; r < lqp.num; ++r) {
+			if (!(rmask & (1 << r))) continue;
+			float tnear[4];
+			unsigned const mask(n.get_line_hit_mask(lqp.p1[r], dinv[r], lqp.tmax[r], tnear));
+
+			for (unsigned k = 0; k < n.nkids; ++k) {
+				if (!(mask & (1 << k))) continue;
+				tnear_min[k] = (kid_rays[k] ? min(tnear_min[k], tnear[k]) : tnear[k]);
+				kid_rays[k] |= (1 << r);
+			}
+		}
+		unsigned order[4], num_hit(0);
+
+		for (unsigned k = 0; k < n.nkids; ++k) { // insertion sort of hit kids by min entry t
+			if (!kid_rays[k]) continue;
+			unsigned pos(num_hit++);
+			for (; pos > 0 && tnear_min[order[pos-1]] > tnear_min[k]; --pos) {order[pos] = order[pos-1];}
+			order[pos] = k;
+		}
+		for (unsigned o = 0; o < num_hit; ++o) { // check leaves front to back
+			unsigned const k(order[o]);
+			if (!n.is_leaf(k)) continue;
+
+			for (unsigned i = n.kid[k], end = n.kid[k] + n.num[k]; i < end; ++i) {
+				if (skip_line_cobj(i, all_zeros, lqp.ignore_cobj, test_alpha, 0.0, skip_non_drawn, 0, skip_movable)) continue; // line independent tests
+				coll_obj const &c(get_cobj(i));
+
+				for (unsigned r = 0; r < lqp.num; ++r) {
+					if (!(kid_rays[k] & (1 << r))) continue;
+					point const &p1(lqp.p1[r]);
+					if (lqp.skip_init_colls[r] && c.contains_pt(p1) && c.contains_point(p1)) continue;
+					if (c.line_int_exact(p1, lqp.p2[r], t, cnorm, 0.0, lqp.tmax[r])) {lqp.register_hit(r, t, cnorm, cixs[i]);}
+				}
+			}
+		}
+		for (unsigned o = num_hit; o > 0; --o) { // push interior kids back to front so that the closest one is visited next
+			unsigned const k(order[o-1]);
+			if (n.is_leaf(k)) continue;
+			assert(ssz < WIDE_STACK_SZ);
+			stack[ssz] = n.kid[k];
+			smask[ssz] = kid_rays[k];
+			++ssz;
+		}
+	}
+	if (VERIFY_WIDE_BVH) { // compare each line against an exact reference query from the original end point
+		for (unsigned r = 0; r < lqp.num; ++r) {
+			point const &p1(lqp.p1[r]);
+			point const p2(lqp_orig.get_end_pt(r));
+			point cpos;
+			vector3d cnorm2;
+			int cindex(-1);
+			bool ret(lqp.tmax[r] != lqp_orig.tmax[r] || lqp.cindex[r] != lqp_orig.cindex[r]); // a new hit was registered
+			bool ret2(check_coll_line_ref(p1, p2, cpos, cnorm2, cindex, lqp.ignore_cobj, 1, test_alpha, skip_non_drawn, lqp.skip_init_colls[r], skip_movable));
+			float const toler(1.0E-5*p2p_dist(p1, lqp.p2[r])); // the packet computes hit t relative to p2 rather than the end point
+			// ignore hits at the end point, which may be the previous hit found again by either query
+			if (ret  && p2p_dist(lqp.cpos[r], p2) <= toler) {ret  = 0;}
+			if (ret2 && p2p_dist(cpos,        p2) <= toler) {ret2 = 0;}
+
+			if (ret != ret2 || (ret && p2p_dist(lqp.cpos[r], cpos) > toler)) {
+				cout << "Error: Wide cobj_bvh_tree line packet query mismatch: " << TXT(r) << TXT(ret) << TXT(ret2) << TXT(lqp.cindex[r]) << TXT(cindex)
+					 << " p1=" << p1.str() << " p2=" << p2.str() << endl;
+				assert(0);
+			}
+		}
+	}
+}
+
 bool cobj_bvh_tree::check_point_contained(point const &p, int &cindex) const {
 
+	if (wnodes.empty()) {return check_point_contained_ref(p, cindex);}
+	bool ret(0);
+	cube_t const pt_cube(p);
+	wide_cube_query_t wcq(wnodes, pt_cube, 0.0);
+
+	for (unsigned start(0), end(0); !ret && wcq.next_leaf(start, end);) {
+		for (unsigned i = start; i < end; ++i) {
+			coll_obj const &c(get_cobj(i));
+			if (c.contains_point(p) && obj_ok(c)) {cindex = cixs[i]; ret = 1; break;}
+		}
+	}
+	if (VERIFY_WIDE_BVH) { // the containing cobj may differ if cobjs overlap
+		int cindex2(-1);
+		bool const ret2(check_point_contained_ref(p, cindex2));
+
+		if (ret != ret2) {
+			cout << "Error: Wide cobj_bvh_tree point query mismatch: " << TXT(ret) << TXT(ret2) << TXT(cindex2) << " p=" << p.str() << endl;
+			assert(0);
+		}
+	}
+	return ret;
+}
+
+bool cobj_bvh_tree::check_point_contained_ref(point const &p, int &cindex) const {
+
 	unsigned const num_nodes((unsigned)nodes.size());
 
 	for (unsigned nix = 0; nix < num_nodes;) {
@@ -499,8 +1153,48 @@ bool cobj_bvh_tree::check_point_contained(point const &p, int &cindex) const {
 }
 
 
+void cobj_bvh_tree::add_intersecting_leaf_cobjs(unsigned start, unsigned end, cube_t const &cube, vector<unsigned> &cobjs,
+	int ignore_cobj, float toler, bool check_ccounter, int id_for_cobj_int) const
+{
+	for (unsigned i = start; i < end; ++i) { // check leaves
+		if ((int)cixs[i] == ignore_cobj) continue;
+		coll_obj const &c(get_cobj(i));
+		if (check_ccounter && c.counter == cobj_counter) continue;
+		if (!cube.intersects(c, toler) || !obj_ok(c))    continue;
+		if (id_for_cobj_int >= 0 && coll_objects[id_for_cobj_int].intersects_cobj(c, toler) != 1) continue;
+		cobjs.push_back(cixs[i]);
+	}
+}
+
+
 void cobj_bvh_tree::get_intersecting_cobjs(cube_t const &cube, vector<unsigned> &cobjs,
 	int ignore_cobj, float toler, bool check_ccounter, int id_for_cobj_int) const
+{
+	if (wnodes.empty()) {
+		get_intersecting_cobjs_ref(cube, cobjs, ignore_cobj, toler, check_ccounter, id_for_cobj_int);
+		return;
+	}
+	size_t const start_sz(cobjs.size());
+	wide_cube_query_t wcq(wnodes, cube, toler);
+
+	for (unsigned start(0), end(0); wcq.next_leaf(start, end);) {
+		add_intersecting_leaf_cobjs(start, end, cube, cobjs, ignore_cobj, toler, check_ccounter, id_for_cobj_int);
+	}
+	if (VERIFY_WIDE_BVH) { // compare the set of cobjs added by each traversal
+		vector<unsigned> cobjs_wide(cobjs.begin()+start_sz, cobjs.end()), cobjs_ref;
+		get_intersecting_cobjs_ref(cube, cobjs_ref, ignore_cobj, toler, check_ccounter, id_for_cobj_int);
+		sort(cobjs_wide.begin(), cobjs_wide.end());
+		sort(cobjs_ref .begin(), cobjs_ref .end());
+
+		if (cobjs_wide != cobjs_ref) {
+			cout << "Error: Wide cobj_bvh_tree cube query mismatch: " << TXT(cobjs_wide.size()) << TXT(cobjs_ref.size()) << " cube=" << cube.str() << endl;
+			assert(0);
+		}
+	}
+}
+
+void cobj_bvh_tree::get_intersecting_cobjs_ref(cube_t const &cube, vector<unsigned> &cobjs,
+	int ignore_cobj, float toler, bool check_ccounter, int id_for_cobj_int) const
 {
 	unsigned const num_nodes((unsigned)nodes.size());
 
@@ -513,14 +1207,7 @@ void cobj_bvh_tree::get_intersecting_cobjs(cube_t const &cube, vector<unsigned>
 			nix = n.next_node_id; // failed the bbox test
 			continue;
 		}
-		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
-			if ((int)cixs[i] == ignore_cobj) continue;
-			coll_obj const &c(get_cobj(i));
-			if (check_ccounter && c.counter == cobj_counter) continue;
-			if (!cube.intersects(c, toler) || !obj_ok(c))    continue;
-			if (id_for_cobj_int >= 0 && coll_objects[id_for_cobj_int].intersects_cobj(c, toler) != 1) continue;
-			cobjs.push_back(cixs[i]);
-		}
+		add_intersecting_leaf_cobjs(n.start, n.end, cube, cobjs, ignore_cobj, toler, check_ccounter, id_for_cobj_int);
 		++nix;
 	}
 }
@@ -588,10 +1275,43 @@ void cobj_bvh_tree::get_coll_line_cobjs(point const &pos1, point const &pos2, in
 void cobj_bvh_tree::get_coll_sphere_cobjs(point const &center, float radius, int ignore_cobj, vert_coll_detector &vcd) const {
 
 	if (nodes.empty()) return;
-	unsigned const num_nodes((unsigned)nodes.size());
 	cube_t bcube(center, center);
 	bcube.expand_by(radius);
 
+	if (VERIFY_WIDE_BVH && !wnodes.empty()) { // compare the candidates from each traversal before passing them to vcd
+		vector<unsigned> cands_wide, cands_ref;
+		get_coll_sphere_cands(bcube, ignore_cobj, 1, nullptr, &cands_wide);
+		get_coll_sphere_cands(bcube, ignore_cobj, 0, nullptr, &cands_ref );
+		sort(cands_wide.begin(), cands_wide.end());
+		sort(cands_ref .begin(), cands_ref .end());
+
+		if (cands_wide != cands_ref) {
+			cout << "Error: Wide cobj_bvh_tree sphere query mismatch: " << TXT(cands_wide.size()) << TXT(cands_ref.size()) << " center=" << center.str() << TXT(radius) << endl;
+			assert(0);
+		}
+	}
+	get_coll_sphere_cands(bcube, ignore_cobj, !wnodes.empty(), &vcd, nullptr);
+}
+
+void add_sphere_cand(unsigned cix, vert_coll_detector *vcd, vector<unsigned> *cands) {
+	if (vcd) {vcd->check_cobj(cix);} else {assert(cands); cands->push_back(cix);}
+}
+
+// passes candidates to vcd if nonzero, otherwise adds them to cands
+void cobj_bvh_tree::get_coll_sphere_cands(cube_t const &bcube, int ignore_cobj, bool use_wide, vert_coll_detector *vcd, vector<unsigned> *cands) const {
+
+	if (use_wide) {
+		wide_cube_query_t wcq(wnodes, bcube, 0.0);
+
+		for (unsigned start(0), end(0); wcq.next_leaf(start, end);) {
+			for (unsigned i = start; i < end; ++i) { // check leaves
+				if ((int)cixs[i] != ignore_cobj && get_cobj(i).intersects(bcube)) {add_sphere_cand(cixs[i], vcd, cands);}
+			}
+		}
+		return;
+	}
+	unsigned const num_nodes((unsigned)nodes.size());
+
 	for (unsigned nix = 0; nix < num_nodes;) {
 		tree_node const &n(nodes[nix]);
 
@@ -603,7 +1323,7 @@ void cobj_bvh_tree::get_coll_sphere_cobjs(point const &center, float radius, int
 		++nix;
 		
 		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
-			if ((int)cixs[i] != ignore_cobj && get_cobj(i).intersects(bcube)) vcd.check_cobj(cixs[i]);
+			if ((int)cixs[i] != ignore_cobj && get_cobj(i).intersects(bcube)) {add_sphere_cand(cixs[i], vcd, cands);}
 		}
 	}
 }
@@ -643,7 +1363,7 @@ void cobj_bvh_tree::build_tree_top_level_omp() { // single octtree level
 
 	// create child nodes and call recursively
 	unsigned cur(n.start), cur_nix(1);
-	unsigned curs[8], cur_nixs[8];
+	unsigned curs[8], cur_nixs[8], next_kids[8];
 	
 	for (int bix = 0; bix < 8; ++bix) {
 		unsigned const count(top_temp_bins[bix].size());
@@ -663,14 +1383,37 @@ void cobj_bvh_tree::build_tree_top_level_omp() { // single octtree level
 		nodes[kid] = tree_node(curs[bix], curs[bix]+count);
 		per_thread_data ptd(cur_nixs[bix]+1, end_nix, 0);
 		build_tree(kid, ((count == num) ? 7 : 0), 1, ptd); // if all in one bin, make that bin a leaf
-		unsigned const next_kid(ptd.get_next_node_ix());
-		assert(next_kid <= end_nix);
-		if (next_kid < end_nix) {nodes[next_kid].next_node_id = end_nix;} // close the gap of unused nodes
+		next_kids[bix] = ptd.get_next_node_ix();
+		assert(next_kids[bix] <= end_nix);
 		nodes[kid].next_node_id = end_nix;
 	}
-	nodes.resize(cur_nix);
 	assert(cur == n.end);
 	n.start = n.end = 0; // branch node has no leaves
+	// remove the unused nodes at the end of each bin's range so that every node is reachable and next_node_id always increases;
+	// remap[i] is the new index of the first used node at or after i, which is also correct for next_node_id values pointing to unused nodes
+	vector<unsigned> remap(cur_nix+1, 0);
+	vector<uint8_t> unused(cur_nix, 0);
+
+	for (int bix = 0; bix < 8; ++bix) {
+		if (top_temp_bins[bix].empty()) continue;
+		for (unsigned i = next_kids[bix]; i < cur_nixs[bix] + get_conservative_num_nodes(top_temp_bins[bix].size()); ++i) {unused[i] = 1;}
+	}
+	unsigned num_used(0);
+
+	for (unsigned i = 0; i < cur_nix; ++i) {
+		remap[i] = num_used;
+		if (!unused[i]) {++num_used;}
+	}
+	remap[cur_nix] = num_used;
+
+	for (unsigned i = 0; i < cur_nix; ++i) { // compact in place; remap[i] <= i, so nodes are never overwritten before they're moved
+		if (unused[i]) continue;
+		unsigned const next_nix(nodes[i].next_node_id);
+		assert(next_nix <= cur_nix);
+		nodes[remap[i]] = nodes[i];
+		nodes[remap[i]].next_node_id = remap[next_nix];
+	}
+	nodes.resize(num_used);
 }
 
 
@@ -764,7 +1507,6 @@ cobj_bvh_tree &get_tree(bool dynamic) {
 
 void build_static_moving_cobj_tree() {
 
-	cobj_tree_static_moving.clear();
 	vector<unsigned> moving_cids(falling_cobjs);
 		
 	for (auto i = moving_cobjs.begin(); i != moving_cobjs.end(); ++i) {
@@ -773,22 +1515,75 @@ void build_static_moving_cobj_tree() {
 	for (platform_cont::const_iterator i = platforms.begin(); i != platforms.end(); ++i) {
 		copy(i->cobjs.begin(), i->cobjs.end(), back_inserter(moving_cids));
 	}
+	if (cobj_tree_static_moving.refit_if_same_cobjs(moving_cids)) return; // same cobjs as last frame, but they may have moved
+	cobj_tree_static_moving.clear();
+
 	if (!moving_cids.empty()) {
 		cobj_tree_static_moving.add_cobj_ids(moving_cids);
 		cobj_tree_static_moving.build_tree_from_cixs(0);
 	}
 }
 
-void build_cobj_tree(bool dynamic, bool verbose) {
+// the key is built from the scene input files and the tree build options; the cobj count is a cheap sanity check
+uint64_t get_static_cobj_tree_key() {
+
+	hash_fnv1a_t hash;
+	hash.add_val(BVH_CACHE_VERSION);
+	hash.add_val(use_wide_cobj_bvh);
+	hash.add_val(mt_cobj_tree_build);
+	hash.add_val(MAX_LEAF_SIZE);
+	hash.add_val(get_scene_files_key());
+	hash.add_val(coll_objects.size());
+	return hash.get();
+}
+
+bool read_static_cobj_tree_cache(string const &fn, uint64_t key) {
+
+	RESET_TIME;
+	mapped_file_t file;
+	if (!file.open(fn)) return 0; // no cache file, not an error
+	binary_mem_reader reader(file.data(), file.size());
+	unsigned version(0);
+	uint64_t file_key(0);
+
+	if (!reader.read_val(version) || !reader.read_val(file_key) || version != BVH_CACHE_VERSION || file_key != key || !get_tree(0).read_from_file(reader)) {
+		std::cerr << "Error reading cobj BVH cache file " << fn << "; ignoring it" << endl;
+		return 0;
+	}
+	PRINT_TIME(" Cobj Tree Read Cache");
+	return 1;
+}
+
+void write_static_cobj_tree_cache(string const &fn, uint64_t key) {
+
+	binary_file_writer writer;
+	if (!writer.open(fn)) return;
+	if (!writer.write_val(BVH_CACHE_VERSION) || !writer.write_val(key) || !get_tree(0).write_to_file(writer)) {std::cerr << "Error writing cobj BVH cache file " << fn << endl;}
+}
+
+// updates the static trees after cobjs have been destroyed or split by CSG, rather than rebuilding them, when possible
+void update_static_cobj_tree(vector<unsigned> const &removed, vector<pair<unsigned, unsigned> > const &added) {
+
+	if (!get_tree(0).apply_cobj_changes(removed, added)) {get_tree(0).add_cobjs(0);}
+	if (!cobj_tree_occlude.apply_cobj_changes(removed, added)) {cobj_tree_occlude.add_cobjs(0);}
+}
+
+void build_cobj_tree(bool dynamic, bool verbose, bool use_cache) {
 	
 	if (!dynamic) { // static
-		get_tree(0).add_cobjs(verbose);
+		uint64_t const key((use_cache && !scene_cache_dir.empty()) ? get_static_cobj_tree_key() : 0);
+		string const fn(key ? get_scene_cache_filename("cobj_bvh_", key) : string());
+
+		if (fn.empty() || !read_static_cobj_tree_cache(fn, key)) {
+			get_tree(0).add_cobjs(verbose);
+			if (!fn.empty()) {write_static_cobj_tree_cache(fn, key);}
+		}
 		cobj_tree_occlude.add_cobjs(verbose);
 		//cout << "occluders: " << cobj_tree_occlude.get_num_objs() << endl;
 		//cobj_tree_triangles.add_cobjs(coll_objects, verbose);
 	}
 	else { // dynamic
-		if (begin_motion) {get_tree(1).add_cobjs(verbose);}
+		if (begin_motion) {get_tree(1).update_cobjs(verbose);}
 		//build_static_moving_cobj_tree();
 	}
 }
@@ -805,6 +1600,24 @@ bool check_coll_line_exact_tree(point const &p1, point const &p2, point &cpos, v
 	return ret;
 }
 
+// packet version of check_coll_line_exact_tree(); hits are accumulated in lqp, so the closest hit across multiple calls is kept
+void check_coll_line_exact_tree_packet(line_query_packet_t &lqp, bool dynamic, int test_alpha, bool skip_non_drawn, bool include_voxels, bool skip_movable, bool no_stat_moving) {
+
+	get_tree(dynamic).check_coll_line_packet(lqp, test_alpha, skip_non_drawn, skip_movable);
+	if (!dynamic && !no_stat_moving) {cobj_tree_static_moving.check_coll_line_packet(lqp, test_alpha, skip_non_drawn, skip_movable);}
+	if (dynamic || !include_voxels) return;
+
+	for (unsigned r = 0; r < lqp.num; ++r) { // voxels don't have a packet query, so test them one line at a time
+		point const &p1(lqp.p1[r]);
+		point const p2(lqp.get_end_pt(r));
+		point cpos;
+		vector3d cnorm;
+		int cindex(-1);
+		if (!check_voxel_coll_line(p1, p2, cpos, cnorm, cindex, lqp.ignore_cobj, 1)) continue;
+		lqp.register_hit(r, min(lqp.tmax[r], lqp.tmax[r]*p2p_dist(p1, cpos)/p2p_dist(p1, p2)), cnorm, cindex);
+	}
+}
+
 // can use with snow shadows, grass shadows, tree leaf shadows
 bool check_coll_line_tree(point const &p1, point const &p2, int &cindex, int ignore_cobj, bool dynamic,
 	int test_alpha, bool skip_non_drawn, bool include_voxels, bool skip_init_colls, bool skip_movable)
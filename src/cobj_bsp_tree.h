@@ -5,6 +5,9 @@
 
 #include "physics_objects.h"
 
+struct binary_file_reader;
+struct binary_file_writer;
+
 
 class cobj_tree_base {
 
@@ -122,12 +125,65 @@ class cobj_bvh_tree : public cobj_tree_base {
 		void increment_node_ix() {assert(cur_nix >= start_nix); cur_nix++;}
 	};
 
+	// flattened 4-wide node built from nodes after construction; child bounds are stored SoA so that all 4 can be tested at once with SSE
+	struct wide_node_t { // size = 128
+		float bmin[3][4], bmax[3][4]; // {x,y,z}x{kid}
+		unsigned kid[4]; // index into wnodes for interior kids, start index into cixs for leaf kids
+		unsigned short num[4]; // number of cixs for leaf kids, 0 for interior kids
+		unsigned short nkids, pad; // only the first nkids entries are valid
+
+		wide_node_t() : nkids(0), pad(0) {
+			for (unsigned n = 0; n < 4; ++n) {kid[n] = num[n] = 0; UNROLL_3X(bmin[i_][n] = bmax[i_][n] = 0.0;)}
+		}
+		bool is_leaf(unsigned n) const {return (num[n] > 0);}
+		void set_kid_bcube(unsigned n, cube_t const &c) {UNROLL_3X(bmin[i_][n] = c.d[i_][0]; bmax[i_][n] = c.d[i_][1];)}
+		cube_t get_kid_bcube(unsigned n) const {return cube_t(bmin[0][n], bmax[0][n], bmin[1][n], bmax[1][n], bmin[2][n], bmax[2][n]);}
+		cube_t get_bcube() const;
+		unsigned get_line_hit_mask(point const &p1, vector3d const &dinv, float tmax, float tnear[4]) const;
+		unsigned get_cube_int_mask(cube_t const &c, float toler) const;
+	};
+
+	static unsigned const WIDE_STACK_SZ = 256; // max traversal stack size for wide nodes
+
+	struct wide_cube_query_t { // iterates over leaf cixs ranges of wide nodes intersecting cube, in the same order as the reference traversal
+		vector<wide_node_t> const &wnodes;
+		cube_t const &cube;
+		float toler;
+		unsigned ssz, stack[WIDE_STACK_SZ];
+
+		wide_cube_query_t(vector<wide_node_t> const &wnodes_, cube_t const &cube_, float toler_) : wnodes(wnodes_), cube(cube_), toler(toler_), ssz(1) {stack[0] = 0;}
+		bool next_leaf(unsigned &start, unsigned &end);
+	};
+
+	vector<wide_node_t> wnodes; // empty if disabled or not built
+	unsigned wide_max_depth, num_refits, build_num_cobjs;
+	float build_area; // sum of node surface areas after the last full build, used to detect when refitting has degraded the tree too much
+
 	void add_cobj(unsigned ix) {if (obj_ok((*cobjs)[ix])) {cixs.push_back(ix);}}
 	coll_obj const &get_cobj(unsigned ix) const {return (*cobjs)[cixs[ix]];}
 	bool create_cixs();
 	void calc_node_bbox(tree_node &n) const;
 	void build_tree_top_level_omp();
 	void build_tree(unsigned nix, unsigned skip_dims, unsigned depth, per_thread_data &ptd);
+	bool is_interior_node(unsigned nix) const;
+	void get_node_kids(unsigned nix, vector<unsigned> &kids) const;
+	bool build_wide_nodes();
+	bool loaded_tree_valid() const;
+	float get_nodes_area() const;
+	bool refit_tree();
+	bool has_same_cobjs(vector<unsigned> cids) const;
+	unsigned build_wide_node(vector<unsigned> &kids, unsigned depth, bool &valid);
+	bool skip_line_cobj(unsigned i, point const &p1, int ignore_cobj, int test_alpha, float max_alpha, bool skip_non_drawn, bool skip_init_colls, bool skip_movable) const;
+	bool check_coll_line_ref(point const &p1, point const &p2, point &cpos, vector3d &cnorm, int &cindex, int ignore_cobj,
+		bool exact, int test_alpha, bool skip_non_drawn, bool skip_init_colls, bool skip_movable) const;
+	bool check_coll_line_wide(point const &p1, point const &p2, point &cpos, vector3d &cnorm, int &cindex, int ignore_cobj,
+		bool exact, int test_alpha, bool skip_non_drawn, bool skip_init_colls, bool skip_movable) const;
+	bool is_valid_line_hit(int cindex, point const &p1, point const &p2, int ignore_cobj, int test_alpha, bool skip_non_drawn, bool skip_init_colls, bool skip_movable) const;
+	bool check_point_contained_ref(point const &p, int &cindex) const;
+	void get_intersecting_cobjs_ref(cube_t const &cube, vector<unsigned> &cobjs, int ignore_cobj, float toler, bool check_ccounter, int id_for_cobj_int) const;
+	void get_coll_sphere_cands(cube_t const &bcube, int ignore_cobj, bool use_wide, vert_coll_detector *vcd, vector<unsigned> *cands) const;
+	void add_intersecting_leaf_cobjs(unsigned start, unsigned end, cube_t const &cube, vector<unsigned> &cobjs,
+		int ignore_cobj, float toler, bool check_ccounter, int id_for_cobj_int) const;
 
 	bool obj_ok(coll_obj const &c) const {
 		return (((is_static && c.status == COLL_STATIC) || (is_dynamic && c.status == COLL_DYNAMIC) || (!is_static && !is_dynamic)) &&
@@ -137,15 +193,22 @@ class cobj_bvh_tree : public cobj_tree_base {
 
 public:
 	cobj_bvh_tree(coll_obj_group const *cobjs_, bool s, bool d, bool o, bool c, bool v)
-		: cobjs(cobjs_), is_static(s), is_dynamic(d), occluders_only(o), cubes_only(c), inc_voxel_cobjs(v) {assert(cobjs);}
+		: cobjs(cobjs_), is_static(s), is_dynamic(d), occluders_only(o), cubes_only(c), inc_voxel_cobjs(v), wide_max_depth(0), num_refits(0), build_num_cobjs(0), build_area(0.0) {assert(cobjs);}
 
 	unsigned get_num_objs() const {return cixs.size();}
+	bool has_wide_nodes() const {return !wnodes.empty();}
 	void clear();
 	void add_cobj_ids(vector<unsigned> const &cids) {assert(cixs.empty() && !cids.empty()); cixs = cids;}
 	void add_cobjs(bool verbose);
 	void build_tree_from_cixs(bool do_mt_build);
+	bool refit_if_same_cobjs(vector<unsigned> const &cids);
+	bool apply_cobj_changes(vector<unsigned> const &removed, vector<pair<unsigned, unsigned> > const &added);
+	void update_cobjs(bool verbose);
+	bool write_to_file(binary_file_writer &writer) const;
+	template<typename R> bool read_from_file(R &reader); // R is binary_file_reader or binary_mem_reader
 	bool check_coll_line(point const &p1, point const &p2, point &cpos, vector3d &cnorm, int &cindex, int ignore_cobj,
 		bool exact, int test_alpha, bool skip_non_drawn, bool skip_init_colls, bool skip_movable) const;
+	void check_coll_line_packet(line_query_packet_t &lqp, int test_alpha, bool skip_non_drawn, bool skip_movable) const;
 	bool check_point_contained(point const &p, int &cindex) const;
 	void get_intersecting_cobjs(cube_t const &cube, vector<unsigned> &cobjs, int ignore_cobj, float toler, bool check_ccounter, int id_for_cobj_int) const;
 	bool is_cobj_contained(point const &viewer, point const *const pts, unsigned npts, int ignore_cobj, int &cobj) const;
@@ -287,6 +287,14 @@ bool check_coll_line_exact(point pos1, point pos2, point &cpos, vector3d &cnorm,
 }
 
 
+// packet version of check_coll_line_exact() for coherent lines; fills in lqp.cpos, lqp.cnorm, and lqp.cindex for each line (no water splashes)
+void check_coll_line_exact_packet(line_query_packet_t &lqp, bool test_alpha, bool skip_dynamic, bool include_voxels, bool no_stat_moving) {
+
+	if (world_mode != WMODE_GROUND || lqp.empty()) return;
+	check_coll_line_exact_tree_packet(lqp, 0, test_alpha, 0, include_voxels, 0, no_stat_moving);
+	if (!skip_dynamic && begin_motion) {check_coll_line_exact_tree_packet(lqp, 1, test_alpha, 0, 0, 0, no_stat_moving);} // find dynamic cobj intersection
+}
+
 bool cobj_contained_ref(point const &pos1, const point *pts, unsigned npts, int cobj, int &last_cobj) {
 
 	if (!have_occluders()) return 0;
@@ -382,6 +382,36 @@ struct cobj_query_callback {
 };
 
 
+struct line_query_packet_t { // batch of coherent line queries that share a single BVH traversal; finds the closest hit for each line
+
+	static unsigned const MAX_LINES = 16; // must fit in an unsigned bit mask
+	unsigned num;
+	int ignore_cobj;
+	point p1[MAX_LINES], p2[MAX_LINES], cpos[MAX_LINES];
+	vector3d cnorm[MAX_LINES];
+	float tmax[MAX_LINES]; // current hit distance as a fraction of (p2 - p1)
+	int cindex[MAX_LINES];
+	bool skip_init_colls[MAX_LINES];
+
+	line_query_packet_t(int ignore_cobj_=-1) : num(0), ignore_cobj(ignore_cobj_) {}
+	bool empty() const {return (num == 0);}
+	bool full () const {return (num == MAX_LINES);}
+	unsigned get_all_mask() const {return ((1U << num) - 1);}
+	point get_end_pt(unsigned ix) const {assert(ix < num); return ((cindex[ix] >= 0) ? cpos[ix] : p2[ix]);}
+	void clear() {num = 0;}
+
+	unsigned add(point const &p1_, point const &p2_, bool skip_init_colls_=0) {
+		assert(num < MAX_LINES);
+		p1[num] = p1_; p2[num] = cpos[num] = p2_; cnorm[num] = zero_vector; tmax[num] = 1.0; cindex[num] = -1; skip_init_colls[num] = skip_init_colls_;
+		return num++;
+	}
+	void register_hit(unsigned ix, float t, vector3d const &cnorm_, int cindex_) {
+		assert(ix < num && t <= tmax[ix]);
+		tmax[ix] = t; cnorm[ix] = cnorm_; cindex[ix] = cindex_; cpos[ix] = p1[ix] + (p2[ix] - p1[ix])*t;
+	}
+};
+
+
 class polygon_t : public vector<vert_norm_tc> {
 
 public:
@@ -43,7 +43,7 @@ void rect::clip_to(float const c[2][2]) {
 
 
 // rr will be removed
-void rect::subtract_from(rect const &rr, deque<rect> &new_rects) const { // subtract ourself from rr
+void rect::subtract_from(rect const &rr, vector<rect> &new_rects) const { // subtract ourself from rr
 
 	if (contains(rr.d)) return;
 	unsigned i2[2], n[2];
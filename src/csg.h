@@ -45,7 +45,7 @@ public:
 		return (d[0][0] < r[0][1]  && d[0][1] > r[0][0]  && d[1][0] < r[1][1]  && d[1][1] > r[1][0]);
 	}
 	void clip_to(float const c[2][2]);
-	void subtract_from(rect const &rr, deque<rect> &new_rects) const;
+	void subtract_from(rect const &rr, vector<rect> &new_rects) const;
 	bool merge_with(rect const &r);
 	void print() const;
 }; // class rect
@@ -77,13 +77,22 @@ public:
 }; // class csg_cube
 
 
+struct cobj_change_list_t { // cobjs changed by a CSG subtract, used to update the static cobj trees in place
+	vector<unsigned> removed;
+	vector<pair<unsigned, unsigned> > added; // {new cobj, removed cobj it was split from}
+
+	bool empty() const {return (removed.empty() && added.empty());}
+	void clear() {removed.clear(); added.clear();}
+};
+
+
 class r_profile {
 
 	bool filled;
 	rect bb;
 	float tot_area, avg_alpha;
 	vector<rect> rects;
-	deque<rect> pend;
+	vector<rect> pend; // FIFO of rects waiting to be merged; a vector so that its capacity is reused across calls
 
 	void add_rect_int(rect const &r);
 
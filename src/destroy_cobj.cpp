@@ -10,6 +10,7 @@
 
 bool const LET_COBJS_FALL    = 0;
 bool const REMOVE_UNANCHORED = 1;
+unsigned const MIN_PARALLEL_CSG_COBJS = 4; // min cobjs in a wave to subtract in parallel
 
 int destroy_thresh(0);
 vector<unsigned> falling_cobjs;
@@ -258,6 +259,52 @@ void add_to_falling_cobjs(set<unsigned> const &ids) {
 void invalidate_static_cobjs() {build_cobj_tree(0, 0);}
 
 
+struct cobj_subtract_t { // result of subtracting the cube from one cobj in a wave
+	unsigned cid;
+	bool removed, full_destroy;
+	coll_obj_group new_cobjs;
+	cobj_subtract_t() : cid(0), removed(0), full_destroy(0) {}
+};
+
+// determines whether cobj cid is affected by cube and computes its fragments; modifies only the cobj itself, so can be called in parallel
+void calc_cobj_subtract(csg_cube const &cube, float clip_cube_volume, int min_destroy, cobj_subtract_t &res) {
+
+	coll_obj &cobj(coll_objects.get_cobj(res.cid));
+	assert(cobj.status == COLL_STATIC);
+	// can't destroy a model3d or voxel terrain cobj because the geometry is also stored in a vbo and won't get updated here
+	if (cobj.cp.cobj_type != COBJ_TYPE_STD) return;
+	int const D(cobj.destroy);
+	if (D <= max(destroy_thresh, (min_destroy-1))) return;
+	if (!cobj.intersects(cube)) return; // no intersection
+	bool const shatter(D >= SHATTERABLE); // Note: shatter includes explode here
+	res.full_destroy = (shatter || cobj.is_movable());
+
+	if (cobj.type == COLL_CUBE && !shatter) {
+		float const min_volume(0.01*min(cobj.volume, clip_cube_volume)), int_volume(csg_cube(cobj, 1).get_overlap_volume(cube));
+		if (int_volume < min_volume) {cube.unset_intersecting_edge_flags(cobj); return;} // don't remove tiny bits from cobjs
+	}
+	res.removed = (res.full_destroy || cobj.subtract_from_cobj(res.new_cobjs, cube, 1));
+}
+
+// subtracts cube from every cobj in the wave without changing coll_objects; results are in the same order as cids
+void calc_wave_subtract(csg_cube const &cube, float clip_cube_volume, int min_destroy, set<unsigned> const &cids, vector<cobj_subtract_t> &results) {
+
+	results.clear();
+	results.resize(cids.size());
+	unsigned n(0);
+	for (auto i = cids.begin(); i != cids.end(); ++i, ++n) {results[n].cid = *i;}
+
+#pragma omp parallel for schedule(dynamic) if (results.size() >= MIN_PARALLEL_CSG_COBJS)
+	for (int i = 0; i < (int)results.size(); ++i) {
+		if (coll_objects.get_cobj(results[i].cid).type == COLL_POLYGON) continue; // done below
+		calc_cobj_subtract(cube, clip_cube_volume, min_destroy, results[i]);
+	}
+	for (auto r = results.begin(); r != results.end(); ++r) { // polygon splitting uses a shared tessellator, so these must be serial
+		if (coll_objects.get_cobj(r->cid).type == COLL_POLYGON) {calc_cobj_subtract(cube, clip_cube_volume, min_destroy, *r);}
+	}
+}
+
+
 // Note: should be named partially_destroy_cube_area() or something like that
 unsigned subtract_cube(vector<color_tid_vol> &cts, vector3d &cdir, csg_cube const &cube_in, int min_destroy) {
 
@@ -269,7 +316,8 @@ unsigned subtract_cube(vector<color_tid_vol> &cts, vector3d &cdir, csg_cube cons
 	point center(cube.get_cube_center());
 	float const clip_cube_volume(cube.get_volume());
 	vector<int> just_added, to_remove;
-	coll_obj_group new_cobjs;
+	vector<cobj_subtract_t> results;
+	cobj_change_list_t changes; // used to update the static cobj tree in place
 	cdir = zero_vector;
 	vector<cube_t> mod_cubes;
 	mod_cubes.push_back(cube);
@@ -281,70 +329,57 @@ unsigned subtract_cube(vector<color_tid_vol> &cts, vector3d &cdir, csg_cube cons
 
 	while (!unique_cobjs.empty()) {
 		set<unsigned> next_cobjs;
+		// determine affected cobjs and their fragments in parallel, then apply the changes serially in cobj order
+		calc_wave_subtract(cube, clip_cube_volume, min_destroy, unique_cobjs, results);
 
-		// determine affected cobjs
-		for (auto k = unique_cobjs.begin(); k != unique_cobjs.end(); ++k) {
-			unsigned const i(*k);
+		for (auto r = results.begin(); r != results.end(); ++r) {
+			if (!r->removed) continue;
+			unsigned const i(r->cid);
 			coll_obj &cobj(cobjs.get_cobj(i));
-			assert(cobj.status == COLL_STATIC);
-			// can't destroy a model3d or voxel terrain cobj because the geometry is also stored in a vbo and won't get updated here
-			if (cobj.cp.cobj_type != COBJ_TYPE_STD) continue;
-			int const D(cobj.destroy);
-			if (D <= max(destroy_thresh, (min_destroy-1))) continue;
-			if (!cobj.intersects(cube)) continue; // no intersection
-			bool const is_cube(cobj.type == COLL_CUBE), is_polygon(cobj.type == COLL_POLYGON);
-			bool const shatter(D >= SHATTERABLE), full_destroy(shatter || cobj.is_movable()); // Note: shatter includes explode here
+			bool const is_cube(cobj.type == COLL_CUBE), is_polygon(cobj.type == COLL_POLYGON), full_destroy(r->full_destroy);
 			csg_cube const cube2(cobj, 1);
-			//if (is_cube && !cube2.contains_pt(cube.get_cube_center())) {} // check for non-destroyable cobj between center and cube2?
 			float volume(cobj.volume);
-			float const min_volume(0.01*min(volume, clip_cube_volume)), int_volume(cube2.get_overlap_volume(cube));
-
-			if (is_cube && !shatter && int_volume < min_volume) { // don't remove tiny bits from cobjs
-				cube.unset_intersecting_edge_flags(cobj);
-				continue;
-			}
-			if (full_destroy || cobj.subtract_from_cobj(new_cobjs, cube, 1)) {
-				bool no_new_cobjs(full_destroy || volume < TOLERANCE);
-				if (no_new_cobjs) {new_cobjs.clear();} // completely destroyed
-				if (is_cube)      {cdir += cube2.closest_side_dir(center);} // inexact
-				if (D == SHATTER_TO_PORTAL) {cobj.create_portal();}
+			int const cgid(cobj.cgroup_id);
+			bool no_new_cobjs(full_destroy || volume < TOLERANCE);
+			if (no_new_cobjs) {r->new_cobjs.clear();} // completely destroyed
+			if (is_cube)      {cdir += cube2.closest_side_dir(center);} // inexact
+			if (cobj.destroy == SHATTER_TO_PORTAL) {cobj.create_portal();}
 				
-				// Note: cobj reference may be invalidated beyond this point
-				for (unsigned j = 0; j < new_cobjs.size(); ++j) { // new cobjs
-					new_cobjs[j].set_reflective_flag(0); // the parts are not reflective
-					int const index(new_cobjs[j].add_coll_cobj()); // not sorted by alpha
-					assert(index >= 0 && (size_t)index < cobjs.size());
-					just_added.push_back(index);
-					volume -= cobjs[index].volume;
-				}
-				if (is_polygon) {volume = max(0.0f, volume);} // FIXME: remove this when polygon splitting is correct
-				assert(volume >= -TOLERANCE); // usually > 0.0
-				int const cgid(cobj.cgroup_id);
+			// Note: cobj reference may be invalidated beyond this point
+			for (unsigned j = 0; j < r->new_cobjs.size(); ++j) { // new cobjs
+				r->new_cobjs[j].set_reflective_flag(0); // the parts are not reflective
+				int const index(r->new_cobjs[j].add_coll_cobj()); // not sorted by alpha
+				assert(index >= 0 && (size_t)index < cobjs.size());
+				just_added.push_back(index);
+				changes.added.emplace_back(index, i);
+				volume -= cobjs[index].volume;
+			}
+			if (is_polygon) {volume = max(0.0f, volume);} // FIXME: remove this when polygon splitting is correct
+			assert(volume >= -TOLERANCE); // usually > 0.0
 
-				// Note: all cobjs in this group should have the same destroy thresh if any are shatterable or explodeable
-				if (cgid >= 0 && full_destroy && cgroups_added.insert(cgid).second) { // newly inserted nonzero group
-					cobj_id_set_t const &group(cobj_groups.get_set(cgid));
+			// Note: all cobjs in this group should have the same destroy thresh if any are shatterable or explodeable
+			if (cgid >= 0 && full_destroy && cgroups_added.insert(cgid).second) { // newly inserted nonzero group
+				cobj_id_set_t const &group(cobj_groups.get_set(cgid));
 
-					for (auto c = group.begin(); c != group.end(); ++c) { // destroy all cobjs in the group
-						if (!seen_cobjs.insert(*c).second) continue; // already processed
-						next_cobjs.insert(*c); // add to the next wave
-					}
-				}
-				cts.push_back(color_tid_vol(cobjs[i], volume, cobjs[i].calc_min_dim(), 0));
-				cobjs[i].clear_internal_data();
-				to_remove.push_back(i);
-				if (full_destroy) {mod_cubes.push_back(cobjs[i]);}
-				int const gid(cobjs[i].group_id);
-
-				if (gid >= 0) { // we only check in the remove case because we can't add without removing
-					assert((unsigned)gid < obj_draw_groups.size());
-					// free vbo and disable vbos for this group permanently because it's too difficult to keep cobjs sorted by group
-					obj_draw_groups[gid].free_vbo();
-					obj_draw_groups[gid].set_vbo_enable(0);
+				for (auto c = group.begin(); c != group.end(); ++c) { // destroy all cobjs in the group
+					if (!seen_cobjs.insert(*c).second) continue; // already processed
+					next_cobjs.insert(*c); // add to the next wave
 				}
 			}
-			new_cobjs.clear();
-		} // for k
+			cts.push_back(color_tid_vol(cobjs[i], volume, cobjs[i].calc_min_dim(), 0));
+			cobjs[i].clear_internal_data();
+			to_remove.push_back(i);
+			changes.removed.push_back(i);
+			if (full_destroy) {mod_cubes.push_back(cobjs[i]);}
+			int const gid(cobjs[i].group_id);
+
+			if (gid >= 0) { // we only check in the remove case because we can't add without removing
+				assert((unsigned)gid < obj_draw_groups.size());
+				// free vbo and disable vbos for this group permanently because it's too difficult to keep cobjs sorted by group
+				obj_draw_groups[gid].free_vbo();
+				obj_draw_groups[gid].set_vbo_enable(0);
+			}
+		} // for r
 		for (auto c = next_cobjs.begin(); c != next_cobjs.end(); ++c) {cube.union_with_cube(cobjs.get_cobj(*c));} // ensure the cube fully contains each new cobj
 		unique_cobjs.swap(next_cobjs); // process next wave
 	} // end while()
@@ -355,7 +390,7 @@ unsigned subtract_cube(vector<color_tid_vol> &cts, vector3d &cdir, csg_cube cons
 		cobjs[*i].remove_waypoint();
 		remove_coll_object(*i); // remove old collision object
 	}
-	if (!to_remove.empty()) {invalidate_static_cobjs();} // after destroyed cobj removal
+	if (!to_remove.empty()) {update_static_cobj_tree(changes.removed, changes.added);} // after destroyed cobj removal; refit rather than rebuild if possible
 
 	// add new waypoints (after build_cobj_tree and end_batch)
 	for (vector<int>::const_iterator i = just_added.begin(); i != just_added.end(); ++i) {
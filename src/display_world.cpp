@@ -7,6 +7,7 @@
 #include "timetest.h"
 #include "physics_objects.h"
 #include "model3d.h"
+#include "profiler.h"
 #include <fstream>
 
 
@@ -741,6 +742,7 @@ void display() {
 	static int init(0), frame_index(0), time_index(0), global_time(0), tticks(0);
 	static point old_spos(0.0, 0.0, 0.0);
 	++cur_display_iter;
+	zone_profiler_next_frame(); // aggregate zones from the previous frame
 	proc_kbd_events();
 
 	if (!init) { // the first frame
@@ -1145,6 +1147,29 @@ void draw_scene_from_custom_frustum(pos_dir_up const &pdu, int cobj_id, int refl
 }
 
 
+// advances the simulation by one fixed timestep without drawing, for the headless benchmark; similar to the map mode update in display()
+void headless_sim_tick() {
+
+	++cur_display_iter;
+	zone_profiler_next_frame();
+	uevent_advance_frame();
+	fticks   = 1.0;
+	iticks   = 1;
+	tfticks += fticks;
+	if (animate2) {sim_ticks = tfticks;}
+	tstep    = TIMESTEP*fticks;
+
+	if (world_mode == WMODE_INF_TERRAIN) {
+		next_city_frame(0); // serial, since there's no draw thread
+	}
+	else if (world_mode == WMODE_GROUND) {
+		process_groups();
+		build_cobj_tree(1, 0);
+		if (game_mode) {update_blasts(); update_game_frame();}
+	}
+}
+
+
 void run_tt_gameplay() {
 
 	process_groups();
@@ -64,6 +64,8 @@ void blastr::check_pointers() {
 
 void register_explosion(point const &pos, float radius, float damage, unsigned eflags, int wclass, uobject *src, free_obj const *parent) {
 	assert(damage >= 0.0);
+	uobj_cmd_buffer_t *const cmds(get_deferred_uobj_cmds());
+	if (cmds) {cmds->add_explosion(uobj_cmd_buffer_t::explosion_t(pos, radius, damage, eflags, wclass, src, parent)); return;} // registered at the next sync point
 	explosions.push_back(explosion(pos, radius, damage, eflags, wclass, src, parent));
 }
 
@@ -89,6 +91,12 @@ void add_blastr(point const &pos, vector3d const &dir, float size, float damage,
 	colorRGBA const &color2, int type, free_obj const *const parent, bool emits_light, float exp_sphere_scale)
 {
 	if (NO_NONETYPE_BRS && type == ETYPE_NONE) return;
+	uobj_cmd_buffer_t *const cmds(get_deferred_uobj_cmds());
+
+	if (cmds) { // added at the next sync point
+		cmds->add_blastr(uobj_cmd_buffer_t::blastr_t(pos, dir, size, damage, time, src, color1, color2, type, parent, emits_light, exp_sphere_scale));
+		return;
+	}
 	bool const one_frame_only(time == 0);
 	if (one_frame_only) {time = 1;}
 	assert(size > 0.0 && time >= 0);
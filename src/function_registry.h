@@ -9,6 +9,7 @@ struct xform_matrix;
 struct cube_with_zval_t;
 
 int omp_get_thread_num_3dw();
+int omp_get_max_threads_3dw();
 
 // function prototypes - main (3DWorld.cpp, etc.)
 bool get_gl_error(unsigned loc_id=0);
@@ -78,6 +79,9 @@ void set_global_state();
 void process_groups();
 void gen_scene(int generate_mesh, int gen_trees, int keep_sin_table, int update_zvals, int rgt_only);
 void write_def_coll_objects_file();
+std::string get_scene_cache_filename(char const *const prefix, uint64_t key, char const *const ext=".bin");
+void register_scene_input_file(std::string const &fn);
+uint64_t get_scene_files_key();
 void init_models();
 void free_models();
 
@@ -88,6 +92,7 @@ point get_sun_pos();
 point get_moon_pos();
 colorRGBA get_bkg_color(point const &p1, vector3d const &v12);
 void draw_scene_from_custom_frustum(pos_dir_up const &pdu, int cobj_id, int reflection_pass, bool inc_mesh, bool inc_grass, bool inc_water);
+void headless_sim_tick();
 
 // function prototypes - draw_world
 void set_fill_mode();
@@ -268,6 +273,8 @@ void end_tiled_terrain_lightning();
 void draw_tiled_terrain_clouds(bool reflection_pass);
 void draw_tiled_terrain_decid_tree_shadows();
 void clear_tiled_terrain(bool no_regen_buildings=0);
+void init_tiled_terrain_hmap_and_buildings();
+unsigned gen_tiled_terrain_tiles_cpu_benchmark();
 void reset_tiled_terrain_state();
 void clear_tiled_terrain_shaders();
 float get_tiled_terrain_water_level();
@@ -322,8 +329,10 @@ void gen_mesh(int surface_type, int keep_sin_table, int update_zvals);
 float do_glaciate_exp(float value);
 float get_rel_wpz();
 void init_terrain_mesh();
+void run_cpu_noise_benchmark();
 float eval_mesh_sin_terms(float xv, float yv);
 float get_exact_zval(float xval, float yval);
+float get_exact_zval_xyoff(float xval_in, float yval_in, int xoff_val, int yoff_val);
 void reset_offsets();
 float get_median_height(float distribution_pos);
 float get_water_z_height();
@@ -445,9 +454,12 @@ void free_cobj_draw_group_vbos();
 
 // function prototypes - coll_cell_search
 void build_static_moving_cobj_tree();
-void build_cobj_tree(bool dynamic=0, bool verbose=1);
+void build_cobj_tree(bool dynamic=0, bool verbose=1, bool use_cache=0);
+void update_static_cobj_tree(vector<unsigned> const &removed, vector<pair<unsigned, unsigned> > const &added);
 bool check_coll_line_exact_tree(point const &p1, point const &p2, point &cpos, vector3d &cnorm, int &cindex, int ignore_cobj,
 	bool dynamic=0, int test_alpha=0, bool skip_non_drawn=0, bool include_voxels=1, bool skip_init_colls=0, bool skip_movable=0, bool no_stat_moving=0);
+void check_coll_line_exact_tree_packet(line_query_packet_t &lqp, bool dynamic=0, int test_alpha=0, bool skip_non_drawn=0,
+	bool include_voxels=1, bool skip_movable=0, bool no_stat_moving=0);
 bool check_coll_line_tree(point const &p1, point const &p2, int &cindex, int ignore_cobj, bool dynamic=0, int test_alpha=0,
 	bool skip_non_drawn=0, bool include_voxels=1, bool skip_init_colls=0, bool skip_movable=0);
 bool cobj_contained_tree(point const &viewer, point const *const pts, unsigned npts, int ignore_cobj, int &cobj);
@@ -462,6 +474,7 @@ bool check_coll_line(point const &pos1, point const &pos2, int &cindex, int c_ob
 	bool include_voxels=1, bool skip_init_colls=0, bool skip_movable=0);
 bool check_coll_line_exact(point pos1, point pos2, point &cpos, vector3d &coll_norm, int &cindex, float splash_val=0.0, int ignore_cobj=-1,
 	bool fast=0, bool test_alpha=0, bool skip_dynamic=0, bool include_voxels=1, bool skip_init_colls=0, bool no_stat_moving=0);
+void check_coll_line_exact_packet(line_query_packet_t &lqp, bool test_alpha=0, bool skip_dynamic=0, bool include_voxels=1, bool no_stat_moving=0);
 bool cobj_contained_ref(point const &pos1, const point *pts, unsigned npts, int cobj, int &last_cobj);
 bool cobj_contained(point const &pos1, const point *pts, unsigned npts, int cobj);
 colorRGBA get_cobj_color_at_point(int cindex, point const &pos, vector3d const &normal, bool fast);
@@ -1009,7 +1022,7 @@ bool check_line_coll_building(point const &p1, point const &p2, unsigned buildin
 cube_t get_building_bcube(unsigned building_id);
 cube_t get_sec_building_bcube(unsigned building_id);
 int get_building_bcube_contains_pos(point const &pos);
-bool check_buildings_ped_coll(point const &pos, float radius, unsigned plot_id, unsigned &building_id);
+bool check_buildings_ped_coll(point const &pos, float radius, unsigned plot_id, unsigned &building_id, vector<point> *points_buf=nullptr);
 bool select_building_in_plot(unsigned plot_id, unsigned rand_val, unsigned &building_id);
 void get_building_bcubes(cube_t const &xy_range, vect_cube_t &bcubes);
 bool get_buildings_line_hit_color(point const &p1, point const &p2, colorRGBA &color);
@@ -1018,6 +1031,7 @@ unsigned get_buildings_gpu_mem_usage();
 vector3d get_buildings_max_extent();
 void clear_building_vbos();
 int create_buildings_tile(int x, int y, bool allow_flatten);
+void update_building_tiles_async(bool enable);
 bool remove_buildings_tile(int x, int y);
 void free_building_indir_texture();
 void end_building_rt_job();
@@ -10,6 +10,9 @@
 #include "draw_utils.h" // for point_sprite_drawer_sized
 #include "subdiv.h" // for sd_sphere_d
 #include "tree_3dw.h" // for tree_placer_t
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 using std::string;
 
@@ -20,16 +23,21 @@ bool const DRAW_INTERIOR_DOORS   = 1;
 bool const DRAW_EXT_REFLECTIONS  = 1;
 bool const LINEAR_ROOM_DLIGHT_ATTEN = 1;
 float const WIND_LIGHT_ON_RAND   = 0.08;
+float const BUILDING_TILE_PREFETCH_TIME = 2.0; // in seconds; building tiles are prefetched around where the camera will be after this much time
+unsigned const MAX_BUILDING_TILE_PUBLISH = 2; // max number of asynchronously generated building tiles to create VBOs for per frame
+float const ROOM_GEOM_PREFETCH_DIST_SCALE = 1.5; // room geom is generated in the background for buildings within this multiple of the room geom draw distance
+unsigned const MAX_ROOM_GEOM_JOBS    = 16; // max number of buildings with room geom queued, being generated, or waiting to be published
+unsigned const MAX_ROOM_GEOM_PUBLISH = 4;  // max number of buildings to add background generated room geom to per frame
 
 bool camera_in_building(0), interior_shadow_maps(0);
 building_params_t global_building_params;
 shader_t reflection_shader;
 building_t const *player_building(nullptr);
 
-extern bool start_in_inf_terrain, draw_building_interiors, flashlight_on, enable_use_temp_vbo, toggle_room_light;
+extern bool start_in_inf_terrain, draw_building_interiors, flashlight_on, enable_use_temp_vbo, toggle_room_light, headless_mode;
 extern unsigned room_mirror_ref_tid;
-extern int rand_gen_index, display_mode, window_width, window_height, camera_surf_collide, animate2;
-extern float CAMERA_RADIUS, city_dlight_pcf_offset_scale;
+extern int rand_gen_index, xoff2, yoff2, display_mode, window_width, window_height, camera_surf_collide, animate2, frame_counter;
+extern float CAMERA_RADIUS, city_dlight_pcf_offset_scale, fticks;
 extern point sun_pos, pre_smap_player_pos;
 extern vector<light_source> dl_sources;
 extern tree_placer_t tree_placer;
@@ -1430,6 +1438,21 @@ void building_t::add_split_roof_shadow_quads(building_draw_t &bdraw) const {
 }
 
 
+class building_creator_t;
+
+struct room_geom_bldg_t { // a building that needs or has room geom; used for background room geom generation and the room geom memory budget
+	building_creator_t *bc;
+	unsigned gix, bix; // index into grid_by_tile and buildings
+	int last_draw_frame;
+	float dist;
+
+	room_geom_bldg_t(building_creator_t *bc_, unsigned gix_, unsigned bix_, float dist_, int ldf=0) : bc(bc_), gix(gix_), bix(bix_), last_draw_frame(ldf), dist(dist_) {}
+	bool operator<(room_geom_bldg_t const &b) const {return (dist < b.dist);}
+};
+
+void update_room_geom_prefetch(vector<building_creator_t *> const &bcs, point const &camera_bs, float room_geom_draw_dist, bool enable);
+
+
 class building_creator_t {
 
 	unsigned grid_sz, gpu_mem_usage;
@@ -1630,15 +1653,21 @@ public:
 		return 1;
 	}
 	void gen(building_params_t const &params, bool city_only, bool non_city_only, bool is_tile, bool allow_flatten, int rseed=123) {
+		if (gen_no_vbos(params, city_only, non_city_only, is_tile, allow_flatten, rseed, xoff2, yoff2)) {create_vbos(is_tile);}
+	}
+	// generates everything except for the VBOs; returns 0 if there are no buildings to generate;
+	// when allow_flatten=0 and is_tile=1, this makes no GL calls and only reads global state, so it can be called from a worker thread
+	// with a private copy of params and the values of xoff2/yoff2 at the time the job was created
+	bool gen_no_vbos(building_params_t const &params, bool city_only, bool non_city_only, bool is_tile, bool allow_flatten, int rseed, int xoff_val, int yoff_val) {
 		assert(!(city_only && non_city_only));
 		clear();
-		if (params.tt_only && world_mode != WMODE_INF_TERRAIN) return;
-		if (params.gen_inf_buildings() && !is_tile && !city_only) return; // secondary buildings - not added here
+		if (params.tt_only && world_mode != WMODE_INF_TERRAIN) return 0;
+		if (params.gen_inf_buildings() && !is_tile && !city_only) return 0; // secondary buildings - not added here
 		vector<unsigned> const &mat_ix_list(params.get_mat_list(city_only, non_city_only));
-		if (params.materials.empty() || mat_ix_list.empty()) return; // no materials
+		if (params.materials.empty() || mat_ix_list.empty()) return 0; // no materials
 		timer_t timer("Gen Buildings", !is_tile);
 		float const def_water_level(get_water_z_height()), min_building_spacing(get_min_obj_spacing());
-		vector3d const offset(-xoff2*DX_VAL, -yoff2*DY_VAL, 0.0);
+		vector3d const offset(-xoff_val*DX_VAL, -yoff_val*DY_VAL, 0.0);
 		vector3d const xlate((world_mode == WMODE_INF_TERRAIN) ? offset : zero_vector); // cancel out xoff2/yoff2 translate
 		vector3d const delta_range((world_mode == WMODE_INF_TERRAIN) ? zero_vector : offset);
 		range = params.materials[mat_ix_list.front()].pos_range; // range is union over all material ranges
@@ -1678,7 +1707,7 @@ public:
 			for (unsigned n = 0; n < params.num_tries; ++n) { // 10 tries to find a non-overlapping building placement
 				building_cand_t b(temp_parts);
 				b.mat_ix = params.choose_rand_mat(rgen, city_only, non_city_only); // set material
-				building_mat_t const &mat(b.get_material());
+				building_mat_t const &mat(params.get_material(b.mat_ix)); // Note: params may be a copy of global_building_params with a different pos_range
 				cube_t pos_range;
 				unsigned plot_ix(0);
 				
@@ -1718,7 +1747,7 @@ public:
 				if (!check_valid_building_placement(params, b, avoid_bcubes, avoid_bcubes_bcube,
 					min_building_spacing, plot_ix, non_city_only, use_city_plots, check_plot_coll)) continue; // check overlap
 				++num_gen;
-				if (!use_city_plots) {center.z = get_exact_zval(center.x+xlate.x, center.y+xlate.y);} // only calculate when needed
+				if (!use_city_plots) {center.z = get_exact_zval_xyoff(center.x+xlate.x, center.y+xlate.y, xoff_val, yoff_val);} // only calculate when needed
 				float const z_sea_level(center.z - def_water_level);
 				if (z_sea_level < 0.0) break; // skip underwater buildings, failed placement
 				if (z_sea_level < mat.min_alt || z_sea_level > mat.max_alt) break; // skip bad altitude buildings, failed placement
@@ -1776,7 +1805,7 @@ public:
 					unsigned num_below(0);
 					
 					for (int d = 0; d < 4; ++d) {
-						float const zval(get_exact_zval(b.bcube.d[0][d&1]+xlate.x, b.bcube.d[1][d>>1]+xlate.y)); // approximate for rotated buildings
+						float const zval(get_exact_zval_xyoff(b.bcube.d[0][d&1]+xlate.x, b.bcube.d[1][d>>1]+xlate.y, xoff_val, yoff_val)); // approximate for rotated buildings
 						min_eq(zmin, zval);
 						num_below += (zval < def_water_level);
 					}
@@ -1836,8 +1865,8 @@ public:
 				 << TXT(s.nrooms) << TXT(s.nceils) << TXT(s.nfloors) << TXT(s.nwalls) << TXT(s.nrgeom) << TXT(s.nobjs) << TXT(s.nverts) << endl;
 		}
 		build_grid_by_tile(is_tile);
-		create_vbos(is_tile);
-	} // end gen()
+		return 1;
+	} // end gen_no_vbos()
 
 	struct pt_by_xval {
 		bool operator()(point const &a, point const &b) const {return (a.x < b.x);}
@@ -1910,6 +1939,42 @@ public:
 	}
 	int get_ped_ix_for_bix(unsigned bix) const {return ((bix < peds_by_bix.size()) ? peds_by_bix[bix] : -1);}
 
+	void get_room_geom_cands(point const &pos, float max_dist, vector<room_geom_bldg_t> &cands) { // buildings within max_dist of pos that need room geom
+		float const ddist_scale(building_draw_windows.empty() ? 0.05 : 1.0); // same as multi_draw()
+
+		for (auto g = grid_by_tile.begin(); g != grid_by_tile.end(); ++g) {
+			if (!g->bcube.closest_dist_less_than(pos, ddist_scale*max_dist)) continue; // too far
+
+			for (auto bi = g->bc_ixs.begin(); bi != g->bc_ixs.end(); ++bi) {
+				building_t const &b(get_building(bi->ix));
+				if (!b.interior || b.is_rotated() || b.has_room_geom()) continue; // no room geom needed
+				if (!b.bcube.closest_dist_less_than(pos, ddist_scale*max_dist)) continue; // too far
+				cands.emplace_back(this, (g - grid_by_tile.begin()), bi->ix, p2p_dist(pos, b.bcube.closest_pt(pos)));
+			}
+		}
+	}
+	void get_room_geom_bldgs(point const &pos, vector<room_geom_bldg_t> &bldgs) { // buildings that currently have room geom
+		for (auto g = grid_by_tile.begin(); g != grid_by_tile.end(); ++g) {
+			if (!g->has_room_geom) continue;
+
+			for (auto bi = g->bc_ixs.begin(); bi != g->bc_ixs.end(); ++bi) {
+				building_t const &b(get_building(bi->ix));
+				if (!b.has_room_geom()) continue;
+				bldgs.emplace_back(this, (g - grid_by_tile.begin()), bi->ix, p2p_dist(pos, b.bcube.closest_pt(pos)), b.interior->room_geom->last_draw_frame);
+			}
+		}
+	}
+	bool publish_room_geom(room_geom_bldg_t const &rb, building_t &src) { // src is a copy of building rb.bix with room geom generated on a worker thread
+		if (rb.gix >= grid_by_tile.size() || rb.bix >= buildings.size()) return 0; // buildings were regenerated
+		building_t &b(buildings[rb.bix]);
+		if (b.bcube != src.bcube || !b.interior) return 0; // not the same building
+		if (b.has_room_geom()) return 0; // already generated on the main thread while the job was running
+		b.take_room_geom_from(src);
+		b.interior->room_geom->last_draw_frame = frame_counter; // treat as recently used so that it's not evicted before it can be drawn
+		grid_by_tile[rb.gix].has_room_geom = 1; // so that it's freed when this tile is out of range
+		return 1;
+	}
+
 	// called once per frame
 	void update_ai_state(vector<pedestrian_t> &people, float delta_dir) { // returns the new pos of each person; dir/orient can be determined from the delta
 		if (!global_building_params.enable_people_ai || !draw_building_interiors || !animate2) return;
@@ -2065,6 +2130,7 @@ public:
 			//timer_t timer2("Draw Building Interiors");
 			float const interior_draw_dist(2.0f*(X_SCENE_SIZE + Y_SCENE_SIZE)), room_geom_draw_dist(0.4*interior_draw_dist);
 			float const room_geom_sm_draw_dist(0.05*interior_draw_dist), z_prepass_dist(0.25*interior_draw_dist);
+			if (!reflection_pass) {update_room_geom_prefetch(bcs, camera_xlated, room_geom_draw_dist, global_building_params.prefetch_room_geom);}
 			glEnable(GL_CULL_FACE); // back face culling optimization, helps with expensive lighting shaders
 			glCullFace(reflection_pass ? GL_FRONT : GL_BACK);
 
@@ -2493,6 +2559,7 @@ public:
 			gpu_mem_usage = (num_everts + num_iverts)*sizeof(vert_norm_comp_tc_color);
 			cout << "Building V: " << num_everts << ", T: " << num_etris << ", interior V: " << num_iverts << ", T: " << num_itris << ", mem: " << gpu_mem_usage << endl;
 		}
+		if (headless_mode) return; // verts are generated, but there's no GL context to upload them to
 		building_draw_vbo.upload_to_vbos();
 		building_draw_windows.upload_to_vbos();
 		building_draw_wind_lights.upload_to_vbos(); // Note: may be empty if not night time
@@ -2632,13 +2699,14 @@ public:
 		return -1;
 	}
 
-	bool check_ped_coll(point const &pos, float radius, unsigned plot_id, unsigned &building_id) const { // Note: not thread safe due to static points
+	bool check_ped_coll(point const &pos, float radius, unsigned plot_id, unsigned &building_id, vector<point> *points_buf) const { // Note: not thread safe unless points_buf is provided
 		if (empty()) return 0;
 		assert(plot_id < bix_by_plot.size());
 		vector<unsigned> const &bixes(bix_by_plot[plot_id]); // should be populated in gen()
 		if (bixes.empty()) return 0;
 		cube_t bcube; bcube.set_from_sphere(pos, radius);
-		static vector<point> points; // reused across calls
+		static vector<point> def_points; // reused across calls
+		vector<point> &points(points_buf ? *points_buf : def_points);
 
 		// Note: assumes buildings are separated so that only one ped collision can occur
 		for (auto b = bixes.begin(); b != bixes.end(); ++b) {
@@ -2709,12 +2777,246 @@ public:
 }; // building_creator_t
 
 
+struct building_tile_job_t { // one building tile generated on a worker thread; bc has no GL state until it's published on the main thread
+	int x, y, xoff_val, yoff_val; // xoff2/yoff2 at the time the job was created, since they can change while the job is running
+	bool non_city_only;
+	float dist; // xy distance from the (predicted) camera position to the tile center; the closest tiles are generated first
+	cube_t bcube; // tile bounds
+	building_params_t params; // copy of global_building_params with pos_range set to the tile bounds
+	building_creator_t bc;
+
+	building_tile_job_t(int x_, int y_, float dist_, cube_t const &bcube_) : x(x_), y(y_), xoff_val(xoff2), yoff_val(yoff2), non_city_only(have_cities()), dist(dist_), bcube(bcube_), params(global_building_params) {
+		params.set_pos_range(bcube);
+	}
+	float get_dist(point const &pos) const {return p2p_dist_xy(pos, bcube.get_cube_center());}
+	void run() {bc.gen_no_vbos(params, 0, non_city_only, 1, 0, get_building_tile_rseed(x, y), xoff_val, yoff_val);}
+	static int get_building_tile_rseed(int x, int y) {return (x + (y << 16) + 12345);} // should not be zero
+};
+
+// worker threads that run jobs in the background; used for building tiles and room geom; T must have a dist member, get_dist(pos), and run()
+template<typename T> class building_gen_pool_t {
+
+	vector<std::thread> threads;
+	vector<T *> queue, done; // queue is sorted so that the highest priority (closest) job is last
+	std::mutex mutex;
+	std::condition_variable cv;
+	unsigned num_running;
+	bool exit_threads;
+
+	struct cmp_dist_greater {
+		bool operator()(T const *a, T const *b) const {return (a->dist > b->dist);}
+	};
+	void run_worker() {
+		while (1) {
+			T *job(nullptr);
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				while (!exit_threads && queue.empty()) {cv.wait(lock);}
+				if (exit_threads) return;
+				job = queue.back();
+				queue.pop_back();
+				++num_running;
+			}
+			job->run();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				done.push_back(job);
+				assert(num_running > 0);
+				--num_running;
+			}
+			cv.notify_all(); // wake up cancel_all() if it's waiting
+		}
+	}
+public:
+	building_gen_pool_t() : num_running(0), exit_threads(0) {}
+	~building_gen_pool_t() {stop();}
+	bool is_started() const {return !threads.empty();}
+
+	void start(unsigned num_threads) {
+		assert(threads.empty() && num_threads > 0);
+		exit_threads = 0;
+		for (unsigned i = 0; i < num_threads; ++i) {threads.push_back(std::thread(&building_gen_pool_t::run_worker, this));}
+	}
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			exit_threads = 1;
+		}
+		cv.notify_all();
+		for (auto i = threads.begin(); i != threads.end(); ++i) {i->join();}
+		threads.clear();
+		for (auto i = queue.begin(); i != queue.end(); ++i) {delete *i;}
+		for (auto i = done .begin(); i != done .end(); ++i) {delete *i;}
+		queue.clear();
+		done.clear();
+	}
+	void add_job(T *job) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back(job);
+			sort(queue.begin(), queue.end(), cmp_dist_greater());
+		}
+		cv.notify_one();
+	}
+	void update_queue(point const &pos, float max_dist, vector<T *> &removed) { // update priorities and remove jobs that are now too far away
+		std::lock_guard<std::mutex> lock(mutex);
+		unsigned qpos(0);
+
+		for (auto i = queue.begin(); i != queue.end(); ++i) {
+			(*i)->dist = (*i)->get_dist(pos);
+			if ((*i)->dist > max_dist) {removed.push_back(*i); continue;}
+			queue[qpos++] = *i;
+		}
+		queue.resize(qpos);
+		sort(queue.begin(), queue.end(), cmp_dist_greater());
+	}
+	void get_finished_jobs(vector<T *> &jobs) {
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.insert(jobs.end(), done.begin(), done.end());
+		done.clear();
+	}
+	void cancel_all(vector<T *> &removed) { // removes all jobs, waiting for any that are currently running
+		std::unique_lock<std::mutex> lock(mutex);
+		removed.insert(removed.end(), queue.begin(), queue.end());
+		queue.clear();
+		while (num_running > 0) {cv.wait(lock);}
+		removed.insert(removed.end(), done.begin(), done.end());
+		done.clear();
+	}
+};
+
+
+struct room_geom_job_t { // room geom and its vertex data generated for a copy of one building on a worker thread
+	room_geom_bldg_t rb;
+	float dist; // distance from the camera to the building; the closest buildings are generated first
+	building_t building; // copy with its own interior, so that the original building can still be used while the job runs
+	vect_cube_t ped_bcubes;
+	tid_nm_pair_t wall_tex;
+
+	room_geom_job_t(room_geom_bldg_t const &rb_, building_t const &b, vect_cube_t const &ped_bcubes_) :
+		rb(rb_), dist(rb_.dist), building(b), ped_bcubes(ped_bcubes_), wall_tex(b.get_material().wall_tex)
+	{
+		building.interior = b.interior->clone_without_room_geom();
+	}
+	float get_dist(point const &pos) const {return p2p_dist(pos, building.bcube.closest_pt(pos));}
+
+	void run() {
+		building.gen_room_geom(ped_bcubes, rb.bix);
+		building.interior->room_geom->create_all_verts(wall_tex); // everything but the VBOs, which are created when the building is drawn
+	}
+};
+
+class room_geom_prefetcher_t { // generates room geom for buildings near the camera in the background and frees room geom to stay under the memory budget
+
+	building_gen_pool_t<room_geom_job_t> gen_pool;
+	vector<room_geom_job_t *> finished, removed; // finished: generated, but waiting to be published
+	set<pair<building_creator_t const *, unsigned>> pending; // {bc, bix} for jobs in gen_pool or finished
+	vector<room_geom_bldg_t> cands, bldgs; // reused temporaries
+	vect_cube_t ped_bcubes; // reused temporary
+	bool assets_loaded;
+
+	struct cmp_job_dist_less {
+		bool operator()(room_geom_job_t const *a, room_geom_job_t const *b) const {return (a->dist < b->dist);}
+	};
+	struct cmp_evict_first { // least recently drawn first, then farthest first
+		bool operator()(room_geom_bldg_t const &a, room_geom_bldg_t const &b) const {
+			if (a.last_draw_frame != b.last_draw_frame) return (a.last_draw_frame < b.last_draw_frame);
+			return (a.dist > b.dist);
+		}
+	};
+	void delete_job(room_geom_job_t *job) {
+		pending.erase(make_pair(job->rb.bc, job->rb.bix));
+		delete job;
+	}
+	void request_room_geom(room_geom_bldg_t const &rb) {
+		if (!pending.insert(make_pair(rb.bc, rb.bix)).second) return; // already pending
+		if (!assets_loaded) {preload_room_geom_assets(); assets_loaded = 1;} // must be done before starting the worker threads
+		if (!gen_pool.is_started()) {gen_pool.start(max(1U, min(2U, std::thread::hardware_concurrency()/4)));}
+		int const ped_ix(rb.bc->get_ped_ix_for_bix(rb.bix));
+		ped_bcubes.clear();
+		if (ped_ix >= 0) {get_ped_bcubes_for_building(ped_ix, rb.bix, ped_bcubes);}
+		gen_pool.add_job(new room_geom_job_t(rb, rb.bc->get_building(rb.bix), ped_bcubes));
+	}
+	// returns the memory used after freeing; buildings within prefetch_dist are never freed, since they would be prefetched again
+	uint64_t free_room_geom_over_budget(vector<building_creator_t *> const &bcs, point const &camera_bs, float prefetch_dist) {
+		uint64_t const budget(uint64_t(global_building_params.room_geom_mem_budget) << 20); // MB => bytes
+		uint64_t mem_usage(0);
+		bldgs.clear();
+		for (auto i = bcs.begin(); i != bcs.end(); ++i) {(*i)->get_room_geom_bldgs(camera_bs, bldgs);}
+		for (auto b = bldgs.begin(); b != bldgs.end(); ++b) {mem_usage += b->bc->get_building(b->bix).interior->room_geom->get_mem_usage();}
+		if (mem_usage <= budget) return mem_usage;
+		sort(bldgs.begin(), bldgs.end(), cmp_evict_first());
+
+		for (auto b = bldgs.begin(); b != bldgs.end() && mem_usage > budget; ++b) {
+			if (b->last_draw_frame + 1 >= frame_counter) break; // drawn last frame; this and everything after it is still in use
+			if (b->dist <= prefetch_dist) continue; // still wanted
+			building_t &building(b->bc->get_building(b->bix));
+			mem_usage -= building.interior->room_geom->get_mem_usage();
+			building.clear_room_geom();
+		}
+		return mem_usage;
+	}
+public:
+	room_geom_prefetcher_t() : assets_loaded(0) {}
+
+	void update(vector<building_creator_t *> const &bcs, point const &camera_bs, float room_geom_draw_dist) {
+		float const prefetch_dist(ROOM_GEOM_PREFETCH_DIST_SCALE*room_geom_draw_dist), max_dist(2.0*prefetch_dist);
+		gen_pool.get_finished_jobs(finished);
+		gen_pool.update_queue(camera_bs, max_dist, removed);
+		unsigned num_keep(0);
+
+		for (auto i = finished.begin(); i != finished.end(); ++i) { // drop jobs for buildings that are too far away or not currently drawn
+			(*i)->dist = (*i)->get_dist(camera_bs);
+			bool const bc_valid(find(bcs.begin(), bcs.end(), (*i)->rb.bc) != bcs.end()); // Note: rb.bc may point to a deleted tile, so it's only compared
+			if ((*i)->dist > max_dist || !bc_valid) {removed.push_back(*i);} else {finished[num_keep++] = *i;}
+		}
+		finished.resize(num_keep);
+		sort(finished.begin(), finished.end(), cmp_job_dist_less()); // publish the closest buildings first
+		unsigned const num_publish(min(MAX_ROOM_GEOM_PUBLISH, (unsigned)finished.size()));
+
+		for (unsigned i = 0; i < num_publish; ++i) { // VBOs are created later when the building is drawn
+			finished[i]->rb.bc->publish_room_geom(finished[i]->rb, finished[i]->building);
+			delete_job(finished[i]);
+		}
+		finished.erase(finished.begin(), finished.begin()+num_publish);
+		for (auto i = removed.begin(); i != removed.end(); ++i) {delete_job(*i);}
+		removed.clear();
+		if (free_room_geom_over_budget(bcs, camera_bs, prefetch_dist) >= (uint64_t(global_building_params.room_geom_mem_budget) << 20)) return; // no room for more
+		if (pending.size() >= MAX_ROOM_GEOM_JOBS) return; // enough work in flight
+		cands.clear();
+		for (auto i = bcs.begin(); i != bcs.end(); ++i) {(*i)->get_room_geom_cands(camera_bs, prefetch_dist, cands);}
+		sort(cands.begin(), cands.end()); // closest first
+
+		for (auto c = cands.begin(); c != cands.end() && pending.size() < MAX_ROOM_GEOM_JOBS; ++c) {request_room_geom(*c);}
+	}
+	void cancel_all() {
+		if (pending.empty()) return;
+		gen_pool.cancel_all(finished);
+		for (auto i = finished.begin(); i != finished.end(); ++i) {delete *i;}
+		finished.clear();
+		pending.clear();
+	}
+};
+
+room_geom_prefetcher_t room_geom_prefetcher;
+
+// called once per frame before drawing building interiors
+void update_room_geom_prefetch(vector<building_creator_t *> const &bcs, point const &camera_bs, float room_geom_draw_dist, bool enable) {
+	if (enable) {room_geom_prefetcher.update(bcs, camera_bs, room_geom_draw_dist);} else {room_geom_prefetcher.cancel_all();}
+}
+
+
 class building_tiles_t {
 	typedef pair<int, int> xy_pair;
 	typedef map<xy_pair, building_creator_t> tile_map_t;
 	tile_map_t tiles; // key is {x, y} pair
 	//set<xy_pair> generated; // only used in heightmap terrain mode, and generally limited to the size of the heightmap in tiles
-	vector3d max_extent;
+	set<xy_pair> pending; // tiles in gen_pool or finished that haven't been published yet; drawing and collision treat these as empty
+	building_gen_pool_t<building_tile_job_t> gen_pool;
+	vector<building_tile_job_t *> finished; // generated, but waiting to be published
+	vector3d max_extent, camera_vel;
+	point last_camera;
+	bool use_async, have_last_camera;
 
 	tile_map_t::const_iterator get_tile_by_pos(point const &pos) const { // Note: pos is in camera space
 		vector3d const xlate(get_camera_coord_space_xlate());
@@ -2722,26 +3024,57 @@ class building_tiles_t {
 		return tiles.find(make_pair(x, y));
 	}
 public:
-	building_tiles_t() : max_extent(zero_vector) {}
+	static cube_t get_tile_bcube(int x, int y, int border) {
+		cube_t bcube(all_zeros);
+		bcube.x1() = get_xval(x*MESH_X_SIZE + border);
+		bcube.y1() = get_yval(y*MESH_Y_SIZE + border);
+		bcube.x2() = get_xval((x+1)*MESH_X_SIZE - border);
+		bcube.y2() = get_yval((y+1)*MESH_Y_SIZE - border);
+		return bcube;
+	}
+	static point get_abs_camera_pos() {return (get_camera_pos() - get_camera_coord_space_xlate());} // camera pos in the same space as building tiles
+private:
+	void request_tile(int x, int y, point const &pos) { // adds a job to generate this tile in the background
+		xy_pair const loc(x, y);
+		if (tiles.find(loc) != tiles.end() || !pending.insert(loc).second) return; // already exists or already pending
+		cube_t const bcube(get_tile_bcube(x, y, 0));
+		if (!gen_pool.is_started()) {gen_pool.start(max(1U, min(4U, std::thread::hardware_concurrency()/2)));}
+		gen_pool.add_job(new building_tile_job_t(x, y, p2p_dist_xy(pos, bcube.get_cube_center()), bcube));
+	}
+	void publish_tile(building_tile_job_t &job) { // move buildings generated by a worker thread into tiles and create their VBOs
+		auto ret(tiles.emplace(make_pair(job.x, job.y), std::move(job.bc)));
+		assert(ret.second); // must not already exist
+		building_creator_t &bc(ret.first->second);
+		if (!bc.empty()) {bc.create_vbos(1);} // is_tile=1
+		max_extent = max_extent.max(bc.get_max_extent());
+	}
+	void cancel_async() {
+		if (pending.empty()) return;
+		gen_pool.cancel_all(finished);
+		for (auto i = finished.begin(); i != finished.end(); ++i) {delete *i;}
+		finished.clear();
+		pending.clear();
+	}
+	struct cmp_job_dist_less {
+		bool operator()(building_tile_job_t const *a, building_tile_job_t const *b) const {return (a->dist < b->dist);}
+	};
+public:
+	building_tiles_t() : max_extent(zero_vector), camera_vel(zero_vector), last_camera(all_zeros), use_async(0), have_last_camera(0) {}
 	bool     empty() const {return tiles.empty();}
 	unsigned size()  const {return tiles.size();}
 	vector3d get_max_extent() const {return max_extent;}
 
-	int create_tile(int x, int y, bool allow_flatten) { // return value: 0=already exists, 1=newly generaged, 2=re-generated
+	int create_tile(int x, int y, bool allow_flatten) { // return value: 0=already exists or generated asynchronously, 1=newly generaged, 2=re-generated
 		xy_pair const loc(x, y);
 		auto it(tiles.find(loc));
 		if (it != tiles.end()) return 0; // already exists
+		if (use_async && !allow_flatten) {request_tile(x, y, get_abs_camera_pos()); return 0;} // will be added to tiles in a later frame
 		//cout << "Create building tile " << x << "," << y << ", tiles: " << tiles.size() << endl; // 299 tiles
 		building_creator_t &bc(tiles[make_pair(x, y)]); // insert it
 		assert(bc.empty());
 		int const border(allow_flatten ? 1 : 0); // add a 1 pixel border around the tile to avoid creating a seam when an adjacent tile's edge height is modified
-		cube_t bcube(all_zeros);
-		bcube.x1() = get_xval(x*MESH_X_SIZE + border);
-		bcube.y1() = get_yval(y*MESH_Y_SIZE + border);
-		bcube.x2() = get_xval((x+1)*MESH_X_SIZE - border);
-		bcube.y2() = get_yval((y+1)*MESH_Y_SIZE - border);
-		global_building_params.set_pos_range(bcube);
-		int const rseed(x + (y << 16) + 12345); // should not be zero
+		global_building_params.set_pos_range(get_tile_bcube(x, y, border));
+		int const rseed(building_tile_job_t::get_building_tile_rseed(x, y));
 		bc.gen(global_building_params, 0, have_cities(), 1, allow_flatten, rseed); // if there are cities, then tiles are non-city/secondary buildings
 		global_building_params.restore_prev_pos_range();
 		max_extent = max_extent.max(bc.get_max_extent());
@@ -2750,16 +3083,75 @@ public:
 	}
 	bool remove_tile(int x, int y) {
 		auto it(tiles.find(make_pair(x, y)));
-		if (it == tiles.end()) return 0; // not found
+		if (it == tiles.end()) return 0; // not found; if pending, it will be dropped by update_async() once it's out of range
 		//cout << "Remove building tile " << x << "," << y << ", tiles: " << tiles.size() << endl;
 		it->second.clear_vbos(); // free VBOs/VAOs
 		tiles.erase(it);
 		return 1;
 	}
+	// called once per frame before create_tile(); publishes finished tiles, drops distant jobs and tiles, and prefetches tiles in the direction of camera motion
+	void update_async(bool enable) {
+		use_async = enable;
+		if (!use_async) {cancel_async(); have_last_camera = 0; return;}
+		point const camera(get_abs_camera_pos());
+		float const tile_width(2.0*X_SCENE_SIZE), draw_dist(get_draw_tile_dist()), max_dist(draw_dist + 2.0*tile_width);
+		float const dt(fticks/TICKS_PER_SECOND);
+		
+		if (have_last_camera && dt > 0.0) { // smoothed camera velocity
+			vector3d vel((camera - last_camera)/dt);
+			vel.z = 0.0;
+			camera_vel = 0.9*camera_vel + 0.1*vel;
+		}
+		last_camera      = camera;
+		have_last_camera = 1;
+		vector3d disp(camera_vel*BUILDING_TILE_PREFETCH_TIME);
+		float const disp_mag(disp.mag());
+		if (disp_mag > tile_width) {disp *= tile_width/disp_mag;} // limit to one tile, which also handles teleports
+		point const pred_camera(camera + disp);
+		vector<building_tile_job_t *> removed;
+		gen_pool.get_finished_jobs(finished);
+		gen_pool.update_queue(pred_camera, max_dist, removed);
+		unsigned num_keep(0);
+
+		for (auto i = finished.begin(); i != finished.end(); ++i) { // drop finished tiles that are no longer needed
+			(*i)->dist = (*i)->get_dist(camera);
+			if ((*i)->dist > max_dist) {removed.push_back(*i);} else {finished[num_keep++] = *i;}
+		}
+		finished.resize(num_keep);
+		sort(finished.begin(), finished.end(), cmp_job_dist_less()); // publish the closest tiles first
+		unsigned const num_publish(min(MAX_BUILDING_TILE_PUBLISH, (unsigned)finished.size()));
+
+		for (unsigned i = 0; i < num_publish; ++i) { // spread VBO creation across frames
+			pending.erase(make_pair(finished[i]->x, finished[i]->y));
+			publish_tile(*finished[i]);
+			delete finished[i];
+		}
+		finished.erase(finished.begin(), finished.begin()+num_publish);
+
+		for (auto i = removed.begin(); i != removed.end(); ++i) {
+			pending.erase(make_pair((*i)->x, (*i)->y));
+			delete *i;
+		}
+		for (auto i = tiles.begin(); i != tiles.end(); ) { // remove tiles that were prefetched but never used, which remove_tile() won't be called for (Note: no ++i)
+			if (p2p_dist_xy(camera, get_tile_bcube(i->first.first, i->first.second, 0).get_cube_center()) > max_dist) {
+				i->second.clear_vbos();
+				tiles.erase(i++);
+			} else {++i;}
+		}
+		// prefetch tiles around the predicted camera position; tiles in range of the current camera position are requested by create_tile()
+		int const tx(round_fp(0.5f*pred_camera.x/X_SCENE_SIZE)), ty(round_fp(0.5f*pred_camera.y/Y_SCENE_SIZE)), rt(int(ceil(draw_dist/tile_width)));
+
+		for (int y = ty - rt; y <= ty + rt; ++y) {
+			for (int x = tx - rt; x <= tx + rt; ++x) {
+				if (p2p_dist_xy(pred_camera, get_tile_bcube(x, y, 0).get_cube_center()) <= draw_dist) {request_tile(x, y, pred_camera);}
+			}
+		}
+	}
 	void clear_vbos() {
 		for (auto i = tiles.begin(); i != tiles.end(); ++i) {i->second.clear_vbos();}
 	}
 	void clear() {
+		cancel_async();
 		clear_vbos();
 		tiles.clear();
 	}
@@ -2842,6 +3234,10 @@ bool remove_buildings_tile(int x, int y) {
 	if (!global_building_params.gen_inf_buildings()) return 0;
 	return building_tiles.remove_tile(x, y);
 }
+void update_building_tiles_async(bool enable) { // called once per frame before create_buildings_tile()
+	if (!global_building_params.gen_inf_buildings()) return;
+	building_tiles.update_async(enable);
+}
 
 vector3d get_tt_xlate_val() {return ((world_mode == WMODE_INF_TERRAIN) ? vector3d(xoff*DX_VAL, yoff*DY_VAL, 0.0) : zero_vector);}
 
@@ -2940,7 +3336,9 @@ cube_t get_building_bcube(unsigned building_id) {return building_creator_city.ge
 cube_t get_sec_building_bcube(unsigned building_id) {return building_creator.get_building_bcube(building_id);}
 bool check_line_coll_building(point const &p1, point const &p2, unsigned building_id) {return building_creator_city.check_line_coll_building(p1, p2, building_id);}
 int get_building_bcube_contains_pos(point const &pos) {return building_creator_city.get_building_bcube_contains_pos(pos);}
-bool check_buildings_ped_coll(point const &pos, float radius, unsigned plot_id, unsigned &building_id) {return building_creator_city.check_ped_coll(pos, radius, plot_id, building_id);}
+bool check_buildings_ped_coll(point const &pos, float radius, unsigned plot_id, unsigned &building_id, vector<point> *points_buf) {
+	return building_creator_city.check_ped_coll(pos, radius, plot_id, building_id, points_buf);
+}
 bool select_building_in_plot(unsigned plot_id, unsigned rand_val, unsigned &building_id) {return building_creator_city.select_building_in_plot(plot_id, rand_val, building_id);}
 bool enable_building_people_ai() {return global_building_params.enable_people_ai;}
 
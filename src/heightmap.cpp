@@ -180,8 +180,35 @@ void tex_mod_map_manager_t::add_mod(tex_mod_vect_t const &mod) { // vector (coul
 	for (tex_mod_vect_t::const_iterator i = mod.begin(); i != mod.end(); ++i) {add_mod(*i);}
 }
 
-void tex_mod_map_manager_t::add_mod(tex_mod_map_t const &mod) { // map (could use a template function)
-	for (tex_mod_map_t::const_iterator i = mod.begin(); i != mod.end(); ++i) {add_mod(mod_elem_t(*i));}
+void tex_mod_map_manager_t::add_mod(tex_mod_map_t const &mod) {mod_map.add(mod);}
+
+
+unsigned tex_mod_map_manager_t::mod_tile_t::count_nonzero() const {
+	unsigned num(0);
+	for (auto i = deltas.begin(); i != deltas.end(); ++i) {num += (*i != 0);}
+	return num;
+}
+
+unsigned tex_mod_map_manager_t::tex_mod_map_t::size() const {
+	unsigned num(0);
+	for (const_iterator i = begin(); i != end(); ++i) {num += i->second.count_nonzero();}
+	return num;
+}
+
+void tex_mod_map_manager_t::tex_mod_map_t::add(tex_mod_map_t const &mod) { // merge tile by tile
+	for (const_iterator i = mod.begin(); i != mod.end(); ++i) {
+		mod_tile_t &tile(get_tile(i->first));
+		for (unsigned n = 0; n < MOD_TILE_AREA; ++n) {tile.deltas[n] += i->second.deltas[n];}
+		tile.dirty = 1;
+	}
+}
+
+void tex_mod_map_manager_t::tex_mod_map_t::get_dirty_tiles(vector<tex_xy_t> &dirty, bool clear_dirty) { // returns tile indices, not texel positions
+	for (tile_map_t::iterator i = tiles.begin(); i != tiles.end(); ++i) {
+		if (!i->second.dirty) continue;
+		dirty.push_back(get_tile_xy(i->first));
+		if (clear_dirty) {i->second.dirty = 0;}
+	}
 }
 
 bool tex_mod_map_manager_t::pop_last_brush(hmap_brush_t &last_brush) {
@@ -201,9 +228,13 @@ bool tex_mod_map_manager_t::undo_last_brush() {
 	return 1;
 }
 
-unsigned const header_sig  = 0xdeadbeef;
-unsigned const trailer_sig = 0xbeefdead;
+unsigned const header_sig    = 0xdeadbeef; // original format: one mod_elem_t per modified texel
+unsigned const header_sig_v2 = 0xdeadbef2; // chunked format: one record per tile
+unsigned const trailer_sig   = 0xbeefdead;
 
+// chunked format: {header_sig_v2, MOD_TILE_SZ, num_chunks, chunks..., num_brushes, brushes..., trailer_sig}
+// each chunk is {key, num}, followed by either num {offset} and num {delta}, or all MOD_TILE_AREA deltas if num == MOD_TILE_AREA;
+// chunks are independent and are merged into the map as they're read, so the file can be streamed without buffering it
 bool tex_mod_map_manager_t::read_mod(string const &fn) {
 
 	//assert(mod_map.empty()); // ???
@@ -214,18 +245,53 @@ bool tex_mod_map_manager_t::read_mod(string const &fn) {
 		cerr << "Error opening terrain height mod map " << fn << " for read" << endl;
 		return 0;
 	}
-	if (read_binary_uint(fp) != header_sig) {
+	unsigned const header(read_binary_uint(fp));
+
+	if (header == header_sig) { // original format
+		unsigned const sz(read_binary_uint(fp));
+
+		for (unsigned i = 0; i < sz; ++i) {
+			mod_elem_t elem;
+			unsigned const elem_read(fread(&elem, sizeof(mod_elem_t), 1, fp));
+			assert(elem_read == 1); // add error checking?
+			mod_map.add(elem);
+		}
+	}
+	else if (header == header_sig_v2) { // chunked format
+		if (read_binary_uint(fp) != MOD_TILE_SZ) {
+			cerr << "Error: unsupported tile size found in terrain height mod map " << fn << "." << endl;
+			checked_fclose(fp);
+			return 0;
+		}
+		unsigned const num_chunks(read_binary_uint(fp));
+		vector<unsigned short> offsets;
+		vector<hmap_val_t> deltas;
+
+		for (unsigned i = 0; i < num_chunks; ++i) {
+			unsigned const key(read_binary_uint(fp)), num(read_binary_uint(fp));
+			assert(num <= MOD_TILE_AREA); // add error checking?
+			deltas.resize(num);
+			mod_tile_t &tile(mod_map.get_tile(key));
+
+			if (num == MOD_TILE_AREA) { // dense
+				unsigned const elem_read(fread(deltas.data(), sizeof(hmap_val_t), num, fp));
+				assert(elem_read == num); // add error checking?
+				for (unsigned n = 0; n < num; ++n) {tile.deltas[n] += deltas[n];}
+			}
+			else if (num > 0) { // sparse
+				offsets.resize(num);
+				unsigned const ix_read(fread(offsets.data(), sizeof(unsigned short), num, fp)), elem_read(fread(deltas.data(), sizeof(hmap_val_t), num, fp));
+				assert(ix_read == num && elem_read == num); // add error checking?
+				for (unsigned n = 0; n < num; ++n) {tile.add(offsets[n], deltas[n]);}
+			}
+			tile.dirty = 1;
+		} // for i
+	}
+	else {
 		cerr << "Error: incorrect header found in terrain height mod map " << fn << "." << endl;
+		checked_fclose(fp);
 		return 0;
 	}
-	unsigned const sz(read_binary_uint(fp));
-
-	for (unsigned i = 0; i < sz; ++i) {
-		mod_elem_t elem;
-		unsigned const elem_read(fread(&elem, sizeof(mod_elem_t), 1, fp)); // use a larger block?
-		assert(elem_read == 1); // add error checking?
-		mod_map.add(elem);
-	}
 	unsigned const bsz(read_binary_uint(fp));
 	brush_vect.resize(bsz);
 
@@ -235,6 +301,7 @@ bool tex_mod_map_manager_t::read_mod(string const &fn) {
 	}
 	if (read_binary_uint(fp) != trailer_sig) {
 		cerr << "Error: incorrect trailer found in terrain height mod map " << fn << "." << endl;
+		checked_fclose(fp);
 		return 0;
 	}
 	checked_fclose(fp);
@@ -249,14 +316,39 @@ bool tex_mod_map_manager_t::write_mod(string const &fn) const {
 		cerr << "Error opening terrain height mod map " << fn << " for write" << endl;
 		return 0;
 	}
-	write_binary_uint(fp, header_sig);
-	write_binary_uint(fp, mod_map.size());
-
-	for (tex_mod_map_t::const_iterator i = mod_map.begin(); i != mod_map.end(); ++i) {
-		mod_elem_t const elem(*i); // could use *i directly?
-		unsigned const elem_write(fwrite(&elem, sizeof(mod_elem_t), 1, fp)); // use a larger block?
-		assert(elem_write == 1); // add error checking?
-	}
+	vector<unsigned> keys; // sorted so that the output is deterministic
+	for (tex_mod_map_t::const_iterator i = mod_map.begin(); i != mod_map.end(); ++i) {keys.push_back(i->first);}
+	sort(keys.begin(), keys.end());
+	vector<unsigned short> offsets;
+	vector<hmap_val_t> deltas;
+	write_binary_uint(fp, header_sig_v2);
+	write_binary_uint(fp, MOD_TILE_SZ);
+	write_binary_uint(fp, keys.size());
+
+	for (auto k = keys.begin(); k != keys.end(); ++k) {
+		vector<hmap_val_t> const &tdeltas(mod_map.find_tile(*k)->deltas);
+		offsets.clear();
+		deltas.clear();
+
+		for (unsigned n = 0; n < MOD_TILE_AREA; ++n) {
+			if (tdeltas[n] == 0) continue;
+			offsets.push_back(n);
+			deltas.push_back(tdeltas[n]);
+		}
+		bool const dense(deltas.size()*(sizeof(unsigned short) + sizeof(hmap_val_t)) >= MOD_TILE_AREA*sizeof(hmap_val_t)); // dense is smaller
+		unsigned const num(dense ? MOD_TILE_AREA : deltas.size());
+		write_binary_uint(fp, *k);
+		write_binary_uint(fp, num);
+
+		if (dense) {
+			unsigned const elem_write(fwrite(tdeltas.data(), sizeof(hmap_val_t), num, fp));
+			assert(elem_write == num); // add error checking?
+		}
+		else if (num > 0) {
+			unsigned const ix_write(fwrite(offsets.data(), sizeof(unsigned short), num, fp)), elem_write(fwrite(deltas.data(), sizeof(hmap_val_t), num, fp));
+			assert(ix_write == num && elem_write == num); // add error checking?
+		}
+	} // for k
 	write_binary_uint(fp, brush_vect.size());
 
 	if (!brush_vect.empty()) { // write brushes
@@ -378,11 +470,38 @@ bool terrain_hmap_manager_t::read_and_apply_mod(string const &fn) {
 	return 1;
 }
 
-void terrain_hmap_manager_t::apply_cur_mod_map() {
-	for (tex_mod_map_t::const_iterator i = mod_map.begin(); i != mod_map.end(); ++i) { // apply the mod to the current texture
-		assert(i->first.x < hmap.width && i->first.y < hmap.height); // ensure the mod values fit within the texture
-		hmap.modify_heightmap_value(i->first.x, i->first.y, i->second.val, 1); // no clamping
-	}
+void terrain_hmap_manager_t::apply_cur_mod_map() { // apply the mod to the current texture
+
+	vector<tex_mod_map_t::const_iterator> tiles; // tiles don't overlap, so they can be applied in parallel
+	tiles.reserve(mod_map.get_num_tiles());
+	for (tex_mod_map_t::const_iterator i = mod_map.begin(); i != mod_map.end(); ++i) {tiles.push_back(i);}
+
+#pragma omp parallel for schedule(dynamic,1)
+	for (int t = 0; t < (int)tiles.size(); ++t) {
+		tex_xy_t const origin(tex_mod_map_t::get_tile_origin(tiles[t]->first));
+		vector<hmap_val_t> const &deltas(tiles[t]->second.deltas);
+
+		for (unsigned y = 0, ix = 0; y < MOD_TILE_SZ; ++y) {
+			for (unsigned x = 0; x < MOD_TILE_SZ; ++x, ++ix) {
+				if (deltas[ix] == 0) continue; // unmodified texel
+				assert(origin.x + x < (unsigned)hmap.width && origin.y + y < (unsigned)hmap.height); // ensure the mod values fit within the texture
+				hmap.modify_heightmap_value(origin.x + x, origin.y + y, deltas[ix], 1); // no clamping
+			}
+		}
+	} // for t
+}
+
+bool terrain_hmap_manager_t::get_mod_tile_mesh_bounds(tex_xy_t const &tile, int &x1, int &y1, int &x2, int &y2) const { // inverse of clamp_xy() without wrapping
+
+	int const tx1(tile.x << MOD_TILE_BITS), ty1(tile.y << MOD_TILE_BITS);
+	if (tx1 >= hmap.width || ty1 >= hmap.height) return 0; // off the texture
+	int const tx2(min(hmap.width, int(tx1 + MOD_TILE_SZ)) - 1), ty2(min(hmap.height, int(ty1 + MOD_TILE_SZ)) - 1);
+	float const scale_inv(1.0/mesh_scale);
+	x1 = floor((tx1 - hmap.width /2)*scale_inv);
+	y1 = floor((ty1 - hmap.height/2)*scale_inv);
+	x2 = ceil ((tx2 - hmap.width /2)*scale_inv);
+	y2 = ceil ((ty2 - hmap.height/2)*scale_inv);
+	return 1;
 }
 
 void terrain_hmap_manager_t::apply_cur_brushes() { // apply the brushes to the current texture
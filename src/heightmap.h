@@ -4,6 +4,7 @@
 #pragma once
 
 #include "3DWorld.h"
+#include <unordered_map>
 
 float const HMAP_DETAIL_SCALE = 16.0;
 float const HMAP_DETAIL_MAG   = 0.01;
@@ -46,21 +47,48 @@ public:
 		bool operator< (tex_xy_t const &t) const {return ((x == t.x) ? (y < t.y) : (x < t.x));}
 	};
 
-	struct mod_map_val_t {
-		hmap_val_t val;
-		mod_map_val_t(hmap_val_t v=0) : val(v) {} // init to zero
-	};
-
 	struct mod_elem_t : public tex_xy_t {
 		hmap_val_t delta;
 		mod_elem_t() : delta(0) {}
 		mod_elem_t(tex_ix_t x_, tex_ix_t y_, hmap_val_t d) : tex_xy_t(x_, y_), delta(d) {}
-		mod_elem_t(pair<tex_xy_t, mod_map_val_t> const &v) : tex_xy_t(v.first), delta(v.second.val) {}
 	};
 
-	struct tex_mod_map_t : public map<tex_xy_t, mod_map_val_t> { // for uniquing/combining modifications to the same xy point
+	static unsigned const MOD_TILE_BITS = 6;
+	static unsigned const MOD_TILE_SZ   = (1 << MOD_TILE_BITS); // 64x64 texels per tile
+	static unsigned const MOD_TILE_MASK = (MOD_TILE_SZ - 1);
+	static unsigned const MOD_TILE_AREA = (MOD_TILE_SZ*MOD_TILE_SZ);
+
+	struct mod_tile_t {
+		vector<hmap_val_t> deltas; // MOD_TILE_AREA row-major values, accumulated over all mods
+		bool dirty; // modified since the last call to get_dirty_tiles()
+
+		mod_tile_t() : deltas(MOD_TILE_AREA, 0), dirty(1) {}
+		void add(unsigned ix, hmap_val_t delta) {assert(ix < MOD_TILE_AREA); deltas[ix] += delta; dirty = 1;}
+		unsigned count_nonzero() const;
+	};
+
+	class tex_mod_map_t { // sparse hash map of tiles, for uniquing/combining modifications to the same xy point
+		typedef std::unordered_map<unsigned, mod_tile_t> tile_map_t; // key is {ty, tx} packed into 32 bits
+		tile_map_t tiles;
+
+		static unsigned get_key(unsigned tx, unsigned ty) {return ((ty << 16) | tx);}
+	public:
+		typedef tile_map_t::const_iterator const_iterator;
+		static tex_xy_t get_tile_xy(unsigned key) {return tex_xy_t((key & 0xFFFF), (key >> 16));}
+		static tex_xy_t get_tile_origin(unsigned key) {tex_xy_t const t(get_tile_xy(key)); return tex_xy_t((t.x << MOD_TILE_BITS), (t.y << MOD_TILE_BITS));}
+
+		bool empty() const {return tiles.empty();}
+		void clear() {tiles.clear();}
+		unsigned get_num_tiles() const {return tiles.size();}
+		unsigned size() const; // number of nonzero deltas
+		const_iterator begin() const {return tiles.begin();}
+		const_iterator end  () const {return tiles.end  ();}
+		mod_tile_t &get_tile(unsigned key) {return tiles[key];}
+		mod_tile_t const *find_tile(unsigned key) const {const_iterator it(tiles.find(key)); return ((it == tiles.end()) ? nullptr : &it->second);}
 		// Note: this isn't entirely correct due to the clamping in the height texture update
-		void add(mod_elem_t const &elem) {operator[](elem).val += elem.delta;}
+		void add(mod_elem_t const &elem) {get_tile(get_key((elem.x >> MOD_TILE_BITS), (elem.y >> MOD_TILE_BITS))).add((((elem.y & MOD_TILE_MASK) << MOD_TILE_BITS) + (elem.x & MOD_TILE_MASK)), elem.delta);}
+		void add(tex_mod_map_t const &mod);
+		void get_dirty_tiles(vector<tex_xy_t> &dirty, bool clear_dirty);
 	};
 
 	struct hmap_brush_t {
@@ -97,6 +125,7 @@ public:
 	bool undo_last_brush(); // unused
 	bool read_mod(std::string const &fn);
 	bool write_mod(std::string const &fn) const;
+	void get_dirty_mod_tiles(vector<tex_xy_t> &dirty, bool clear_dirty=1) {mod_map.get_dirty_tiles(dirty, clear_dirty);}
 
 	virtual bool modify_height_value(int x, int y, hmap_val_t val, bool is_delta, float fract_x=0.0, float fract_y=0.0, bool allow_wrap=1) = 0;
 	virtual ~tex_mod_map_manager_t() {}
@@ -130,6 +159,7 @@ public:
 	hmap_val_t scale_delta(float delta) const;
 	bool read_and_apply_mod(std::string const &fn);
 	void apply_cur_mod_map();
+	bool get_mod_tile_mesh_bounds(tex_xy_t const &tile, int &x1, int &y1, int &x2, int &y2) const;
 	void apply_cur_brushes();
 	bool enabled() const {return hmap.is_allocated();}
 	~terrain_hmap_manager_t() {hmap.free_data();}
@@ -3,10 +3,17 @@
 // 10/14/13
 #include "targa.h"
 #include "textures.h"
+#include "gl_ext_arb.h"
+#include "function_registry.h"
+#include "binary_file_io.h"
 #include <fstream> // for filebuf
 
 using namespace std;
 
+extern bool cpu_texture_compress;
+
+unsigned const TEX_CACHE_MAGIC = 0x43543344; // "D3TC"
+
 #ifdef ENABLE_JPEG
 #define INT32 prev_INT32 // fix conflicting typedef used in freeglut
 #include "jpeglib.h"
@@ -705,6 +712,135 @@ void texture_t::load_dds(int index) {
 }
 
 
+#ifdef ENABLE_DDS
+void upload_gli_texture(gli::texture2d const &Texture, unsigned tid) {
+
+	bool const compressed(gli::is_compressed(Texture.format()));
+	gli::gl GL(gli::gl::PROFILE_GL33);
+	gli::gl::format const Format(GL.translate(Texture.format(), Texture.swizzles()));
+	glBindTexture(GL_TEXTURE_2D, tid);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(Texture.levels() - 1));
+	glTexStorage2D(GL_TEXTURE_2D, Texture.levels(), Format.Internal, Texture.extent().x, Texture.extent().y);
+
+	for (gli::texture2d::size_type Level = 0; Level < Texture.levels(); ++Level) {
+		if (compressed) {
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, Level, 0, 0, Texture[Level].extent().x, Texture[Level].extent().y,
+				Format.Internal, Texture[Level].size(), Texture[Level].data());
+		}
+		else {
+			glTexSubImage2D(GL_TEXTURE_2D, Level, 0, 0, Texture[Level].extent().x, Texture[Level].extent().y,
+				Format.External, Format.Type, Texture[Level].data());
+		}
+	} 
+}
+
+gli::format get_bcn_gli_format(unsigned ncolors) {
+	gli::format const formats[4] = {gli::FORMAT_R_ATI1N_UNORM_BLOCK8, gli::FORMAT_RG_ATI2N_UNORM_BLOCK16, gli::FORMAT_RGB_DXT1_UNORM_BLOCK8, gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16};
+	assert(ncolors >= 1 && ncolors <= 4);
+	return formats[ncolors-1];
+}
+#endif
+
+// compresses the texture and its mipmaps to BCn on the CPU and uploads them to the bound texture, then writes them to the texture cache;
+// returns 0 if this texture isn't using a compressed format, in which case the caller should upload the uncompressed data instead
+bool texture_t::upload_cpu_compressed() {
+
+#ifdef ENABLE_DDS
+	if (!cpu_texture_compress || is_16_bit_gray || !is_allocated()) return 0;
+	if (calc_internal_format() == get_internal_texture_format(ncolors, 0, 0)) return 0; // not a compressed format
+	gli::extent2d const extent(width, height);
+	unsigned const num_levels(use_mipmaps ? gli::levels(extent) : 1);
+	gli::texture2d texture(get_bcn_gli_format(ncolors), extent, num_levels);
+	vector<unsigned char> idata, odata;
+	unsigned char const *level_data(data); // level 0 is compressed directly from the image data
+	color_wrapper cw; cw.set_c4(color);
+
+	for (unsigned level = 0, w = width, h = height; level < num_levels; ++level) {
+		if (level > 0) {
+			calc_next_mipmap_level(level_data, odata, w, h, cw);
+			idata.swap(odata);
+			level_data = &idata.front();
+			w = max(w>>1, 1U); h = max(h>>1, 1U);
+		}
+		assert(texture[level].size() == get_bcn_compressed_size(w, h, ncolors));
+		compress_bcn_image(level_data, w, h, ncolors, (unsigned char *)texture[level].data());
+	}
+	upload_gli_texture(texture, tid);
+
+	if (!cpu_cache_fn.empty()) { // set by try_load_cpu_compressed_cache() before the image was decoded
+		vector<char> dds_data;
+		binary_file_writer writer;
+		int const vals[4] = {width, height, ncolors, use_mipmaps};
+
+		if (!gli::save_dds(texture, dds_data) || !writer.open(cpu_cache_fn) || !writer.write_val(TEX_CACHE_MAGIC) || !writer.write(vals, sizeof(int), 4) ||
+			!writer.write_val(has_binary_alpha) || !writer.write_val(normal_map) || !writer.write_val(color) || !writer.write_vector(dds_data))
+		{
+			cerr << "Error writing texture cache file " << cpu_cache_fn << endl;
+		}
+	}
+	return 1;
+#else
+	return 0; // gli is required for the DDS cache and format translation
+#endif
+}
+
+// reads the values that are normally computed from the decoded image; returns 0 and leaves the texture unmodified if the header is invalid
+template<typename R> bool texture_t::read_cpu_cache_header(R &reader) {
+
+	unsigned magic(0);
+	int vals[4] = {0};
+	bool hba(0), nm(0);
+	colorRGBA c;
+	if (!reader.read_val(magic) || !reader.read(vals, sizeof(int), 4) || !reader.read_val(hba) || !reader.read_val(nm) || !reader.read_val(c)) return 0;
+	if (magic != TEX_CACHE_MAGIC || vals[0] <= 0 || vals[1] <= 0 || vals[2] < 1 || vals[2] > 4) return 0;
+	width  = vals[0]; height = vals[1]; ncolors = vals[2]; use_mipmaps = vals[3];
+	has_binary_alpha = hba; normal_map = nm; color = c;
+	return 1;
+}
+
+// called in place of load() and init(); if this texture was compressed on the CPU in a previous run, sets it up to upload the compressed
+// mipmap chain from the texture cache in deferred_load_and_bind() without decoding the source image; also sets cpu_cache_fn for writing
+bool texture_t::try_load_cpu_compressed_cache(texture_t const *const alpha_src, bool alpha_in_red_comp, bool is_bump) {
+
+#ifdef ENABLE_DDS
+	cpu_cache_fn = get_cpu_compressed_cache_fn(alpha_src, alpha_in_red_comp, is_bump);
+	if (cpu_cache_fn.empty()) return 0;
+	binary_file_reader reader;
+	if (!reader.open(cpu_cache_fn, 1)) return 0; // quiet=1: not yet cached, or this texture isn't compressed
+
+	if (!read_cpu_cache_header(reader)) {
+		cerr << "Error reading texture cache file " << cpu_cache_fn << "; ignoring it" << endl;
+		return 0;
+	}
+	defer_load_type = DEFER_TYPE_CPU_CACHE;
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+// uploads the compressed mipmap chain directly from the mapped texture cache file
+bool texture_t::upload_cpu_compressed_cache() {
+
+#ifdef ENABLE_DDS
+	mapped_file_t file;
+	if (!file.open(cpu_cache_fn)) return 0;
+	binary_mem_reader reader(file.data(), file.size());
+	size_t dds_size(0);
+	if (!read_cpu_cache_header(reader) || !reader.read_val(dds_size)) return 0;
+	char const *const dds_data((char const *)reader.skip(dds_size));
+	if (dds_data == nullptr) return 0; // truncated
+	gli::texture2d const texture(gli::load_dds(dds_data, dds_size));
+	if (texture.empty() || texture.format() != get_bcn_gli_format(ncolors) || texture.extent() != gli::extent2d(width, height)) return 0;
+	upload_gli_texture(texture, tid);
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+
 void texture_t::deferred_load_and_bind() {
 
 	defer_load();
@@ -723,25 +859,17 @@ void texture_t::deferred_load_and_bind() {
 			height  = Texture.extent().y;
 			ncolors = component_count(Texture.format());
 			assert(width > 0 && height > 0);
-			gli::gl GL(gli::gl::PROFILE_GL33);
-			gli::gl::format const Format(GL.translate(Texture.format(), Texture.swizzles()));
-			glBindTexture(GL_TEXTURE_2D, tid);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(Texture.levels() - 1));
-			glTexStorage2D(GL_TEXTURE_2D, Texture.levels(), Format.Internal, width, height);
-
-			for (gli::texture2d::size_type Level = 0; Level < Texture.levels(); ++Level) {
-				if (compressed) {
-					glCompressedTexSubImage2D(GL_TEXTURE_2D, Level, 0, 0, Texture[Level].extent().x, Texture[Level].extent().y,
-						Format.Internal, Texture[Level].size(), Texture[Level].data());
-				}
-				else {
-					glTexSubImage2D(GL_TEXTURE_2D, Level, 0, 0, Texture[Level].extent().x, Texture[Level].extent().y,
-						Format.External, Format.Type, Texture[Level].data());
-				}
-			} 
+			upload_gli_texture(Texture, tid);
 		}
 		break;
+	case DEFER_TYPE_CPU_CACHE:
+		if (upload_cpu_compressed_cache()) break;
+		cerr << "Error reading texture cache file " << cpu_cache_fn << "; loading " << name << " instead" << endl;
+		cpu_cache_fn.clear(); // don't overwrite it with a texture that may be missing its alpha channel or normal map conversion
+		defer_load_type = DEFER_TYPE_NONE; // caller will upload the decoded image
+		load(-1);
+		init();
+		break;
 	default:
 		cerr << "Unhandled texture defer type " << defer_load_type << endl;
 		exit(1);
@@ -105,12 +105,12 @@ bool r_profile::add_rect(float const d[3][2], unsigned d0, unsigned d1, float al
 	for (unsigned i = 0; i < nrects; ++i) { // check if contained in any rect
 		if (rects[i].contains(r.d)) return 1; // minor performance improvement
 	}
+	assert(pend.empty());
 	pend.push_back(r);
 
-	while (!pend.empty()) { // merge new rect into working set while removing overlaps
+	for (unsigned p = 0; p < pend.size(); ++p) { // merge new rect into working set while removing overlaps; split rects are appended to pend
 		bool bad_rect(0);
-		rect rr(pend.front());
-		pend.pop_front();
+		rect const rr(pend[p]); // copy, since pend may be reallocated
 
 		for (unsigned i = 0; i < nrects; ++i) { // could start i at the value of i where rr was inserted into pend
 			if (rects[i].overlaps(rr.d)) { // split rr
@@ -121,6 +121,7 @@ bool r_profile::add_rect(float const d[3][2], unsigned d0, unsigned d1, float al
 		}
 		if (!bad_rect) add_rect_int(rr);
 	}
+	pend.clear(); // keeps capacity
 	if (rects.size() > nrects) avg_alpha = 1.0; // at least one rect was added, *** FIX ***
 	return 1;
 }
@@ -163,8 +164,8 @@ void r_profile::clear_within(float const c[2]) {
 		removed = 1;
 		--i; // wraparound OK
 	}
-	copy(pend.begin(), pend.end(), back_inserter(rects));
-	pend.resize(0);
+	rects.insert(rects.end(), pend.begin(), pend.end());
+	pend.clear();
 	if (removed) filled = 0;
 	//avg_alpha = 1.0; // FIXME: recalculate?
 }
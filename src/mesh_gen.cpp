@@ -10,6 +10,18 @@
 #include "shaders.h"
 #include "gl_ext_arb.h"
 #include <glm/gtc/noise.hpp>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define USE_AVX2_NOISE // runtime selected based on CPU support
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
 
 
 int      const NUM_FREQ_COMP      = 9;
@@ -27,6 +39,7 @@ bool     const DEF_GLACIATE       = 1;
 float    const DEF_GLACIATE_EXP   = 3.0;
 bool     const GEN_SCROLLING_MESH = 1;
 float    const S_GEN_ATTEN_DIST   = 128.0;
+unsigned const NOISE_BATCH_SZ     = 64; // max number of points per batched noise call
 
 int   const F_TABLE_SIZE = NUM_FREQ_COMP*N_RAND_SIN2;
 
@@ -198,9 +211,7 @@ void gen_mesh_sine_table(float **matrix, int x_offset, int y_offset, int xsize,
 	mesh_xy_grid_cache_t height_gen;
 	height_gen.build_arrays((x_offset - xsize/2)*DX_VAL, (y_offset - ysize/2)*DY_VAL, DX_VAL, DY_VAL, xsize, ysize);
 
-	for (int i = 0; i < ysize; ++i) {
-		for (int j = 0; j < xsize; ++j) {matrix[i][j] = height_gen.eval_index(j, i);}
-	}
+	for (int i = 0; i < ysize; ++i) {height_gen.eval_row(i, matrix[i]);}
 }
 
 
@@ -464,9 +475,13 @@ void estimate_zminmax(bool using_eq) {
 		height_gen.build_arrays(0.0, 0.0, rm_scale, rm_scale, EST_RAND_PARAM, EST_RAND_PARAM);
 		height_histogram.reserve(EST_RAND_PARAM*EST_RAND_PARAM/16); // 1024 values
 
+		float heights[EST_RAND_PARAM];
+
 		for (unsigned i = 0; i < EST_RAND_PARAM; ++i) {
+			height_gen.eval_row(i, heights);
+
 			for (unsigned j = 0; j < EST_RAND_PARAM; ++j) {
-				float const height(height_gen.eval_index(j, i)); // no glaciate
+				float const height(heights[j]); // no glaciate
 				zmax_est = max(zmax_est, float(fabs(height)));
 				if (!(i&3) && !(j&3)) {height_histogram.push_back(height);} // only 1/16 of the values
 			}
@@ -624,9 +639,7 @@ bool mesh_xy_grid_cache_t::build_arrays(float x0, float y0, float dx, float dy,
 		
 #pragma omp parallel for schedule(static,1)
 		for (int y = 0; y < (int)cur_ny; ++y) {
-			for (unsigned x = 0; x < cur_nx; ++x) {
-				cached_vals[y*cur_nx + x] = eval_index(x, y, 0, 0); // Note: no glaciate, min_start_sin=0, use_cache=0
-			}
+			eval_row(y, &cached_vals[y*cur_nx], 0, 0); // Note: no glaciate, min_start_sin=0, use_cache=0
 		}
 	}
 	return 1; // results are available
@@ -746,6 +759,181 @@ float get_noise_zval(float xval, float yval, int mode, int shape) {
 	return zval*get_hmap_scale(mode);
 }
 
+// *** batched CPU noise ***
+
+bool cpu_supports_avx2() {
+#ifdef USE_AVX2_NOISE
+#ifdef _MSC_VER
+	int regs[4] = {0};
+	__cpuid(regs, 1);
+	if (!(regs[2] & (1 << 27)) || (_xgetbv(0) & 6) != 6) return 0; // OS must support XSAVE and save YMM registers
+	__cpuidex(regs, 7, 0);
+	return ((regs[1] & (1 << 5)) != 0);
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+#else
+	return 0;
+#endif
+}
+
+bool have_avx2() {
+	static bool const supported(cpu_supports_avx2()); // checked once
+	return supported;
+}
+
+#ifdef USE_AVX2_NOISE
+// 8-wide version of glm::simplex(vec2), with operations in the same order so that results match the scalar version
+AVX2_TARGET void simplex_noise_avx2(float const *xs, float const *ys, float *out, unsigned n) {
+
+	__m256 const C0(_mm256_set1_ps(0.211324865405187f)), C1(_mm256_set1_ps(0.366025403784439f)), C2(_mm256_set1_ps(-0.577350269189626f)), C3(_mm256_set1_ps(0.024390243902439f));
+	__m256 const zero(_mm256_setzero_ps()), one(_mm256_set1_ps(1.0f)), two(_mm256_set1_ps(2.0f)), half(_mm256_set1_ps(0.5f));
+	__m256 const v289(_mm256_set1_ps(289.0f)), inv289(_mm256_set1_ps(1.0f/289.0f)), v34(_mm256_set1_ps(34.0f)), v130(_mm256_set1_ps(130.0f));
+	__m256 const tis0(_mm256_set1_ps(1.79284291400159f)), tis1(_mm256_set1_ps(0.85373472095314f)), abs_mask(_mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF)));
+	unsigned const nv(n & ~7U);
+
+	for (unsigned i = 0; i < nv; i += 8) {
+		__m256 const vx(_mm256_loadu_ps(xs + i)), vy(_mm256_loadu_ps(ys + i));
+		// first corner
+		__m256 const s(_mm256_add_ps(_mm256_mul_ps(vx, C1), _mm256_mul_ps(vy, C1)));
+		__m256 ix(_mm256_floor_ps(_mm256_add_ps(vx, s))), iy(_mm256_floor_ps(_mm256_add_ps(vy, s)));
+		__m256 const t(_mm256_add_ps(_mm256_mul_ps(ix, C0), _mm256_mul_ps(iy, C0)));
+		__m256 const x0x(_mm256_add_ps(_mm256_sub_ps(vx, ix), t)), x0y(_mm256_add_ps(_mm256_sub_ps(vy, iy), t));
+		// other corners
+		__m256 const i1x(_mm256_and_ps(_mm256_cmp_ps(x0x, x0y, _CMP_GT_OQ), one)), i1y(_mm256_sub_ps(one, i1x));
+		__m256 const x12x(_mm256_sub_ps(_mm256_add_ps(x0x, C0), i1x)), x12y(_mm256_sub_ps(_mm256_add_ps(x0y, C0), i1y));
+		__m256 const x12z(_mm256_add_ps(x0x, C2)), x12w(_mm256_add_ps(x0y, C2));
+		// permutations
+		ix = _mm256_sub_ps(ix, _mm256_mul_ps(v289, _mm256_floor_ps(_mm256_div_ps(ix, v289))));
+		iy = _mm256_sub_ps(iy, _mm256_mul_ps(v289, _mm256_floor_ps(_mm256_div_ps(iy, v289))));
+		__m256 const pin[3] = {iy, _mm256_add_ps(iy, i1y), _mm256_add_ps(iy, one)}, xoff[3] = {zero, i1x, one};
+		__m256 const xc[3] = {x0x, x12x, x12z}, yc[3] = {x0y, x12y, x12w};
+		__m256 sum(zero);
+
+		for (unsigned k = 0; k < 3; ++k) {
+			__m256 p(pin[k]);
+			p = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(p, v34), one), p); // permute
+			p = _mm256_sub_ps(p, _mm256_mul_ps(_mm256_floor_ps(_mm256_mul_ps(p, inv289)), v289));
+			p = _mm256_add_ps(_mm256_add_ps(p, ix), xoff[k]);
+			p = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(p, v34), one), p); // permute
+			p = _mm256_sub_ps(p, _mm256_mul_ps(_mm256_floor_ps(_mm256_mul_ps(p, inv289)), v289));
+			__m256 m(_mm256_max_ps(_mm256_sub_ps(half, _mm256_add_ps(_mm256_mul_ps(xc[k], xc[k]), _mm256_mul_ps(yc[k], yc[k]))), zero));
+			m = _mm256_mul_ps(m, m);
+			m = _mm256_mul_ps(m, m);
+			// gradients
+			__m256 const pc(_mm256_mul_ps(p, C3));
+			__m256 const x(_mm256_sub_ps(_mm256_mul_ps(two, _mm256_sub_ps(pc, _mm256_floor_ps(pc))), one));
+			__m256 const h(_mm256_sub_ps(_mm256_and_ps(x, abs_mask), half));
+			__m256 const a0(_mm256_sub_ps(x, _mm256_floor_ps(_mm256_add_ps(x, half))));
+			m = _mm256_mul_ps(m, _mm256_sub_ps(tis0, _mm256_mul_ps(tis1, _mm256_add_ps(_mm256_mul_ps(a0, a0), _mm256_mul_ps(h, h)))));
+			__m256 const g(_mm256_add_ps(_mm256_mul_ps(a0, xc[k]), _mm256_mul_ps(h, yc[k])));
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(m, g));
+		} // for k
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(v130, sum));
+	} // for i
+	for (unsigned i = nv; i < n; ++i) {out[i] = glm::simplex(glm::vec2(xs[i], ys[i]));} // remainder
+}
+#endif
+
+// same as gen_noise(), but for n <= NOISE_BATCH_SZ points at once
+void gen_noise_batch(float const *xv, float const *yv, float *zv, unsigned n, int mode, int shape, bool use_simd) {
+
+	assert(n <= NOISE_BATCH_SZ);
+	float mag(1.0), freq(1.0), rx, ry;
+	float px[NOISE_BATCH_SZ], py[NOISE_BATCH_SZ], noise[NOISE_BATCH_SZ];
+	unsigned const end_octave(NUM_FREQ_COMP - start_eval_sin/N_RAND_SIN2);
+	float const lacunarity(1.92), gain(0.5);
+	bool const is_simplex(mode == MGEN_SIMPLEX || mode == MGEN_SIMPLEX_GPU || mode == MGEN_DWARP_GPU);
+	gen_rx_ry(rx, ry); // once per batch rather than once per point
+	for (unsigned i = 0; i < n; ++i) {zv[i] = 0.0;}
+
+	for (unsigned o = 0; o < end_octave; ++o) {
+		for (unsigned i = 0; i < n; ++i) {px[i] = freq*xv[i] + rx; py[i] = freq*yv[i] + ry;}
+#ifdef USE_AVX2_NOISE
+		if (use_simd && is_simplex && have_avx2()) {simplex_noise_avx2(px, py, noise, n);} else
+#endif
+		if (is_simplex) {for (unsigned i = 0; i < n; ++i) {noise[i] = glm::simplex(glm::vec2(px[i], py[i]));}}
+		else            {for (unsigned i = 0; i < n; ++i) {noise[i] = glm::perlin (glm::vec2(px[i], py[i]));}}
+
+		for (unsigned i = 0; i < n; ++i) {
+			float val(noise[i]);
+			switch (shape) {
+			case 0: break; // linear - do nothing
+			case 1: val = fabs(val) - 0.40; break; // billowy
+			case 2: val = 0.45 - fabs(val); break; // ridged
+			}
+			zv[i] += mag*val;
+		}
+		mag  *= gain;
+		freq *= lacunarity;
+		rx   *= 1.5;
+		ry   *= 1.5;
+	} // for o
+}
+
+// same as get_noise_zval() for n points
+void get_noise_zval_batch(float const *xval, float const *yval, float *zval, unsigned n, int mode, int shape, bool use_simd) {
+
+	assert(mode != MGEN_SINE); // mode 0 not supported by this function
+	float const xy_scale(MESH_SCALE_FACTOR*mesh_scale), hmap_scale(get_hmap_scale(mode));
+	float xv[NOISE_BATCH_SZ], yv[NOISE_BATCH_SZ];
+
+	for (unsigned s = 0; s < n; s += NOISE_BATCH_SZ) {
+		unsigned const num(min(NOISE_BATCH_SZ, n-s));
+		for (unsigned i = 0; i < num; ++i) {xv[i] = xy_scale*xval[s+i]; yv[i] = xy_scale*yval[s+i];}
+
+		if (mode == MGEN_DWARP_GPU) { // domain warping
+			float const scale(0.2);
+			float dx1[NOISE_BATCH_SZ], dy1[NOISE_BATCH_SZ], dx2[NOISE_BATCH_SZ], dy2[NOISE_BATCH_SZ], tx[NOISE_BATCH_SZ], ty[NOISE_BATCH_SZ];
+			for (unsigned i = 0; i < num; ++i) {tx[i] = xv[i] + 0.0; ty[i] = yv[i] + 0.0;}
+			gen_noise_batch(tx, ty, dx1, num, mode, shape, use_simd);
+			for (unsigned i = 0; i < num; ++i) {tx[i] = xv[i] + 5.2; ty[i] = yv[i] + 1.3;}
+			gen_noise_batch(tx, ty, dy1, num, mode, shape, use_simd);
+			for (unsigned i = 0; i < num; ++i) {tx[i] = (xv[i] + scale*dx1[i] + 1.7); ty[i] = (yv[i] + scale*dy1[i] + 9.2);}
+			gen_noise_batch(tx, ty, dx2, num, mode, shape, use_simd);
+			for (unsigned i = 0; i < num; ++i) {tx[i] = (xv[i] + scale*dx1[i] + 8.3); ty[i] = (yv[i] + scale*dy1[i] + 2.8);}
+			gen_noise_batch(tx, ty, dy2, num, mode, shape, use_simd);
+			for (unsigned i = 0; i < num; ++i) {xv[i] += scale*dx2[i]; yv[i] += scale*dy2[i];}
+		}
+		gen_noise_batch(xv, yv, zval+s, num, mode, shape, use_simd);
+
+		for (unsigned i = 0; i < num; ++i) {
+			postproc_noise_zval(zval[s+i]);
+			zval[s+i] *= hmap_scale;
+		}
+	} // for s
+}
+
+// compares the scalar noise path to the batched path with and without SIMD
+void run_cpu_noise_benchmark() {
+
+	unsigned const grid_sz(256), num_samples(grid_sz*grid_sz);
+	int const mode(MGEN_SIMPLEX);
+	vector<float> xvals(num_samples), yvals(num_samples), zvals[3];
+
+	for (unsigned y = 0; y < grid_sz; ++y) {
+		for (unsigned x = 0; x < grid_sz; ++x) {xvals[y*grid_sz + x] = 0.37*x; yvals[y*grid_sz + x] = 0.37*y;}
+	}
+	cout << "CPU noise benchmark: " << num_samples << " samples, shape " << mesh_gen_shape << ", AVX2 " << (have_avx2() ? "enabled" : "not available") << endl;
+
+	for (unsigned m = 0; m < 3; ++m) { // scalar, batch, batch+SIMD
+		if (m == 2 && !have_avx2()) break;
+		zvals[m].resize(num_samples);
+		auto const start_time(std::chrono::high_resolution_clock::now());
+
+		if (m == 0) {
+			for (unsigned i = 0; i < num_samples; ++i) {zvals[m][i] = get_noise_zval(xvals[i], yvals[i], mode, mesh_gen_shape);}
+		}
+		else {get_noise_zval_batch(&xvals.front(), &yvals.front(), &zvals[m].front(), num_samples, mode, mesh_gen_shape, (m == 2));}
+		double const secs(std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count());
+		float max_diff(0.0);
+		for (unsigned i = 0; i < num_samples; ++i) {max_diff = max(max_diff, fabs(zvals[m][i] - zvals[0][i]));}
+		cout << ((m == 0) ? "Scalar     " : ((m == 1) ? "Batch      " : "Batch AVX2 ")) << ": " << 1000.0*secs << " ms, "
+			 << num_samples/max(secs, 1.0E-6)/1.0E6 << "M samples/sec, max diff " << max_diff << endl;
+	}
+}
+
+
 
 float mesh_xy_grid_cache_t::eval_index(unsigned x, unsigned y, int min_start_sin, bool use_cache) const {
 
@@ -775,16 +963,75 @@ float mesh_xy_grid_cache_t::eval_index(unsigned x, unsigned y, int min_start_sin
 		}
 		apply_noise_shape_final(zval, gen_shape);
 	}
-	if (do_glaciate) {
-		apply_glaciate(zval);
+	if (do_glaciate) {apply_glaciate_terms(zval, x, y);}
+	return zval;
+}
+
+void mesh_xy_grid_cache_t::apply_glaciate_terms(float &zval, unsigned x, unsigned y) const {
+
+	apply_glaciate(zval);
 		
-		if (hmap_params.sine_mag > 0.0) {
-			assert(cur_nx + y < sine_mag_terms.size());
-			zval += sine_mag_terms[x]*sine_mag_terms[cur_nx + y] + sine_offset;
-			if (hmap_params.volcano_width > 0.0 && hmap_params.volcano_height > 0.0) {zval += get_volcano_height((x*mdx + mx0)*DX_VAL_INV, (y*mdy + my0)*DY_VAL_INV);}
+	if (hmap_params.sine_mag > 0.0) {
+		assert(cur_nx + y < sine_mag_terms.size());
+		zval += sine_mag_terms[x]*sine_mag_terms[cur_nx + y] + sine_offset;
+		if (hmap_params.volcano_width > 0.0 && hmap_params.volcano_height > 0.0) {zval += get_volcano_height((x*mdx + mx0)*DX_VAL_INV, (y*mdy + my0)*DY_VAL_INV);}
+	}
+}
+
+#ifdef USE_AVX2_NOISE
+// sums xterms[x*F_TABLE_SIZE+k]*yterms[k] for k in [start_ix, F_TABLE_SIZE) for 8 x values at a time;
+// each lane adds the terms in the same order as eval_index(), so results match the scalar version
+AVX2_TARGET void sum_sine_terms_avx2(float const *xterms, float const *yterms, float *out, unsigned nx, int start_ix) {
+
+	__m256i const offsets(_mm256_setr_epi32(0, F_TABLE_SIZE, 2*F_TABLE_SIZE, 3*F_TABLE_SIZE, 4*F_TABLE_SIZE, 5*F_TABLE_SIZE, 6*F_TABLE_SIZE, 7*F_TABLE_SIZE));
+	unsigned const nv(nx & ~7U);
+
+	for (unsigned x = 0; x < nv; x += 8) {
+		float const *const xptr(xterms + x*F_TABLE_SIZE);
+		__m256 sum(_mm256_setzero_ps());
+
+		for (int k = start_ix; k < F_TABLE_SIZE; ++k) {
+			__m256 const xv(_mm256_i32gather_ps(xptr + k, offsets, 4)); // same term for 8 consecutive x values
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(xv, _mm256_set1_ps(yterms[k]))); // no FMA, to match the scalar rounding
 		}
+		_mm256_storeu_ps(out + x, sum);
+	} // for x
+	for (unsigned x = nv; x < nx; ++x) { // remainder
+		float const *const xptr(xterms + x*F_TABLE_SIZE);
+		float zval(0.0);
+		for (int k = start_ix; k < F_TABLE_SIZE; ++k) {zval += xptr[k]*yterms[k];}
+		out[x] = zval;
 	}
-	return zval;
+}
+#endif
+
+// same as calling eval_index() for each x in row y, but evaluates sine tables with AVX2 and CPU perlin/simplex noise in batches
+void mesh_xy_grid_cache_t::eval_row(unsigned y, float *zvals, int min_start_sin, bool use_cache) const {
+
+	assert(y < cur_ny);
+	bool const use_cached_vals((use_cache || gen_mode >= MGEN_SIMPLEX_GPU) && !cached_vals.empty());
+
+#ifdef USE_AVX2_NOISE
+	if (!use_cached_vals && gen_mode == MGEN_SINE && have_avx2()) {
+		sum_sine_terms_avx2(&xyterms.front(), (&xyterms.front() + yterms_start + y*F_TABLE_SIZE), zvals, cur_nx, max(start_eval_sin, min_start_sin));
+
+		for (unsigned x = 0; x < cur_nx; ++x) {
+			apply_noise_shape_final(zvals[x], gen_shape);
+			if (do_glaciate) {apply_glaciate_terms(zvals[x], x, y);}
+		}
+		return;
+	}
+#endif
+	if (use_cached_vals || gen_mode == MGEN_SINE) {
+		for (unsigned x = 0; x < cur_nx; ++x) {zvals[x] = eval_index(x, y, min_start_sin, use_cache);}
+		return;
+	}
+	static thread_local vector<float> xvals, yvals; // reused across rows and calls; eval_row() may be called from multiple threads
+	xvals.resize(cur_nx);
+	yvals.assign(cur_nx, (y*mdy + my0)*DY_VAL_INV);
+	for (unsigned x = 0; x < cur_nx; ++x) {xvals[x] = (x*mdx + mx0)*DX_VAL_INV;}
+	get_noise_zval_batch(&xvals.front(), &yvals.front(), zvals, cur_nx, gen_mode, gen_shape, 1); // use_simd=1
+	if (do_glaciate) {for (unsigned x = 0; x < cur_nx; ++x) {apply_glaciate_terms(zvals[x], x, y);}}
 }
 
 
@@ -811,7 +1058,10 @@ float eval_mesh_sin_terms_scaled(float xval, float yval, float xy_scale) {
 }
 
 
-float get_exact_zval(float xval_in, float yval_in) {
+float get_exact_zval(float xval_in, float yval_in) {return get_exact_zval_xyoff(xval_in, yval_in, xoff2, yoff2);}
+
+// xoff_val/yoff_val should be the values of xoff2/yoff2 that the caller used to translate xval_in/yval_in; used when xoff2/yoff2 may be changed by another thread
+float get_exact_zval_xyoff(float xval_in, float yval_in, int xoff_val, int yoff_val) {
 
 	float xval((xval_in + X_SCENE_SIZE)*DX_VAL_INV + 0.5); // convert from real to index space, as in get_xpos()/get_ypos() but as FP
 	float yval((yval_in + Y_SCENE_SIZE)*DY_VAL_INV + 0.5);
@@ -821,8 +1071,8 @@ float get_exact_zval(float xval_in, float yval_in) {
 		clamp_to_mesh(xy);
 		return mesh_height[xy[1]][xy[0]]; // could interpolate?
 	}
-	xval += xoff2; // offset by current mesh transform
-	yval += yoff2;
+	xval += xoff_val; // offset by current mesh transform
+	yval += yoff_val;
 
 	if (using_tiled_terrain_hmap_tex()) {
 		float zval(get_tiled_terrain_height_tex(xval, yval));
@@ -12,12 +12,15 @@
 #include "lightmap.h" // for lmap_manager_t
 #include <fstream>
 #include <queue>
+#include <chrono>
 #include "meshoptimizer.h"
 
 bool const ENABLE_BUMP_MAPS  = 1;
 bool const ENABLE_SPEC_MAPS  = 1;
 bool const ENABLE_INTER_REFLECTIONS = 1;
 unsigned const MAGIC_NUMBER  = 42987143; // arbitrary file signature
+unsigned const MAGIC_NUMBER_V2 = 42987144; // compressed format with per-material chunks
+unsigned const MODEL3D_FLAG_NO_TANGENTS = 1; // v2 file flag: tangents were dropped and must be recalculated on read
 unsigned const BLOCK_SIZE    = 32768; // in vertex indices
 
 bool model_calc_tan_vect(1); // slower and more memory but sometimes better quality/smoother transitions
@@ -91,11 +94,15 @@ bool texture_manager::ensure_texture_loaded(texture_t &t, int tid, bool is_bump)
 	// Note: it's incorrect to call t.has_alpha() here because that uses color, which hasn't been computed yet (t.init() is called later);
 	// but that's okay, do_gl_init() will disable custom mipmaps for textures with color.A == 1.0
 	if (use_model2d_tex_mipmaps && enable_model3d_custom_mipmaps /*&& t.has_alpha()*/) {t.use_mipmaps = 4;}
+	bool const has_alpha_src(t.alpha_tid >= 0 && t.alpha_tid != tid); // if alpha is the same texture then the alpha channel should already be set
+	if (t.try_load_cpu_compressed_cache((has_alpha_src ? &get_texture(t.alpha_tid) : nullptr), texture_alpha_in_red_comp, is_bump)) return 1; // no decode needed
 	t.load(-1);
 		
-	if (t.alpha_tid >= 0 && t.alpha_tid != tid) { // if alpha is the same texture then the alpha channel should already be set
+	if (has_alpha_src) {
 		ensure_tid_loaded(t.alpha_tid, 0);
-		t.copy_alpha_from_texture(get_texture(t.alpha_tid), texture_alpha_in_red_comp);
+		texture_t &at(get_texture(t.alpha_tid));
+		if (at.is_cpu_cache_only()) {at.load(-1);} // alpha source was read from the texture cache, so decode it to get the alpha values
+		t.copy_alpha_from_texture(at, texture_alpha_in_red_comp);
 	}
 	if (is_bump) {t.make_normal_map();}
 	t.init(); // must be after alpha copy
@@ -169,6 +176,83 @@ template<typename V> void read_vector(istream &in, V &v) {
 }
 
 
+// ************ model3d v2 chunks ************
+
+// v2 model3d files consist of a header, an offset table, and one chunk for the unbound geometry followed by one chunk per material;
+// each chunk is self-contained so that chunks can be encoded and decoded in parallel, or read directly from a memory mapped file
+struct model3d_chunk_writer_t {
+	vector<unsigned char> data;
+
+	void write(void const *ptr, size_t sz) {data.insert(data.end(), (unsigned char const *)ptr, (unsigned char const *)ptr + sz);}
+	template<typename T> void write_val(T const &val) {write(&val, sizeof(T));}
+	void write_str(string const &str) {write_val((unsigned)str.size()); write(str.data(), str.size());}
+};
+
+struct model3d_chunk_reader_t {
+	unsigned char const *cur, *end;
+
+	model3d_chunk_reader_t(unsigned char const *data, size_t sz) : cur(data), end(data + sz) {}
+	size_t bytes_left() const {return (end - cur);}
+	bool read_ptr(unsigned char const *&ptr, size_t sz) { // returns a pointer into the chunk rather than copying
+		if (sz > bytes_left()) return 0;
+		ptr  = cur;
+		cur += sz;
+		return 1;
+	}
+	bool read(void *ptr, size_t sz) {
+		unsigned char const *src(nullptr);
+		if (!read_ptr(src, sz)) return 0;
+		memcpy(ptr, src, sz);
+		return 1;
+	}
+	template<typename T> bool read_val(T &val) {return read(&val, sizeof(T));}
+	bool read_str(string &str) {
+		unsigned sz(0);
+		unsigned char const *src(nullptr);
+		if (!read_val(sz) || !read_ptr(src, sz)) return 0;
+		str.assign((char const *)src, sz);
+		return 1;
+	}
+};
+
+bool write_encoded_vertex_buffer(model3d_chunk_writer_t &w, void const *verts, unsigned num, unsigned vert_size) {
+	vector<unsigned char> enc(meshopt_encodeVertexBufferBound(num, vert_size));
+	size_t const enc_sz(num ? meshopt_encodeVertexBuffer(enc.data(), enc.size(), verts, num, vert_size) : 0);
+	if (num > 0 && enc_sz == 0) return 0;
+	w.write_val((unsigned)enc_sz);
+	w.write(enc.data(), enc_sz);
+	return 1;
+}
+
+bool read_encoded_vertex_buffer(model3d_chunk_reader_t &r, void *verts, unsigned num, unsigned vert_size) {
+	unsigned enc_sz(0);
+	unsigned char const *enc(nullptr);
+	if (!r.read_val(enc_sz) || !r.read_ptr(enc, enc_sz)) return 0;
+	return (num == 0 || meshopt_decodeVertexBuffer(verts, num, vert_size, enc, enc_sz) == 0);
+}
+
+template<typename T> bool write_model_verts(model3d_chunk_writer_t &w, vector<T> const &verts, bool drop_tangents) {
+	return write_encoded_vertex_buffer(w, verts.data(), verts.size(), sizeof(T));
+}
+template<> bool write_model_verts(model3d_chunk_writer_t &w, vector<vert_norm_tc_tan> const &verts, bool drop_tangents) {
+	if (!drop_tangents) {return write_encoded_vertex_buffer(w, verts.data(), verts.size(), sizeof(vert_norm_tc_tan));}
+	vector<vert_norm_tc> const vntc(verts.begin(), verts.end()); // strip off the tangents, which are recalculated when read
+	return write_encoded_vertex_buffer(w, vntc.data(), vntc.size(), sizeof(vert_norm_tc));
+}
+
+template<typename T> bool read_model_verts(model3d_chunk_reader_t &r, vector<T> &verts, unsigned num, bool tangents_dropped) {
+	verts.resize(num);
+	return read_encoded_vertex_buffer(r, verts.data(), num, sizeof(T));
+}
+template<> bool read_model_verts(model3d_chunk_reader_t &r, vector<vert_norm_tc_tan> &verts, unsigned num, bool tangents_dropped) {
+	if (!tangents_dropped) {verts.resize(num); return read_encoded_vertex_buffer(r, verts.data(), num, sizeof(vert_norm_tc_tan));}
+	vector<vert_norm_tc> vntc(num);
+	if (!read_encoded_vertex_buffer(r, vntc.data(), num, sizeof(vert_norm_tc))) return 0;
+	verts.assign(vntc.begin(), vntc.end()); // tangents are zero
+	return 1;
+}
+
+
 // ************ vntc_vect_t/indexed_vntc_vect_t ************
 
 // explicit template instantiations of vert_norm case, used for voxel_model, where tc=0.0
@@ -645,16 +729,12 @@ template<typename T> unsigned indexed_vntc_vect_t<T>::add_vertex(T const &v, ver
 
 	T v2(v);
 	if (vmap.get_average_normals()) {v2.n = zero_vector;}
-	auto it(vmap.find(v2));
-	unsigned ix;
+	unsigned const ix(vmap.insert(v2, (unsigned)size()));
 
-	if (it == vmap.end()) { // not found
-		ix = (unsigned)size();
+	if (ix == size()) { // not found
 		this->push_back(v);
-		vmap[v2] = ix;
 	}
 	else { // found
-		ix = it->second;
 		assert(ix < size());
 
 		if (vmap.get_average_normals()) {
@@ -773,6 +853,52 @@ template<typename T> void indexed_vntc_vect_t<T>::read(istream &in) {
 	read_vector(in, indices);
 }
 
+template<typename T> bool indexed_vntc_vect_t<T>::write_compressed(model3d_chunk_writer_t &w, unsigned npts, bool drop_tangents) const {
+
+	w.write_val((unsigned)size());
+	w.write_val((unsigned)indices.size());
+	if (!write_model_verts(w, *this, drop_tangents)) return 0;
+	if (indices.empty()) return 1;
+
+	if (npts != 3) { // the index codec only handles triangle lists, so quad indices are stored uncompressed
+		w.write(indices.data(), indices.size()*sizeof(unsigned));
+		return 1;
+	}
+	// Note: the index codec may rotate the vertices of a triangle, but it preserves the winding order
+	vector<unsigned char> enc(meshopt_encodeIndexBufferBound(indices.size(), size()));
+	size_t const enc_sz(meshopt_encodeIndexBuffer(enc.data(), enc.size(), indices.data(), indices.size()));
+	if (enc_sz == 0) return 0;
+	w.write_val((unsigned)enc_sz);
+	w.write(enc.data(), enc_sz);
+	return 1;
+}
+
+template<typename T> bool indexed_vntc_vect_t<T>::read_compressed(model3d_chunk_reader_t &r, unsigned npts, bool tangents_dropped) {
+
+	unsigned num_verts(0), num_ixs(0);
+	if (!r.read_val(num_verts) || !r.read_val(num_ixs)) return 0;
+	if (!read_model_verts(r, *this, num_verts, tangents_dropped)) return 0;
+	indices.resize(num_ixs);
+
+	if (num_ixs > 0) {
+		if (npts != 3) {
+			if (!r.read(indices.data(), num_ixs*sizeof(unsigned))) return 0;
+		}
+		else {
+			unsigned enc_sz(0);
+			unsigned char const *enc(nullptr);
+			if (!r.read_val(enc_sz) || !r.read_ptr(enc, enc_sz)) return 0;
+			if (meshopt_decodeIndexBuffer(indices.data(), num_ixs, sizeof(unsigned), enc, enc_sz) != 0) return 0;
+		}
+		for (auto i = indices.begin(); i != indices.end(); ++i) {if (*i >= num_verts) return 0;} // the decoder doesn't check for bad data
+	}
+	bool const is_tan_type(sizeof(T) == sizeof(vert_norm_tc_tan)); // HACK to get the type, same as vntc_vect_t<T>::read()
+	this->has_tangents = (is_tan_type && !tangents_dropped);
+	if (is_tan_type && tangents_dropped) {calc_tangents(npts);}
+	if (!empty()) {this->calc_bounding_volumes();}
+	return 1;
+}
+
 
 // ************ polygon_t ************
 
@@ -938,6 +1064,30 @@ template<typename T> bool vntc_vect_block_t<T>::read(istream &in) {
 	return 1;
 }
 
+template<typename T> bool vntc_vect_block_t<T>::write_compressed(model3d_chunk_writer_t &w, unsigned npts, bool drop_tangents) const {
+
+	w.write_val((unsigned)this->size());
+
+	for (auto i = begin(); i != end(); ++i) {
+		if (!i->write_compressed(w, npts, drop_tangents)) return 0;
+	}
+	return 1;
+}
+
+template<typename T> bool vntc_vect_block_t<T>::read_compressed(model3d_chunk_reader_t &r, unsigned npts, bool tangents_dropped) {
+
+	this->clear();
+	unsigned num(0);
+	if (!r.read_val(num) || num > r.bytes_left()/(3*sizeof(unsigned))) return 0; // each block has at least 3 values
+	this->resize(num);
+
+	for (auto i = begin(); i != end(); ++i) {
+		if (!i->read_compressed(r, npts, tangents_dropped)) return 0;
+	}
+	if (merge_model_objects) {merge_into_single_vector();} // model was split per object, and we don't want that; merge into a single vector
+	return 1;
+}
+
 
 // ************ geometry_t ************
 
@@ -1239,6 +1389,22 @@ bool material_t::read(istream &in) {
 }
 
 
+bool material_t::write_compressed(model3d_chunk_writer_t &w, bool drop_tangents) const {
+
+	w.write((material_params_t const *)this, sizeof(material_params_t));
+	w.write_str(name);
+	w.write_str(filename);
+	return (geom.write_compressed(w, drop_tangents) && geom_tan.write_compressed(w, drop_tangents));
+}
+
+
+bool material_t::read_compressed(model3d_chunk_reader_t &r, bool tangents_dropped) {
+
+	if (!r.read((material_params_t *)this, sizeof(material_params_t)) || !r.read_str(name) || !r.read_str(filename)) return 0;
+	return (geom.read_compressed(r, tangents_dropped) && geom_tan.read_compressed(r, tangents_dropped));
+}
+
+
 // ************ model3d ************
 
 
@@ -2158,7 +2324,7 @@ void model3d::show_stats() const {
 }
 
 
-bool model3d::write_to_disk(string const &fn) const { // Note: transforms not written
+bool model3d::write_to_disk(string const &fn, bool compressed, bool drop_tangents) const { // Note: transforms not written
 
 	ofstream out(fn, ios::out | ios::binary);
 	
@@ -2167,6 +2333,7 @@ bool model3d::write_to_disk(string const &fn) const { // Note: transforms not wr
 		return 0;
 	}
 	cout << "Writing model3d file " << fn << endl;
+	if (compressed) {return write_to_disk_compressed(out, drop_tangents);}
 	write_uint(out, MAGIC_NUMBER);
 	out.write((char const *)&bcube, sizeof(cube_t));
 	if (!unbound_geom.write(out)) return 0;
@@ -2181,6 +2348,32 @@ bool model3d::write_to_disk(string const &fn) const { // Note: transforms not wr
 	return out.good();
 }
 
+// v2 format: magic number, flags, bcube, num materials, chunk offset table, then chunks (unbound geom followed by materials)
+bool model3d::write_to_disk_compressed(ostream &out, bool drop_tangents) const {
+
+	unsigned const num_chunks(materials.size() + 1);
+	vector<model3d_chunk_writer_t> chunks(num_chunks);
+	vector<unsigned char> chunk_valid(num_chunks, 0);
+
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < (int)num_chunks; ++i) {
+		chunk_valid[i] = ((i == 0) ? unbound_geom.write_compressed(chunks[i], drop_tangents) : materials[i-1].write_compressed(chunks[i], drop_tangents));
+	}
+	for (unsigned i = 0; i < num_chunks; ++i) {
+		if (!chunk_valid[i]) {cerr << "Error writing material" << endl; return 0;}
+	}
+	vector<uint64_t> offsets(num_chunks+1); // offsets of each chunk from the start of the file, plus the end of the last chunk
+	offsets[0] = 3*sizeof(unsigned) + sizeof(cube_t) + offsets.size()*sizeof(uint64_t);
+	for (unsigned i = 0; i < num_chunks; ++i) {offsets[i+1] = offsets[i] + chunks[i].data.size();}
+	write_uint(out, MAGIC_NUMBER_V2);
+	write_uint(out, (drop_tangents ? MODEL3D_FLAG_NO_TANGENTS : 0));
+	out.write((char const *)&bcube, sizeof(cube_t));
+	write_uint(out, (unsigned)materials.size());
+	out.write((char const *)offsets.data(), offsets.size()*sizeof(uint64_t));
+	for (auto i = chunks.begin(); i != chunks.end(); ++i) {out.write((char const *)i->data.data(), i->data.size());}
+	return out.good();
+}
+
 
 bool model3d::read_from_disk(string const &fn) { // Note: transforms not read
 
@@ -2193,12 +2386,18 @@ bool model3d::read_from_disk(string const &fn) { // Note: transforms not read
 	clear(); // ???
 	unsigned const magic_number_comp(read_uint(in));
 
-	if (magic_number_comp != MAGIC_NUMBER) {
+	if (magic_number_comp != MAGIC_NUMBER && magic_number_comp != MAGIC_NUMBER_V2) {
 		cerr << "Error reading model3d file " << fn << ": Invalid file format (magic number check failed)." << endl;
 		return 0;
 	}
 	cout << "Reading model3d file " << fn << endl;
 	from_model3d_file = 1;
+
+	if (magic_number_comp == MAGIC_NUMBER_V2) {
+		if (read_from_disk_compressed(in)) return 1;
+		cerr << "Error reading model3d file " << fn << ": Invalid or truncated data." << endl;
+		return 0;
+	}
 	in.read((char *)&bcube, sizeof(cube_t));
 	if (!unbound_geom.read(in)) return 0;
 	materials.resize(read_uint(in));
@@ -2214,6 +2413,39 @@ bool model3d::read_from_disk(string const &fn) { // Note: transforms not read
 	return in.good();
 }
 
+// reads the rest of the file in one block, then decodes the chunks in parallel
+bool model3d::read_from_disk_compressed(istream &in) {
+
+	unsigned const flags(read_uint(in));
+	in.read((char *)&bcube, sizeof(cube_t));
+	unsigned const num_mats(read_uint(in)), num_chunks(num_mats + 1);
+	if (!in.good() || num_mats > (1U << 24)) return 0; // sanity check
+	vector<uint64_t> offsets(num_chunks+1);
+	in.read((char *)offsets.data(), offsets.size()*sizeof(uint64_t));
+	if (!in.good() || offsets[0] != (uint64_t)in.tellg()) return 0;
+	
+	for (unsigned i = 0; i < num_chunks; ++i) {
+		if (offsets[i+1] < offsets[i]) return 0;
+	}
+	vector<unsigned char> data(offsets.back() - offsets.front());
+	in.read((char *)data.data(), data.size());
+	if (!in.good()) return 0;
+	bool const tangents_dropped((flags & MODEL3D_FLAG_NO_TANGENTS) != 0);
+	vector<unsigned char> chunk_valid(num_chunks, 0);
+	materials.resize(num_mats);
+
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < (int)num_chunks; ++i) {
+		model3d_chunk_reader_t reader((data.data() + (offsets[i] - offsets.front())), (offsets[i+1] - offsets[i]));
+		chunk_valid[i] = ((i == 0) ? unbound_geom.read_compressed(reader, tangents_dropped) : materials[i-1].read_compressed(reader, tangents_dropped));
+	}
+	for (unsigned i = 0; i < num_chunks; ++i) {
+		if (!chunk_valid[i]) {cerr << "Error reading material" << endl; return 0;}
+	}
+	for (deque<material_t>::iterator m = materials.begin(); m != materials.end(); ++m) {mat_map[m->name] = (m - materials.begin());}
+	return 1;
+}
+
 
 void model3d::proc_model_normals(vector<counted_normal> &cn, int recalc_normals, float nmag_thresh) {
 
@@ -2430,6 +2662,27 @@ void model3d_stats_t::print() const {
 
 void free_model_context() {all_models.free_context();}
 
+// compares vertex deduplication throughput of the old tree map and the hash map on a stream of polygon vertices from a model file
+void run_vertex_dedup_benchmark(vector<vert_norm_tc> const &verts) {
+
+	if (verts.empty()) return;
+
+	for (unsigned use_hash_map = 0; use_hash_map < 2; ++use_hash_map) {
+		vntc_map_t vmap(0, (use_hash_map != 0));
+		size_t num_unique(0);
+		auto const start_time(std::chrono::high_resolution_clock::now());
+
+		for (auto i = verts.begin(); i != verts.end(); ++i) {
+			if (vmap.size() >= MAX_VMAP_SIZE) {vmap.clear();} // same limit as model loading
+			unsigned const ix((unsigned)vmap.size());
+			if (vmap.insert(*i, ix) == ix) {++num_unique;}
+		}
+		double const secs(std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count());
+		cout << (use_hash_map ? "Hash map" : "Tree map") << " vertex dedup: " << verts.size() << " verts, " << num_unique << " unique, "
+			 << 1000.0*secs << " ms, " << verts.size()/max(secs, 1.0E-6)/1.0E6 << "M verts/sec" << endl;
+	}
+}
+
 void render_models(int shadow_pass, int reflection_pass, int trans_op_mask, vector3d const &xlate) { // shadow_only: 0=non-shadow pass, 1=sun/moon shadow, 2=dynamic shadow
 	all_models.render((shadow_pass != 0), reflection_pass, trans_op_mask, xlate);
 	if (trans_op_mask & 1) {draw_buildings(shadow_pass, 0, xlate);} // opaque pass (first); Note: not passing reflection_pass (which is for water plane, not mirrors)
@@ -181,21 +181,103 @@ template<typename T> struct hash_by_bytes { // should work with all packed verte
 	//uint32_t operator()(T const &v) const {return jenkins_one_at_a_time_hash((const uint32_t*)&v, sizeof(T)>>2);} // faster but lower quality hash
 };
 
-//template<typename T> class vertex_map_t : public unordered_map<T, unsigned, hash_by_bytes<T>> {
-template<typename T> class vertex_map_t : public map<T, unsigned> {
+// open addressing hash map from vertex to index using linear probing, with flat storage and no per-vertex allocations;
+// T must be made up only of floats (so that there's no padding); vertices are compared with operator<, the same as map<T, unsigned>,
+// and -0.0 is hashed as 0.0 so that vertices that compare equal always have the same hash
+template<typename T> class vertex_hash_map_t {
+
+	vector<unsigned> table; // index into keys + 1, or 0 for empty; size is a power of 2
+	vector<T> keys;
+	vector<unsigned> vals;
+	vector<uint32_t> hashes; // cached hash of each key to speed up compares and growing
+
+	static uint32_t hash_vert(T const &v) {
+		static_assert((sizeof(T) % sizeof(float)) == 0 && sizeof(float) == sizeof(uint32_t), "vertex must be made of floats");
+		unsigned const num_words(sizeof(T)/sizeof(float));
+		uint32_t words[num_words];
+		memcpy(words, &v, sizeof(T));
+		uint32_t h(2166136261U);
+
+		for (unsigned i = 0; i < num_words; ++i) {
+			uint32_t const w((words[i] == 0x80000000U) ? 0U : words[i]); // -0.0 => 0.0; done on the bits since fast math may drop a (v + 0.0)
+			h = (h ^ w)*16777619U; h ^= (h >> 15);
+		}
+		h ^= (h >> 16); h *= 0x85ebca6bU; h ^= (h >> 13); // final mix so that the low bits used for the table index are well distributed
+		return h;
+	}
+	unsigned find_slot(T const &v, uint32_t h) const { // returns the slot containing v, or the empty slot where it should be inserted
+		unsigned const mask(table.size() - 1);
+
+		for (unsigned s = (h & mask);; s = ((s + 1) & mask)) {
+			unsigned const e(table[s]);
+			if (e == 0 || (hashes[e-1] == h && !(keys[e-1] < v) && !(v < keys[e-1]))) return s;
+		}
+		return 0; // never gets here
+	}
+	void grow() {
+		vector<unsigned> new_table(max(64U, 2U*(unsigned)table.size()), 0);
+		table.swap(new_table);
+		unsigned const mask(table.size() - 1);
+
+		for (unsigned k = 0; k < keys.size(); ++k) {
+			unsigned s(hashes[k] & mask);
+			while (table[s] != 0) {s = ((s + 1) & mask);}
+			table[s] = k+1;
+		}
+	}
+public:
+	size_t size() const {return keys.size();}
+
+	void clear() {
+		if (8*keys.size() < table.size()) { // sparse table, faster to clear only the used slots
+			unsigned const mask(table.size() - 1);
+
+			for (unsigned k = 0; k < keys.size(); ++k) {
+				unsigned s(hashes[k] & mask);
+				while (table[s] != k+1) {s = ((s + 1) & mask);} // may skip over already cleared slots
+				table[s] = 0;
+			}
+		}
+		else {std::fill(table.begin(), table.end(), 0);}
+		keys.clear(); vals.clear(); hashes.clear();
+	}
+	unsigned insert(T const &v, unsigned val) { // returns the existing val for v, or adds v with val if not present
+		if (2*(keys.size() + 1) > table.size()) {grow();} // max load factor of 0.5
+		uint32_t const h(hash_vert(v));
+		unsigned const s(find_slot(v, h));
+		if (table[s] != 0) return vals[table[s]-1]; // found
+		keys.push_back(v);
+		vals.push_back(val);
+		hashes.push_back(h);
+		table[s] = keys.size();
+		return val;
+	}
+};
+
+
+template<typename T> class vertex_map_t {
 
 	int last_mat_id;
 	unsigned last_obj_id;
-	bool average_normals;
+	bool average_normals, use_hash_map;
+	vertex_hash_map_t<T> hash_map;
+	map<T, unsigned> tree_map; // previous implementation, kept for comparison
 
 public:
-	vertex_map_t(bool average_normals_=0) : last_mat_id(-1), last_obj_id(0), average_normals(average_normals_) {}
+	vertex_map_t(bool average_normals_=0, bool use_hash_map_=1) :
+		last_mat_id(-1), last_obj_id(0), average_normals(average_normals_), use_hash_map(use_hash_map_) {}
 	bool get_average_normals() const {return average_normals;}
-	
+	size_t size() const {return (use_hash_map ? hash_map.size() : tree_map.size());}
+	void clear() {if (use_hash_map) {hash_map.clear();} else {tree_map.clear();}}
+
+	unsigned insert(T const &v, unsigned ix) { // returns the existing index for v, or adds v with index ix if not present
+		if (use_hash_map) {return hash_map.insert(v, ix);}
+		return tree_map.insert(make_pair(v, ix)).first->second;
+	}
 	void check_for_clear(int mat_id) {
-		if (mat_id != last_mat_id || this->size() >= MAX_VMAP_SIZE) {
+		if (mat_id != last_mat_id || size() >= MAX_VMAP_SIZE) {
 			last_mat_id = mat_id;
-			this->clear();
+			clear();
 		}
 	}
 };
@@ -223,6 +305,10 @@ template<typename T> cube_t get_polygon_bbox(vector<T> const &p) {
 }
 
 
+struct model3d_chunk_writer_t; // forward declaration
+struct model3d_chunk_reader_t; // forward declaration
+
+
 template<typename T> class vntc_vect_t : public vector<T>, public indexed_vao_manager_with_shadow_t {
 
 protected:
@@ -315,6 +401,8 @@ public:
 	void invert_tcy();
 	void write(ostream &out) const;
 	void read(istream &in);
+	bool write_compressed(model3d_chunk_writer_t &w, unsigned npts, bool drop_tangents) const;
+	bool read_compressed(model3d_chunk_reader_t &r, unsigned npts, bool tangents_dropped);
 	bool indexing_enabled() const {return !indices.empty();}
 	void mark_need_normalize() {need_normalize = 1;}
 };
@@ -341,6 +429,8 @@ template<typename T> struct vntc_vect_block_t : public deque<indexed_vntc_vect_t
 	void merge_into_single_vector();
 	bool write(ostream &out) const;
 	bool read(istream &in);
+	bool write_compressed(model3d_chunk_writer_t &w, unsigned npts, bool drop_tangents) const;
+	bool read_compressed(model3d_chunk_reader_t &r, unsigned npts, bool tangents_dropped);
 };
 
 
@@ -367,6 +457,12 @@ template<typename T> struct geometry_t {
 	void simplify_indices(float reduce_target);
 	bool write(ostream &out) const {return (triangles.write(out) && quads.write(out));}
 	bool read(istream &in)         {return (triangles.read (in ) && quads.read (in ));}
+	bool write_compressed(model3d_chunk_writer_t &w, bool drop_tangents) const {
+		return (triangles.write_compressed(w, 3, drop_tangents) && quads.write_compressed(w, 4, drop_tangents));
+	}
+	bool read_compressed(model3d_chunk_reader_t &r, bool tangents_dropped) {
+		return (triangles.read_compressed(r, 3, tangents_dropped) && quads.read_compressed(r, 4, tangents_dropped));
+	}
 };
 
 
@@ -446,6 +542,8 @@ struct material_t : public material_params_t {
 	colorRGBA get_avg_color(texture_manager const &tmgr, int default_tid=-1) const;
 	bool write(ostream &out) const;
 	bool read(istream &in);
+	bool write_compressed(model3d_chunk_writer_t &w, bool drop_tangents) const;
+	bool read_compressed(model3d_chunk_reader_t &r, bool tangents_dropped);
 };
 
 
@@ -584,8 +682,10 @@ public:
 	void get_stats(model3d_stats_t &stats) const;
 	void show_stats() const;
 	void get_all_mat_lib_fns(set<std::string> &mat_lib_fns) const;
-	bool write_to_disk (string const &fn) const;
+	bool write_to_disk (string const &fn, bool compressed=0, bool drop_tangents=0) const;
+	bool write_to_disk_compressed(ostream &out, bool drop_tangents) const;
 	bool read_from_disk(string const &fn);
+	bool read_from_disk_compressed(istream &in);
 	static void proc_model_normals(vector<counted_normal> &cn, int recalc_normals, float nmag_thresh=0.7);
 	static void proc_model_normals(vector<weighted_normal> &wn, int recalc_normals, float nmag_thresh=0.7);
 	void write_to_cobj_file(std::ostream &out) const;
@@ -631,6 +731,7 @@ template<typename T> bool split_polygon(polygon_t const &poly, vector<T> &ppts,
 bool use_model3d_bump_maps();
 void coll_tquads_from_triangles(vector<triangle> const &triangles, vector<coll_tquad> &ppts, colorRGBA const &color);
 void free_model_context();
+void run_vertex_dedup_benchmark(vector<vert_norm_tc> const &verts);
 void render_models(int shadow_pass, int reflection_pass, int trans_op_mask=3, vector3d const &xlate=zero_vector);
 void ensure_model_reflection_cube_maps();
 void auto_calc_model_zvals();
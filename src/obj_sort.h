@@ -5,8 +5,6 @@
 
 #include "ship.h"
 
-unsigned const LEFT_EDGE_BIT = 0x80000000U;
-
 
 struct cached_obj : public sphere_t {
 
@@ -30,17 +28,6 @@ struct cached_obj : public sphere_t {
 };
 
 
-struct interval {
-
-	float val;
-	unsigned ix;
-
-	interval() : val(0.0f), ix(0) {}
-	interval(float v, unsigned i, bool l) : val(v), ix(i) {if (l) ix |= LEFT_EDGE_BIT;}
-	bool operator<(interval const &iv) const {return (val < iv.val);}
-};
-
-
 struct comp_co_fast_x {
 	bool operator()(cached_obj const &o1, cached_obj const &o2) {
 		return (o1.pos.x < o2.pos.x);
@@ -12,7 +12,7 @@
 #include "fast_atof.h"
 
 
-extern bool use_obj_file_bump_grayscale;
+extern bool use_obj_file_bump_grayscale, benchmark_vertex_dedup, parallel_obj_file_load, compress_model3d_files, model3d_drop_tangents;
 extern float model_auto_tc_scale, model_mat_lod_thresh;
 extern model3ds all_models;
 
@@ -146,7 +146,7 @@ protected:
 			char const c(get_next_char());
 			if (fast_isspace(c)) {if (ix == 0) continue; else break;} // leading/trailing whitespace
 
-			if (ix == 0 && !fast_isdigit(c) && c != '.' && c != '-') { // not a fp number
+			if (ix == 0 && !fast_isdigit(c) && c != '.' && c != '-' && c != '+') { // not a fp number
 				unget_last_char(c);
 				return 0;
 			}
@@ -225,6 +225,236 @@ public:
 };
 
 
+
+// ************ Parallel Object File Parser ************
+
+
+unsigned const OBJ_PARSE_CHUNK_SIZE = (1 << 22); // 4MB; chunks are split on line boundaries
+
+enum {OBJ_CMD_USEMTL=0, OBJ_CMD_MTLLIB, OBJ_CMD_SMOOTH, OBJ_CMD_OBJECT, OBJ_CMD_GROUP, OBJ_CMD_BAD_FACE, OBJ_CMD_UNDEF};
+
+struct obj_state_cmd_t { // non-geometry record, applied in file order between faces when the chunks are merged
+	unsigned type, face_ix, line, val; // face_ix = number of faces in this chunk before this record
+	string str;
+	obj_state_cmd_t(unsigned type_, unsigned face_ix_, unsigned line_, unsigned val_=0, string const &str_="") :
+		type(type_), face_ix(face_ix_), line(line_), val(val_), str(str_) {}
+};
+
+struct obj_file_chunk_t {
+	char const *begin, *end;
+	unsigned num_lines, num_v, num_tc, num_n; // counts from the first pass
+	unsigned line_off, v_off, tc_off, n_off; // sums of counts over all previous chunks
+	vector<point> v;
+	vector<colorRGB> colors; // empty if this chunk has no vertex colors
+	vector<point2d<float> > tc;
+	vector<vector3d> n;
+	vector<vntc_ix_t> pts; // with indices already resolved to the merged vectors
+	vector<unsigned> face_npts;
+	vector<obj_state_cmd_t> cmds;
+	string error;
+	unsigned error_line;
+	bool had_zero_index;
+
+	obj_file_chunk_t(char const *begin_, char const *end_) : begin(begin_), end(end_), num_lines(0), num_v(0), num_tc(0), num_n(0),
+		line_off(0), v_off(0), tc_off(0), n_off(0), error_line(0), had_zero_index(0) {}
+};
+
+
+class obj_chunk_parser_t {
+
+	obj_file_chunk_t &chunk;
+	geom_xform_t const &xf;
+	int recalc_normals;
+	char const *pos, *line_end;
+	unsigned cur_line;
+
+	static bool is_space(char c) {return (c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f');} // excludes newline
+	static bool is_digit(char c) {return (c >= '0' && c <= '9');}
+	static bool token_is(char const *s, char const *e, char const *str) {size_t const len(strlen(str)); return (size_t(e - s) == len && memcmp(s, str, len) == 0);}
+	void skip_space() {while (pos < line_end && is_space(*pos)) {++pos;}}
+
+	void next_line(char const *line_start) {
+		pos = line_start;
+		char const *const nl((char const *)memchr(line_start, '\n', (chunk.end - line_start)));
+		line_end = (nl ? nl : chunk.end);
+	}
+	void read_token(char const *&s, char const *&e) {
+		skip_space();
+		s = pos;
+		while (pos < line_end && !is_space(*pos)) {++pos;}
+		e = pos;
+	}
+	bool read_float(float &val) {
+		skip_space();
+		if (pos == line_end || !(is_digit(*pos) || *pos == '.' || *pos == '-' || *pos == '+')) return 0; // not a fp number; fast_atoreal_move() accepts a leading sign
+		pos = Assimp::fast_atoreal_move<float>(pos, val); // stops at the newline or the null terminator at the end of the file
+		return 1;
+	}
+	bool read_point(point &p, unsigned req_num=3) {
+		for (unsigned i = 0; i < 3; ++i) {
+			if (!read_float(p[i])) {return (i >= req_num);} // success if we read enough values
+		}
+		return 1;
+	}
+	bool read_int(int &v) {
+		skip_space();
+		char const *s(pos);
+		bool const is_neg(s < line_end && *s == '-');
+		if (is_neg) {++s;}
+		if (s == line_end || !is_digit(*s)) return 0; // no integer characters
+		for (v = 0; s < line_end && is_digit(*s); ++s) {v = 10*v + unsigned(*s - '0');}
+		if (is_neg) {v = -v;}
+		pos = s;
+		return 1;
+	}
+	void read_str_to_newline(string &str) {
+		skip_space();
+		char const *e(line_end);
+		while (e > pos && is_space(*(e-1))) {--e;} // strip trailing whitespace
+		str.assign(pos, e);
+		pos = line_end;
+	}
+	bool resolve_index(int ix, unsigned vect_sz, unsigned &ret) { // same rules as normalize_index(), with vect_sz = size at this point in the file
+		if      (ix > 0) {ret = ix - 1;} // positive (absolute) index, starting from 1
+		else if (ix < 0) {if (unsigned(-ix) > vect_sz) return 0; ret = vect_sz + ix;} // negative (relative) index
+		else {chunk.had_zero_index = 1; ret = 0;} // invalid zero index
+		return (ret < vect_sz);
+	}
+	bool set_error(char const *const msg) {
+		chunk.error = msg;
+		chunk.error_line = cur_line;
+		return 0;
+	}
+	void add_cmd(unsigned type, unsigned val=0, string const &str="") {chunk.cmds.emplace_back(type, (unsigned)chunk.face_npts.size(), cur_line, val, str);}
+	bool read_face();
+	bool read_line();
+
+public:
+	obj_chunk_parser_t(obj_file_chunk_t &chunk_, geom_xform_t const &xf_, int recalc_normals_) :
+		chunk(chunk_), xf(xf_), recalc_normals(recalc_normals_), pos(nullptr), line_end(nullptr), cur_line(0) {}
+
+	void count_records() { // first pass: count lines and vertex records so that each chunk knows its index offsets
+		for (char const *line_start = chunk.begin; line_start < chunk.end; line_start = line_end + 1) {
+			next_line(line_start);
+			++chunk.num_lines;
+			char const *s, *e;
+			read_token(s, e);
+			if      (token_is(s, e, "v" )) {++chunk.num_v;}
+			else if (token_is(s, e, "vt")) {++chunk.num_tc;}
+			else if (token_is(s, e, "vn") && !recalc_normals) {++chunk.num_n;} // normals are dropped when recalculated
+		}
+	}
+	bool parse() { // second pass: read all records; returns 0 and sets chunk.error on failure
+		cur_line = chunk.line_off;
+
+		for (char const *line_start = chunk.begin; line_start < chunk.end; line_start = line_end + 1) {
+			next_line(line_start);
+			++cur_line; // line numbers start at 1
+			if (!read_line()) return 0;
+		}
+		return 1;
+	}
+};
+
+bool obj_chunk_parser_t::read_face() {
+
+	unsigned const pts_start(chunk.pts.size());
+	unsigned const nv(chunk.v_off + chunk.v.size()), ntc(chunk.tc_off + chunk.tc.size()), nn(chunk.n_off + chunk.n.size());
+	int vix(0), tix(0), nix(0);
+
+	while (read_int(vix)) { // read vertex index
+		vntc_ix_t vntc_ix;
+		if (!resolve_index(vix, nv, vntc_ix.vix)) return set_error("Invalid vertex index in face");
+
+		if (pos < line_end && *pos == '/') {
+			++pos;
+			unsigned ix(0);
+
+			if (read_int(tix)) { // read text coord index
+				if (!resolve_index(tix, ntc, ix)) return set_error("Invalid texture coord index in face");
+				vntc_ix.tix = ix+1; // account for tc[0]
+			}
+			if (pos < line_end && *pos == '/') {
+				++pos;
+
+				if (read_int(nix) && !recalc_normals) { // read normal index
+					if (!resolve_index(nix, nn, ix)) return set_error("Invalid normal index in face");
+					vntc_ix.nix = ix+1; // account for n[0]
+				} // else the normal will be recalculated later
+			}
+		}
+		chunk.pts.push_back(vntc_ix);
+	} // end while vertex
+	unsigned const npts(chunk.pts.size() - pts_start);
+
+	if (npts < 3) {
+		chunk.pts.resize(pts_start); // remove pts
+		add_cmd(OBJ_CMD_BAD_FACE, npts); // report it during the merge
+	}
+	else {chunk.face_npts.push_back(npts);}
+	return 1;
+}
+
+bool obj_chunk_parser_t::read_line() {
+
+	char const *s, *e;
+	read_token(s, e);
+	if (s == e || *s == '#') return 1; // empty line or comment
+
+	if (token_is(s, e, "f")) {return read_face();}
+	else if (token_is(s, e, "v")) { // vertex
+		point p;
+		if (!read_point(p)) return set_error("Error reading vertex");
+		chunk.v.push_back(p);
+		xf.xform_pos(chunk.v.back());
+		colorRGB color;
+
+		if (read_float(color.R)) {
+			if (!read_float(color.G) || !read_float(color.B)) return set_error("Error reading vertex color");
+			if (chunk.colors.empty()) {chunk.colors.resize(chunk.v.size()-1, WHITE);} // pad colors up to this point with white
+			chunk.colors.push_back(color);
+		}
+		else if (!chunk.colors.empty()) {chunk.colors.push_back(WHITE);} // color not specified, and in colors mode, pad with white
+	}
+	else if (token_is(s, e, "vt")) { // tex coord
+		point tc3d;
+		if (!read_point(tc3d, 2)) return set_error("Error reading texture coord");
+		chunk.tc.push_back(point2d<float>(tc3d.x, tc3d.y)); // discard tc3d.z
+	}
+	else if (token_is(s, e, "vn")) { // normal
+		vector3d normal;
+		if (!read_point(normal)) return set_error("Error reading normal");
+
+		if (!recalc_normals) {
+			xf.xform_pos_rm(normal);
+			chunk.n.push_back(normal);
+		}
+	}
+	else if (token_is(s, e, "l")) {} // line - ignore
+	else if (token_is(s, e, "o")) {add_cmd(OBJ_CMD_OBJECT);} // object definition
+	else if (token_is(s, e, "g")) {add_cmd(OBJ_CMD_GROUP );} // group
+	else if (token_is(s, e, "s")) { // smoothing/shading (off/on or 0/1)
+		int sg(0);
+
+		if (!read_int(sg) || sg < 0) {
+			read_token(s, e);
+			if (!token_is(s, e, "off")) return set_error("Error reading smoothing group");
+			sg = 0;
+		}
+		add_cmd(OBJ_CMD_SMOOTH, sg);
+	}
+	else if (token_is(s, e, "usemtl") || token_is(s, e, "mtllib")) { // use material or material library
+		bool const is_mtllib(*s == 'm');
+		string name;
+		read_str_to_newline(name);
+		if (name.empty()) return set_error(is_mtllib ? "Error reading material library" : "Error reading material");
+		add_cmd((is_mtllib ? OBJ_CMD_MTLLIB : OBJ_CMD_USEMTL), 0, name);
+	}
+	else {add_cmd(OBJ_CMD_UNDEF, 0, string(s, e));}
+	return 1;
+}
+
+
 // ************************************************
 
 
@@ -316,6 +546,327 @@ class object_file_reader_model : public object_file_reader, public model_from_fi
 		return 1;
 	}
 
+	static unsigned const POLY_BLOCK_SIZE = (1 << 18); // 256K
+
+	struct obj_parse_data_t { // data read from the object file that's used to build the model
+		vector<point> v; // vertices
+		vector<vector3d> n; // normals
+		// weighted_normal can also be used, but doesn't work well; see face_weight_avg mode selected by recalc_normals==2
+		vector<counted_normal> vn; // vertex normals
+		vector<point2d<float> > tc; // texture coords
+		vector<colorRGB> colors; // vertex colors
+		deque<poly_data_block> pblocks;
+		set<string> loaded_mat_libs;
+		int cur_mat_id;
+		unsigned smoothing_group, prev_smoothing_group, num_objects, num_groups, obj_group_id;
+		bool is_textured, had_npts_error;
+
+		obj_parse_data_t() : cur_mat_id(-1), smoothing_group(0), prev_smoothing_group(0), num_objects(0), num_groups(0), obj_group_id(0), is_textured(0), had_npts_error(0) {
+			tc.push_back(point2d<float>(0.0, 0.0)); // default tex coords
+			n.push_back(zero_vector); // default normal
+		}
+	};
+
+	poly_data_block &add_face_header(obj_parse_data_t &d) {
+		model.mark_mat_as_used(d.cur_mat_id);
+
+		if (d.pblocks.empty() || d.pblocks.back().pts.size() >= POLY_BLOCK_SIZE || d.smoothing_group != d.prev_smoothing_group) { // create a new block
+			if (!d.pblocks.empty()) {
+				remove_excess_cap(d.pblocks.back().polys);
+				remove_excess_cap(d.pblocks.back().pts);
+			}
+			d.pblocks.push_back(poly_data_block());
+			d.prev_smoothing_group = d.smoothing_group;
+		}
+		poly_data_block &pb(d.pblocks.back());
+		pb.polys.push_back(poly_header_t(d.cur_mat_id, d.obj_group_id));
+		return pb;
+	}
+	void calc_face_normals(obj_parse_data_t &d, poly_data_block &pb, unsigned pix, int recalc_normals) const {
+		vector<point> const &v(d.v);
+		vector<counted_normal> &vn(d.vn);
+		unsigned const npts(pb.polys.back().npts);
+		vector3d &normal(pb.polys.back().n);
+
+		for (unsigned i = pix; i < pix+npts-2; ++i) { // find a nonzero normal
+			normal = cross_product((v[pb.pts[i+1].vix] - v[pb.pts[i].vix]), (v[pb.pts[i+2].vix] - v[pb.pts[i].vix])); // backwards?
+			// if we disable this normalize() we will weight normal contributions by polygon area,
+			// but we have to change the code below and it causes problems with vertex uniquing
+			normal.normalize();
+			if (normal != zero_vector) break; // got a good normal
+		}
+		if (recalc_normals) {
+			bool const face_weight_avg(recalc_normals == 2 && (npts == 3 || npts == 4)); // only works for quads and triangles
+			float face_area(0.0);
+
+			if (face_weight_avg) {
+				point face_pts[4];
+				for (unsigned i = 0; i < npts; ++i) {face_pts[i] = v[pb.pts[i+pix].vix];}
+				face_area = polygon_area(face_pts, npts);
+			}
+			for (unsigned i = pix; i < pix+npts; ++i) {
+				unsigned const vix(pb.pts[i].vix);
+				assert((unsigned)vix < vn.size());
+				bool const using_texgen(d.is_textured && model_auto_tc_scale > 0.0 && pb.pts[i].tix == 0);
+
+				if (vn[vix].is_valid() && (using_texgen || dot_product(normal, vn[vix].get_norm()) < 0.25)) { // normals in disagreement (or using texgen)
+					vn[vix] = zero_vector; // zero it out so that it becomes invalid later
+				}
+				else if (face_weight_avg) {vn[vix].add_normal(face_area*normal);} // face weighted average
+				else {vn[vix].add_normal(normal);} // unweighted average of normals
+			}
+		}
+	}
+	void set_material(obj_parse_data_t &d, string const &material_name) {
+		d.cur_mat_id = model.find_material(material_name);
+
+		if (d.cur_mat_id >= 0) { // material was valid
+			int const tid(model.get_material(d.cur_mat_id).d_tid);
+			d.is_textured = (tid >= 0 && model.tmgr.get_tex_avg_color(tid) != WHITE); // no texture, or all white texture
+		}
+	}
+
+	bool read_serial(obj_parse_data_t &d, geom_xform_t const &xf, int recalc_normals) {
+		if (!open_file()) return 0;
+		vector<point> &v(d.v);
+		vector<vector3d> &n(d.n);
+		vector<counted_normal> &vn(d.vn);
+		vector<point2d<float> > &tc(d.tc);
+		vector<colorRGB> &colors(d.colors);
+		char s[MAX_CHARS];
+		string material_name, mat_lib, group_name, object_name;
+		unsigned approx_line(0);
+
+		while (read_string(s, MAX_CHARS)) {
+			++approx_line;
+
+			if (s[0] == 0) {
+				cout << "empty/unparseable line?" << endl;
+				continue;
+			}
+			else if (s[0] == '#') { // comment
+				read_to_newline(fp); // ignore
+			}
+			else if (strcmp(s, "f") == 0) { // face
+				poly_data_block &pb(add_face_header(d));
+				unsigned &npts(pb.polys.back().npts);
+				unsigned const pix((unsigned)pb.pts.size()), pts_start(pb.pts.size());
+				int vix(0), tix(0), nix(0);
+
+				while (read_int(vix)) { // read vertex index
+					normalize_index(vix, (unsigned)v.size());
+					vntc_ix_t vntc_ix(vix, 0, 0);
+					int const c(get_next_char());
+
+					if (c == '/') {
+						if (read_int(tix)) { // read text coord index
+							normalize_index(tix, (unsigned)tc.size()-1); // account for tc[0]
+							vntc_ix.tix = tix+1; // account for tc[0]
+						}
+						int const c2(get_next_char());
+
+						if (c2 == '/') {
+							if (read_int(nix) && !recalc_normals) { // read normal index
+								normalize_index(nix, (unsigned)n.size()-1); // account for n[0]
+								vntc_ix.nix = nix+1; // account for n[0]
+							} // else the normal will be recalculated later
+						}
+						else {unget_last_char(c2);}
+					}
+					else {unget_last_char(c);}
+					pb.pts.push_back(vntc_ix);
+					++npts;
+				} // end while vertex
+				if (npts < 3) {
+					if (!d.had_npts_error) {cerr << "Error near line " << approx_line << ": face has only " << npts << " vertices." << endl; d.had_npts_error = 1;}
+					pb.pts.resize(pts_start);
+					pb.polys.pop_back(); // remove pts and polygon
+					continue; // skip it
+				}
+				calc_face_normals(d, pb, pix, recalc_normals);
+			}
+			else if (strcmp(s, "v") == 0) { // vertex
+				v.push_back(point());
+				if (recalc_normals) {vn.push_back(counted_normal());} // vertex normal
+
+				if (!read_point(v.back())) {
+					cerr << "Error reading vertex from object file " << filename << " near line " << approx_line << endl;
+					return 0;
+				}
+				colorRGB color;
+				int const color_ret(read_optional_color_RGB(color));
+				if (color_ret == 2) {cerr << "Error reading vertex color from object file " << filename << " near line " << approx_line << endl; return 0;}
+				else if (color_ret == 1) {
+					if (colors.empty()) {colors.resize(v.size()-1, WHITE);} // pad colors up to this point with white
+					colors.push_back(color);
+				}
+				else if (!colors.empty()) {colors.push_back(WHITE);} // color not specified, and in colors mode, pad with white
+				xf.xform_pos(v.back());
+			}
+			else if (strcmp(s, "vt") == 0) { // tex coord
+				point tc3d;
+
+				if (!read_point(tc3d, 2)) {
+					cerr << "Error reading texture coord from object file " << filename << " near line " << approx_line << endl;
+					return 0;
+				}
+				tc.push_back(point2d<float>(tc3d.x, tc3d.y)); // discard tc3d.z
+			}
+			else if (strcmp(s, "vn") == 0) { // normal
+				vector3d normal;
+
+				if (!read_point(normal)) {
+					cerr << "Error reading normal from object file " << filename << " near line " << approx_line << endl;
+					return 0;
+				}
+				if (!recalc_normals) {
+					xf.xform_pos_rm(normal);
+					n.push_back(normal);
+				}
+			}
+			else if (strcmp(s, "l") == 0) { // line
+				read_to_newline(fp); // ignore
+			}
+			else if (strcmp(s, "o") == 0) { // object definition
+				read_str_to_newline(fp, object_name); // can be empty?
+				++d.num_objects;
+				++d.obj_group_id;
+			}
+			else if (strcmp(s, "g") == 0) { // group
+				read_str_to_newline(fp, group_name); // can be empty
+				++d.num_groups;
+				++d.obj_group_id;
+			}
+			else if (strcmp(s, "s") == 0) { // smoothing/shading (off/on or 0/1)
+				if (!read_uint(d.smoothing_group)) {
+					if (!read_string(s, MAX_CHARS) || strcmp(s, "off") != 0) {
+						cerr << "Error reading smoothing group from object file " << filename << " near line " << approx_line << endl;
+						return 0;
+					}
+					d.smoothing_group = 0;
+				}
+			}
+			else if (strcmp(s, "usemtl") == 0) { // use material
+				read_str_to_newline(fp, material_name);
+
+				if (material_name.empty()) {
+					if (!had_empty_mat_error) {cerr << "Error reading material from object file " << filename << " near line " << approx_line << endl;}
+					had_empty_mat_error = 1;
+					return 0;
+				}
+				set_material(d, material_name);
+			}
+			else if (strcmp(s, "mtllib") == 0) { // material library
+				read_str_to_newline(fp, mat_lib);
+
+				if (mat_lib.empty()) {
+					cerr << "Error reading material library from object file " << filename << " near line " << approx_line << endl;
+					return 0;
+				}
+				if (!try_load_mat_lib(mat_lib, d.loaded_mat_libs, approx_line)) {
+					//return 0; // nonfatal
+				}
+			}
+			else {
+				cerr << "Error: Undefined entry '" << s << "' in object file " << filename << " near line " << approx_line << endl;
+				read_to_newline(fp); // ignore this line
+				//return 0;
+			}
+		} // while
+		return 1;
+	}
+
+	void apply_state_cmd(obj_parse_data_t &d, obj_state_cmd_t const &cmd) {
+		switch (cmd.type) {
+		case OBJ_CMD_USEMTL: set_material(d, cmd.str); break;
+		case OBJ_CMD_MTLLIB: try_load_mat_lib(cmd.str, d.loaded_mat_libs, cmd.line); break; // nonfatal
+		case OBJ_CMD_SMOOTH: d.smoothing_group = cmd.val; break;
+		case OBJ_CMD_OBJECT: ++d.num_objects; ++d.obj_group_id; break;
+		case OBJ_CMD_GROUP:  ++d.num_groups;  ++d.obj_group_id; break;
+		case OBJ_CMD_BAD_FACE:
+			model.mark_mat_as_used(d.cur_mat_id);
+			if (!d.had_npts_error) {cerr << "Error near line " << cmd.line << ": face has only " << cmd.val << " vertices." << endl; d.had_npts_error = 1;}
+			break;
+		case OBJ_CMD_UNDEF:
+			cerr << "Error: Undefined entry '" << cmd.str << "' in object file " << filename << " near line " << cmd.line << endl;
+			break;
+		default: assert(0);
+		}
+	}
+
+	// reads the whole file into memory, splits it into chunks on line boundaries, and parses the chunks in parallel;
+	// indices are resolved on the worker threads using per-chunk record counts from a first pass,
+	// then the chunks are merged in file order so that the resulting model is the same as with read_serial()
+	bool read_parallel(obj_parse_data_t &d, geom_xform_t const &xf, int recalc_normals) {
+		if (!open_file(1)) return 0; // binary mode, so that the file size matches the number of bytes read
+		vector<char> file_data;
+		fseek(fp, 0, SEEK_END);
+		long const file_size(ftell(fp));
+		fseek(fp, 0, SEEK_SET);
+		if (file_size > 0) {file_data.resize(file_size + 1, 0);} // add a null terminator
+		bool const read_ok(file_size <= 0 || fread(file_data.data(), 1, file_size, fp) == (size_t)file_size);
+		close_file();
+		if (!read_ok) {cerr << "Error reading object file " << filename << endl; return 0;}
+		if (file_data.empty()) return 1; // empty file
+		char const *const data_end(file_data.data() + file_size);
+		vector<obj_file_chunk_t> chunks;
+
+		for (char const *pos = file_data.data(); pos < data_end;) {
+			char const *end(min((pos + OBJ_PARSE_CHUNK_SIZE), data_end));
+			if (end < data_end) {char const *const nl((char const *)memchr(end, '\n', (data_end - end))); end = (nl ? nl+1 : data_end);} // extend to the end of the line
+			chunks.emplace_back(pos, end);
+			pos = end;
+		}
+		int const num_chunks(chunks.size());
+#pragma omp parallel for schedule(dynamic,1)
+		for (int i = 0; i < num_chunks; ++i) {obj_chunk_parser_t(chunks[i], xf, recalc_normals).count_records();}
+		unsigned num_lines(0), num_v(0), num_tc(0), num_n(0);
+
+		for (auto c = chunks.begin(); c != chunks.end(); ++c) {
+			c->line_off = num_lines; c->v_off = num_v; c->tc_off = num_tc; c->n_off = num_n;
+			num_lines += c->num_lines; num_v += c->num_v; num_tc += c->num_tc; num_n += c->num_n;
+		}
+#pragma omp parallel for schedule(dynamic,1)
+		for (int i = 0; i < num_chunks; ++i) {obj_chunk_parser_t(chunks[i], xf, recalc_normals).parse();}
+		bool had_zero_index(0), has_colors(0);
+
+		for (auto c = chunks.begin(); c != chunks.end(); ++c) {
+			if (!c->error.empty()) {cerr << c->error << " from object file " << filename << " near line " << c->error_line << endl; return 0;}
+			assert(c->v.size() == c->num_v && c->tc.size() == c->num_tc && c->n.size() == c->num_n);
+			had_zero_index |= c->had_zero_index;
+			has_colors     |= !c->colors.empty();
+		}
+		if (had_zero_index) {cerr << "Error: Invalid zero index in object file" << endl;}
+		d.v.reserve(num_v);
+		d.tc.reserve(num_tc+1);
+		d.n.reserve(num_n+1);
+		if (recalc_normals) {d.vn.resize(num_v);}
+		if (has_colors) {d.colors.resize(num_v, WHITE);}
+
+		for (auto c = chunks.begin(); c != chunks.end(); ++c) { // merge in file order
+			d.v.insert (d.v.end(),  c->v.begin(),  c->v.end());
+			d.tc.insert(d.tc.end(), c->tc.begin(), c->tc.end());
+			d.n.insert (d.n.end(),  c->n.begin(),  c->n.end());
+			if (!c->colors.empty()) {assert(c->colors.size() == c->v.size()); copy(c->colors.begin(), c->colors.end(), d.colors.begin()+c->v_off);}
+			auto cmd(c->cmds.begin());
+			unsigned pix(0);
+
+			for (unsigned f = 0; f < c->face_npts.size(); ++f) {
+				for (; cmd != c->cmds.end() && cmd->face_ix <= f; ++cmd) {apply_state_cmd(d, *cmd);}
+				unsigned const npts(c->face_npts[f]);
+				poly_data_block &pb(add_face_header(d));
+				unsigned const start_pix((unsigned)pb.pts.size());
+				pb.pts.insert(pb.pts.end(), (c->pts.begin() + pix), (c->pts.begin() + pix + npts));
+				pb.polys.back().npts = npts;
+				calc_face_normals(d, pb, start_pix, recalc_normals);
+				pix += npts;
+			}
+			for (; cmd != c->cmds.end(); ++cmd) {apply_state_cmd(d, *cmd);}
+			*c = obj_file_chunk_t(c->begin, c->end); // free memory
+		} // for c
+		return 1;
+	}
+
 public:
 	object_file_reader_model(string const &fn, model3d &model_) : object_file_reader(fn), model_from_file_t(fn, model_), had_empty_mat_error(0) {}
 
@@ -531,207 +1082,16 @@ public:
 
 	bool read(geom_xform_t const &xf, int recalc_normals, bool verbose) {
 		RESET_TIME;
-		if (!open_file()) return 0;
 		cout << "Reading object file " << filename << endl;
-		unsigned const block_size = (1 << 18); // 256K
-		int cur_mat_id(-1);
-		unsigned smoothing_group(0), prev_smoothing_group(0), num_faces(0), num_objects(0), num_groups(0), obj_group_id(0);
-		vector<point> v; // vertices
-		vector<vector3d> n; // normals
-		// weighted_normal can also be used, but doesn't work well; see face_weight_avg mode selected by recalc_normals==2
-		vector<counted_normal> vn; // vertex normals
-		vector<point2d<float> > tc; // texture coords
-		vector<colorRGB> colors; // vertex colors
-		deque<poly_data_block> pblocks;
-		set<string> loaded_mat_libs;
-		char s[MAX_CHARS];
-		string material_name, mat_lib, group_name, object_name;
-		tc.push_back(point2d<float>(0.0, 0.0)); // default tex coords
-		n.push_back(zero_vector); // default normal
-		unsigned approx_line(0);
-		bool is_textured(0), had_npts_error(0);
-
-		while (read_string(s, MAX_CHARS)) {
-			++approx_line;
-
-			if (s[0] == 0) {
-				cout << "empty/unparseable line?" << endl;
-				continue;
-			}
-			else if (s[0] == '#') { // comment
-				read_to_newline(fp); // ignore
-			}
-			else if (strcmp(s, "f") == 0) { // face
-				model.mark_mat_as_used(cur_mat_id);
-
-				if (pblocks.empty() || pblocks.back().pts.size() >= block_size || smoothing_group != prev_smoothing_group) { // create a new block
-					if (!pblocks.empty()) {
-						remove_excess_cap(pblocks.back().polys);
-						remove_excess_cap(pblocks.back().pts);
-					}
-					pblocks.push_back(poly_data_block());
-					prev_smoothing_group = smoothing_group;
-				}
-				poly_data_block &pb(pblocks.back());
-				pb.polys.push_back(poly_header_t(cur_mat_id, obj_group_id));
-				unsigned &npts(pb.polys.back().npts);
-				unsigned const pix((unsigned)pb.pts.size()), pts_start(pb.pts.size());
-				int vix(0), tix(0), nix(0);
-
-				while (read_int(vix)) { // read vertex index
-					normalize_index(vix, (unsigned)v.size());
-					vntc_ix_t vntc_ix(vix, 0, 0);
-					int const c(get_next_char());
-
-					if (c == '/') {
-						if (read_int(tix)) { // read text coord index
-							normalize_index(tix, (unsigned)tc.size()-1); // account for tc[0]
-							vntc_ix.tix = tix+1; // account for tc[0]
-						}
-						int const c2(get_next_char());
-
-						if (c2 == '/') {
-							if (read_int(nix) && !recalc_normals) { // read normal index
-								normalize_index(nix, (unsigned)n.size()-1); // account for n[0]
-								vntc_ix.nix = nix+1; // account for n[0]
-							} // else the normal will be recalculated later
-						}
-						else {unget_last_char(c2);}
-					}
-					else {unget_last_char(c);}
-					pb.pts.push_back(vntc_ix);
-					++npts;
-				} // end while vertex
-				if (npts < 3) {
-					if (!had_npts_error) {cerr << "Error near line " << approx_line << ": face has only " << npts << " vertices." << endl; had_npts_error = 1;}
-					pb.pts.resize(pts_start);
-					pb.polys.pop_back(); // remove pts and polygon
-					continue; // skip it
-				}
-				vector3d &normal(pb.polys.back().n);
-				
-				for (unsigned i = pix; i < pix+npts-2; ++i) { // find a nonzero normal
-					normal = cross_product((v[pb.pts[i+1].vix] - v[pb.pts[i].vix]), (v[pb.pts[i+2].vix] - v[pb.pts[i].vix])); // backwards?
-					// if we disable this normalize() we will weight normal contributions by polygon area,
-					// but we have to change the code below and it causes problems with vertex uniquing
-					normal.normalize();
-					if (normal != zero_vector) break; // got a good normal
-				}
-				if (recalc_normals) {
-					bool const face_weight_avg(recalc_normals == 2 && (npts == 3 || npts == 4)); // only works for quads and triangles
-					float face_area(0.0);
-
-					if (face_weight_avg) {
-						point face_pts[4];
-						for (unsigned i = 0; i < npts; ++i) {face_pts[i] = v[pb.pts[i+pix].vix];}
-						face_area = polygon_area(face_pts, npts);
-					}
-					for (unsigned i = pix; i < pix+npts; ++i) {
-						unsigned const vix(pb.pts[i].vix);
-						assert((unsigned)vix < vn.size());
-						bool const using_texgen(is_textured && model_auto_tc_scale > 0.0 && pb.pts[i].tix == 0);
-
-						if (vn[vix].is_valid() && (using_texgen || dot_product(normal, vn[vix].get_norm()) < 0.25)) { // normals in disagreement (or using texgen)
-							vn[vix] = zero_vector; // zero it out so that it becomes invalid later
-						}
-						else if (face_weight_avg) {vn[vix].add_normal(face_area*normal);} // face weighted average
-						else {vn[vix].add_normal(normal);} // unweighted average of normals
-					}
-				}
-			}
-			else if (strcmp(s, "v") == 0) { // vertex
-				v.push_back(point());
-				if (recalc_normals) {vn.push_back(counted_normal());} // vertex normal
-			
-				if (!read_point(v.back())) {
-					cerr << "Error reading vertex from object file " << filename << " near line " << approx_line << endl;
-					return 0;
-				}
-				colorRGB color;
-				int const color_ret(read_optional_color_RGB(color));
-				if (color_ret == 2) {cerr << "Error reading vertex color from object file " << filename << " near line " << approx_line << endl; return 0;}
-				else if (color_ret == 1) {
-					if (colors.empty()) {colors.resize(v.size()-1, WHITE);} // pad colors up to this point with white
-					colors.push_back(color);
-				}
-				else if (!colors.empty()) {colors.push_back(WHITE);} // color not specified, and in colors mode, pad with white
-				xf.xform_pos(v.back());
-			}
-			else if (strcmp(s, "vt") == 0) { // tex coord
-				point tc3d;
-			
-				if (!read_point(tc3d, 2)) {
-					cerr << "Error reading texture coord from object file " << filename << " near line " << approx_line << endl;
-					return 0;
-				}
-				tc.push_back(point2d<float>(tc3d.x, tc3d.y)); // discard tc3d.z
-			}
-			else if (strcmp(s, "vn") == 0) { // normal
-				vector3d normal;
-			
-				if (!read_point(normal)) {
-					cerr << "Error reading normal from object file " << filename << " near line " << approx_line << endl;
-					return 0;
-				}
-				if (!recalc_normals) {
-					xf.xform_pos_rm(normal);
-					n.push_back(normal);
-				}
-			}
-			else if (strcmp(s, "l") == 0) { // line
-				read_to_newline(fp); // ignore
-			}
-			else if (strcmp(s, "o") == 0) { // object definition
-				read_str_to_newline(fp, object_name); // can be empty?
-				++num_objects;
-				++obj_group_id;
-			}
-			else if (strcmp(s, "g") == 0) { // group
-				read_str_to_newline(fp, group_name); // can be empty
-				++num_groups;
-				++obj_group_id;
-			}
-			else if (strcmp(s, "s") == 0) { // smoothing/shading (off/on or 0/1)
-				if (!read_uint(smoothing_group)) {
-					if (!read_string(s, MAX_CHARS) || strcmp(s, "off") != 0) {
-						cerr << "Error reading smoothing group from object file " << filename << " near line " << approx_line << endl;
-						return 0;
-					}
-					smoothing_group = 0;
-				}
-			}
-			else if (strcmp(s, "usemtl") == 0) { // use material
-				read_str_to_newline(fp, material_name);
-
-				if (material_name.empty()) {
-					if (!had_empty_mat_error) {cerr << "Error reading material from object file " << filename << " near line " << approx_line << endl;}
-					had_empty_mat_error = 1;
-					return 0;
-				}
-				cur_mat_id = model.find_material(material_name);
-				
-				if (cur_mat_id >= 0) { // material was valid
-					int const tid(model.get_material(cur_mat_id).d_tid);
-					is_textured = (tid >= 0 && model.tmgr.get_tex_avg_color(tid) != WHITE); // no texture, or all white texture
-				}
-			}
-			else if (strcmp(s, "mtllib") == 0) { // material library
-				read_str_to_newline(fp, mat_lib);
-
-				if (mat_lib.empty()) {
-					cerr << "Error reading material library from object file " << filename << " near line " << approx_line << endl;
-					return 0;
-				}
-				if (!try_load_mat_lib(mat_lib, loaded_mat_libs, approx_line)) {
-					//return 0; // nonfatal
-				}
-			}
-			else {
-				cerr << "Error: Undefined entry '" << s << "' in object file " << filename << " near line " << approx_line << endl;
-				read_to_newline(fp); // ignore this line
-				//return 0;
-			}
-		} // while
+		obj_parse_data_t d;
+		if (!(parallel_obj_file_load ? read_parallel(d, xf, recalc_normals) : read_serial(d, xf, recalc_normals))) return 0;
+		vector<point> &v(d.v);
+		vector<vector3d> &n(d.n);
+		vector<counted_normal> &vn(d.vn);
+		vector<point2d<float> > &tc(d.tc);
+		vector<colorRGB> &colors(d.colors);
+		deque<poly_data_block> &pblocks(d.pblocks);
+		unsigned num_faces(0);
 		remove_excess_cap(v);
 		remove_excess_cap(n);
 		remove_excess_cap(tc);
@@ -742,6 +1102,7 @@ public:
 		PRINT_TIME("Model Texture Load");
 		size_t const num_blocks(pblocks.size());
 		model3d::proc_model_normals(vn, recalc_normals); // if recalc_normals
+		vector<vert_norm_tc> bench_verts; // only used with benchmark_vertex_dedup
 
 		while (!pblocks.empty()) {
 			poly_data_block const &pd(pblocks.back());
@@ -779,18 +1140,20 @@ public:
 					if (!colors.empty()) {assert(V.vix < colors.size()); poly.color += colors[V.vix];}
 				} // for p
 				if (!colors.empty()) {poly.color = poly.color/j->npts; poly.color.A = 1.0;} // FIXME: uses average vertex color for each face/polygon
+				if (benchmark_vertex_dedup) {bench_verts.insert(bench_verts.end(), poly.begin(), poly.end());}
 				num_faces += model.add_polygon(poly, vmap, vmap_tan, j->mat_id, j->obj_id);
 				pix += j->npts;
 			} // for j
 			pblocks.pop_back();
 		}
+		if (benchmark_vertex_dedup) {run_vertex_dedup_benchmark(bench_verts);}
 		model.finalize(); // optimize vertices, remove excess capacity, compute bounding cube, subdivide, generate LOD blocks
 		PRINT_TIME("Model3d Build");
 		
 		if (verbose) {
 			size_t const nn(recalc_normals ? vn.size() : n.size());
 			cout << "verts: " << v.size() << ", normals: " << nn << ", tcs: " << tc.size() << ", colors: " << colors.size() << ", faces: " << num_faces
-				 << ", objects: " << num_objects << ", groups: " << num_groups << ", blocks: " << num_blocks << endl;
+				 << ", objects: " << d.num_objects << ", groups: " << d.num_groups << ", blocks: " << num_blocks << endl;
 			model.show_stats();
 		}
 		return 1;
@@ -811,7 +1174,7 @@ bool write_model3d_file(string const &base_fn, model3d &cur_model) {
 	out_fn += ".model3d";
 	cur_model.calc_tangent_vectors(); // tangent vectors are needed for writing
 				
-	if (!cur_model.write_to_disk(out_fn)) {
+	if (!cur_model.write_to_disk(out_fn, compress_model3d_files, model3d_drop_tangents)) {
 		cerr << "Error writing model3d file " << out_fn << endl;
 		return 0;
 	}
@@ -822,6 +1185,7 @@ bool write_model3d_file(string const &base_fn, model3d &cur_model) {
 
 bool read_3ds_file_model(string const &filename, model3d &model, geom_xform_t const &xf, int use_vertex_normals, bool verbose);
 bool read_3ds_file_pts(string const &filename, vector<coll_tquad> *ppts, geom_xform_t const &xf, colorRGBA const &def_c, bool verbose);
+void register_scene_input_file(string const &fn);
 
 // recalc_normals: 0=no, 1=yes, 2=face_weight_avg
 bool load_model_file(string const &filename, model3ds &models, geom_xform_t const &xf, int def_tid, colorRGBA const &def_c,
@@ -857,6 +1221,7 @@ bool read_model_file(string const &filename, vector<coll_tquad> *ppts, geom_xfor
 	int reflective, float metalness, bool load_models, int recalc_normals, int group_cobjs_level, bool write_file, bool verbose)
 {
 	setlocale(LC_ALL, "C");
+	register_scene_input_file(filename); // cobjs may be created from model polygons
 
 	if (load_models) {
 		if (!load_model_file(filename, all_models, xf, def_tid, def_c, reflective, metalness, recalc_normals, group_cobjs_level, write_file, verbose)) return 0;
@@ -3,6 +3,7 @@
 // 12/6/18
 #include "city.h"
 #include "shaders.h"
+#include "profiler.h"
 
 float const PED_WIDTH_SCALE  = 0.5; // ratio of collision radius to model radius (x/y)
 float const PED_HEIGHT_SCALE = 2.5; // ratio of collision radius to model height (z)
@@ -10,7 +11,7 @@ float const CROSS_SPEED_MULT = 1.8; // extra speed multiplier when crossing the
 float const CROSS_WAIT_TIME  = 60.0; // in seconds
 bool const FORCE_USE_CROSSWALKS = 0; // more realistic and safe, but causes problems with pedestian collisions
 
-extern bool tt_fire_button_down;
+extern bool tt_fire_button_down, parallel_ped_update;
 extern int display_mode, game_mode, animate2, frame_counter;
 extern float FAR_CLIP;
 extern double camera_zh;
@@ -52,7 +53,7 @@ float get_sidewalk_width(cube_t const &plot_bcube) { // Note: technically should
 	return -STREETLIGHT_DIST_FROM_PLOT_EDGE*plot_sz + streetlight_ns::get_streetlight_pole_radius();
 }
 
-bool pedestrian_t::check_inside_plot(ped_manager_t &ped_mgr, point const &prev_pos, cube_t const &plot_bcube, cube_t const &next_plot_bcube) {
+bool pedestrian_t::check_inside_plot(ped_manager_t &ped_mgr, point const &prev_pos, cube_t const &plot_bcube, cube_t const &next_plot_bcube, ped_update_state_t *pus) {
 	if (in_building) return 0; // not implemented yet
 	//if (ssn == 2516) {cout << "in_the_road: " << in_the_road << ", pos: " << pos.str() << ", plot_bcube: " << plot_bcube.str() << ", npbc: " << next_plot_bcube.str() << endl;}
 	if (plot_bcube.contains_pt_xy(pos)) {return 1;} // inside the plot
@@ -60,8 +61,8 @@ bool pedestrian_t::check_inside_plot(ped_manager_t &ped_mgr, point const &prev_p
 	if (next_plot == plot) return 0; // no next plot - clip to this plot
 	
 	if (next_plot_bcube.contains_pt_xy(pos)) {
-		ped_mgr.move_ped_to_next_plot(*this);
-		next_plot = ped_mgr.get_next_plot(*this);
+		ped_mgr.move_ped_to_next_plot(*this, pus);
+		next_plot = ped_mgr.get_next_plot(*this, -1, (pus ? &pus->rgen : nullptr)); // use the per-thread rgen in the parallel update
 		return 1;
 	}
 	cube_t union_plot_bcube(plot_bcube);
@@ -88,11 +89,11 @@ bool pedestrian_t::check_road_coll(ped_manager_t const &ped_mgr, cube_t const &p
 	return 0;
 }
 
-bool pedestrian_t::is_valid_pos(vect_cube_t const &colliders, bool &ped_at_dest, ped_manager_t const *const ped_mgr) const {
+bool pedestrian_t::is_valid_pos(vect_cube_t const &colliders, bool &ped_at_dest, ped_manager_t const *const ped_mgr, vector<point> *bldg_points) const {
 	if (in_the_road || in_building) return 1; // not in a plot, no collision detection needed
 	unsigned building_id(0);
 
-	if (check_buildings_ped_coll(pos, radius, plot, building_id)) {
+	if (check_buildings_ped_coll(pos, radius, plot, building_id, bldg_points)) {
 		if (!has_dest_bldg || building_id != dest_bldg) return 0;
 		bool const ret(!at_dest);
 		ped_at_dest = 1;
@@ -125,15 +126,22 @@ void register_ped_coll(pedestrian_t &p1, pedestrian_t &p2, unsigned pid1, unsign
 	p2.collided = p2.ped_coll = 1; p2.colliding_ped = pid1;
 }
 
-bool pedestrian_t::check_ped_ped_coll_range(vector<pedestrian_t> &peds, unsigned pid, unsigned ped_start, unsigned target_plot, float prox_radius, vector3d &force) {
-	float const prox_radius_sq(prox_radius*prox_radius);
+// T is either pedestrian_t or ped_snapshot_t; returns the index of the colliding ped, or -1 if there was no collision
+template<typename T> int check_ped_ped_coll_range(pedestrian_t const &ped, vector<T> const &peds, unsigned pid, unsigned ped_start, unsigned ped_end,
+	unsigned target_plot, float prox_radius, vector3d &force)
+{
+	point const &pos(ped.pos);
+	vector3d const &vel(ped.vel);
+	float const radius(ped.radius), speed(ped.speed), prox_radius_sq(prox_radius*prox_radius);
+	assert(ped_start <= ped_end && ped_end <= peds.size());
 
-	for (auto i = peds.begin()+ped_start; i != peds.end(); ++i) { // check every ped until we exit target_plot
+	for (auto i = peds.begin()+ped_start; i != peds.begin()+ped_end; ++i) { // check every ped until we exit target_plot
 		if (i->plot != target_plot) break; // moved to a new plot, no collision, done; since plots are globally unique across cities, we don't need to check cities
+		if (unsigned(i - peds.begin()) == pid) continue; // skip self; can happen when reading the snapshot after this ped moved to a new plot
 		float const dist_sq(p2p_dist_xy_sq(pos, i->pos));
 		if (dist_sq > prox_radius_sq) continue; // proximity test
 		float const r_sum(0.6f*(radius + i->radius)); // using a smaller radius to allow peds to get close to each other
-		if (dist_sq < r_sum*r_sum) {register_ped_coll(*this, *i, pid, (i - peds.begin())); return 1;} // collision
+		if (dist_sq < r_sum*r_sum) {return (i - peds.begin());} // collision
 		if (speed < TOLERANCE) continue;
 		vector3d const delta_v(vel - i->vel), delta_p((pos.x - i->pos.x), (pos.y - i->pos.y), 0.0);
 		float const dp(-dot_product_xy(delta_v, delta_p));
@@ -147,33 +155,48 @@ bool pedestrian_t::check_ped_ped_coll_range(vector<pedestrian_t> &peds, unsigned
 		force += rejection*(rel_vel*force_mult*fmag/rmag);
 		//cout << TXT(r_sum) << TXT(dist) << TXT(fmag) << ", dv: " << delta_v.str() << ", dp: " << delta_p.str() << ", rej: " << rejection.str() << ", force: " << force.str() << endl;
 	} // for i
-	return 0;
+	return -1;
 }
 
-bool pedestrian_t::check_ped_ped_coll(ped_manager_t const &ped_mgr, vector<pedestrian_t> &peds, unsigned pid, float delta_dir) {
+bool pedestrian_t::check_ped_ped_coll(ped_manager_t const &ped_mgr, vector<pedestrian_t> &peds, unsigned pid, float delta_dir, ped_update_state_t *pus) {
 	if (in_building) return 0; // no ped-ped collisions in buildings (yet)
 	assert(pid < peds.size());
 	float const timestep(2.0*TICKS_PER_SECOND), lookahead_dist(timestep*speed); // how far we can travel in 2s
 	float const prox_radius(1.2*radius + lookahead_dist); // assume other ped has a similar radius
 	vector3d force(zero_vector);
-	if (check_ped_ped_coll_range(peds, pid, pid+1, plot, prox_radius, force)) return 1;
+	int const coll_ix(check_ped_ped_coll_range(*this, peds, pid, pid+1, (pus ? pus->ped_end : peds.size()), plot, prox_radius, force));
+	if (coll_ix >= 0) {register_ped_coll(*this, peds[coll_ix], pid, coll_ix); return 1;}
 
 	if (in_the_road && next_plot != plot) {
 		// need to check for coll between two peds crossing the street from different sides, since they won't be in the same plot while in the street
 		unsigned const ped_ix(ped_mgr.get_first_ped_at_plot(next_plot));
 		assert(ped_ix <= peds.size()); // could be at the end
-		if (check_ped_ped_coll_range(peds, pid, ped_ix, next_plot, prox_radius, force)) return 1;
+
+		if (pus) { // parallel update: peds in other plots may be updated concurrently, so read their frame start state and defer the write to the other ped
+			vector<ped_snapshot_t> const &snap(ped_mgr.get_ped_snapshot());
+			int const coll_ix(check_ped_ped_coll_range(*this, snap, pid, ped_ix, snap.size(), next_plot, prox_radius, force));
+
+			if (coll_ix >= 0) {
+				collided = ped_coll = 1; colliding_ped = coll_ix;
+				pus->ped_colls.emplace_back(coll_ix, pid);
+				return 1;
+			}
+		}
+		else {
+			int const coll_ix(check_ped_ped_coll_range(*this, peds, pid, ped_ix, peds.size(), next_plot, prox_radius, force));
+			if (coll_ix >= 0) {register_ped_coll(*this, peds[coll_ix], pid, coll_ix); return 1;}
+		}
 	}
 	if (force != zero_vector) {set_velocity((0.1*delta_dir)*force + ((1.0 - delta_dir)/speed)*vel);} // apply ped repulsive force
 	return 0;
 }
 
-bool pedestrian_t::check_ped_ped_coll_stopped(vector<pedestrian_t> &peds, unsigned pid) {
+bool pedestrian_t::check_ped_ped_coll_stopped(vector<pedestrian_t> &peds, unsigned pid, unsigned ped_end) {
 	if (in_building) return 0; // no ped-ped collisions in buildings (yet)
-	assert(pid < peds.size());
+	assert(pid < ped_end && ped_end <= peds.size());
 
 	// Note: shouldn't have to check peds in the next plot, assuming that if we're stopped, they likely are as well, and won't be walking toward us
-	for (auto i = peds.begin()+pid+1; i != peds.end(); ++i) { // check every ped until we exit target_plot
+	for (auto i = peds.begin()+pid+1; i != peds.begin()+ped_end; ++i) { // check every ped until we exit target_plot
 		if (i->plot != plot) break; // moved to a new plot, no collision, done; since plots are globally unique across cities, we don't need to check cities
 		if (!dist_xy_less_than(pos, i->pos, 0.6f*(radius + i->radius))) continue; // no collision
 		i->collided = i->ped_coll = 1; i->colliding_ped = pid;
@@ -420,11 +443,11 @@ point pedestrian_t::get_dest_pos(cube_t const &plot_bcube, cube_t const &next_pl
 	return pos; // no dest
 }
 
-bool pedestrian_t::choose_alt_next_plot(ped_manager_t const &ped_mgr) {
+bool pedestrian_t::choose_alt_next_plot(ped_manager_t const &ped_mgr, rand_gen_t *rgen) {
 	reset_waiting(); // reset waiting state regardless of outcome; we don't want to get here every frame if we fail to find another plot
 	if (plot == next_plot) return 0; // no next plot (error?)
 	//if (next_plot == dest_plot) return 0; // the next plot is our desination, should we still choose another plot?
-	unsigned const cand_next_plot(ped_mgr.get_next_plot(*this, next_plot));
+	unsigned const cand_next_plot(ped_mgr.get_next_plot(*this, next_plot, rgen));
 	if (cand_next_plot == next_plot || cand_next_plot == plot) return 0; // failed
 	next_plot = cand_next_plot;
 	return 1; // success
@@ -476,17 +499,24 @@ void pedestrian_t::move(ped_manager_t const &ped_mgr, cube_t const &plot_bcube,
 	anim_time += timestep*speed;
 }
 
-void pedestrian_t::next_frame(ped_manager_t &ped_mgr, vector<pedestrian_t> &peds, unsigned pid, rand_gen_t &rgen, float delta_dir) {
+// pus is non-null for the parallel update, where peds are updated by plot and side effects outside the current plot are deferred
+void pedestrian_t::next_frame(ped_manager_t &ped_mgr, vector<pedestrian_t> &peds, unsigned pid, rand_gen_t &rgen, float delta_dir, ped_update_state_t *pus) {
 	if (destroyed)    return; // destroyed
 	if (speed == 0.0) return; // not moving, no update needed
 	if (in_building)  return; // building update/movement logic handled elsewhere
 
 	// navigation with destination
 	if (at_dest) {
+		assert(pus == nullptr); // the parallel update handles this serially before updating plots
 		register_at_dest();
 		ped_mgr.choose_new_ped_plot_pos(*this);
 	}
-	if (at_crosswalk) {ped_mgr.mark_crosswalk_in_use(*this);}
+	if (at_crosswalk) {
+		if (pus) {pus->crosswalks.emplace_back(pos, dir, city);}
+		else {ped_mgr.mark_crosswalk_in_use(*this);}
+	}
+	path_finder_t &path_finder(pus ? pus->path_finder : ped_mgr.path_finder);
+	vector<point> *const bldg_points(pus ? &pus->bldg_points : nullptr);
 	// movement logic
 	cube_t const &plot_bcube(ped_mgr.get_city_plot_bcube_for_peds(city, plot));
 	cube_t const &next_plot_bcube(ped_mgr.get_city_plot_bcube_for_peds(city, next_plot));
@@ -494,12 +524,12 @@ void pedestrian_t::next_frame(ped_manager_t &ped_mgr, vector<pedestrian_t> &peds
 	move(ped_mgr, plot_bcube, next_plot_bcube, delta_dir);
 
 	if (is_stopped) { // ignore any collisions and just stand there, keeping the same target_pos; will go when path is clear
-		if (get_wait_time_secs() > CROSS_WAIT_TIME && choose_alt_next_plot(ped_mgr)) { // give up and choose another destination if waiting for too long
+		if (get_wait_time_secs() > CROSS_WAIT_TIME && choose_alt_next_plot(ped_mgr, (pus ? &rgen : nullptr))) { // give up and choose another destination if waiting for too long
 			target_pos = all_zeros;
 			go(); // back up or turn so that we don't walk forward into the street? move() should attempt to rotate in place
 		}
 		else {
-			check_ped_ped_coll_stopped(peds, pid); // still need to check for other peds colliding with us; this doesn't always work
+			check_ped_ped_coll_stopped(peds, pid, (pus ? pus->ped_end : peds.size())); // still need to check for other peds colliding with us; this doesn't always work
 			collided = ped_coll = 0;
 			return;
 		}
@@ -509,10 +539,10 @@ void pedestrian_t::next_frame(ped_manager_t &ped_mgr, vector<pedestrian_t> &peds
 	bool outside_plot(0);
 
 	if (collided) {} // already collided with a previous ped this frame, handled below
-	else if (!check_inside_plot(ped_mgr, prev_pos, plot_bcube, next_plot_bcube)) {collided = outside_plot = 1;} // outside the plot, treat as a collision with the plot bounds
-	else if (!is_valid_pos(colliders, at_dest, &ped_mgr)) {collided = 1;} // collided with a static collider
+	else if (!check_inside_plot(ped_mgr, prev_pos, plot_bcube, next_plot_bcube, pus)) {collided = outside_plot = 1;} // outside the plot, treat as a collision with the plot bounds
+	else if (!is_valid_pos(colliders, at_dest, &ped_mgr, bldg_points)) {collided = 1;} // collided with a static collider
 	else if (check_road_coll(ped_mgr, plot_bcube, next_plot_bcube)) {collided = 1;} // collided with something in the road (stoplight, streetlight, etc.)
-	else if (check_ped_ped_coll(ped_mgr, peds, pid, delta_dir)) {collided = 1;} // collided with another pedestrian
+	else if (check_ped_ped_coll(ped_mgr, peds, pid, delta_dir, pus)) {collided = 1;} // collided with another pedestrian
 	else { // no collisions
 		//cout << TXT(pid) << TXT(plot) << TXT(dest_plot) << TXT(next_plot) << TXT(at_dest) << TXT(delta_dir) << TXT((unsigned)stuck_count) << TXT(collided) << endl;
 		vector3d dest_pos(get_dest_pos(plot_bcube, next_plot_bcube, ped_mgr));
@@ -527,12 +557,12 @@ void pedestrian_t::next_frame(ped_manager_t &ped_mgr, vector<pedestrian_t> &peds
 			}
 			// run only every several frames to reduce runtime; also run when at dest and when close to the current target pos or at the destination
 			if (at_dest || update_path) {
-				get_avoid_cubes(ped_mgr, colliders, dest_pos, ped_mgr.path_finder.get_avoid_vector());
+				get_avoid_cubes(ped_mgr, colliders, dest_pos, path_finder.get_avoid_vector());
 				target_pos = all_zeros;
 				cube_t union_plot_bcube(plot_bcube);
 				union_plot_bcube.union_with_cube(next_plot_bcube); // this is the area the ped is constrained to (both plots + road in between)
 				// run path finding between pos and dest_pos using avoid cubes
-				if (ped_mgr.path_finder.run(pos, dest_pos, union_plot_bcube, 0.1*radius, dest_pos)) {target_pos = dest_pos;}
+				if (path_finder.run(pos, dest_pos, union_plot_bcube, 0.1*radius, dest_pos)) {target_pos = dest_pos;}
 			}
 			else if (target_valid()) {dest_pos = target_pos;} // use previous frame's dest if valid
 			vector3d dest_dir((dest_pos.x - pos.x), (dest_pos.y - pos.y), 0.0); // zval=0, not normalized
@@ -552,7 +582,7 @@ void pedestrian_t::next_frame(ped_manager_t &ped_mgr, vector<pedestrian_t> &peds
 			point const cur_pos(pos);
 			pos = prev_pos; // restore to previous valid pos unless we're outside the plot
 			// if prev pos is also invalid, undo the restore to avoid getting this ped stuck in a collision object
-			if (!is_valid_pos(colliders, at_dest, &ped_mgr) || check_road_coll(ped_mgr, plot_bcube, next_plot_bcube)) {pos = cur_pos;}
+			if (!is_valid_pos(colliders, at_dest, &ped_mgr, bldg_points) || check_road_coll(ped_mgr, plot_bcube, next_plot_bcube)) {pos = cur_pos;}
 		}
 		vector3d new_dir;
 
@@ -563,7 +593,8 @@ void pedestrian_t::next_frame(ped_manager_t &ped_mgr, vector<pedestrian_t> &peds
 		}
 		if (ped_coll) {
 			assert(colliding_ped < peds.size());
-			vector3d const coll_dir(peds[colliding_ped].pos - pos);
+			bool const use_snap(pus && !pus->owns_ped(colliding_ped)); // other ped may be updated concurrently
+			vector3d const coll_dir((use_snap ? ped_mgr.get_ped_snapshot()[colliding_ped].pos : peds[colliding_ped].pos) - pos);
 			new_dir = cross_product(vel, plus_z);
 			if (dot_product_xy(new_dir, coll_dir) > 0.0) {new_dir = -new_dir;} // orient away from the other ped
 		}
@@ -684,6 +715,14 @@ void ped_manager_t::sort_by_city_and_plot() {
 	//timer_t timer("Ped Sort"); // 0.12ms
 	if (peds.empty()) return;
 	bool const first_sort(by_city.empty()); // since peds can't yet move between cities, we only need to sorty by city the first time
+	bool has_ped_colls(0);
+
+	for (auto i = peds.begin(); i != peds.end(); ++i) { // colliding_ped is an index into peds, so convert it to the other ped's SSN while sorting
+		if (!i->ped_coll) continue; // colliding_ped is unused
+		assert(i->colliding_ped < peds.size());
+		i->colliding_ped = peds[i->colliding_ped].ssn;
+		has_ped_colls = 1;
+	}
 
 	if (first_sort) { // construct by_city
 		sort(peds.begin(), peds.end());
@@ -712,6 +751,20 @@ void ped_manager_t::sort_by_city_and_plot() {
 		while (pix < peds.size() && peds[pix].plot == plot) {++pix;}
 		by_plot[plot+1] = pix; // next plot begins here
 	}
+	if (has_ped_colls) { // convert colliding_ped from SSN back to the new index
+		vector<unsigned> ssn_to_ix;
+
+		for (unsigned i = 0; i < peds.size(); ++i) {
+			unsigned const ssn(peds[i].ssn);
+			if (ssn >= ssn_to_ix.size()) {ssn_to_ix.resize(ssn+1, peds.size());}
+			ssn_to_ix[ssn] = i;
+		}
+		for (auto i = peds.begin(); i != peds.end(); ++i) {
+			if (!i->ped_coll) continue;
+			assert(i->colliding_ped < ssn_to_ix.size() && ssn_to_ix[i->colliding_ped] < peds.size());
+			i->colliding_ped = ssn_to_ix[i->colliding_ped];
+		}
+	}
 	need_to_sort_peds = 0; // peds are now sorted
 }
 
@@ -789,14 +842,66 @@ void ped_manager_t::remove_destroyed_peds() {
 	ped_destroyed = 0;
 }
 
-void ped_manager_t::register_ped_new_plot(pedestrian_t const &ped) {
-	if (!need_to_sort_city.empty()) {need_to_sort_city[ped.city] = 1;}
+void ped_manager_t::register_ped_new_plot(pedestrian_t const &ped) {register_ped_new_plot(ped.city);}
+
+void ped_manager_t::register_ped_new_plot(unsigned city) {
+	if (!need_to_sort_city.empty()) {need_to_sort_city[city] = 1;}
 	need_to_sort_peds = 1;
 }
-void ped_manager_t::move_ped_to_next_plot(pedestrian_t &ped) {
+void ped_manager_t::move_ped_to_next_plot(pedestrian_t &ped, ped_update_state_t *pus) {
 	if (ped.next_plot == ped.plot) return; // already there (error?)
 	ped.plot = ped.next_plot; // assumes plot is adjacent; doesn't actually do any moving, only registers the move
-	register_ped_new_plot(ped);
+	if (pus) {pus->new_plot_cities.push_back(ped.city);} // deferred until all plots are updated
+	else {register_ped_new_plot(ped);}
+}
+
+// Updates peds in parallel, with each plot's peds updated in order by a single thread. Peds in other plots are read from the frame start snapshot,
+// and writes outside the current plot are deferred and applied after all plots are updated, so the result doesn't depend on the number of threads.
+void ped_manager_t::next_frame_parallel(float delta_dir) {
+	//timer_t timer("Ped Update Parallel");
+	PROFILE_ZONE("Ped Update Parallel");
+	// peds that reached their destination choose a new one here because this uses rgen and may respawn them in a different plot
+	for (auto i = peds.begin(); i != peds.end(); ++i) {
+		if (i->destroyed || i->speed == 0.0 || i->in_building || !i->at_dest) continue; // same as pedestrian_t::next_frame()
+		i->register_at_dest();
+		choose_new_ped_plot_pos(*i);
+	}
+	if (need_to_sort_peds) {sort_by_city_and_plot();} // each ped must be in the range of its plot
+	peds_snap.resize(peds.size());
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < (int)peds.size(); ++i) {peds_snap[i] = ped_snapshot_t(peds[i]);}
+	update_states.resize(max(1, omp_get_max_threads_3dw()));
+	int const num_plots(by_plot.empty() ? 0 : (by_plot.size() - 1));
+	unsigned const frame_seed(rgen.rand());
+
+#pragma omp parallel for schedule(dynamic,16)
+	for (int plot = 0; plot < num_plots; ++plot) {
+		unsigned const ped_start(by_plot[plot]), ped_end(by_plot[plot+1]);
+		if (ped_start == ped_end) continue; // no peds in this plot
+		PROFILE_ZONE("Ped Plot Update"); // per-thread totals show load imbalance across plots
+		ped_update_state_t &pus(update_states[omp_get_thread_num_3dw()]);
+		pus.ped_start = ped_start;
+		pus.ped_end   = ped_end;
+		pus.rgen.set_state(frame_seed, plot+1); // seeded by plot rather than by thread
+		pus.rgen.rand_mix();
+		for (unsigned i = ped_start; i < ped_end; ++i) {peds[i].next_frame(*this, peds, i, pus.rgen, delta_dir, &pus);}
+	}
+	// apply deferred writes; these are order independent except for ped_colls, which are sorted
+	vector<pair<unsigned, unsigned>> ped_colls;
+
+	for (auto s = update_states.begin(); s != update_states.end(); ++s) {
+		for (auto c = s->new_plot_cities.begin(); c != s->new_plot_cities.end(); ++c) {register_ped_new_plot(*c);}
+		for (auto c = s->crosswalks.begin(); c != s->crosswalks.end(); ++c) {mark_crosswalk_in_use(c->city, c->pos, c->dir);}
+		vector_add_to(s->ped_colls, ped_colls);
+		s->clear_deferred();
+	}
+	sort(ped_colls.begin(), ped_colls.end());
+
+	for (auto c = ped_colls.begin(); c != ped_colls.end(); ++c) {
+		assert(c->first < peds.size());
+		pedestrian_t &ped(peds[c->first]);
+		ped.collided = ped.ped_coll = 1; ped.colliding_ped = c->second; // will be handled in the next frame
+	}
 }
 
 void ped_manager_t::next_frame() {
@@ -816,7 +921,10 @@ void ped_manager_t::next_frame() {
 		if (first_frame) { // choose initial ped destinations (must be after building setup, etc.)
 			for (auto i = peds.begin(); i != peds.end(); ++i) {choose_dest_building_or_parked_car(*i);}
 		}
-		for (auto i = peds.begin(); i != peds.end(); ++i) {i->next_frame(*this, peds, (i - peds.begin()), rgen, delta_dir);}
+		if (parallel_ped_update && !first_frame && !by_plot.empty()) {next_frame_parallel(delta_dir);}
+		else {
+			for (auto i = peds.begin(); i != peds.end(); ++i) {i->next_frame(*this, peds, (i - peds.begin()), rgen, delta_dir);}
+		}
 		if (need_to_sort_peds) {sort_by_city_and_plot();}
 		first_frame = 0;
 	}
@@ -861,34 +969,47 @@ bool ped_manager_t::has_nearby_car(pedestrian_t const &ped, bool road_dim, float
 	return has_nearby_car_on_road(ped, road_dim, (unsigned)road_ix, delta_time, dbg_cubes);
 }
 
+struct comp_car_front { // for binary search on the front end of cars moving in the same direction on the same road
+	bool dim, dir;
+	comp_car_front(bool dim_, bool dir_) : dim(dim_), dir(dir_) {}
+	bool operator()(car_base_t const &c, float val) const {return (c.bcube.d[dim][dir] < val);}
+};
+
 bool ped_manager_t::has_nearby_car_on_road(pedestrian_t const &ped, bool dim, unsigned road_ix, float delta_time, vect_cube_t *dbg_cubes) const {
 	if (ped.city >= cars_by_city.size()) return 0; // no cars in this city? should be rare, unless cars aren't enabled
 	car_city_vect_t const &cv(cars_by_city[ped.city]);
 	point const &pos(ped.pos);
+	vector3d const max_car_sz(city_params.get_max_car_size());
+	float const max_car_len(1.01*max(max_car_sz.x, max_car_sz.y)); // upper bound on the distance between the front and back of a car
 
 	for (unsigned dir = 0; dir < 2; ++dir) { // look both ways before crossing
 		auto const &cars(cv.cars[dim][dir]);
 		car_base_t ref_car; ref_car.cur_city = ped.city; ref_car.cur_road = road_ix;
 		auto range_start(std::lower_bound(cars.begin(), cars.end(), ref_car, comp_car_road())); // binary search acceleration
+		auto range_end  (std::upper_bound(range_start,  cars.end(), ref_car, comp_car_road()));
 		float const speed_mult(CAR_SPEED_SCALE*city_params.car_speed), pos_min(pos[dim] - ped.radius), pos_max(pos[dim] + ped.radius);
 		auto closest_car(cars.end());
-
-		for (auto it = range_start; it != cars.end(); ++it) {
-			car_base_t const &c(*it);
-			assert(c.cur_city == ped.city && c.dim == dim && c.dir == (dir != 0));
-			if (c.cur_road != road_ix) break; // different road, done
-			float const val(c.bcube.d[dim][!dir]); // back end of the car
-			if (dir) {if (val > pos_max) break;   } // already passed the ped, not a threat - done (cars are sorted in this dim)
-			else     {if (val < pos_min) continue;} // already passed the ped, not a threat - skip to next car
-			if (closest_car == cars.end()) {closest_car = it;} // first threatening car
-			else {
-				float const val2(closest_car->bcube.d[dim][!dir]);
-				if (dir ? (val > val2) : (val < val2)) {closest_car = it;} // this car is closer
+		// cars on a road are sorted by their front ends, so we can binary search to the ped's position rather than iterating over every car on the road
+		comp_car_front const cmp(dim, (dir != 0));
+
+		if (dir) { // find the car with the highest back end that hasn't passed the ped, searching backward from the first car that's entirely past the ped
+			for (auto it = std::lower_bound(range_start, range_end, (pos_max + max_car_len), cmp); it != range_start;) {
+				--it;
+				if (closest_car != cars.end() && it->bcube.d[dim][1] < closest_car->bcube.d[dim][0]) break; // this car and all before it are behind the closest car
+				if (it->bcube.d[dim][0] > pos_max) continue; // back end has already passed the ped, not a threat
+				if (closest_car == cars.end() || it->bcube.d[dim][0] > closest_car->bcube.d[dim][0]) {closest_car = it;} // this car is closer
+			}
+		}
+		else { // the first car whose back end hasn't passed the ped is the closest
+			for (auto it = std::lower_bound(range_start, range_end, (pos_min - max_car_len), cmp); it != range_end; ++it) {
+				if (it->bcube.d[dim][1] < pos_min) continue; // already passed the ped, not a threat - skip to next car
+				closest_car = it;
+				break;
 			}
-			if (!dir) break; // no cars can be closer than this (cars are sorted in this dim)
-		} // for it
+		}
 		if (closest_car == cars.end()) continue; // no car found
 		car_base_t const &c(*closest_car);
+		assert(c.cur_city == ped.city && c.cur_road == road_ix && c.dim == dim && c.dir == (dir != 0));
 		float lo(c.bcube.d[dim][0]), hi(c.bcube.d[dim][1]), travel_dist(0.0);
 
 		if (lo >= pos_max || hi <= pos_min) { // current car doesn't already overlap, do more work to determine if it will overlap pos sometime in the near future
@@ -54,8 +54,7 @@ typedef vector<wpt_ix_t> waypt_adj_vect;
 struct waypoint_t {
 
 	bool user_placed, placed_item, goal, temp, visited, disabled, next_valid;
-	int came_from, item_group, item_ix, coll_id, connected_to;
-	float g_score, h_score, f_score;
+	int item_group, item_ix, coll_id, connected_to;
 	point pos;
 	double last_smiley_time;
 	waypt_adj_vect next_wpts, prev_wpts;
@@ -87,6 +86,17 @@ struct wpt_goal {
 
 	wpt_goal(int m=0, unsigned w=0, point const &p=all_zeros);
 	bool is_reachable() const;
+	bool operator==(wpt_goal const &g) const {return (mode == g.mode && wpt == g.wpt && pos == g.pos);}
+};
+
+
+struct wpt_path_query_t {
+
+	unsigned cur;
+	wpt_goal goal;
+	int next_wpt; // result: -1 if there is no path to the goal
+
+	wpt_path_query_t(unsigned cur_=0, wpt_goal const &goal_=wpt_goal()) : cur(cur_), goal(goal_), next_wpt(-1) {}
 };
 
 
@@ -167,7 +177,7 @@ struct player_state { // size = big
 	int target, objective, weapon, wmode, powerup, powerup_time, cb_hurt;
 	int kills, deaths, suicides, team_kills, max_kills, tot_kills, killer;
 	int init_frame, fire_frame, was_hit, hitter, last_teleporter, target_visible, kill_time, rot_counter, uw_time, jump_time, freeze_time;
-	int target_type, stopped_time, last_waypoint;
+	int target_type, stopped_time, last_waypoint, planned_path_frame;
 	unsigned tid, fall_counter, chunk_index;
 	float shields, plasma_size, zvel, dpos, last_dz, last_zvel, last_wpt_dist;
 	double ticks_since_fired;
@@ -182,6 +192,7 @@ struct player_state { // size = big
 	map<unsigned, count_t> blocked_waypts;
 	waypt_used_set waypts_used;
 	unreachable_pts unreachable[2]; // {objects, waypoints}
+	wpt_path_query_t planned_path; // valid if planned_path_frame == frame_counter
 	destination_marker dest_mark;
 	rand_gen_t player_rgen;
 
@@ -193,7 +204,7 @@ struct player_state { // size = big
 	player_state() : plasma_loaded(0), on_waypt_path(0), is_jumping(0), target(-1), objective(-1), weapon(0), wmode(0), powerup(PU_NONE), powerup_time(0),
 		 cb_hurt(0), kills(0), deaths(0), suicides(0), team_kills(0), max_kills(0), tot_kills(0), killer(NO_SOURCE), init_frame(0), fire_frame(0), was_hit(0),
 		hitter(NO_SOURCE), last_teleporter(NO_SOURCE), target_visible(0), kill_time(0), rot_counter(0), uw_time(0), jump_time(0), freeze_time(0), target_type(0),
-		stopped_time(0), last_waypoint(-1), tid(0), fall_counter(0), chunk_index(0), shields(0.0), plasma_size(0.0), zvel(0.0), dpos(0.0), last_dz(0.0), last_zvel(0.0),
+		stopped_time(0), last_waypoint(-1), planned_path_frame(-1), tid(0), fall_counter(0), chunk_index(0), shields(0.0), plasma_size(0.0), zvel(0.0), dpos(0.0), last_dz(0.0), last_zvel(0.0),
 		last_wpt_dist(0.0), ticks_since_fired(0.0), target_pos(all_zeros), objective_pos(all_zeros), cb_pos(all_zeros), hit_dir(all_zeros), velocity(zero_vector),
 		prev_foot_pos(all_zeros), step_num(0), foot_down(0)
 	{init_wa();}
@@ -228,6 +239,7 @@ struct player_state { // size = big
 		point &target, int &target_visible, float &min_dist) const;
 	void check_cand_waypoint(point const &pos, point const &avoid_dir, int smiley_id,
 		unsigned i, int curw, float dmult, pos_dir_up const &pdu, bool next, float max_dist_sq);
+	wpt_goal get_waypoint_goal(int smiley_id, int last_target_visible, int last_target_type) const;
 	void mark_waypoint_reached(int curw, int smiley_id);
 	int find_nearest_obj(point const &pos, pos_dir_up const &pdu, point const &avoid_dir, int smiley_id, point &target_pt,
 		float &min_dist, vector<type_wt_t> types, int last_target_visible, int last_target_type);
@@ -295,6 +307,8 @@ struct jump_pad : public sphere_t {
 // function prototypes
 bool check_step_dz(point &cur, point const &lpos, float radius);
 int find_optimal_next_waypoint(unsigned cur, wpt_goal const &goal, set<unsigned> const &wps_penalty);
+void find_optimal_next_waypoints(vector<wpt_path_query_t> &queries);
+void plan_smiley_waypoint_paths();
 void find_optimal_waypoint(point const &pos, vector<od_data> &oddatav, wpt_goal const &goal);
 bool can_make_progress(point const &pos, point const &opos, bool check_uw);
 bool is_valid_path(point const &start, point const &end, bool check_uw);
@@ -4,9 +4,16 @@
 
 #include "3DWorld.h"
 #include "profiler.h"
+#include <mutex>
+#include <fstream>
+#include <cstring>
 
 using std::string;
 
+bool zone_profiler_enabled(0);
+
+extern string zone_profile_trace_fn;
+
 
 template <typename T> class timing_profiler {
 
@@ -17,6 +24,7 @@ template <typename T> class timing_profiler {
 		void add(T t) {++count; time += t; tmax = max(tmax, t);}
 	};
 	map<string, entry_t> entries;
+	std::mutex mutex; // timing can be registered from worker threads
 
 public:
 	bool enabled;
@@ -25,6 +33,7 @@ public:
 	void clear() {entries.clear();}
 
 	void register_time(const char *str, T delta_time) {
+		std::lock_guard<std::mutex> lock(mutex);
 		if (enabled) {entries[str].add(delta_time);}
 		else {cout << str << " time = " << delta_time << endl;}
 	}
@@ -45,20 +54,237 @@ public:
 timing_profiler<int> global_profiler;
 timing_profiler<float> global_highres_profiler;
 
-void toggle_timing_profiler() {global_profiler.enabled ^= 1; global_highres_profiler.enabled ^= 1;}
-void register_timing_value(const char *str, int delta_time) {global_profiler.register_time(str, delta_time);}
+
+
+// ************ Zone Profiler ************
+
+
+unsigned const ZONE_RING_SIZE = (1 << 14); // events per thread; older events are overwritten
+unsigned const ZONE_MAX_DEPTH = 64; // deeper zones are counted for nesting but not recorded
+unsigned const ZONE_NAME_LEN  = 40;
+
+struct zone_event_t {
+	long long start_us, dur_us;
+	unsigned depth;
+	char name[ZONE_NAME_LEN];
+};
+
+struct zone_thread_buf_t {
+	unsigned tid; // registration order, used as the trace thread ID
+	unsigned depth; // current number of open zones
+	bool in_use;
+	unsigned long long num_added, num_aggregated; // totals over all time; the ring holds the last ZONE_RING_SIZE events
+	long long open_start[ZONE_MAX_DEPTH];
+	char const *open_name[ZONE_MAX_DEPTH];
+	vector<zone_event_t> events; // allocated on first use
+	std::mutex mutex; // only contended while the main thread aggregates or writes events
+
+	zone_thread_buf_t(unsigned tid_) : tid(tid_), depth(0), in_use(1), num_added(0), num_aggregated(0) {}
+	unsigned long long get_first_valid() const {return ((num_added > ZONE_RING_SIZE) ? (num_added - ZONE_RING_SIZE) : 0);}
+
+	void add(char const *const name, long long start_us, long long dur_us, unsigned depth_) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (events.empty()) {events.resize(ZONE_RING_SIZE);}
+		zone_event_t &e(events[num_added % ZONE_RING_SIZE]);
+		e.start_us = start_us;
+		e.dur_us   = dur_us;
+		e.depth    = depth_;
+		strncpy(e.name, name, ZONE_NAME_LEN-1);
+		e.name[ZONE_NAME_LEN-1] = 0;
+		++num_added;
+	}
+};
+
+class zone_profiler_t {
+
+	struct zone_stats_t {
+		unsigned frames, count;
+		long long total_us, max_frame_us;
+		double sum_max_thread_us, sum_mean_thread_us; // for load imbalance
+		zone_stats_t() : frames(0), count(0), total_us(0), max_frame_us(0), sum_max_thread_us(0.0), sum_mean_thread_us(0.0) {}
+	};
+	struct frame_entry_t {
+		unsigned count;
+		map<unsigned, long long> thread_us; // {tid => time}
+		frame_entry_t() : count(0) {}
+	};
+	vector<zone_thread_buf_t *> threads; // never freed; buffers of exited threads are reused by new threads
+	map<string, zone_stats_t> stats;
+	std::mutex mutex; // protects threads and stats
+	steady_clock::time_point const start_time;
+
+public:
+	zone_profiler_t() : start_time(steady_clock::now()) {}
+	long long get_time_us() const {return duration_cast<microseconds>(steady_clock::now() - start_time).count();}
+
+	zone_thread_buf_t *alloc_thread_buf() {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (auto i = threads.begin(); i != threads.end(); ++i) {
+			if ((*i)->in_use) continue;
+			(*i)->in_use = 1;
+			(*i)->depth  = 0;
+			return *i;
+		}
+		threads.push_back(new zone_thread_buf_t(threads.size()));
+		return threads.back();
+	}
+	void free_thread_buf(zone_thread_buf_t *buf) {
+		std::lock_guard<std::mutex> lock(mutex);
+		buf->in_use = 0;
+	}
+	void next_frame() { // fold new events from all threads into per-zone stats
+		std::lock_guard<std::mutex> lock(mutex);
+		map<string, frame_entry_t> frame;
+
+		for (auto i = threads.begin(); i != threads.end(); ++i) {
+			zone_thread_buf_t &buf(**i);
+			std::lock_guard<std::mutex> buf_lock(buf.mutex);
+
+			for (unsigned long long n = max(buf.num_aggregated, buf.get_first_valid()); n < buf.num_added; ++n) {
+				zone_event_t const &e(buf.events[n % ZONE_RING_SIZE]);
+				frame_entry_t &fe(frame[e.name]);
+				++fe.count;
+				fe.thread_us[buf.tid] += e.dur_us;
+			}
+			buf.num_aggregated = buf.num_added;
+		}
+		for (auto i = frame.begin(); i != frame.end(); ++i) {
+			zone_stats_t &zs(stats[i->first]);
+			long long frame_us(0), max_thread_us(0);
+
+			for (auto t = i->second.thread_us.begin(); t != i->second.thread_us.end(); ++t) {
+				frame_us     += t->second;
+				max_thread_us = max(max_thread_us, t->second);
+			}
+			++zs.frames;
+			zs.count    += i->second.count;
+			zs.total_us += frame_us;
+			zs.max_frame_us        = max(zs.max_frame_us, frame_us);
+			zs.sum_max_thread_us  += max_thread_us;
+			zs.sum_mean_thread_us += double(frame_us)/i->second.thread_us.size();
+		}
+	}
+	void print_and_clear_stats() {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (stats.empty()) return;
+		cout << "zone frames count total_ms max_frame_ms avg_frame_ms imbalance" << endl;
+		unsigned max_name(0);
+		for (auto i = stats.begin(); i != stats.end(); ++i) {max_name = max(max_name, (unsigned)i->first.size());}
+
+		for (auto i = stats.begin(); i != stats.end(); ++i) {
+			zone_stats_t const &zs(i->second);
+			string const spaces((max_name - i->first.size()), ' ');
+			// imbalance = slowest thread / average thread per frame; 1.0 is perfectly balanced
+			cout << i->first << spaces << ": " << zs.frames << "\t" << zs.count << "\t" << 0.001*zs.total_us << "\t" << 0.001*zs.max_frame_us << "\t"
+				 << 0.001*zs.total_us/zs.frames << "\t" << ((zs.sum_mean_thread_us > 0.0) ? zs.sum_max_thread_us/zs.sum_mean_thread_us : 1.0) << endl;
+		}
+		stats.clear();
+	}
+	bool write_trace(string const &fn) {
+		std::ofstream out(fn);
+
+		if (!out.good()) {
+			cout << "Error: Failed to open zone profiler trace file " << fn << " for writing" << endl;
+			return 0;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		unsigned num_events(0);
+		out << "{\"traceEvents\":[" << endl;
+
+		for (auto i = threads.begin(); i != threads.end(); ++i) {
+			zone_thread_buf_t &buf(**i);
+			std::lock_guard<std::mutex> buf_lock(buf.mutex);
+			if (num_events > 0) {out << "," << endl;}
+			out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buf.tid << ",\"args\":{\"name\":\"thread " << buf.tid << "\"}}";
+			++num_events;
+
+			for (unsigned long long n = buf.get_first_valid(); n < buf.num_added; ++n) {
+				zone_event_t const &e(buf.events[n % ZONE_RING_SIZE]);
+				out << "," << endl << "{\"name\":\"";
+
+				for (char const *c = e.name; *c; ++c) { // escape for JSON
+					if (*c == '"' || *c == '\\') {out << '\\';}
+					out << ((*c < ' ') ? ' ' : *c);
+				}
+				out << "\",\"ph\":\"X\",\"ts\":" << e.start_us << ",\"dur\":" << e.dur_us << ",\"pid\":1,\"tid\":" << buf.tid << ",\"args\":{\"depth\":" << e.depth << "}}";
+				++num_events;
+			}
+		}
+		out << endl << "]}" << endl;
+		cout << "Wrote " << num_events << " zone profiler events to " << fn << endl;
+		return out.good();
+	}
+};
+
+zone_profiler_t zone_profiler;
+
+struct zone_thread_state_t { // returns the buffer to the pool when the thread exits
+	zone_thread_buf_t *buf;
+	zone_thread_state_t() : buf(nullptr) {}
+	~zone_thread_state_t() {if (buf) {zone_profiler.free_thread_buf(buf);}}
+};
+thread_local zone_thread_state_t zone_thread_state; // works for both OpenMP and std::thread workers
+
+zone_thread_buf_t &get_zone_thread_buf() {
+	if (zone_thread_state.buf == nullptr) {zone_thread_state.buf = zone_profiler.alloc_thread_buf();}
+	return *zone_thread_state.buf;
+}
+
+long long get_zone_profiler_time_us() {return zone_profiler.get_time_us();}
+
+unsigned zone_profiler_begin(char const *const name) {
+	zone_thread_buf_t &buf(get_zone_thread_buf());
+
+	if (buf.depth < ZONE_MAX_DEPTH) {
+		buf.open_start[buf.depth] = zone_profiler.get_time_us();
+		buf.open_name [buf.depth] = name;
+	}
+	return buf.depth++;
+}
+void zone_profiler_end(unsigned zone_id) { // also closes any inner zones that are still open
+	zone_thread_buf_t &buf(get_zone_thread_buf());
+	if (zone_id >= buf.depth) return; // already closed
+	long long const end_us(zone_profiler.get_time_us());
+
+	while (buf.depth > zone_id) {
+		--buf.depth;
+		if (buf.depth < ZONE_MAX_DEPTH) {buf.add(buf.open_name[buf.depth], buf.open_start[buf.depth], (end_us - buf.open_start[buf.depth]), buf.depth);}
+	}
+}
+void add_zone_profiler_event(char const *const name, long long start_us, long long dur_us) { // for timers not using profile_zone_t
+	if (!zone_profiler_enabled) return;
+	zone_thread_buf_t &buf(get_zone_thread_buf());
+	buf.add(name, start_us, dur_us, buf.depth);
+}
+void zone_profiler_next_frame() {
+	if (zone_profiler_enabled) {zone_profiler.next_frame();}
+}
+bool write_zone_profiler_trace(string const &fn) {return zone_profiler.write_trace(fn);}
+
+
+void toggle_timing_profiler() {global_profiler.enabled ^= 1; global_highres_profiler.enabled ^= 1; zone_profiler_enabled ^= 1;}
+
+void register_timing_value(const char *str, int delta_time) { // RESET_TIME/PRINT_TIME and timer_t are also recorded as zones
+	if (zone_profiler_enabled) {long long const end_us(get_zone_profiler_time_us()); add_zone_profiler_event(str, (end_us - 1000LL*delta_time), 1000LL*delta_time);}
+	global_profiler.register_time(str, delta_time);
+}
 
 void timing_profiler_stats() {
 	global_profiler.stats();
 	global_profiler.clear();
 	global_highres_profiler.stats();
 	global_highres_profiler.clear();
+	zone_profiler.print_and_clear_stats();
+	if (zone_profiler_enabled && !zone_profile_trace_fn.empty()) {write_zone_profiler_trace(zone_profile_trace_fn);}
 }
 
 void highres_timer_t::end() {
 	if (!enabled || name.empty()) return;
 	float const elapsed(duration_cast<duration<float>>(clock.now() - timer1).count());
 	global_highres_profiler.register_time(name.c_str(), 1000.0f*elapsed); // print in ms
+	long long const dur_us(1000000.0f*elapsed), end_us(get_zone_profiler_time_us());
+	add_zone_profiler_event(name.c_str(), (end_us - dur_us), dur_us);
 	name.clear(); // make sure we don't double count this
 }
 
@@ -20,3 +20,27 @@ public:
 	void end();
 };
 
+
+// hierarchical zone profiler: zones are recorded into per-thread ring buffers while the timing profiler is enabled,
+// aggregated per frame, and can be exported in Chrome trace event format (chrome://tracing or ui.perfetto.dev)
+extern bool zone_profiler_enabled;
+
+long long get_zone_profiler_time_us();
+unsigned zone_profiler_begin(char const *const name);
+void zone_profiler_end(unsigned zone_id);
+void add_zone_profiler_event(char const *const name, long long start_us, long long dur_us);
+void zone_profiler_next_frame();
+bool write_zone_profiler_trace(std::string const &fn);
+
+class profile_zone_t { // scoped zone; name must remain valid until the end of the scope
+	unsigned zone_id;
+	bool active;
+public:
+	profile_zone_t(char const *const name) : zone_id(0), active(zone_profiler_enabled) {if (active) {zone_id = zone_profiler_begin(name);}}
+	~profile_zone_t() {if (active) {zone_profiler_end(zone_id);}}
+};
+
+#define PROFILE_ZONE_CAT2(a, b) a##b
+#define PROFILE_ZONE_CAT(a, b) PROFILE_ZONE_CAT2(a, b)
+#define PROFILE_ZONE(name) profile_zone_t const PROFILE_ZONE_CAT(profile_zone_, __LINE__)(name)
+
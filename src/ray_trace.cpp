@@ -17,6 +17,7 @@ float const DIFFUSE_REFL  = 0.9; // 90%  diffuse  reflectivity
 float const SPEC_REFL     = 1.0; // 100% specular reflectivity
 float const SNOW_ALBEDO   = 0.9;
 float const ICE_ALBEDO    = 0.8;
+bool const USE_RAY_PACKETS = 1; // trace primary rays in coherent packets that share a single cobj BVH traversal
 
 bool keep_beams(0); // debugging mode
 bool kill_raytrace(0);
@@ -259,7 +260,8 @@ unsigned add_path_to_lmcs(lmap_manager_t *lmgr, cube_t *bcube, point p1, point c
 
 
 void cast_light_ray(lmap_manager_t *lmgr, point p1, point p2, float weight, float weight0, colorRGBA color, float line_length,
-	int ignore_cobj, int ltype, unsigned depth, rand_gen_t &rgen, cobj_ray_accum_map_t *accum_map, cube_t *bcube=nullptr)
+	int ignore_cobj, int ltype, unsigned depth, rand_gen_t &rgen, cobj_ray_accum_map_t *accum_map, cube_t *bcube=nullptr,
+	line_query_packet_t const *lqp=nullptr, unsigned lqp_ix=0)
 {
 	if (depth > MAX_RAY_BOUNCES) return;
 	if (ltype == LIGHTING_DYNAMIC && depth > 4) return; // use a sensible default since this is running during rendering
@@ -267,16 +269,27 @@ void cast_light_ray(lmap_manager_t *lmgr, point p1, point p2, float weight, floa
 	++tot_rays;
 
 	// find intersection point with scene cobjs
-	point orig_p1(p1);
-	if (!do_line_clip_scene(p1, p2, min(zbottom, czmin), max(ztop, czmax))) return;
-	if ((display_mode & 0x01) && is_under_mesh(p1)) return;
 	int cindex(-1), xpos(0), ypos(0);
 	point cpos(p2);
 	vector3d cnorm;
 	float t(0.0), zval(0.0);
-	bool snow_coll(0), ice_coll(0), water_coll(0), mesh_coll(0);
+	bool snow_coll(0), ice_coll(0), water_coll(0), mesh_coll(0), coll(0);
+
+	if (lqp) { // p1 and p2 were already clipped and tested against the scene cobjs as part of a packet
+		assert(lqp_ix < lqp->num && p1 == lqp->p1[lqp_ix] && p2 == lqp->p2[lqp_ix]);
+		cindex = lqp->cindex[lqp_ix];
+		cpos   = lqp->cpos  [lqp_ix];
+		cnorm  = lqp->cnorm [lqp_ix];
+		coll   = (cindex >= 0);
+	}
+	else {
+		point orig_p1(p1);
+		if (!do_line_clip_scene(p1, p2, min(zbottom, czmin), max(ztop, czmax))) return;
+		if ((display_mode & 0x01) && is_under_mesh(p1)) return;
+		cpos = p2;
+		coll = check_coll_line_exact(p1, p2, cpos, cnorm, cindex, 0.0, ignore_cobj, 1, 0, 1, 1, (p1 == orig_p1), no_stat_moving); // fast=1, exclude voxels, maybe skip init colls
+	}
 	vector3d const dir((p2 - p1).get_norm());
-	bool coll(check_coll_line_exact(p1, p2, cpos, cnorm, cindex, 0.0, ignore_cobj, 1, 0, 1, 1, (p1 == orig_p1), no_stat_moving)); // fast=1, exclude voxels, maybe skip init colls
 	assert(coll ? (cindex >= 0 && cindex < (int)coll_objects.size()) : (cindex == -1));
 
 	// find the intersection point with the model3ds
@@ -494,6 +507,53 @@ void cast_light_ray(lmap_manager_t *lmgr, point p1, point p2, float weight, floa
 }
 
 
+// buffers primary light rays with the same ignore_cobj so that their cobj intersections can be found with a single packet query
+class light_ray_packet_t {
+
+	struct pending_ray_t {
+		float weight, weight0;
+		colorRGBA color;
+		pending_ray_t(float w, float w0, colorRGBA const &c) : weight(w), weight0(w0), color(c) {}
+	};
+	lmap_manager_t *lmgr;
+	float line_length;
+	int ltype;
+	rand_gen_t &rgen;
+	cobj_ray_accum_map_t *accum_map;
+	line_query_packet_t lqp;
+	vector<pending_ray_t> rays; // one per lqp line
+
+public:
+	light_ray_packet_t(lmap_manager_t *lmgr_, float line_length_, int ignore_cobj, int ltype_, rand_gen_t &rgen_, cobj_ray_accum_map_t *accum_map_)
+		: lmgr(lmgr_), line_length(line_length_), ltype(ltype_), rgen(rgen_), accum_map(accum_map_), lqp(ignore_cobj) {rays.reserve(line_query_packet_t::MAX_LINES);}
+	~light_ray_packet_t() {flush();}
+
+	// same as calling cast_light_ray() with depth=0, except that the ray may be deferred until the next flush()
+	void add(point p1, point p2, float weight, float weight0, colorRGBA const &color) {
+		if (!USE_RAY_PACKETS) {cast_light_ray(lmgr, p1, p2, weight, weight0, color, line_length, lqp.ignore_cobj, ltype, 0, rgen, accum_map); return;}
+		point const orig_p1(p1);
+
+		// do the same clipping and rejection tests as cast_light_ray()
+		if (!do_line_clip_scene(p1, p2, min(zbottom, czmin), max(ztop, czmax)) || ((display_mode & 0x01) && is_under_mesh(p1))) {++tot_rays; return;}
+		lqp.add(p1, p2, (p1 == orig_p1)); // maybe skip init colls
+		rays.emplace_back(weight, weight0, color);
+		if (lqp.full()) {flush();}
+	}
+	void flush() {
+		if (lqp.empty()) return;
+		check_coll_line_exact_packet(lqp, 0, 1, 1, no_stat_moving); // skip dynamic, include voxels
+		assert(rays.size() == lqp.num);
+
+		for (unsigned i = 0; i < lqp.num; ++i) { // cast rays in the order they were added
+			pending_ray_t const &r(rays[i]);
+			cast_light_ray(lmgr, lqp.p1[i], lqp.p2[i], r.weight, r.weight0, r.color, line_length, lqp.ignore_cobj, ltype, 0, rgen, accum_map, nullptr, &lqp, i);
+		}
+		lqp.clear();
+		rays.clear();
+	}
+};
+
+
 struct rt_data {
 	unsigned ix, num, job_id, checksum;
 	int rseed, ltype;
@@ -640,12 +700,11 @@ bool cube_light_src_vect::ray_intersects_any(point const &start_pt, point const
 }
 
 
-void trace_one_global_ray(lmap_manager_t *lmgr, point const &pos, point const &pt, colorRGBA const &color, float ray_wt,
-	int ltype, bool is_scene_cube, rand_gen_t &rgen, cobj_ray_accum_map_t *accum_map, float line_length)
-{
+void trace_one_global_ray(light_ray_packet_t &packet, point const &pos, point const &pt, colorRGBA const &color, float ray_wt, bool is_scene_cube, float line_length) {
+
 	point const end_pt(pt + (pt - pos).get_norm()*line_length);
 	if (is_scene_cube && global_cube_lights.ray_intersects_any(pt, end_pt)) return; // don't double count
-	cast_light_ray(lmgr, pos, end_pt, ray_wt, ray_wt, color, line_length, -1, ltype, 0, rgen, accum_map);
+	packet.add(pos, end_pt, ray_wt, ray_wt, color);
 }
 
 
@@ -655,6 +714,7 @@ void trace_ray_block_global_cube(lmap_manager_t *lmgr, cube_t const &bnds, point
 	float const line_length(2.0*get_scene_radius());
 	vector3d const ldir((bnds.get_cube_center() - pos).get_norm());
 	float proj_area[3] = {0}, tot_area(0.0);
+	light_ray_packet_t packet(lmgr, line_length, -1, ltype, rgen, accum_map); // rays all start at pos
 
 	for (unsigned i = 0; i < 3; ++i) { // adjust the number or weight of rays based on sun/moon position, or simply modify color scale?
 		if (disabled_edges & EFLAGS[i][ldir[i] < 0.0]) continue; // should this be here, or should we just skip them later?
@@ -680,7 +740,7 @@ void trace_ray_block_global_cube(lmap_manager_t *lmgr, cube_t const &bnds, point
 				if (verbose && ((s%1000) == 0)) {increment_printed_number(s/1000);}
 				pt[d0] = rgen.rand_uniform(bnds.d[d0][0], bnds.d[d0][1]);
 				pt[d1] = rgen.rand_uniform(bnds.d[d1][0], bnds.d[d1][1]);
-				trace_one_global_ray(lmgr, pos, pt, color, ray_wt, ltype, is_scene_cube, rgen, accum_map, line_length);
+				trace_one_global_ray(packet, pos, pt, color, ray_wt, is_scene_cube, line_length);
 			}
 		}
 		else {
@@ -697,10 +757,11 @@ void trace_ray_block_global_cube(lmap_manager_t *lmgr, cube_t const &bnds, point
 					if (kill_raytrace) break;
 					if (verbose && ((num%1000) == 0)) increment_printed_number(num/1000);
 					pt[d1] = bnds.d[d1][0] + (s1 + rgen.rand_uniform(0.0, 1.0))*len1/n1;
-					trace_one_global_ray(lmgr, pos, pt, color, ray_wt, ltype, is_scene_cube, rgen, accum_map, line_length);
+					trace_one_global_ray(packet, pos, pt, color, ray_wt, is_scene_cube, line_length);
 				}
 			}
 		}
+		packet.flush();
 		if (verbose) {cout << endl;}
 	} // for i
 }
@@ -769,6 +830,7 @@ void trace_ray_block_sky(rt_data *data) {
 			} while (pts[p].z < zbottom); // force above zbottom
 		}
 		sort(pts.begin(), pts.end());
+		light_ray_packet_t packet(data->lmgr, line_length, -1, LIGHTING_SKY, rgen, &data->accum_map);
 		if (data->verbose) {cout << "Sky light source progress (of " << block_npts << "): 0";}
 
 		for (unsigned p = 0; p < block_npts; ++p) {
@@ -788,9 +850,10 @@ void trace_ray_block_sky(rt_data *data) {
 				if (dot_product(dirs[r], pt) >= 0.0) continue; // can get here when (-Z_SCENE_SIZE, Z_SCENE_SIZE) does not contain (czmin, czmax)
 				point const end_pt(pt + dirs[r]*line_length);
 				if (sky_cube_lights.ray_intersects_any(pt, end_pt)) continue; // don't double count
-				cast_light_ray(data->lmgr, pt, end_pt, ray_wt, ray_wt, WHITE, line_length, -1, LIGHTING_SKY, 0, rgen, &data->accum_map);
+				packet.add(pt, end_pt, ray_wt, ray_wt, WHITE);
 				++start_rays;
 			}
+			packet.flush(); // flush before generating the next point's dirs so that rgen is used in the same order as unbatched rays
 		}
 		if (data->verbose) {cout << endl;}
 	}
@@ -923,6 +986,7 @@ void ray_trace_local_light_source(lmap_manager_t *lmgr, light_source const &ls,
 		}
 		assert(tot_area > 0.0);
 		//cout << TXT(tot_area) << TXT(radius) << TXT(ray_wt) << TXT(num_rays) << TXT(N_RAYS) << endl;
+		light_ray_packet_t packet(lmgr, line_length, -1, ltype, rgen, nullptr); // init_cobj not used here
 
 		for (unsigned dim = 0; dim < 3; ++dim) {
 			unsigned const d1((dim+1)%3), d2((dim+2)%3);
@@ -944,7 +1008,7 @@ void ray_trace_local_light_source(lmap_manager_t *lmgr, light_source const &ls,
 					start_pt[d1] = rgen.rand_uniform(cube.d[d1][0], cube.d[d1][1]);
 					start_pt[d2] = rgen.rand_uniform(cube.d[d2][0], cube.d[d2][1]);
 					point const end_pt(start_pt + dir*line_length);
-					cast_light_ray(lmgr, start_pt, end_pt, ray_wt, ray_wt, lcolor, line_length, -1, ltype, 0, rgen, nullptr); // init_cobj not used here
+					packet.add(start_pt, end_pt, ray_wt, ray_wt, lcolor);
 				} // for n
 			} // for dir
 		} // for dim
@@ -954,6 +1018,7 @@ void ray_trace_local_light_source(lmap_manager_t *lmgr, light_source const &ls,
 	int init_cobj(-1);
 	check_coll_line(lpos, lpos2, init_cobj, -1, 1, 2); // find most opaque (max alpha) containing object
 	assert(init_cobj < (int)coll_objects.size());
+	light_ray_packet_t packet(lmgr, line_length, init_cobj, ltype, rgen, nullptr);
 
 	for (unsigned n = 0; n < num_rays; ++n) {
 		if (kill_raytrace) break;
@@ -990,7 +1055,7 @@ void ray_trace_local_light_source(lmap_manager_t *lmgr, light_source const &ls,
 			if (line_light) {start_pt += n*delta;} // fixed spacing along the length of the line
 		}
 		point const end_pt(start_pt + dir*line_length);
-		cast_light_ray(lmgr, start_pt, end_pt, weight, weight, lcolor, line_length, init_cobj, ltype, 0, rgen, nullptr);
+		packet.add(start_pt, end_pt, weight, weight, lcolor);
 	} // for n
 }
 
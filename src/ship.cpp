@@ -33,6 +33,8 @@ vector<cached_obj> c_uobjs_lit; // lit objects, used for lighting
 vector<ship_explosion> exploding;
 vector<free_obj const *> a_targets(NUM_ALIGNMENT, NULL), attackers(NUM_ALIGNMENT, NULL);
 vector<cached_obj> c_uobjs;
+vector<uobj_cmd_buffer_t> uobj_cmd_buffers; // one per thread, only used in the parallel phases of apply_univ_physics()
+bool defer_uobj_cmds(0);
 usw_ray_group trail_rays, beam_rays; // engine trails, beams
 vector<temp_source> temp_sources;
 vector<hyper_inhibit_t> hyper_inhibits;
@@ -57,7 +59,7 @@ unsigned align_t_kills[NUM_ALIGNMENT] = {0};
 unsigned friendly_kills[NUM_ALIGNMENT]= {0};
 
 
-extern bool allow_shader_invariants;
+extern bool allow_shader_invariants, parallel_uobj_update;
 extern int show_framerate, frame_counter, display_mode, animate2, do_run, show_scores;
 extern float fticks, player_sensor_dist_mult;
 extern double tfticks;
@@ -147,6 +149,21 @@ void update_maxvals(unsigned *v, unsigned n) {
 	for (unsigned i = 0; i < n; ++i) {v[i] = get_num_chars(v[i]);}
 }
 
+
+struct uobj_coll_stats_t {
+	unsigned long long num_calls, cand_pairs, olap_pairs, coll_pairs;
+	uobj_coll_stats_t() : num_calls(0), cand_pairs(0), olap_pairs(0), coll_pairs(0) {}
+
+	void print_and_reset() {
+		if (num_calls == 0) return;
+		cout << "Collision pairs per step: candidate: " << cand_pairs/num_calls << ", overlapping: " << olap_pairs/num_calls << ", collided: " << coll_pairs/num_calls
+			 << ", pruned: " << ((cand_pairs == 0) ? 0.0 : 100.0*(1.0 - double(olap_pairs)/double(cand_pairs))) << "%" << endl;
+		*this = uobj_coll_stats_t();
+	}
+};
+uobj_coll_stats_t uobj_coll_stats;
+
+
 void show_stats() {
 
 	int const cwidth(18);
@@ -267,6 +284,7 @@ void show_stats() {
 	print_univ_owner_stats();
 	cout << "Alloced: Ships: " << alloced_fobjs[0] << " - " << alloced_fobjs[1] << " = " <<
 		(alloced_fobjs[0] - alloced_fobjs[1]) << ", Proj+Part: " << alloced_fobjs[2] << " (x100)" << endl;
+	uobj_coll_stats.print_and_reset();
 }
 
 
@@ -435,7 +453,11 @@ bool add_uobj(free_obj *obj, int coll_test) {
 		unsigned const coll_ix(check_for_obj_coll(obj->get_pos(), obj->get_c_radius()));
 		coll = (coll_ix > 0);
 	}
-	if (!coll || coll_test != 2) uobjs.push_back(obj);
+	if (!coll || coll_test != 2) {
+		uobj_cmd_buffer_t *const cmds(get_deferred_uobj_cmds());
+		if (cmds) {cmds->add_new_obj(obj);} // added at the next sync point
+		else {uobjs.push_back(obj);}
+	}
 	return coll;
 }
 
@@ -476,6 +498,75 @@ void get_cached_objs(vector<free_obj *> const &objs, vector<cached_obj> &cobjs)
 	for (size_t i = 0; i < size; ++i) {cobjs[i].set_obj(objs[i]);}
 }
 
+uobj_cmd_buffer_t *get_deferred_uobj_cmds() { // returns NULL if not in a parallel update phase
+
+	if (!defer_uobj_cmds) return NULL;
+	unsigned const tid(omp_get_thread_num_3dw());
+	assert(tid < uobj_cmd_buffers.size());
+	return &uobj_cmd_buffers[tid];
+}
+
+void begin_deferred_uobj_cmds() {
+
+	assert(!defer_uobj_cmds);
+	uobj_cmd_buffers.resize(max(1, omp_get_max_threads_3dw()));
+	defer_uobj_cmds = 1;
+}
+
+// with a static schedule each thread processes a contiguous range of objects in thread order, so replaying each buffer's commands
+// in issue order, one buffer after another, gives the same sequence as a serial update, independent of the number of threads
+void apply_deferred_uobj_cmds() {
+
+	assert(defer_uobj_cmds);
+	defer_uobj_cmds = 0;
+
+	for (auto b = uobj_cmd_buffers.begin(); b != uobj_cmd_buffers.end(); ++b) {
+		for (auto c = b->cmds.begin(); c != b->cmds.end(); ++c) {
+			switch (c->type) {
+			case uobj_cmd_buffer_t::CMD_NEW_OBJ:
+				uobjs.push_back(b->new_objs[c->ix]);
+				break;
+			case uobj_cmd_buffer_t::CMD_PARTICLE: {
+				uobj_cmd_buffer_t::particle_t const &i(b->particles[c->ix]);
+				gen_particle(i.type, i.c1, i.c2, i.lt, i.pos, i.vel, i.size, i.damage, i.align, i.coll, i.texture_id);
+				break;
+			}
+			case uobj_cmd_buffer_t::CMD_EXPLOSION: {
+				uobj_cmd_buffer_t::explosion_t const &i(b->explosions[c->ix]);
+				register_explosion(i.pos, i.radius, i.damage, i.eflags, i.wclass, i.src, i.parent);
+				break;
+			}
+			case uobj_cmd_buffer_t::CMD_BLASTR: {
+				uobj_cmd_buffer_t::blastr_t const &i(b->blastrs[c->ix]);
+				add_blastr(i.pos, i.dir, i.size, i.damage, i.time, i.src, i.c1, i.c2, i.type, i.parent, i.emits_light, i.exp_sphere_scale);
+				break;
+			}
+			case uobj_cmd_buffer_t::CMD_WARNING:
+				send_warning_message(b->warnings[c->ix]);
+				break;
+			default: assert(0);
+			}
+		}
+		b->clear();
+	}
+}
+
+// these only modify the object itself; other side effects go through get_deferred_uobj_cmds()
+bool has_local_physics(free_obj const *const obj) {
+	return (!obj->is_ship() && (obj->is_proj() || obj->is_particle() || obj->is_part_cloud()));
+}
+
+void advance_uobj(free_obj *const obj, unsigned t, float timestep) {
+
+	if (!obj->is_ok()) {
+		// nothing
+	}
+	else if (obj->get_flags() & (OBJ_FLAGS_DIST | OBJ_FLAGS_ORBT)) {
+		if (t == 0) {obj->advance_time(fticks);}
+	}
+	else {obj->advance_time(timestep);}
+}
+
 void remove_bad_cobjs_and_particles(vector<cached_obj> &objs) {
 
 	auto i(objs.begin()), o(i);
@@ -559,15 +650,44 @@ void apply_univ_physics() {
 
 	if (animate2) {
 		// before or after advance time and collision detection?
-		for (unsigned i = 0; i < nobjs; ++i) { // can create new objects here
-			if (c_uobjs[i].flags & (OBJ_FLAGS_SHIP | OBJ_FLAGS_PROJ)) {c_uobjs[i].obj->ai_action();}
+		if (parallel_uobj_update) {
+			// only projectile AI, projectile/particle physics, and advance_time() are parallel; ship AI and ship physics call rand() and
+			// update shared team, target, and attacker state (and destroy/fragment ships), so they stay serial and in object order
+			for (unsigned i = 0; i < nobjs; ++i) {
+				if (c_uobjs[i].flags & OBJ_FLAGS_SHIP) {c_uobjs[i].obj->ai_action();}
+			}
+			begin_deferred_uobj_cmds();
+#pragma omp parallel for schedule(static)
+			for (int i = 0; i < (int)nobjs; ++i) { // projectile seeking only reads ships, which are no longer changing
+				if ((c_uobjs[i].flags & (OBJ_FLAGS_SHIP | OBJ_FLAGS_PROJ)) == OBJ_FLAGS_PROJ) {c_uobjs[i].obj->ai_action();}
+			}
+			apply_deferred_uobj_cmds();
+		}
+		else {
+			for (unsigned i = 0; i < nobjs; ++i) { // can create new objects here
+				if (c_uobjs[i].flags & (OBJ_FLAGS_SHIP | OBJ_FLAGS_PROJ)) {c_uobjs[i].obj->ai_action();}
+			}
 		}
 		if (player_autopilot) {update_cpos();}
 		if (TIMETEST) PRINT_TIME("  AI Action");
 
 		// c_uobjs is invalid at this point
 		// don't update nobjs - delay first physics event for new objects until next frame
-		for (unsigned i = 0; i < nobjs; ++i) {uobjs[i]->apply_physics();}
+		if (parallel_uobj_update) {
+			begin_deferred_uobj_cmds();
+#pragma omp parallel for schedule(static)
+			for (int i = 0; i < (int)nobjs; ++i) {
+				if (has_local_physics(uobjs[i])) {uobjs[i]->apply_physics();}
+			}
+			apply_deferred_uobj_cmds();
+
+			for (unsigned i = 0; i < nobjs; ++i) {
+				if (!has_local_physics(uobjs[i])) {uobjs[i]->apply_physics();}
+			}
+		}
+		else {
+			for (unsigned i = 0; i < nobjs; ++i) {uobjs[i]->apply_physics();}
+		}
 		if (TIMETEST) PRINT_TIME("  Apply Physics");
 		float const timestep(fticks/NUM_TIMESTEPS);
 
@@ -575,14 +695,20 @@ void apply_univ_physics() {
 			collision_detect_objects(coll_objs, t);
 			if (t == 0) {remove_bad_cobjs_and_particles(coll_objs);}
 
-			for (unsigned i = 0; i < nobjs; ++i) {
-				if (!uobjs[i]->is_ok()) {
-					// nothing
+			if (parallel_uobj_update) {
+				begin_deferred_uobj_cmds();
+#pragma omp parallel for schedule(static)
+				for (int i = 0; i < (int)nobjs; ++i) {
+					if (!uobjs[i]->has_serial_advance()) {advance_uobj(uobjs[i], t, timestep);}
 				}
-				else if (uobjs[i]->get_flags() & (OBJ_FLAGS_DIST | OBJ_FLAGS_ORBT)) {
-					if (t == 0) {uobjs[i]->advance_time(fticks);}
+				apply_deferred_uobj_cmds();
+
+				for (unsigned i = 0; i < nobjs; ++i) {
+					if (uobjs[i]->has_serial_advance()) {advance_uobj(uobjs[i], t, timestep);}
 				}
-				else {uobjs[i]->advance_time(timestep);}
+			}
+			else {
+				for (unsigned i = 0; i < nobjs; ++i) {advance_uobj(uobjs[i], t, timestep);}
 			}
 		}
 		if (TIMETEST) PRINT_TIME("  Advance + Collision");
@@ -629,13 +755,35 @@ bool proc_coll(free_obj *o1, free_obj *o2) {
 }
 
 
+struct uobj_bp_entry_t { // broadphase interval of one object along the sweep axis
+	float lo, hi;
+	unsigned ix;
+	uobj_bp_entry_t(float lo_, float hi_, unsigned ix_) : lo(lo_), hi(hi_), ix(ix_) {}
+	bool operator<(uobj_bp_entry_t const &e) const {return ((lo == e.lo) ? (ix < e.ix) : (lo < e.lo));} // ix makes the order deterministic
+};
+
+bool skip_coll_pair(unsigned flags1, unsigned flags2) {
+
+	if ((flags1 | flags2) & OBJ_FLAGS_BAD_) return 1;
+	if (flags1 & flags2 & OBJ_FLAGS_PART)   return 1; // skip particle-particle collisions
+	if (flags1 & flags2 & OBJ_FLAGS_NOC2)   return 1; // both objects have their C2 flags set, skip the collision
+	if ((flags1 & flags2 & OBJ_FLAGS_PROJ) && ((flags1 | flags2) & OBJ_FLAGS_NOPC)) return 1; // no projectile-projectile collision
+	return 0;
+}
+
+bool cached_objs_intersect(cached_obj const &a, cached_obj const &b) {
+	return dist_less_than(a.pos, b.pos, (a.radius + b.radius));
+}
+
+
+// sweep and prune along the axis with the largest spread of object centers; candidate pairs are found in parallel,
+// then processed serially in sweep order, so the result doesn't depend on the number of threads
 void collision_detect_objects(vector<cached_obj> &objs, unsigned t) {
 
 	//RESET_TIME;
 	unsigned const size((unsigned)objs.size());
-	static vector<interval> intervals;
-	intervals.clear();
-	intervals.reserve(2*size);
+	double sum[3] = {0.0}, sum_sq[3] = {0.0};
+	unsigned num_active(0);
 
 	for (unsigned i = 0; i < size; ++i) {
 		if (objs[i].flags & OBJ_FLAGS_BAD_) continue;
@@ -645,59 +793,82 @@ void collision_detect_objects(vector<cached_obj> &objs, unsigned t) {
 			continue;
 		}
 		if (t > 0) {objs[i].refresh();} // physics advance was run since last refresh
-		double const radius(objs[i].radius), val(objs[i].pos.x);
-		float const left(float(val - radius)), right(float(val + radius));
+		UNROLL_3X(sum[i_] += objs[i].pos[i_]; sum_sq[i_] += objs[i].pos[i_]*objs[i].pos[i_];)
+		++num_active;
+	}
+	unsigned axis(0);
+
+	if (num_active > 0) {
+		double max_var(0.0);
+
+		for (unsigned d = 0; d < 3; ++d) {
+			double const mean(sum[d]/num_active), var(sum_sq[d]/num_active - mean*mean);
+			if (var > max_var) {max_var = var; axis = d;}
+		}
+	}
+	static vector<uobj_bp_entry_t> entries;
+	entries.clear();
+	entries.reserve(num_active);
+
+	for (unsigned i = 0; i < size; ++i) {
+		if (objs[i].flags & OBJ_FLAGS_BAD_) continue;
+		if (t > 0 && (objs[i].flags & (OBJ_FLAGS_DIST | OBJ_FLAGS_ORBT))) continue;
+		double const radius(objs[i].radius), val(objs[i].pos[axis]);
+		float const lo(float(val - radius)), hi(float(val + radius));
 		assert(radius > 0.0);
-		if (left == right) continue; // floating point precision limitation or bug?
-		assert(left < right);
-		intervals.push_back(interval(left,  i, 1));
-		intervals.push_back(interval(right, i, 0));
+		if (lo == hi) continue; // floating point precision limitation or bug?
+		assert(lo < hi);
+		entries.emplace_back(lo, hi, i);
 	}
-	unsigned const size2((unsigned)intervals.size());
-	static vector<unsigned> locs, work;
-	locs.resize(size);
-	work.clear();
-	sort(intervals.begin(), intervals.end());
-
-	for (unsigned i = 0; i < size2; ++i) {
-		unsigned const ix(intervals[i].ix & ~LEFT_EDGE_BIT), ix_flags(objs[ix].flags);
-		unsigned bad_flags(OBJ_FLAGS_BAD_);
-		if ( ix_flags & OBJ_FLAGS_PART) {bad_flags |= OBJ_FLAGS_PART;} // skip particle-particle collisions
-		if ( ix_flags & OBJ_FLAGS_NOC2) {bad_flags |= OBJ_FLAGS_NOC2;} // both objects have their C2 flags set, skip the collision
-		if ((ix_flags & OBJ_FLAGS_PROJ) && (ix_flags & OBJ_FLAGS_NOPC)) {bad_flags |= OBJ_FLAGS_PROJ;} // no projectile-projectile collision
-		
-		if (intervals[i].ix & LEFT_EDGE_BIT) { // start a new sphere
-			unsigned const wsize((unsigned)work.size());
-
-			if (wsize > 0) {
-				point const pos_i(objs[ix].pos);
-				float const c_radius_i(objs[ix].radius), pisd(pos_i.y);
-
-				for (unsigned k = 0; k < wsize; ++k) {
-					cached_obj &obj(objs[work[k]]);
-					if (obj.flags & bad_flags) continue;
-					float const radius(c_radius_i + obj.radius);
-					if (fabs(pisd - obj.pos.y) > radius || !dist_less_than(pos_i, obj.pos, radius)) continue; // no intersection
-
-					if (proc_coll(objs[ix].obj, obj.obj)) {
-						objs[ix].refresh(); // ???
-						obj.refresh(); // ???
-					}
-				}
-			}
-			locs[ix] = wsize;
-			work.push_back(ix);
+	sort(entries.begin(), entries.end());
+	unsigned const num_entries((unsigned)entries.size());
+	typedef pair<unsigned, unsigned> obj_pair_t; // {later, earlier} in sweep order
+
+	struct thread_pairs_t { // written by one thread in the loop below
+		vector<obj_pair_t> pairs;
+		unsigned long long cands;
+		// pad so that the written fields of two threads are at least one cache line apart, even if the vector's storage isn't 64-byte aligned
+		char pad[128 - sizeof(vector<obj_pair_t>) - sizeof(unsigned long long)];
+		thread_pairs_t() : cands(0) {}
+	};
+	static vector<thread_pairs_t> thread_pairs;
+	unsigned const num_threads(max(1, omp_get_max_threads_3dw()));
+	thread_pairs.resize(num_threads);
+	for (unsigned i = 0; i < num_threads; ++i) {thread_pairs[i].pairs.clear(); thread_pairs[i].cands = 0;}
+
+#pragma omp parallel for schedule(static) if (num_entries > 1024)
+	for (int i = 0; i < (int)num_entries; ++i) {
+		unsigned const tid(omp_get_thread_num_3dw());
+		assert(tid < num_threads);
+		thread_pairs_t &tp(thread_pairs[tid]);
+		uobj_bp_entry_t const &ei(entries[i]);
+		cached_obj const &oi(objs[ei.ix]);
+
+		for (unsigned j = i+1; j < num_entries && entries[j].lo <= ei.hi; ++j) {
+			unsigned const jx(entries[j].ix);
+			++tp.cands;
+			if (skip_coll_pair(oi.flags, objs[jx].flags) || !cached_objs_intersect(oi, objs[jx])) continue;
+			tp.pairs.emplace_back(jx, ei.ix);
 		}
-		else { // end a current sphere
-			assert(!work.empty());
-			unsigned const lix(locs[ix]);
-			//assert(ix < size && lix < work.size() && work[lix] == ix && locs[work.back()] == work.size()-1);
-			swap(work[lix], work.back());
-			locs[work[lix]] = lix;
-			work.pop_back();
+	}
+	for (unsigned i = 0; i < num_threads; ++i) {
+		vector<obj_pair_t> const &pairs(thread_pairs[i].pairs);
+		uobj_coll_stats.cand_pairs += thread_pairs[i].cands;
+		uobj_coll_stats.olap_pairs += pairs.size();
+
+		for (auto p = pairs.begin(); p != pairs.end(); ++p) {
+			cached_obj &o1(objs[p->first]), &o2(objs[p->second]);
+			// objects may have been moved or destroyed by earlier collisions in this step
+			if (skip_coll_pair(o1.flags, o2.flags) || !cached_objs_intersect(o1, o2)) continue;
+
+			if (proc_coll(o1.obj, o2.obj)) {
+				o1.refresh(); // ???
+				o2.refresh(); // ???
+				++uobj_coll_stats.coll_pairs;
+			}
 		}
 	}
-	assert(work.empty());
+	++uobj_coll_stats.num_calls;
 	//PRINT_TIME("Collision");
 }
 
@@ -705,6 +876,12 @@ void collision_detect_objects(vector<cached_obj> &objs, unsigned t) {
 uparticle *gen_particle(unsigned type, colorRGBA const &c1, colorRGBA const &c2, unsigned lt, point const &pos,
 						vector3d const &vel, float size, float damage, unsigned align, bool coll, int texture_id)
 {
+	uobj_cmd_buffer_t *const cmds(get_deferred_uobj_cmds());
+
+	if (cmds) { // created at the next sync point; the allocator isn't thread safe
+		cmds->add_particle(uobj_cmd_buffer_t::particle_t(type, c1, c2, lt, pos, vel, size, damage, align, coll, texture_id));
+		return NULL;
+	}
 	static free_obj_allocator<uparticle> allocator;
 	uparticle *part = allocator.alloc(type);
 	part->set_params(type, pos, vel, signed_rand_vector_norm(), size, c1, c2, lt, damage, align, coll, texture_id);
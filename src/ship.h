@@ -810,6 +810,7 @@ public:
 	virtual void first_frame_hook() {}
 	virtual void apply_physics();
 	virtual void advance_time(float timestep);
+	virtual bool has_serial_advance() const {return 0;} // advance_time() has side effects outside of this object
 	virtual int get_gravity(vector3d &vgravity, point const &mpos) const {return 0;}
 	virtual bool fire_weapon(vector3d const &fire_dir, float target_dist) {return 0;} // default - do nothing (should this be here?)
 	virtual bool dec_ref() {return 0;} // could be const?
@@ -941,6 +942,7 @@ public:
 	//float damage(float val, int type, point const &hit_pos, free_obj const *source, int wc);
 	void explode(float damage, float bradius, int etype, vector3d const &edir, int exp_time, int wclass, int align, unsigned eflags, free_obj const *parent_);
 	void advance_time(float timestep);
+	bool has_serial_advance() const {return 1;} // gen_pos() uses rand()
 };
 
 
@@ -214,6 +214,70 @@ public:
 };
 
 
+// per-thread record of the global side effects of free objects updated in parallel; applied in object order at the next sync point
+struct uobj_cmd_buffer_t {
+
+	struct particle_t {
+		unsigned type, lt, align;
+		colorRGBA c1, c2;
+		point pos;
+		vector3d vel;
+		float size, damage;
+		int texture_id;
+		bool coll;
+
+		particle_t(unsigned type_, colorRGBA const &c1_, colorRGBA const &c2_, unsigned lt_, point const &pos_, vector3d const &vel_,
+			float size_, float damage_, unsigned align_, bool coll_, int texture_id_) : type(type_), lt(lt_), align(align_), c1(c1_), c2(c2_),
+			pos(pos_), vel(vel_), size(size_), damage(damage_), texture_id(texture_id_), coll(coll_) {}
+	};
+	struct explosion_t {
+		point pos;
+		float radius, damage;
+		unsigned eflags;
+		int wclass;
+		uobject *src;
+		free_obj const *parent;
+
+		explosion_t(point const &pos_, float radius_, float damage_, unsigned eflags_, int wclass_, uobject *src_, free_obj const *parent_) :
+			pos(pos_), radius(radius_), damage(damage_), eflags(eflags_), wclass(wclass_), src(src_), parent(parent_) {}
+	};
+	struct blastr_t {
+		point pos;
+		vector3d dir;
+		float size, damage, exp_sphere_scale;
+		int time, src, type;
+		colorRGBA c1, c2;
+		free_obj const *parent;
+		bool emits_light;
+
+		blastr_t(point const &pos_, vector3d const &dir_, float size_, float damage_, int time_, int src_, colorRGBA const &c1_, colorRGBA const &c2_,
+			int type_, free_obj const *parent_, bool emits_light_, float exp_sphere_scale_) : pos(pos_), dir(dir_), size(size_), damage(damage_),
+			exp_sphere_scale(exp_sphere_scale_), time(time_), src(src_), type(type_), c1(c1_), c2(c2_), parent(parent_), emits_light(emits_light_) {}
+	};
+	enum {CMD_NEW_OBJ=0, CMD_PARTICLE, CMD_EXPLOSION, CMD_BLASTR, CMD_WARNING};
+
+	struct cmd_t {
+		unsigned char type;
+		unsigned ix; // index into the vector for this command type
+
+		cmd_t(unsigned char type_, size_t ix_) : type(type_), ix((unsigned)ix_) {}
+	};
+	vector<cmd_t> cmds; // all commands in the order they were issued
+	vector<free_obj *> new_objs;
+	vector<particle_t> particles;
+	vector<explosion_t> explosions;
+	vector<blastr_t> blastrs;
+	vector<string> warnings;
+
+	void add_new_obj  (free_obj *obj) {cmds.emplace_back(CMD_NEW_OBJ,   new_objs.size  ()); new_objs.push_back(obj);}
+	void add_particle (particle_t  const &p) {cmds.emplace_back(CMD_PARTICLE,  particles.size ()); particles.push_back(p);}
+	void add_explosion(explosion_t const &e) {cmds.emplace_back(CMD_EXPLOSION, explosions.size()); explosions.push_back(e);}
+	void add_blastr   (blastr_t    const &b) {cmds.emplace_back(CMD_BLASTR,    blastrs.size   ()); blastrs.push_back(b);}
+	void add_warning  (string      const &msg) {cmds.emplace_back(CMD_WARNING,   warnings.size  ()); warnings.push_back(msg);}
+	void clear() {cmds.clear(); new_objs.clear(); particles.clear(); explosions.clear(); blastrs.clear(); warnings.clear();}
+};
+
+
 // ship_config.cpp
 void setup_ships();
 bool is_valid_starting_ship_pos(point const &spos, unsigned sclass);
@@ -258,6 +322,7 @@ void add_parts_projs(point const &pos, float radius, vector3d const &dir, colorR
 us_projectile *create_projectile(unsigned type, free_obj const *const parent, unsigned align, point const &pos,
 								 vector3d const &vel, vector3d const &dir, vector3d const &upv);
 void apply_explosion(point const &pos, float radius, float damage, unsigned eflags, int wclass, uobject *ptr, free_obj const *parent);
+uobj_cmd_buffer_t *get_deferred_uobj_cmds();
 free_obj const *check_for_incoming_proj(point const &pos, int align, float dist);
 void shift_univ_objs(point const &pos, bool shift_player_ship);
 void create_univ_cube_map();
@@ -0,0 +1,201 @@
+// 3D World - CPU BC1/BC3/BC4/BC5 Texture Block Compression
+// by Frank Gennari
+// 10/18/26
+
+#include "textures.h"
+#include "function_registry.h"
+#include "binary_file_io.h" // for hash_fnv1a_t
+#include <sys/stat.h>
+
+unsigned const MIN_PARALLEL_BLOCK_ROWS = 8; // don't bother with multiple threads for small mipmap levels
+unsigned const TEX_CACHE_VERSION       = 2; // increment when the compressor or mipmap generation changes
+
+extern bool cpu_texture_compress;
+
+string append_texture_dir(string const &filename);
+
+
+// 16 texels of up to 4 channels, stored SoA so that the per-block loops are simple and vectorizable
+struct texel_block_t {
+	unsigned char c[4][16];
+
+	// reads the 4x4 block at block (bx, by); texels past the edge of small images are clamped to the last row/column
+	void load(unsigned char const *data, unsigned w, unsigned h, unsigned ncolors, unsigned bx, unsigned by) {
+		for (unsigned y = 0; y < 4; ++y) {
+			unsigned const yy(min(4*by+y, h-1));
+
+			for (unsigned x = 0; x < 4; ++x) {
+				unsigned char const *const t(data + ncolors*(yy*w + min(4*bx+x, w-1)));
+				for (unsigned n = 0; n < ncolors; ++n) {c[n][4*y+x] = t[n];}
+			}
+		}
+	}
+};
+
+
+// single channel block: two 8-bit endpoints and 16 3-bit indices; used for BC4, BC5 (x2), and the BC3 alpha block
+void encode_bc4_block(unsigned char const v[16], unsigned char *out) {
+
+	unsigned vmin(255), vmax(0);
+	for (unsigned i = 0; i < 16; ++i) {vmin = min(vmin, (unsigned)v[i]); vmax = max(vmax, (unsigned)v[i]);}
+	out[0] = (unsigned char)vmax; // a0 > a1 selects the 8 value mode
+	out[1] = (unsigned char)vmin;
+	uint64_t bits(0);
+
+	if (vmax > vmin) { // else all indices are 0
+		unsigned const range(vmax - vmin);
+
+		for (unsigned i = 0; i < 16; ++i) {
+			unsigned const pos((7*(vmax - v[i]) + range/2)/range); // 0 = vmax, 7 = vmin
+			unsigned const ix((pos == 0) ? 0 : ((pos == 7) ? 1 : pos+1)); // map from linear order to palette order
+			bits |= (uint64_t(ix) << (3*i));
+		}
+	}
+	for (unsigned i = 0; i < 6; ++i) {out[i+2] = (unsigned char)(bits >> (8*i));}
+}
+
+
+inline unsigned pack_565(float const c[3]) {
+	unsigned const r(min(31U, unsigned(c[0]*(31.0f/255.0f) + 0.5f))), g(min(63U, unsigned(c[1]*(63.0f/255.0f) + 0.5f))), b(min(31U, unsigned(c[2]*(31.0f/255.0f) + 0.5f)));
+	return ((r << 11) | (g << 5) | b);
+}
+inline void unpack_565(unsigned v, int c[3]) {
+	unsigned const r((v >> 11) & 31), g((v >> 5) & 63), b(v & 31);
+	c[0] = (r << 3) | (r >> 2); c[1] = (g << 2) | (g >> 4); c[2] = (b << 3) | (b >> 2);
+}
+
+// RGB block: endpoints are found by projecting the texels onto the principal axis of their color distribution;
+// always uses the 4 color mode, so this is also valid as the color part of a BC3 block
+void encode_bc1_block(texel_block_t const &b, unsigned char *out) {
+
+	float mean[3] = {0.0f, 0.0f, 0.0f};
+	for (unsigned i = 0; i < 16; ++i) {UNROLL_3X(mean[i_] += b.c[i_][i];)}
+	UNROLL_3X(mean[i_] *= (1.0f/16.0f);)
+	float cov[6] = {0.0f}; // xx, xy, xz, yy, yz, zz
+
+	for (unsigned i = 0; i < 16; ++i) {
+		float const r(b.c[0][i] - mean[0]), g(b.c[1][i] - mean[1]), bl(b.c[2][i] - mean[2]);
+		cov[0] += r*r; cov[1] += r*g; cov[2] += r*bl; cov[3] += g*g; cov[4] += g*bl; cov[5] += bl*bl;
+	}
+	float axis[3] = {1.0f, 1.0f, 1.0f};
+
+	for (unsigned iter = 0; iter < 4; ++iter) { // power iteration
+		float const x(cov[0]*axis[0] + cov[1]*axis[1] + cov[2]*axis[2]);
+		float const y(cov[1]*axis[0] + cov[3]*axis[1] + cov[4]*axis[2]);
+		float const z(cov[2]*axis[0] + cov[4]*axis[1] + cov[5]*axis[2]);
+		float const mag(max(fabs(x), max(fabs(y), fabs(z))));
+		if (mag < 1.0E-6f) break; // constant color block; keep the current axis
+		axis[0] = x/mag; axis[1] = y/mag; axis[2] = z/mag;
+	}
+	float tmin(0.0f), tmax(0.0f);
+
+	for (unsigned i = 0; i < 16; ++i) {
+		float const t((b.c[0][i] - mean[0])*axis[0] + (b.c[1][i] - mean[1])*axis[1] + (b.c[2][i] - mean[2])*axis[2]);
+		tmin = min(tmin, t); tmax = max(tmax, t);
+	}
+	float const inset((tmax - tmin)/32.0f); // pull the endpoints in slightly to reduce quantization error
+	tmin += inset; tmax -= inset;
+	float e0[3], e1[3];
+	UNROLL_3X(e0[i_] = max(0.0f, min(255.0f, mean[i_] + tmax*axis[i_])); e1[i_] = max(0.0f, min(255.0f, mean[i_] + tmin*axis[i_]));)
+	unsigned c0(pack_565(e0)), c1(pack_565(e1));
+	if (c0 < c1) {swap(c0, c1);} // c0 > c1 selects the 4 color mode
+	unsigned indices(0);
+
+	if (c0 > c1) { // else the block is a single color and all indices are 0
+		int pal[4][3];
+		unpack_565(c0, pal[0]);
+		unpack_565(c1, pal[1]);
+		UNROLL_3X(pal[2][i_] = (2*pal[0][i_] + pal[1][i_])/3; pal[3][i_] = (pal[0][i_] + 2*pal[1][i_])/3;)
+
+		for (unsigned i = 0; i < 16; ++i) {
+			unsigned best_ix(0), best_dist(~0U);
+
+			for (unsigned p = 0; p < 4; ++p) {
+				int const dr(b.c[0][i] - pal[p][0]), dg(b.c[1][i] - pal[p][1]), db(b.c[2][i] - pal[p][2]);
+				unsigned const dist(dr*dr + dg*dg + db*db);
+				if (dist < best_dist) {best_dist = dist; best_ix = p;}
+			}
+			indices |= (best_ix << (2*i));
+		}
+	}
+	out[0] = (unsigned char)c0; out[1] = (unsigned char)(c0 >> 8);
+	out[2] = (unsigned char)c1; out[3] = (unsigned char)(c1 >> 8);
+	for (unsigned i = 0; i < 4; ++i) {out[i+4] = (unsigned char)(indices >> (8*i));}
+}
+
+
+// ncolors selects the format: 1 = BC4, 2 = BC5, 3 = BC1, 4 = BC3
+unsigned get_bcn_block_bytes(unsigned ncolors) {
+	assert(ncolors >= 1 && ncolors <= 4);
+	return ((ncolors == 1 || ncolors == 3) ? 8 : 16);
+}
+unsigned get_bcn_compressed_size(unsigned w, unsigned h, unsigned ncolors) {
+	return get_bcn_block_bytes(ncolors)*((w+3)/4)*((h+3)/4);
+}
+
+// compresses a w x h image with ncolors 8-bit channels into out, which must hold get_bcn_compressed_size() bytes
+void compress_bcn_image(unsigned char const *data, unsigned w, unsigned h, unsigned ncolors, unsigned char *out) {
+
+	assert(data && out && w > 0 && h > 0);
+	unsigned const bw((w+3)/4), bh((h+3)/4), block_bytes(get_bcn_block_bytes(ncolors));
+
+#pragma omp parallel for schedule(dynamic,1) if (bh >= MIN_PARALLEL_BLOCK_ROWS)
+	for (int by = 0; by < (int)bh; ++by) {
+		texel_block_t block;
+
+		for (unsigned bx = 0; bx < bw; ++bx) {
+			block.load(data, w, h, ncolors, bx, by);
+			unsigned char *const bout(out + block_bytes*(by*bw + bx));
+
+			switch (ncolors) {
+			case 1: encode_bc4_block(block.c[0], bout); break;
+			case 2: encode_bc4_block(block.c[0], bout); encode_bc4_block(block.c[1], bout+8); break;
+			case 3: encode_bc1_block(block, bout); break;
+			case 4: encode_bc4_block(block.c[3], bout); encode_bc1_block(block, bout+8); break;
+			}
+		} // for bx
+	} // for by
+}
+
+
+uint64_t get_texture_file_mtime(string const &filename) { // returns 0 if the file doesn't exist
+	struct stat st;
+	if (stat(append_texture_dir(filename).c_str(), &st) == 0 || stat(filename.c_str(), &st) == 0) {return (uint64_t)st.st_mtime;}
+	return 0;
+}
+
+// returns the texture cache filename for this texture's source file and load parameters, or an empty string if this texture shouldn't be cached;
+// this is called before the source image is decoded, so it only uses values that are known up front; alpha_src is where the alpha channel is copied from
+string texture_t::get_cpu_compressed_cache_fn(texture_t const *const alpha_src, bool alpha_in_red_comp, bool is_bump) const {
+
+	if (!cpu_texture_compress || type != 0) return string(); // only cache textures loaded from files, since generated textures may change
+	if (defer_load() || format == 10 || get_file_extension(name, 0, 1) == "dds") return string(); // DDS files are already compressed
+	if (use_mipmaps == 2) return string(); // CPU side mipmaps need the decoded image
+	uint64_t const mtime(get_texture_file_mtime(name));
+	if (mtime == 0) return string(); // source file not found
+	hash_fnv1a_t hash;
+	hash.add_val(TEX_CACHE_VERSION);
+	hash.add_str(name);
+	hash.add_val(mtime);
+	hash.add_val(format);
+	hash.add_val(width); // requested size; 0 means use the size of the image file
+	hash.add_val(height);
+	hash.add_val(ncolors);
+	hash.add_val(use_mipmaps);
+	hash.add_val(mipmap_alpha_weight);
+	hash.add_val(invert_y);
+	hash.add_val(invert_alpha);
+	hash.add_val(do_compress);
+	hash.add_val(normal_map);
+	hash.add_val(is_bump);
+
+	if (alpha_src != nullptr) { // alpha channel is merged in from another texture file
+		uint64_t const alpha_mtime(get_texture_file_mtime(alpha_src->name));
+		if (alpha_src->type != 0 || alpha_mtime == 0) return string(); // alpha isn't from a file, so we can't tell if it changed
+		hash.add_str(alpha_src->name);
+		hash.add_val(alpha_mtime);
+		hash.add_val(alpha_in_red_comp);
+	}
+	return get_scene_cache_filename("tex_", hash.get());
+}
+
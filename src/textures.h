@@ -27,3 +27,9 @@ inline void unpack_color(unsigned char dst[3], colorRGBA const& src) {
 	UNROLL_3X(dst[i_] = (unsigned char)(255.0f * src[i_]);)
 }
 
+
+// CPU block compression, in texture_compress.cpp; ncolors selects the format: 1 = BC4, 2 = BC5, 3 = BC1, 4 = BC3
+unsigned get_bcn_block_bytes(unsigned ncolors);
+unsigned get_bcn_compressed_size(unsigned w, unsigned h, unsigned ncolors);
+void compress_bcn_image(unsigned char const *data, unsigned w, unsigned h, unsigned ncolors, unsigned char *out);
+
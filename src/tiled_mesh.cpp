@@ -51,7 +51,7 @@ hmap_brush_param_t cur_brush_param;
 tile_offset_t model3d_offset;
 
 extern bool inf_terrain_scenery, enable_tiled_mesh_ao, underwater, fog_enabled, volume_lighting, combined_gu, enable_depth_clamp, tt_triplanar_tex, use_grass_tess;
-extern bool use_instanced_pine_trees, enable_tt_model_reflect, water_is_lava, tt_fire_button_down, flashlight_on;
+extern bool use_instanced_pine_trees, enable_tt_model_reflect, water_is_lava, tt_fire_button_down, flashlight_on, async_tile_gen;
 extern unsigned grass_density, max_unique_trees, shadow_map_sz, num_birds_per_tile, num_fish_per_tile, erosion_iters_tt, num_rnd_grass_blocks;
 extern int DISABLE_WATER, display_mode, tree_mode, leaf_color_changed, ground_effects_level, animate2, iticks, num_trees, window_width, window_height;
 extern int invert_mh_image, is_cloudy, camera_surf_collide, show_fog, mesh_gen_mode, mesh_gen_shape, cloud_model, precip_mode, auto_time_adv, draw_model;
@@ -217,6 +217,27 @@ public:
 		if (cur_tile) {cur_tile->fill_adj_mask(modified, x, y);}
 		return 1;
 	}
+	void invalidate_dirty_mod_tiles() { // invalidate the mesh height of existing tiles that overlap modified regions of the mod map
+		// Note: mirrored copies of the heightmap outside of the texture bounds aren't invalidated
+		vector<tex_xy_t> dirty;
+		get_dirty_mod_tiles(dirty);
+		int const tsz(get_tile_size());
+
+		for (auto i = dirty.begin(); i != dirty.end(); ++i) {
+			int x1(0), y1(0), x2(0), y2(0);
+			if (!get_mod_tile_mesh_bounds(*i, x1, y1, x2, y2)) continue;
+			--x1; --y1; ++x2; ++y2; // include adjacent tiles that share an edge
+			int const tx1((x1 - ((x1 < 0) ? tsz-1 : 0))/tsz), ty1((y1 - ((y1 < 0) ? tsz-1 : 0))/tsz); // round toward lower integer
+			int const tx2((x2 - ((x2 < 0) ? tsz-1 : 0))/tsz), ty2((y2 - ((y2 < 0) ? tsz-1 : 0))/tsz);
+
+			for (int ty = ty1; ty <= ty2; ++ty) {
+				for (int tx = tx1; tx <= tx2; ++tx) {
+					tile_t *tile(get_tile_from_xy(tile_xy_pair(tx, ty)));
+					if (tile) {tile->invalidate_mesh_height();}
+				}
+			}
+		} // for i
+	}
 };
 
 
@@ -235,6 +256,7 @@ bool read_default_hmap_modmap() {
 
 	if (read_hmap_modmap_fn.empty()) return 0;
 	if (!terrain_hmap_manager.read_and_apply_mod(read_hmap_modmap_fn)) return 0;
+	terrain_hmap_manager.invalidate_dirty_mod_tiles(); // in case tiles were already generated
 	cout << "Read heightmap modmap " << read_hmap_modmap_fn << endl;
 	return 1;
 }
@@ -420,7 +442,7 @@ bool setup_height_gen(mesh_xy_grid_cache_t &height_gen, float x0, float y0, floa
 }
 
 
-bool tile_t::create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait) {
+bool tile_t::create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait, bool single_thread) { // single_thread=1 when called from a worker thread
 
 	//timer_t timer("Create Zvals");
 	if (enable_terrain_env) {update_terrain_params();}
@@ -436,10 +458,8 @@ bool tile_t::create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait) {
 		if (!results_ready) {assert(no_wait); return 0;} // cached heights are not yet ready
 		ao_zvals.resize(context_sz*context_sz);
 
-#pragma omp parallel for schedule(static,1)
-		for (int y = 0; y < (int)context_sz; ++y) {
-			for (unsigned x = 0; x < context_sz; ++x) {ao_zvals[y*context_sz + x] = height_gen.eval_index(x, y);}
-		}
+#pragma omp parallel for schedule(static,1) if (!single_thread)
+		for (int y = 0; y < (int)context_sz; ++y) {height_gen.eval_row(y, &ao_zvals[y*context_sz]);}
 	}
 	else {
 		bool results_ready(setup_height_gen(height_gen, get_xval(x1), get_yval(y1), deltax, deltay, zvsize, zvsize, 0, no_wait)); // cache_values=0
@@ -447,18 +467,22 @@ bool tile_t::create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait) {
 	}
 	float const xy_mult(1.0/float(size)), wpz_max(get_water_z_height() + ocean_wave_height);
 
-#pragma omp parallel for schedule(static,1)
+#pragma omp parallel for schedule(static,1) if (!single_thread)
 	for (int y = 0; y < (int)zvsize; ++y) {
+		float *const row(&zvals[y*zvsize]);
+		bool const use_height_gen(add_detail || (!using_hmap && ao_zvals.empty()));
+		if (use_height_gen) {height_gen.eval_row(y, row);} // evaluate the whole row at once, which is faster for CPU noise
+
 		for (unsigned x = 0; x < zvsize; ++x) {
-			float &zval(zvals[y*zvsize + x]);
+			float &zval(row[x]);
 
 			if (using_hmap) {
-				zval = terrain_hmap_manager.get_clamped_height((x1 + x), (y1 + y));
-				if (add_detail) {zval += HMAP_DETAIL_MAG*height_gen.eval_index(x, y);} // less hard-coded - scale by delta between adjacent zvals?
+				float const hmap_zval(terrain_hmap_manager.get_clamped_height((x1 + x), (y1 + y)));
+				zval = (add_detail ? (hmap_zval + HMAP_DETAIL_MAG*zval) : hmap_zval); // less hard-coded - scale by delta between adjacent zvals?
 			}
 			else {
 				if (!ao_zvals.empty()) {zval = ao_zvals[(y + AO_RAY_LEN)*context_sz + (x + AO_RAY_LEN)];} // use AO zvals
-				else                   {zval = height_gen.eval_index(x, y);} // use height gen
+				// else zval was set by height gen above
 
 				if (USE_PARAMS_HSCALE) {
 					float const xv(float(x)*xy_mult), yv(float(y)*xy_mult);
@@ -538,7 +562,7 @@ float tile_t::get_zval_at(float x, float y, bool in_global_space) const {
 
 // *** shadows + AO lighting ***
 
-void tile_t::calc_mesh_ao_lighting() {
+void tile_t::calc_mesh_ao_lighting(bool single_thread) {
 
 	//timer_t timer("Calc Tile AO Lighting");
 	// caclulate ray step directions
@@ -567,7 +591,7 @@ void tile_t::calc_mesh_ao_lighting() {
 	float const dz(0.5*HALF_DXY);
 	ao_lighting.resize(stride*stride);
 
-#pragma omp parallel
+#pragma omp parallel if (!single_thread)
 	{
 		if (!use_ao_zvals) {
 #pragma omp for schedule(static,1)
@@ -2068,16 +2092,128 @@ void lightning_strike_t::end_draw() const {
 // *** tile_draw_t ***
 
 
+// *** tile_gen_pool_t ***
+
+void tile_gen_pool_t::start(unsigned num_threads) {
+	assert(threads.empty() && num_threads > 0);
+	exit_threads = 0;
+	for (unsigned i = 0; i < num_threads; ++i) {threads.push_back(std::thread(&tile_gen_pool_t::run_worker, this));}
+}
+
+void tile_gen_pool_t::stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		exit_threads = 1;
+	}
+	cv.notify_all();
+	for (auto i = threads.begin(); i != threads.end(); ++i) {i->join();}
+	threads.clear();
+	for (auto i = queue.begin(); i != queue.end(); ++i) {delete i->second;}
+	for (auto i = done .begin(); i != done .end(); ++i) {delete *i;}
+	queue.clear();
+	done.clear();
+}
+
+void tile_gen_pool_t::run_worker() {
+	mesh_xy_grid_cache_t height_gen; // one per worker
+
+	while (1) {
+		tile_t *tile(nullptr);
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!exit_threads && queue.empty()) {cv.wait(lock);}
+			if (exit_threads) return;
+			tile = queue.back().second;
+			queue.pop_back();
+			++num_running;
+		}
+		// each worker already runs on its own core, so the inner OpenMP loops are run serially to avoid oversubscription
+		tile->create_zvals(height_gen, 0, 1); // CPU mode, always completes
+		if (enable_tiled_mesh_ao) {tile->calc_mesh_ao_lighting(1);} // only reads this tile's zvals
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done.push_back(tile);
+			assert(num_running > 0);
+			--num_running;
+		}
+		cv.notify_all(); // wake up cancel_all() if it's waiting
+	}
+}
+
+void tile_gen_pool_t::add_tiles(vector<pair<float, tile_t *> > const &tiles) {
+	if (tiles.empty()) return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.insert(queue.end(), tiles.begin(), tiles.end());
+		sort(queue.begin(), queue.end(), std::greater<pair<float, tile_t *> >()); // highest priority last
+	}
+	cv.notify_all();
+}
+
+void tile_gen_pool_t::update_queue(vector<tile_t *> &removed) { // update priorities for the new camera position and remove tiles that are now too far away
+	std::lock_guard<std::mutex> lock(mutex);
+	unsigned qpos(0);
+
+	for (auto i = queue.begin(); i != queue.end(); ++i) {
+		if (i->second->get_rel_dist_to_camera() >= CREATE_DIST_TILES) {removed.push_back(i->second); continue;}
+		i->first = i->second->get_draw_priority();
+		queue[qpos++] = *i;
+	}
+	queue.resize(qpos);
+	sort(queue.begin(), queue.end(), std::greater<pair<float, tile_t *> >());
+}
+
+void tile_gen_pool_t::get_finished_tiles(vector<tile_t *> &tiles) {
+	std::lock_guard<std::mutex> lock(mutex);
+	tiles.insert(tiles.end(), done.begin(), done.end());
+	done.clear();
+}
+
+void tile_gen_pool_t::cancel_all(vector<tile_t *> &removed) { // removes all tiles, waiting for any that are currently being generated
+	std::unique_lock<std::mutex> lock(mutex);
+	for (auto i = queue.begin(); i != queue.end(); ++i) {removed.push_back(i->second);}
+	queue.clear();
+	while (num_running > 0) {cv.wait(lock);}
+	removed.insert(removed.end(), done.begin(), done.end());
+	done.clear();
+}
+
+
 tile_draw_t::tile_draw_t() : buildings_valid(0), tiles_gen_prev_frame(0), terrain_zmin(0.0), lod_renderer(USE_TREE_BILLBOARDS) {
 	assert(MESH_X_SIZE == MESH_Y_SIZE && X_SCENE_SIZE == Y_SCENE_SIZE);
 }
 
+// generates the zvals of all tiles in range of the camera with CPU noise, then discards them; used for the headless benchmark
+unsigned tile_draw_t::gen_tiles_cpu_benchmark() {
+
+	update_hmap_and_buildings();
+	point const camera(get_camera_pos() - get_tiled_terrain_model_xlate());
+	int const tile_radius(int(CREATE_DIST_TILES*TILE_RADIUS) + 1);
+	int const toffx(int(0.5*camera.x/X_SCENE_SIZE)), toffy(int(0.5*camera.y/Y_SCENE_SIZE));
+	int const prev_mesh_gen_mode(mesh_gen_mode);
+	if (mesh_gen_mode >= MGEN_SIMPLEX_GPU) {mesh_gen_mode = MGEN_SIMPLEX;} // GPU simplex => CPU simplex
+	mesh_xy_grid_cache_t height_gen;
+	unsigned num_tiles(0);
+
+	for (int y = -tile_radius + toffy; y <= tile_radius + toffy; ++y) {
+		for (int x = -tile_radius + toffx; x <= tile_radius + toffx; ++x) {
+			tile_t tile(get_tile_size(), x, y);
+			if (tile.get_rel_dist_to_camera() >= CREATE_DIST_TILES) continue; // too far away to create
+			tile.create_zvals(height_gen, 0); // rows are generated in parallel
+			++num_tiles;
+		}
+	}
+	mesh_gen_mode = prev_mesh_gen_mode;
+	return num_tiles;
+}
+
 void tile_draw_t::clear(bool no_regen_buildings) {
 
 	clear_vbos_tids(); // needed to clear vbo, ivbo, and free list
 	for (tile_map::iterator i = tiles.begin(); i != tiles.end(); ++i) {i->second->clear();} // may not be necessary
 	to_draw.clear();
 	tiles.clear();
+	cancel_async_tile_gen();
 	shadow_recomp_queue.clear();
 	if (!no_regen_buildings && !have_cities()) {buildings_valid = 0;} // can't regenerate buildings after cities and cars have been placed
 }
@@ -2087,17 +2223,19 @@ void tile_draw_t::insert_tile(tile_t *tile) {
 	assert(did_ins);
 }
 
+void tile_draw_t::cancel_async_tile_gen() {
+	if (async_gen_tiles.empty()) return;
+	vector<tile_t *> removed;
+	tile_gen_pool.cancel_all(removed);
+	for (auto i = removed.begin(); i != removed.end(); ++i) {delete *i;}
+	async_gen_tiles.clear();
+}
+
 void tile_draw_t::free_compute_shader() {
 	for (auto i = height_gens.begin(); i != height_gens.end(); ++i) {i->clear_context();}
 }
 
-float tile_draw_t::update(float &min_camera_dist) { // view-independent updates; returns terrain zmin
-
-	//timer_t timer("TT Update");
-	unsigned const max_tile_gen_per_frame = 16; // higher = less overall gen time (more parallel), but longer wait for first render
-	unsigned const max_cpu_tiles          = 3; // 0 = GPU only
-	unsigned const max_defer_tiles        = 8; // 0 = disable
-	if (height_gens.empty()) {height_gens.resize(max(max_defer_tiles, 1U));}
+void tile_draw_t::update_hmap_and_buildings() { // heightmap (with cities), buildings, and models; doesn't require a GL context
 
 	if (terrain_hmap_manager.maybe_load(mh_filename_tt, (invert_mh_image != 0))) {
 		read_default_hmap_modmap();
@@ -2109,6 +2247,16 @@ float tile_draw_t::update(float &min_camera_dist) { // view-independent updates;
 		buildings_valid = 1;
 	}
 	auto_calc_model_zvals(); // must be done after heightmap loading but before any tiles are created
+}
+
+float tile_draw_t::update(float &min_camera_dist) { // view-independent updates; returns terrain zmin
+
+	//timer_t timer("TT Update");
+	unsigned const max_tile_gen_per_frame = 16; // higher = less overall gen time (more parallel), but longer wait for first render
+	unsigned const max_cpu_tiles          = 3; // 0 = GPU only
+	unsigned const max_defer_tiles        = 8; // 0 = disable
+	if (height_gens.empty()) {height_gens.resize(max(max_defer_tiles, 1U));}
+	update_hmap_and_buildings();
 	to_draw.clear();
 	terrain_zmin = FAR_DISTANCE;
 	grass_tile_manager.update(); // every frame, even if not in tiled terrain mode?
@@ -2120,6 +2268,10 @@ float tile_draw_t::update(float &min_camera_dist) { // view-independent updates;
 	int const x2( tile_radius + toffx), y2( tile_radius + toffy);
 	unsigned const init_tiles((unsigned)tiles.size());
 	bool const create_buildings_first(FLATTEN_BUILDING_TILE && using_tiled_terrain_hmap_tex());
+	bool const gpu_mode(mesh_gen_mode >= MGEN_SIMPLEX_GPU);
+	// async generation is only used for CPU height generation, and not when the heightmap can be modified while tiles are being generated
+	bool const can_async_gen(async_tile_gen && !gpu_mode && !create_buildings_first && inf_terrain_fire_mode == FM_NONE);
+	bool const use_async_gen(can_async_gen && !tiles.empty()); // generate the first set of tiles synchronously so that there's something to draw
 	unsigned num_erased(0);
 	min_camera_dist = FAR_DISTANCE;
 	// Note: we may want to calculate distant low-res or larger tiles when the camera is high above the mesh
@@ -2135,6 +2287,21 @@ float tile_draw_t::update(float &min_camera_dist) { // view-independent updates;
 		}
 		to_gen_zvals.clear();
 	}
+	if (!can_async_gen) {cancel_async_tile_gen();}
+	else if (!async_gen_tiles.empty()) { // insert tiles finished by the worker threads, and drop queued tiles that are no longer needed
+		vector<tile_t *> gen_tiles, removed;
+		tile_gen_pool.get_finished_tiles(gen_tiles);
+		tile_gen_pool.update_queue(removed);
+
+		for (auto i = gen_tiles.begin(); i != gen_tiles.end(); ++i) {
+			async_gen_tiles.erase((*i)->get_tile_xy_pair());
+			insert_tile(*i); // will be deleted in update_range() below if too far away
+		}
+		for (auto i = removed.begin(); i != removed.end(); ++i) {
+			async_gen_tiles.erase((*i)->get_tile_xy_pair());
+			delete *i;
+		}
+	}
 	for (tile_map::iterator i = tiles.begin(); i != tiles.end(); ) { // update tiles and free old tiles (Note: no ++i)
 		if (!i->second->update_range(smap_manager)) { // delete this tile
 			i->second->clear();
@@ -2146,6 +2313,7 @@ float tile_draw_t::update(float &min_camera_dist) { // view-independent updates;
 		for (int x = x1; x <= x2; ++x ) {
 			tile_xy_pair const txy(x, y);
 			if (tiles.find(txy) != tiles.end()) continue; // already exists
+			if (async_gen_tiles.find(txy) != async_gen_tiles.end()) continue; // already being generated
 			tile_t tile(get_tile_size(), x, y);
 			if (tile.get_rel_dist_to_camera() >= CREATE_DIST_TILES) continue; // too far away to create
 			tile_t *new_tile(new tile_t(tile));
@@ -2155,9 +2323,14 @@ float tile_draw_t::update(float &min_camera_dist) { // view-independent updates;
 		} // for x
 	} // for y
 	//if (to_gen_zvals.size() < max_cpu_tiles) {to_gen_zvals.clear();} // block until at least max_cpu_tiles tiles to generate (lower average gen time, but causes more slow frames/lag)
+	if (use_async_gen && !to_gen_zvals.empty()) { // send all new tiles to the worker threads, with no per-frame limit
+		if (!tile_gen_pool.is_started()) {tile_gen_pool.start(max(1U, min(4U, std::thread::hardware_concurrency()/2)));}
+		for (auto i = to_gen_zvals.begin(); i != to_gen_zvals.end(); ++i) {async_gen_tiles.insert(i->second->get_tile_xy_pair());}
+		tile_gen_pool.add_tiles(to_gen_zvals);
+		to_gen_zvals.clear();
+	}
 	unsigned const num_to_gen(to_gen_zvals.size());
 	unsigned gen_this_frame(min(num_to_gen, max_tile_gen_per_frame));
-	bool const gpu_mode(mesh_gen_mode >= MGEN_SIMPLEX_GPU);
 	
 	// to balance tile gen time across frames, generate a number of tiles equal to the average of this frame and the previous frame
 	if (gen_this_frame > 1 && gen_this_frame < max_tile_gen_per_frame && inf_terrain_fire_mode == FM_NONE) { // disable this mode when editing mesh height to prevent visual artifacts
@@ -2194,6 +2367,8 @@ float tile_draw_t::update(float &min_camera_dist) { // view-independent updates;
 		to_gen_zvals.clear();
 		mesh_gen_mode = prev_mesh_gen_mode;
 	}
+	update_building_tiles_async(async_tile_gen && !create_buildings_first); // buildings that flatten the heightmap must be created before the tile's zvals
+
 	for (tile_map::iterator i = tiles.begin(); i != tiles.end(); ++i) { // calculate terrain_zmin and updated building tiles
 		float const rel_dist(i->second->get_rel_dist_to_camera());
 
@@ -3427,6 +3602,8 @@ void draw_tiled_terrain(int reflection_pass) {
 void draw_tiled_terrain_lightning(bool reflection_pass) {terrain_tile_draw.update_lightning(reflection_pass);}
 void end_tiled_terrain_lightning() {terrain_tile_draw.end_lightning();}
 void clear_tiled_terrain(bool no_regen_buildings) {terrain_tile_draw.clear(no_regen_buildings);}
+void init_tiled_terrain_hmap_and_buildings() {terrain_tile_draw.update_hmap_and_buildings();}
+unsigned gen_tiled_terrain_tiles_cpu_benchmark() {return terrain_tile_draw.gen_tiles_cpu_benchmark();}
 void draw_tiled_terrain_clouds(bool reflection_pass) {terrain_tile_draw.draw_tile_clouds(reflection_pass);}
 void draw_tiled_terrain_decid_tree_shadows() {terrain_tile_draw.draw_decid_tree_shadows();}
 void reset_tiled_terrain_state() {terrain_tile_draw.clear_vbos_tids();}
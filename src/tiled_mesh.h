@@ -13,6 +13,9 @@
 #include "tree_3dw.h"
 #include "shadow_map.h"
 #include "animals.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 
 bool const ENABLE_TREE_LOD    = 1; // faster but has popping artifacts
@@ -281,7 +284,7 @@ public:
 	void clear_shadow_map(tile_shadow_map_manager *smap_manager);
 	void clear_vbo_tid(tile_shadow_map_manager *smap_manager);
 	void clear_pine_tree_vbos() {pine_trees.clear_vbos();}
-	bool create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait);
+	bool create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait, bool single_thread=0);
 	void get_z_minmax_for_area(point const &pos, float radius, float &zmin, float &zmax) const;
 	float get_zval_at(float x, float y, bool in_global_space) const;
 
@@ -292,7 +295,7 @@ public:
 	vector3d get_mesh_xlate() const {return mesh_off.get_xlate() + vector3d(xstart, ystart, 0.0);}
 
 	// *** shadows ***
-	void calc_mesh_ao_lighting();
+	void calc_mesh_ao_lighting(bool single_thread=0);
 	void calc_shadows_for_light(unsigned l);
 	static void proc_tile_queue(tile_t *init_tile, unsigned l);
 	void calc_shadows(bool calc_sun, bool calc_moon, bool no_push=0);
@@ -407,6 +410,33 @@ public:
 }; // tile_t
 
 
+// worker threads that generate tile zvals (and AO lighting, if enabled) in the background when using CPU height generation;
+// only the steps that depend on nothing but the tile itself run here - trees, scenery, grass, shadows (which read adjacent tiles),
+// and textures/VBOs (which need the GL context) are still created on the main thread when the tile is first drawn
+class tile_gen_pool_t {
+
+	vector<std::thread> threads;
+	vector<pair<float, tile_t *> > queue; // {priority, tile}, sorted so that the highest priority (lowest value) tile is last
+	vector<tile_t *> done;
+	std::mutex mutex;
+	std::condition_variable cv;
+	unsigned num_running;
+	bool exit_threads;
+
+	void run_worker();
+public:
+	tile_gen_pool_t() : num_running(0), exit_threads(0) {}
+	~tile_gen_pool_t() {stop();}
+	bool is_started() const {return !threads.empty();}
+	void start(unsigned num_threads);
+	void stop();
+	void add_tiles(vector<pair<float, tile_t *> > const &tiles);
+	void update_queue(vector<tile_t *> &removed);
+	void get_finished_tiles(vector<tile_t *> &tiles);
+	void cancel_all(vector<tile_t *> &removed);
+};
+
+
 class tile_draw_t : public indexed_vbo_manager_t {
 
 	typedef map<tile_xy_pair, std::unique_ptr<tile_t> > tile_map;
@@ -424,6 +454,8 @@ class tile_draw_t : public indexed_vbo_manager_t {
 	vector<pair<float, tile_t *>> to_gen_zvals;
 	cloud_draw_list_t to_draw_clouds;
 	vector<mesh_xy_grid_cache_t> height_gens;
+	tile_gen_pool_t tile_gen_pool;
+	tile_set_t async_gen_tiles; // tiles in tile_gen_pool that haven't been inserted yet
 	lightning_strike_t lightning_strike;
 	tree_lod_render_t lod_renderer;
 	crack_ibuf_t crack_ibuf;
@@ -437,13 +469,16 @@ class tile_draw_t : public indexed_vbo_manager_t {
 	vector<tile_t *> occluders; // reused across draw calls
 	vector<cube_t> test_cubes; // reused across draw calls
 	void insert_tile(tile_t *tile);
+	void cancel_async_tile_gen();
 
 public:
 	tile_draw_t();
 	~tile_draw_t() {/*clear();*/}
 	void clear(bool no_regen_buildings);
 	void free_compute_shader();
+	void update_hmap_and_buildings();
 	float update(float &min_camera_dist);
+	unsigned gen_tiles_cpu_benchmark();
 private:
 	static void setup_terrain_textures(shader_t &s, unsigned start_tu_id);
 	static void add_texture_colors(shader_t &s, unsigned start_tu_id);
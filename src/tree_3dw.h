@@ -15,6 +15,8 @@ class tree_data_t;
 class cobj_bvh_tree;
 class tree;
 class tile_t;
+struct binary_file_reader;
+struct binary_file_writer;
 
 // small tree classes
 enum {TREE_CLASS_NONE=0, TREE_CLASS_PINE, TREE_CLASS_DECID, TREE_CLASS_PALM, TREE_CLASS_DETAILED, NUM_TREE_CLASSES};
@@ -133,9 +135,10 @@ struct tree_xform_t {
 
 class tree_builder_t : public tree_xform_t {
 
-	static vector<tree_cylin >   cylin_cache;
-	static vector<tree_branch>   branch_cache;
-	static vector<tree_branch *> branch_ptr_cache;
+	// per-thread so that multiple trees can be generated in parallel
+	static thread_local vector<tree_cylin >   cylin_cache;
+	static thread_local vector<tree_branch>   branch_cache;
+	static thread_local vector<tree_branch *> branch_ptr_cache;
 
 	tree_branch base, roots, *branches_34[2], **branches;
 	int base_num_cylins, root_num_cylins, ncib, num_1_branches, num_big_branches_min, num_big_branches_max;
@@ -224,6 +227,8 @@ public:
 	void make_private_copy(tree_data_t &dest) const;
 	void gen_tree_data(int tree_type_, int size, float tree_depth, float height_scale, float br_scale_mult, float nl_scale,
 		float bbo_scale, bool has_4th_branches_, cube_t const *clip_cube, bool create_bush, rand_gen_t &rgen);
+	bool write_to_file(binary_file_writer &writer) const;
+	bool read_from_file(binary_file_reader &reader);
 	void mark_leaf_changed(unsigned ix);
 	void gen_leaf_color();
 	void update_all_leaf_colors();
@@ -238,6 +243,8 @@ public:
 	void remove_leaf_ix(unsigned i, bool update_data);
 	bool spraypaint_leaves(point const &pos, float radius, colorRGBA const &color, bool check_only);
 	void bend_leaf(unsigned i, float angle);
+	void bend_leaves(unsigned start, unsigned end, float const *angles, unsigned char const *bend_mask);
+	void mark_leaf_range_changed(unsigned start, unsigned end);
 	void draw_leaf_quads_from_vbo(unsigned max_leaves) const;
 	void draw_leaves_shadow_only(float size_scale);
 	void ensure_branch_vbo();
@@ -346,7 +353,8 @@ public:
 	void remove_collision_objects();
 	bool check_sphere_coll(point &center, float radius) const;
 	float calc_size_scale(point const &draw_pos) const;
-	void update_leaf_orients_wind();
+	bool update_leaf_orients_wind(unsigned start, unsigned end);
+	static void update_leaf_orients_wind_all(vector<tree *> &trees);
 	void draw_branches_top(shader_t &s, tree_lod_render_t &lod_renderer, bool shadow_only, bool reflection_pass, vector3d const &xlate, int wsoff_loc);
 	void draw_leaves_top(shader_t &s, tree_lod_render_t &lod_renderer, bool shadow_only, bool reflection_pass, vector3d const &xlate,
 		int wsoff_loc, int tex0_loc, vector<tree *> &to_update_leaves);
@@ -382,10 +390,15 @@ class tree_data_manager_t : public vector<tree_data_t> {
 
 	float last_tree_scale;
 	int last_rgi;
+	bool all_generated;
+	vector<unsigned char> slot_is_bush;
+
+	void gen_all_tree_data();
 
 public:
-	tree_data_manager_t() : last_tree_scale(1.0), last_rgi(0) {}
+	tree_data_manager_t() : last_tree_scale(1.0), last_rgi(0), all_generated(0) {}
 	void ensure_init();
+	int find_non_bush_slot(int tree_id, unsigned range_start, unsigned range_end) const;
 	void clear_context();
 	void on_leaf_color_change();
 	unsigned get_gpu_mem() const;
@@ -414,7 +427,7 @@ public:
 	unsigned scroll_trees(int ext_x1, int ext_x2, int ext_y1, int ext_y2);
 	void post_scroll_remove();
 	void gen_deterministic(int x1, int y1, int x2, int y2, float vegetation_, float mesh_dz, tile_t const *const cur_tile=nullptr);
-	void add_new_tree(rand_gen_t &rgen, int &ttype);
+	void add_new_tree(rand_gen_t &rgen, int &ttype, bool allow_bushes);
 	void gen_trees_tt_within_radius(int x1, int y1, int x2, int y2, point const &center, float radius, bool is_square=0,
 		float mesh_dz=-1.0, tile_t const *const cur_tile=nullptr, float vegetation_=1.0, bool use_density=0);
 	void shift_by(vector3d const &vd);
@@ -0,0 +1 @@
+../dependencies/meshoptimizer/src/vertexcodec.cpp
\ No newline at end of file
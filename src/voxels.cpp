@@ -38,6 +38,8 @@ extern coll_obj_group coll_objects;
 
 template class voxel_grid<float>;  // explicit instantiation
 template class voxel_grid<cube_t>; // explicit instantiation
+template class sparse_voxel_grid<float>;         // explicit instantiation
+template class sparse_voxel_grid<unsigned char>; // explicit instantiation
 
 int get_range_to_mesh(point const &pos, vector3d const &vcf, point &coll_pos);
 bool read_voxel_brushes();
@@ -78,28 +80,21 @@ float noise_texture_manager_t::eval_at(point const &pos) const {
 }
 
 
-template<typename V> void voxel_grid<V>::init_grid(unsigned nx_, unsigned ny_, unsigned nz_, V default_val, unsigned num_blocks) {
+void voxel_grid_base::init_dims(unsigned nx_, unsigned ny_, unsigned nz_, unsigned num_blocks) {
 	nx = nx_; ny = ny_; nz = nz_;
 	xblocks = 1+(nx-1)/num_blocks; // ceil
 	yblocks = 1+(ny-1)/num_blocks; // ceil
-	unsigned const tot_size(nx * ny * nz);
-	assert(tot_size > 0);
-	clear();
-	resize(tot_size, default_val);
+	assert(nx * ny * nz > 0);
 }
 
-template<typename V> void voxel_grid<V>::init(unsigned nx_, unsigned ny_, unsigned nz_, vector3d const &vsz_,
-	point const &center_, V const &default_val, unsigned num_blocks)
-{
-	init_grid(nx_, ny_, nz_, default_val, num_blocks);
+void voxel_grid_base::init_pos(vector3d const &vsz_, point const &center_) {
 	vsz = vsz_;
 	assert(vsz.x > 0.0 && vsz.y > 0.0 && vsz.z > 0.0);
 	center = center_;
 	lo_pos = center - 0.5*vector3d((nx-1)*vsz.x, (ny-1)*vsz.y, (nz-1)*vsz.z);
 }
 
-template<typename V> void voxel_grid<V>::init(unsigned nx_, unsigned ny_, unsigned nz_, cube_t const &bcube, V const &default_val, unsigned num_blocks) {
-	init_grid(nx_, ny_, nz_, default_val, num_blocks);
+void voxel_grid_base::init_pos(cube_t const &bcube) {
 	assert(!bcube.is_zero_area());
 	vector3d const csz(bcube.get_size());
 	center = bcube.get_cube_center();
@@ -108,6 +103,25 @@ template<typename V> void voxel_grid<V>::init(unsigned nx_, unsigned ny_, unsign
 }
 
 
+template<typename V> void voxel_grid<V>::init_grid(unsigned nx_, unsigned ny_, unsigned nz_, V default_val, unsigned num_blocks) {
+	init_dims(nx_, ny_, nz_, num_blocks);
+	clear();
+	resize(nx*ny*nz, default_val);
+}
+
+template<typename V> void voxel_grid<V>::init(unsigned nx_, unsigned ny_, unsigned nz_, vector3d const &vsz_,
+	point const &center_, V const &default_val, unsigned num_blocks)
+{
+	init_grid(nx_, ny_, nz_, default_val, num_blocks);
+	init_pos(vsz_, center_);
+}
+
+template<typename V> void voxel_grid<V>::init(unsigned nx_, unsigned ny_, unsigned nz_, cube_t const &bcube, V const &default_val, unsigned num_blocks) {
+	init_grid(nx_, ny_, nz_, default_val, num_blocks);
+	init_pos(bcube);
+}
+
+
 // Note: assumes mesh is centered around 0,0
 template<> void voxel_grid<float>::init_from_heightmap(float **height, unsigned mesh_nx, unsigned mesh_ny,
 	unsigned zsteps, float mesh_xsize, float mesh_ysize, unsigned num_blocks, bool invert)
@@ -171,7 +185,7 @@ template<> void voxel_grid<float>::downsample_2x() { // modify in place, perserv
 template<> void voxel_grid<cube_t>::downsample_2x() {assert(0);} // not supported
 
 
-template<typename V> void voxel_grid<V>::get_bcube_ix_bounds(cube_t const &bcube, int llc[3], int urc[3]) const {
+void voxel_grid_base::get_bcube_ix_bounds(cube_t const &bcube, int llc[3], int urc[3]) const {
 
 	get_xyz(bcube.get_llc(), llc);
 	get_xyz(bcube.get_urc(), urc);
@@ -199,13 +213,30 @@ template<typename T> bool write_pod(T const &v, FILE *fp, char const *const name
 }
 
 
-template<typename V> bool voxel_grid<V>::read(FILE *fp) {
+bool voxel_grid_base::read_header(FILE *fp) {
 
 	assert(fp);
-	unsigned sz(0);
 	if (!read_pod(nx, fp, "voxel nx") || !read_pod(nx, fp, "voxel ny") || !read_pod(nx, fp, "voxel nz")) return 0;
 	if (!read_pod(xblocks, fp, "voxel xblocks") || !read_pod(yblocks, fp, "voxel yblocks")) return 0;
 	if (!read_pod(vsz, fp, "voxel vsz") || !read_pod(center, fp, "voxel center") || !read_pod(lo_pos, fp, "voxel lo_pos")) return 0;
+	return 1;
+}
+
+
+bool voxel_grid_base::write_header(FILE *fp) const {
+
+	assert(fp);
+	if (!write_pod(nx, fp, "voxel nx") || !write_pod(nx, fp, "voxel ny") || !write_pod(nx, fp, "voxel nz")) return 0;
+	if (!write_pod(xblocks, fp, "voxel xblocks") || !write_pod(yblocks, fp, "voxel yblocks")) return 0;
+	if (!write_pod(vsz, fp, "voxel vsz") || !write_pod(center, fp, "voxel center") || !write_pod(lo_pos, fp, "voxel lo_pos")) return 0;
+	return 1;
+}
+
+
+template<typename V> bool voxel_grid<V>::read(FILE *fp) {
+
+	unsigned sz(0);
+	if (!read_header(fp)) return 0;
 	if (!read_pod(sz, fp, "voxel_grid size")) return 0;
 	
 	if (empty()) {
@@ -225,11 +256,8 @@ template<typename V> bool voxel_grid<V>::read(FILE *fp) {
 
 template<typename V> bool voxel_grid<V>::write(FILE *fp) const {
 
-	assert(fp);
 	unsigned const sz(size());
-	if (!write_pod(nx, fp, "voxel nx") || !write_pod(nx, fp, "voxel ny") || !write_pod(nx, fp, "voxel nz")) return 0;
-	if (!write_pod(xblocks, fp, "voxel xblocks") || !write_pod(yblocks, fp, "voxel yblocks")) return 0;
-	if (!write_pod(vsz, fp, "voxel vsz") || !write_pod(center, fp, "voxel center") || !write_pod(lo_pos, fp, "voxel lo_pos")) return 0;
+	if (!write_header(fp)) return 0;
 	if (!write_pod(sz, fp, "voxel_grid size")) return 0;
 	
 	if (fwrite(&front(), sizeof(V), size(), fp) != size()) {
@@ -240,6 +268,168 @@ template<typename V> bool voxel_grid<V>::write(FILE *fp) const {
 }
 
 
+template<typename V> void sparse_voxel_grid<V>::init(unsigned nx_, unsigned ny_, unsigned nz_, vector3d const &vsz_,
+	point const &center_, V const &default_val, unsigned num_blocks)
+{
+	init_dims(nx_, ny_, nz_, num_blocks);
+	init_pos(vsz_, center_);
+	clear();
+	alloc_bricks(default_val);
+}
+
+template<typename V> void sparse_voxel_grid<V>::alloc_bricks(V const &default_val) {
+	bnx = 1+(nx-1)/VOXEL_BRICK_SZ; // ceil
+	bny = 1+(ny-1)/VOXEL_BRICK_SZ;
+	bnz = 1+(nz-1)/VOXEL_BRICK_SZ;
+	bricks.resize(bnx*bny*bnz, brick_t(default_val)); // all uniform
+}
+
+template<typename V> void sparse_voxel_grid<V>::clear() {
+	vector<brick_t>().swap(bricks); // free the dense bricks as well
+}
+
+template<typename V> unsigned sparse_voxel_grid<V>::get_num_dense_bricks() const {
+
+	unsigned num(0);
+	for (auto i = bricks.begin(); i != bricks.end(); ++i) {num += !i->vals.empty();}
+	return num;
+}
+
+template<typename V> size_t sparse_voxel_grid<V>::get_mem_usage() const {
+	return (bricks.capacity()*sizeof(brick_t) + size_t(get_num_dense_bricks())*VOXEL_BRICK_VOL*sizeof(V));
+}
+
+template<typename V> void sparse_voxel_grid<V>::get_brick_bounds(unsigned bix, unsigned lo[3], unsigned hi[3]) const {
+
+	assert(bix < bricks.size());
+	unsigned const bz(bix%bnz), bxy(bix/bnz), bx(bxy%bnx), by(bxy/bnx), num[3] = {nx, ny, nz}, bxyz[3] = {bx, by, bz};
+	UNROLL_3X(lo[i_] = bxyz[i_]*VOXEL_BRICK_SZ; hi[i_] = min(num[i_], lo[i_]+VOXEL_BRICK_SZ);)
+}
+
+template<typename V> bool sparse_voxel_grid<V>::brick_in_xy_range(unsigned bix, unsigned x1, unsigned y1, unsigned x2, unsigned y2) const {
+
+	unsigned lo[3], hi[3];
+	get_brick_bounds(bix, lo, hi);
+	return (lo[0] >= x1 && lo[1] >= y1 && hi[0] <= x2 && hi[1] <= y2);
+}
+
+template<typename V> void sparse_voxel_grid<V>::set_brick_uniform(unsigned bix, V const &val) {
+
+	assert(bix < bricks.size());
+	bricks[bix].val = val;
+	vector<V>().swap(bricks[bix].vals); // free dense storage
+}
+
+// returns true if the brick is now uniform
+template<typename V> bool sparse_voxel_grid<V>::compact_brick(unsigned bix) {
+
+	assert(bix < bricks.size());
+	vector<V> const &vals(bricks[bix].vals);
+	if (vals.empty()) return 1; // already uniform
+	unsigned lo[3], hi[3];
+	get_brick_bounds(bix, lo, hi);
+	V const val(vals[get_ix_in_brick(lo[0], lo[1], lo[2])]);
+
+	for (unsigned y = lo[1]; y < hi[1]; ++y) { // only compare voxels inside the grid for partial bricks at the edges
+		for (unsigned x = lo[0]; x < hi[0]; ++x) {
+			for (unsigned z = lo[2]; z < hi[2]; ++z) {
+				if (!(vals[get_ix_in_brick(x, y, z)] == val)) return 0;
+			}
+		}
+	}
+	set_brick_uniform(bix, val);
+	return 1;
+}
+
+// returns bricks overlapping the x/y range over all z, in y, x, z order
+template<typename V> void sparse_voxel_grid<V>::get_bricks_in_xy_range(unsigned x1, unsigned y1, unsigned x2, unsigned y2, vector<unsigned> &bixs) const {
+
+	bixs.clear();
+	if (empty() || x1 >= x2 || y1 >= y2) return;
+	unsigned const bx1(x1 >> VOXEL_BRICK_BITS), by1(y1 >> VOXEL_BRICK_BITS), bx2((min(x2, nx)-1) >> VOXEL_BRICK_BITS), by2((min(y2, ny)-1) >> VOXEL_BRICK_BITS);
+
+	for (unsigned by = by1; by <= by2; ++by) {
+		for (unsigned bx = bx1; bx <= bx2; ++bx) {
+			for (unsigned bz = 0; bz < bnz; ++bz) {bixs.push_back(bz + (bx + by*bnx)*bnz);}
+		}
+	}
+}
+
+template<typename V> void sparse_voxel_grid<V>::compact_range(unsigned x1, unsigned y1, unsigned x2, unsigned y2) {
+
+	vector<unsigned> bixs;
+	get_bricks_in_xy_range(x1, y1, x2, y2, bixs);
+	for (auto b = bixs.begin(); b != bixs.end(); ++b) {compact_brick(*b);}
+}
+
+// vals is in dense yxz order; bricks with all equal values are stored as uniform
+template<typename V> void sparse_voxel_grid<V>::import_dense(vector<V> const &vals) {
+
+	assert(vals.size() == size());
+
+	for (unsigned bix = 0; bix < bricks.size(); ++bix) {
+		brick_t &b(bricks[bix]);
+		unsigned lo[3], hi[3];
+		get_brick_bounds(bix, lo, hi);
+		b.val = vals[get_ix(lo[0], lo[1], lo[2])];
+		b.vals.clear();
+
+		for (unsigned y = lo[1]; y < hi[1]; ++y) {
+			for (unsigned x = lo[0]; x < hi[0]; ++x) {
+				for (unsigned z = lo[2]; z < hi[2]; ++z) {
+					V const &val(vals[get_ix(x, y, z)]);
+					if (b.vals.empty() && val == b.val) continue; // still uniform
+					make_brick_dense(b);
+					b.vals[get_ix_in_brick(x, y, z)] = val;
+				}
+			}
+		}
+	}
+}
+
+// uses the same file format as voxel_grid
+template<typename V> bool sparse_voxel_grid<V>::read(FILE *fp) {
+
+	unsigned sz(0);
+	if (!read_header(fp)) return 0;
+	if (!read_pod(sz, fp, "voxel_grid size")) return 0;
+
+	if (empty()) {alloc_bricks(V());} // use the dimensions from the header
+	if (sz != size()) {
+		cerr << "Error reading voxel_grid size: expected " << size() << " but got " << sz << endl;
+		return 0;
+	}
+	vector<V> vals(sz);
+
+	if (fread(&vals.front(), sizeof(V), sz, fp) != sz) {
+		cerr << "Error reading voxel_grid data" << endl;
+		return 0;
+	}
+	import_dense(vals);
+	return 1;
+}
+
+template<typename V> bool sparse_voxel_grid<V>::write(FILE *fp) const {
+
+	unsigned const sz(size());
+	if (!write_header(fp)) return 0;
+	if (!write_pod(sz, fp, "voxel_grid size")) return 0;
+	vector<V> vals;
+	vals.reserve(sz);
+
+	for (unsigned y = 0; y < ny; ++y) {
+		for (unsigned x = 0; x < nx; ++x) {
+			for (unsigned z = 0; z < nz; ++z) {vals.push_back(get(x, y, z));}
+		}
+	}
+	if (fwrite(&vals.front(), sizeof(V), sz, fp) != sz) {
+		cerr << "Error writing voxel_grid data" << endl;
+		return 0;
+	}
+	return 1;
+}
+
+
 bool voxel_model::from_file(string const &fn) {
 
 	FILE *fp(fopen(fn.c_str(), "rb"));
@@ -301,13 +491,15 @@ void voxel_manager::create_procedural(float mag, float freq, vector3d const &off
 		cshader.add_uniform_float("start_freq", 0.25*freq);
 		cshader.add_uniform_float("rx", rx);
 		cshader.add_uniform_float("ry", ry);
-		cshader.gen_matrix_R32F(*this, tid); // write directly to voxel values
-		if (normalize_to_1) {for (iterator i = begin(); i != end(); ++i) {*i = CLIP_TO_pm1(*i);}}
+		vector<float> vals(size());
+		cshader.gen_matrix_R32F(vals, tid); // Note: the GPU writes a dense array, which is converted to bricks after
+		if (normalize_to_1) {for (auto i = vals.begin(); i != vals.end(); ++i) {*i = CLIP_TO_pm1(*i);}}
 		cshader.end_shader();
 		free_texture(tid);
+		import_dense(vals);
 		return;
 	}
-	#pragma omp parallel for schedule(static,1)
+	#pragma omp parallel for schedule(static,VOXEL_BRICK_SZ) // one row of bricks per chunk so that each brick is written by a single thread
 	for (int y = 0; y < (int)ny; ++y) { // generate voxel values
 		for (unsigned x = 0; x < nx; ++x) {
 			for (unsigned z = 0; z < nz; ++z) {
@@ -340,6 +532,7 @@ void voxel_manager::create_procedural(float mag, float freq, vector3d const &off
 				set(x, y, z, val); // scale value?
 			}
 		}
+		if (((y+1) & VOXEL_BRICK_MASK) == 0 || y+1 == (int)ny) {compact_range(0, (y & ~VOXEL_BRICK_MASK), nx, y+1);} // end of brick row
 	}
 }
 
@@ -350,6 +543,7 @@ void voxel_manager::create_from_cobjs(coll_obj_group &cobjs, float filled_val) {
 		if (i->cp.cobj_type != COBJ_TYPE_VOX_TERRAIN) continue; // skip it
 		add_cobj_voxels(*i, filled_val);
 	}
+	compact();
 }
 
 
@@ -400,7 +594,7 @@ void voxel_manager::add_cobj_voxels(coll_obj &cobj, float filled_val) {
 
 void voxel_manager::atten_at_edges(float val) { // and top (5 edges)
 
-#pragma omp parallel for schedule(static)
+#pragma omp parallel for schedule(static,VOXEL_BRICK_SZ) // one row of bricks per chunk
 	for (int y = 0; y < (int)ny; ++y) {
 		float const vy(1.0 - 2.0*fabs(y - 0.5*ny)/float(ny)); // 0 at edges, 1 at center
 
@@ -418,7 +612,7 @@ void voxel_manager::atten_at_edges(float val) { // and top (5 edges)
 
 void voxel_manager::atten_at_top_only(float val) {
 
-#pragma omp parallel for schedule(static)
+#pragma omp parallel for schedule(static,VOXEL_BRICK_SZ) // one row of bricks per chunk
 	for (int y = 0; y < (int)ny; ++y) {
 		for (unsigned x = 0; x < nx; ++x) {
 			float top_atten_val(0.0);
@@ -432,19 +626,20 @@ void voxel_manager::atten_at_top_only(float val) {
 				top_atten_val = 2.0*eval_mesh_sin_terms(params.height_eval_freq*pos.x, params.height_eval_freq*pos.y);
 			}
 			for (unsigned z = 0; z < nz; ++z) {
-				float &v(get_ref(x, y, z));
+				float dv(0.0);
 	
 				if (params.atten_top_mode == 1) { // atten to mesh
 					float const z_atten(((get_zv(z)) - top_atten_val)/(vsz.z*nz) - 0.5);
-					if (z_atten > 0.0) v += val*z_atten;
+					if (z_atten > 0.0) dv = val*z_atten;
 				}
 				else if (params.atten_top_mode == 2) { // atten to random
-					v += top_atten_val + val*(z/float(nz) - 0.5);
+					dv = top_atten_val + val*(z/float(nz) - 0.5);
 				}
 				else {
 					float const z_atten(z/float(nz) - 0.75);
-					if (z_atten > 0.0) v += val*z_atten;
+					if (z_atten > 0.0) dv = val*z_atten;
 				}
+				if (dv != 0.0) {get_ref(x, y, z) += dv;} // only make the brick dense if modified
 			}
 		}
 	}
@@ -455,7 +650,7 @@ void voxel_manager::atten_to_sphere(float val, float inner_radius, bool atten_in
 
 	float const two_nz_inv(2.0/float(nz));
 
-#pragma omp parallel for schedule(static)
+#pragma omp parallel for schedule(static,VOXEL_BRICK_SZ) // one row of bricks per chunk
 	for (int y = 0; y < (int)ny; ++y) {
 		float const vy(2.0*fabs(y - 0.5*ny)/float(ny)); // 1 at edges, 0 at center
 
@@ -473,7 +668,7 @@ void voxel_manager::atten_to_sphere(float val, float inner_radius, bool atten_in
 				else if (atten_inner) {
 					adj = (radius - inner_radius)/inner_radius;
 				}
-				get_ref(x, y, z) += val*adj;
+				if (adj != 0.0) {get_ref(x, y, z) += val*adj;}
 			}
 		}
 	}
@@ -504,11 +699,10 @@ unsigned voxel_manager::add_triangles_for_voxel(tri_data_t::value_type &tri_vert
 
 	for (unsigned yhi = 0; yhi < 2; ++yhi) {
 		for (unsigned xhi = 0; xhi < 2; ++xhi) {
-			unsigned const ix(get_ix(xv[xhi], yv[yhi], z));
-			if (all_under_mesh) {all_under_mesh = ((outside[ix] & UNDER_MESH_BIT) != 0);}
+			if (all_under_mesh) {all_under_mesh = ((outside.get(xv[xhi], yv[yhi], z) & UNDER_MESH_BIT) != 0);}
 			
 			for (unsigned zhi = 0; zhi < 2; ++zhi) {
-				if (outside[ix + zv[zhi]-z] & 7) {cix |= 1 << ((xhi^yhi) + 2*yhi + 4*zhi);} // outside or on edge
+				if (outside.get(xv[xhi], yv[yhi], zv[zhi]) & 7) {cix |= 1 << ((xhi^yhi) + 2*yhi + 4*zhi);} // outside or on edge
 			}
 		}
 	}
@@ -534,9 +728,8 @@ unsigned voxel_manager::add_triangles_for_voxel(tri_data_t::value_type &tri_vert
 
 		for (unsigned d = 0; d < 2; ++d) {
 			unsigned const yhi((eix[d] & 2) >> 1), xhi(yhi ^ (eix[d] & 1)), zhi(eix[d] >> 2);
-			unsigned const ix(get_ix(xv[xhi], yv[yhi], zv[zhi]));
 			xhv &= xhi; yhv &= yhi; zhv &= zhi;
-			vals[d] = ((outside[ix] & 7) == ON_EDGE_BIT) ? params.isolevel : operator[](ix);
+			vals[d] = ((outside.get(xv[xhi], yv[yhi], zv[zhi]) & 7) == ON_EDGE_BIT) ? params.isolevel : get(xv[xhi], yv[yhi], zv[zhi]);
 			pts[d].assign(cube.d[0][xhi], cube.d[1][yhi], cube.d[2][zhi]);
 		}
 		vlist[i] = interpolate_pt(params.isolevel, pts[0], pts[1], vals[0], vals[1]);
@@ -586,7 +779,7 @@ void voxel_manager::determine_voxels_outside() { // determine inside/outside poi
 	outside.init(nx, ny, nz, vsz, center, 0, params.num_blocks);
 	bool const sphere_mode(params.atten_sphere_mode());
 
-#pragma omp parallel for schedule(static)
+#pragma omp parallel for schedule(static,VOXEL_BRICK_SZ) // one row of bricks per chunk so that each brick is written by a single thread
 	for (int y = 0; y < (int)ny; ++y) {
 		for (unsigned x = 0; x < nx; ++x) {
 			point const pos(get_pt_at(x, y, 0));
@@ -595,6 +788,7 @@ void voxel_manager::determine_voxels_outside() { // determine inside/outside poi
 			unsigned const zix(no_zix ? 0 : max(0, int((z_min_matrix[ypos][xpos] - lo_pos.z)/vsz.z)));
 			for (unsigned z = 0; z < nz; ++z) {calc_outside_val(x, y, z, (z < zix));}
 		}
+		if (((y+1) & VOXEL_BRICK_MASK) == 0 || y+1 == (int)ny) {outside.compact_range(0, (y & ~VOXEL_BRICK_MASK), nx, y+1);} // end of brick row
 	}
 }
 
@@ -701,12 +895,15 @@ void voxel_model::remove_unconnected_outside_modified_blocks(bool postproc_brush
 		assert(time_at_drop <= tfticks);
 
 		for (vector<pt_ix_t>::const_iterator i = updated_pts.begin(); i != updated_pts.end(); ++i) {
-			unsigned ix(i->ix);
-			float const val(operator[](ix));
-			make_voxel_outside(ix);
-			assert(ix > 0); --ix; // move down one z step
-			operator[](ix) = val;
-			outside[ix]    = (is_under_mesh(i->pt - point(0.0, 0.0, vsz.z)) ? UNDER_MESH_BIT : 0); // make inside or under mesh
+			unsigned x, y, z;
+			get_xyz_from_ix(i->ix, x, y, z);
+			float const val(get(x, y, z));
+			make_voxel_outside(x, y, z);
+			dirty_bricks.insert(get_brick_ix(x, y, z));
+			assert(z > 0); --z; // move down one z step
+			set(x, y, z, val);
+			outside.set(x, y, z, (is_under_mesh(i->pt - point(0.0, 0.0, vsz.z)) ? UNDER_MESH_BIT : 0)); // make inside or under mesh
+			dirty_bricks.insert(get_brick_ix(x, y, z));
 		}
 		return; // no fragments or sound (of could add sounds when falling begins?)
 	}
@@ -723,63 +920,124 @@ void voxel_model::remove_unconnected_outside_modified_blocks(bool postproc_brush
 }
 
 
-#define FLOOD_FILL_INNER(pos, min_range, max_range, step) \
-	if (pos >= min_range + 1) { \
-		unsigned const ix(cur - step); \
-		if (outside[ix] == fill_val) {work.push_back(ix); outside[ix] |= bit_mask;} \
-	} \
-	if (pos + 1 < max_range) { \
-		unsigned const ix(cur + step); \
-		if (outside[ix] == fill_val) {work.push_back(ix); outside[ix] |= bit_mask;} \
+// marks and adds voxel x,y,z if its value is fill_val, where x,y,z must be within the range;
+// a uniform brick of fill_val that's entirely within the range is marked as a whole without making it dense and added to temp_brick_work
+void voxel_manager::flood_fill_add(unsigned x, unsigned y, unsigned z, unsigned x1, unsigned y1, unsigned x2, unsigned y2,
+	vector<unsigned> &work, unsigned char fill_val, unsigned char bit_mask)
+{
+	unsigned const bix(outside.get_brick_ix(x, y, z));
+
+	if (outside.is_brick_uniform(bix)) {
+		if (outside.get_brick_val(bix) != fill_val) return;
+
+		if (outside.brick_in_xy_range(bix, x1, y1, x2, y2)) {
+			outside.set_brick_uniform(bix, (fill_val | bit_mask));
+			temp_brick_work.push_back(bix);
+			return;
+		}
 	}
+	else if (outside.get(x, y, z) != fill_val) return;
+	work.push_back(outside.get_ix(x, y, z));
+	outside.set(x, y, z, (fill_val | bit_mask));
+}
 
 void voxel_manager::flood_fill_range(unsigned x1, unsigned y1, unsigned x2, unsigned y2, vector<unsigned> &work, unsigned char fill_val, unsigned char bit_mask) {
 
-	unsigned const nxnz(nx*nz);
+	vector<unsigned> &brick_work(temp_brick_work); // uniform bricks marked as a whole, which only need to expand from their faces
+
+	while (!work.empty() || !brick_work.empty()) {
+		if (!brick_work.empty()) {
+			unsigned const bix(brick_work.back());
+			brick_work.pop_back();
+			unsigned lo[3], hi[3];
+			outside.get_brick_bounds(bix, lo, hi);
 
-	while (!work.empty()) {
+			for (unsigned y = lo[1]; y < hi[1]; ++y) {
+				for (unsigned z = lo[2]; z < hi[2]; ++z) {
+					if (lo[0] > x1) {flood_fill_add(lo[0]-1, y, z, x1, y1, x2, y2, work, fill_val, bit_mask);}
+					if (hi[0] < x2) {flood_fill_add(hi[0],   y, z, x1, y1, x2, y2, work, fill_val, bit_mask);}
+				}
+			}
+			for (unsigned x = lo[0]; x < hi[0]; ++x) {
+				for (unsigned z = lo[2]; z < hi[2]; ++z) {
+					if (lo[1] > y1) {flood_fill_add(x, lo[1]-1, z, x1, y1, x2, y2, work, fill_val, bit_mask);}
+					if (hi[1] < y2) {flood_fill_add(x, hi[1],   z, x1, y1, x2, y2, work, fill_val, bit_mask);}
+				}
+			}
+			for (unsigned y = lo[1]; y < hi[1]; ++y) {
+				for (unsigned x = lo[0]; x < hi[0]; ++x) {
+					if (lo[2] > 0 ) {flood_fill_add(x, y, lo[2]-1, x1, y1, x2, y2, work, fill_val, bit_mask);}
+					if (hi[2] < nz) {flood_fill_add(x, y, hi[2],   x1, y1, x2, y2, work, fill_val, bit_mask);}
+				}
+			}
+			continue;
+		}
 		unsigned const cur(work.back());
 		work.pop_back();
 		assert(cur < outside.size());
-		assert(outside[cur] & bit_mask);
-		assert(nxnz > 0 && nz > 0);
-		unsigned const y(cur/nxnz), cur_xz(cur - y*nxnz), x(cur_xz/nz), z(cur_xz - x*nz);
-		FLOOD_FILL_INNER(x, x1, x2, nz);
-		FLOOD_FILL_INNER(y, y1, y2, nxnz);
-		FLOOD_FILL_INNER(z, 0,  nz, 1);
+		unsigned x, y, z;
+		outside.get_xyz_from_ix(cur, x, y, z);
+		assert(outside.get(x, y, z) & bit_mask);
+		if (x > x1)   {flood_fill_add(x-1, y, z, x1, y1, x2, y2, work, fill_val, bit_mask);}
+		if (x+1 < x2) {flood_fill_add(x+1, y, z, x1, y1, x2, y2, work, fill_val, bit_mask);}
+		if (y > y1)   {flood_fill_add(x, y-1, z, x1, y1, x2, y2, work, fill_val, bit_mask);}
+		if (y+1 < y2) {flood_fill_add(x, y+1, z, x1, y1, x2, y2, work, fill_val, bit_mask);}
+		if (z > 0)    {flood_fill_add(x, y, z-1, x1, y1, x2, y2, work, fill_val, bit_mask);}
+		if (z+1 < nz) {flood_fill_add(x, y, z+1, x1, y1, x2, y2, work, fill_val, bit_mask);}
 	} // while
 }
 
 
+void clip_brick_bounds_to_xy_range(unsigned lo[3], unsigned hi[3], unsigned x1, unsigned y1, unsigned x2, unsigned y2) {
+	lo[0] = max(lo[0], x1); lo[1] = max(lo[1], y1);
+	hi[0] = min(hi[0], x2); hi[1] = min(hi[1], y2);
+}
+
+
 // outside: 0=inside, 1=outside, 2=on_edge, 4-bit set=anchored, 8-bit set=under mesh
-// NOTE: not thread safe due to class member <work>
+// NOTE: not thread safe due to class members <temp_work> and <temp_brick_work>
 void voxel_manager::remove_unconnected_outside_range(bool keep_at_edge, unsigned x1, unsigned y1, unsigned x2, unsigned y2,
 	vector<unsigned> *xy_updated, vector<pt_ix_t> *updated_pts, bool mark_only)
 {
 	//timer_t timer("Remove Unconnected");
 	assert(!outside.empty());
 	vector<unsigned> &work(temp_work); // stack of voxels to process
-	assert(work.empty());
+	assert(work.empty() && temp_brick_work.empty());
+	vector<unsigned> bixs;
+	outside.get_bricks_in_xy_range(x1, y1, x2, y2, bixs);
 
 	if (params.atten_sphere_mode() || !use_mesh) { // sphere mode / not mesh mode
-		unsigned const x(nx/2), y(ny/2); // add a single point at the center of the sphere (will only work for filled sphere center)
+		unsigned const x(nx/2), y(ny/2), z(nz/2); // add a single point at the center of the sphere (will only work for filled sphere center)
 
 		if (x >= x1 && x <= x2 && y >= y1 && y <= y2) {
-			unsigned const ix(outside.get_ix(x, y, nz/2));
-			assert(outside[ix] != UNDER_MESH_BIT); // outside or above mesh
-			work.push_back(ix); // inside, anchored to the mesh
-			outside[ix] |= ANCHORED_BIT; // mark as anchored
+			unsigned char const val(outside.get(x, y, z));
+			assert(val != UNDER_MESH_BIT); // outside or above mesh
+			work.push_back(outside.get_ix(x, y, z)); // inside, anchored to the mesh
+			outside.set(x, y, z, (val | ANCHORED_BIT)); // mark as anchored
 		}
 	}
 	else { // add voxels along the mesh surface
-		for (unsigned y = y1; y < y2; ++y) {
-			for (unsigned x = x1; x < x2; ++x) {
-				unsigned ix(outside.get_ix(x, y, 0));
-
-				for (unsigned z = 0; z < nz; ++z, ++ix) {
-					if (outside[ix] != UNDER_MESH_BIT) continue; // outside or above mesh
-					work.push_back(ix); // inside, anchored to the mesh
-					outside[ix] |= ANCHORED_BIT; // mark as anchored
+		for (auto b = bixs.begin(); b != bixs.end(); ++b) {
+			if (outside.is_brick_uniform(*b)) {
+				if (outside.get_brick_val(*b) != UNDER_MESH_BIT) continue; // outside or above mesh
+
+				if (outside.brick_in_xy_range(*b, x1, y1, x2, y2)) { // anchor the entire brick
+					outside.set_brick_uniform(*b, (UNDER_MESH_BIT | ANCHORED_BIT));
+					temp_brick_work.push_back(*b);
+					continue;
+				}
+			}
+			unsigned lo[3], hi[3];
+			outside.get_brick_bounds(*b, lo, hi);
+			clip_brick_bounds_to_xy_range(lo, hi, x1, y1, x2, y2);
+
+			for (unsigned y = lo[1]; y < hi[1]; ++y) {
+				for (unsigned x = lo[0]; x < hi[0]; ++x) {
+					for (unsigned z = lo[2]; z < hi[2]; ++z) {
+						if (outside.get(x, y, z) != UNDER_MESH_BIT) continue; // outside or above mesh
+						work.push_back(outside.get_ix(x, y, z)); // inside, anchored to the mesh
+						outside.set(x, y, z, (UNDER_MESH_BIT | ANCHORED_BIT)); // mark as anchored
+					}
 				}
 			}
 		}
@@ -792,76 +1050,136 @@ void voxel_manager::remove_unconnected_outside_range(bool keep_at_edge, unsigned
 				if (x != x1 && x+1 != x2 && y != y1 && y+1 != y2) continue; // not on scene edge
 
 				for (unsigned z = 0; z < nz; ++z) {
-					unsigned const ix(outside.get_ix(x, y, z));
-					if (outside[ix] == 1) continue; // outside
-					work.push_back(ix); // inside, anchored to the mesh
-					outside[ix] |= ANCHORED_BIT; // mark as anchored
+					unsigned char const val(outside.get(x, y, z));
+					if (val == 1) continue; // outside
+					work.push_back(outside.get_ix(x, y, z)); // inside, anchored to the mesh
+					outside.set(x, y, z, (val | ANCHORED_BIT)); // mark as anchored
 				}
 			}
 		}
 	}
 	flood_fill_range(x1, y1, x2, y2, work, 0, ANCHORED_BIT); // fill inside voxels (anchor regions)
+	vector<unsigned char> col_updated((x2 - x1)*(y2 - y1), 0);
 
 	// if anchored or on_edge remove the anchored bit, else mark outside
-	for (unsigned y = y1; y < y2; ++y) {
-		for (unsigned x = x1; x < x2; ++x) {
-			bool had_update(0);
+	for (auto b = bixs.begin(); b != bixs.end(); ++b) {
+		bool const whole_brick(outside.is_brick_uniform(*b) && outside.brick_in_xy_range(*b, x1, y1, x2, y2));
 
-			for (unsigned z = 0; z < nz; ++z) {
-				unsigned const ix(outside.get_ix(x, y, z));
+		if (whole_brick) {
+			unsigned char const val(outside.get_brick_val(*b));
+			if (val > 1) {outside.set_brick_uniform(*b, (val & ~ANCHORED_BIT)); continue;} // anchored, on edge, or under mesh
+			if (val == 1) continue; // outside
+		}
+		unsigned lo[3], hi[3];
+		outside.get_brick_bounds(*b, lo, hi);
+		clip_brick_bounds_to_xy_range(lo, hi, x1, y1, x2, y2);
 
-				if (outside[ix] > 1) { // anchored, on edge, or under mesh
-					outside[ix] &= ~ANCHORED_BIT; // remove anchored bit
-				}
-				else if (outside[ix] != 1) { // inside and non-anchored
-					if (updated_pts) {updated_pts->push_back(pt_ix_t(get_pt_at(x, y, z), ix));}
-					if (!mark_only ) {make_voxel_outside(ix);}
-					had_update = 1;
+		for (unsigned y = lo[1]; y < hi[1]; ++y) {
+			for (unsigned x = lo[0]; x < hi[0]; ++x) {
+				for (unsigned z = lo[2]; z < hi[2]; ++z) {
+					unsigned char const val(outside.get(x, y, z));
+
+					if (val > 1) { // anchored, on edge, or under mesh
+						outside.set(x, y, z, (val & ~ANCHORED_BIT)); // remove anchored bit
+					}
+					else if (val != 1) { // inside and non-anchored
+						if (updated_pts) {updated_pts->push_back(pt_ix_t(get_pt_at(x, y, z), get_ix(x, y, z)));}
+						if (!mark_only && !whole_brick) {make_voxel_outside(x, y, z);}
+						col_updated[(y - y1)*(x2 - x1) + (x - x1)] = 1;
+					}
 				}
 			}
-			if (had_update && xy_updated) {xy_updated->push_back(y*nx + x);}
 		}
+		if (whole_brick && !mark_only) {make_brick_outside(*b);} // the entire brick is inside and non-anchored
 	}
+	if (xy_updated) {
+		for (unsigned y = y1; y < y2; ++y) {
+			for (unsigned x = x1; x < x2; ++x) {
+				if (col_updated[(y - y1)*(x2 - x1) + (x - x1)]) {xy_updated->push_back(y*nx + x);}
+			}
+		}
+	}
+	compact_voxel_range(x1, y1, x2, y2); // bricks written above may be uniform again
 }
 
 
 void voxel_manager::remove_interior_holes() {
 
 	vector<unsigned> &work(temp_work); // stack of voxels to process
-	assert(work.empty());
+	assert(work.empty() && temp_brick_work.empty());
 
 	for (unsigned y = 0; y < ny; ++y) { // seed with +z plane
 		for (unsigned x = 0; x < nx; ++x) {
-			unsigned const ix(outside.get_ix(x, y, nz-1));
-
-			if (outside[ix]) {
-				work.push_back(ix);
-				outside[ix] |= ANCHORED_BIT; // mark as anchored
+			unsigned char const val(outside.get(x, y, nz-1));
+			if (val == 0 || (val & ANCHORED_BIT)) continue; // inside or already anchored
+			
+			if (val == 1) { // may anchor the entire brick
+				flood_fill_add(x, y, nz-1, 0, 0, nx, ny, work, 1, ANCHORED_BIT);
+			}
+			else {
+				work.push_back(outside.get_ix(x, y, nz-1));
+				outside.set(x, y, nz-1, (val | ANCHORED_BIT)); // mark as anchored
 			}
 		}
 	}
-	if (work.empty()) return; // can't find empty space for the seed, bail out (shouldn't happen often)
+	if (work.empty() && temp_brick_work.empty()) return; // can't find empty space for the seed, bail out (shouldn't happen often)
 	flood_fill_range(0, 0, nx, ny, work, 1, ANCHORED_BIT); // fill outside, not on edge or under mesh, and non-anchored
+	vector<unsigned> bixs;
+	outside.get_bricks_in_xy_range(0, 0, nx, ny, bixs);
 
 	// if inside but not anchored mark as outside
-	for (unsigned ix = 0; ix < size(); ++ix) {
-		if (outside[ix] & ANCHORED_BIT) { // anchored
-			outside[ix] &= ~ANCHORED_BIT; // remove anchored bit
+	for (auto b = bixs.begin(); b != bixs.end(); ++b) {
+		if (outside.is_brick_uniform(*b)) { // all bricks are within the range
+			unsigned char const val(outside.get_brick_val(*b));
+			if (val & ANCHORED_BIT) {outside.set_brick_uniform(*b, (val & ~ANCHORED_BIT));} // remove anchored bit
+			else if (val == 1) {make_brick_inside(*b);} // outside, not on edge or under mesh, and non-anchored
+			continue;
 		}
-		else if (outside[ix] == 1) { // outside, not on edge or under mesh, and non-anchored
-			make_voxel_inside(ix);
+		unsigned lo[3], hi[3];
+		outside.get_brick_bounds(*b, lo, hi);
+
+		for (unsigned y = lo[1]; y < hi[1]; ++y) {
+			for (unsigned x = lo[0]; x < hi[0]; ++x) {
+				for (unsigned z = lo[2]; z < hi[2]; ++z) {
+					unsigned char const val(outside.get(x, y, z));
+
+					if (val & ANCHORED_BIT) { // anchored
+						outside.set(x, y, z, (val & ~ANCHORED_BIT)); // remove anchored bit
+					}
+					else if (val == 1) { // outside, not on edge or under mesh, and non-anchored
+						make_voxel_inside(x, y, z);
+					}
+				}
+			}
 		}
 	}
+	compact_voxel_range(0, 0, nx, ny);
 }
 
 
-void voxel_manager::make_voxel_outside(unsigned ix) {
-	outside[ix] = 1; // make outside
-	operator[](ix) = params.isolevel - (params.invert ? -TOLERANCE : TOLERANCE); // change voxel value to be outside
+float get_outside_val(voxel_params_t const &params) {return (params.isolevel - (params.invert ? -TOLERANCE : TOLERANCE));}
+float get_inside_val (voxel_params_t const &params) {return (params.isolevel + (params.invert ? -TOLERANCE : TOLERANCE));}
+
+void voxel_manager::make_voxel_outside(unsigned x, unsigned y, unsigned z) {
+	outside.set(x, y, z, 1); // make outside
+	set(x, y, z, get_outside_val(params)); // change voxel value to be outside
+}
+void voxel_manager::make_voxel_inside(unsigned x, unsigned y, unsigned z) {
+	outside.set(x, y, z, 0); // make inside
+	set(x, y, z, get_inside_val(params)); // change voxel value to be inside
+}
+void voxel_manager::make_brick_outside(unsigned bix) {
+	outside.set_brick_uniform(bix, 1);
+	set_brick_uniform(bix, get_outside_val(params));
 }
-void voxel_manager::make_voxel_inside(unsigned ix) {
-	outside[ix] = 0; // make inside
-	operator[](ix) = params.isolevel + (params.invert ? -TOLERANCE : TOLERANCE); // change voxel value to be inside
+void voxel_manager::make_brick_inside(unsigned bix) {
+	outside.set_brick_uniform(bix, 0);
+	set_brick_uniform(bix, get_inside_val(params));
+}
+
+void voxel_manager::compact_voxel_range(unsigned x1, unsigned y1, unsigned x2, unsigned y2) {
+	outside.compact_range(x1, y1, x2, y2);
+	compact_range(x1, y1, x2, y2);
 }
 
 
@@ -892,12 +1210,11 @@ bool voxel_manager::sphere_intersect(point const &center, float radius, point *i
 
 	for (int y = llc[1]; y <= urc[1]; ++y) {
 		for (int x = llc[0]; x <= urc[0]; ++x) {
-			unsigned const xy_offset((x + y*nx)*nz);
 			point p(get_pt_at(x, y, llc[2]));
 
 			for (int z = llc[2]; z <= urc[2]; ++z) {
 				p.z += vsz.z;
-				if (is_outside(xy_offset+z) || !dist_less_than(p, center, radius)) continue;
+				if (is_outside(x, y, z) || !dist_less_than(p, center, radius)) continue;
 				if (int_pt) {*int_pt = p;}
 				return 1;
 			}
@@ -932,10 +1249,14 @@ bool voxel_manager::line_intersect(point const &p1, point const &p2, point *int_
 unsigned voxel_manager::upload_to_3d_texture(int wrap) const { // only works for float type
 
 	vector<unsigned char> data;
-	data.resize(size());
+	data.reserve(size());
 
-	for (unsigned i = 0; i < size(); ++i) {
-		data[i] = (unsigned char)(255*CLIP_TO_01(fabs(operator[](i)))); // use fabs() to convert from [-1,1] to [0,1]
+	for (unsigned y = 0; y < ny; ++y) { // yxz order
+		for (unsigned x = 0; x < nx; ++x) {
+			for (unsigned z = 0; z < nz; ++z) {
+				data.push_back((unsigned char)(255*CLIP_TO_01(fabs(get(x, y, z))))); // use fabs() to convert from [-1,1] to [0,1]
+			}
+		}
 	}
 	return create_3d_texture(nx, ny, nz, 1, data, GL_LINEAR, wrap);
 }
@@ -993,6 +1314,20 @@ bool voxel_model::has_filled_at_edges() const {
 }
 
 
+// returns 0 if all voxels in the brick are inside, 1 if all are outside or on the edge, and 2 if mixed
+unsigned char voxel_model::get_outside_brick_class(unsigned bix) const {
+
+	if (outside.is_brick_uniform(bix)) {return ((outside.get_brick_val(bix) & 7) != 0);}
+	vector<unsigned char> const &vals(outside.get_brick_vals(bix)); // includes unused values outside the grid for edge bricks, which is conservative
+	bool const first_outside((vals.front() & 7) != 0);
+
+	for (auto i = vals.begin()+1; i != vals.end(); ++i) {
+		if (((*i & 7) != 0) != first_outside) return 2;
+	}
+	return first_outside;
+}
+
+
 unsigned voxel_model::get_block_ix(unsigned voxel_ix) const {
 
 	assert(voxel_ix < size());
@@ -1026,6 +1361,7 @@ void voxel_model::clear() {
 	}
 	modified_blocks.clear();
 	next_frame_modified_blocks.clear();
+	dirty_bricks.clear();
 	ao_lighting.clear();
 	voxel_manager::clear();
 	volume_added = 0;
@@ -1081,11 +1417,40 @@ unsigned voxel_model::create_block(voxel_ix_cache &vix_cache, unsigned block_ix,
 	assert(tri_block.empty());
 	vix_cache.init(xblocks+1, yblocks+1, nz, vsz, zero_vector, vert_ix_cache_entry(), 1);
 	unsigned const xbix(block_ix%params.num_blocks), ybix(block_ix/params.num_blocks), step(1 << lod_level);
+	unsigned const x_end((xbix+1)*xblocks), y_end((ybix+1)*yblocks), bnz(1 + ((nz-1) >> VOXEL_BRICK_BITS));
+	unsigned const bx1((xbix*xblocks) >> VOXEL_BRICK_BITS), bx2(min(x_end-1+step, nx-1) >> VOXEL_BRICK_BITS);
+	unsigned const by1((ybix*yblocks) >> VOXEL_BRICK_BITS), by2(min(y_end-1+step, ny-1) >> VOXEL_BRICK_BITS);
+	// inside/outside class of each brick covering this block, calculated on demand (3 = not yet calculated);
+	// voxels where all corners are in bricks that are entirely inside or entirely outside have no triangles and can be skipped
+	vector<unsigned char> brick_class((bx2 - bx1 + 1)*(by2 - by1 + 1)*bnz, 3), zclass(bnz, 2);
+	unsigned cur_brick_range[4] = {1, 0, 1, 0}; // {x1, x2, y1, y2}, starts invalid
 	unsigned count(0);
 
-	for (unsigned y = ybix*yblocks; y < (ybix+1)*yblocks; y += step) {
-		for (unsigned x = xbix*xblocks; x < (xbix+1)*xblocks; x += step) {
+	for (unsigned y = ybix*yblocks; y < y_end; y += step) {
+		for (unsigned x = xbix*xblocks; x < x_end; x += step) {
+			unsigned const x2(min(x+step, nx-1)), y2(min(y+step, ny-1));
+			if (x2 <= x || y2 <= y) continue; // invalid (empty) range
+			unsigned const brick_range[4] = {(x >> VOXEL_BRICK_BITS), (x2 >> VOXEL_BRICK_BITS), (y >> VOXEL_BRICK_BITS), (y2 >> VOXEL_BRICK_BITS)};
+
+			if (!std::equal(brick_range, brick_range+4, cur_brick_range)) { // new column of bricks, recalculate the class at each z
+				std::copy(brick_range, brick_range+4, cur_brick_range);
+
+				for (unsigned bz = 0; bz < bnz; ++bz) {
+					unsigned char zc(3);
+
+					for (unsigned by = brick_range[2]; by <= brick_range[3]; ++by) {
+						for (unsigned bx = brick_range[0]; bx <= brick_range[1]; ++bx) {
+							unsigned char &bc(brick_class[bz + ((bx - bx1) + (by - by1)*(bx2 - bx1 + 1))*bnz]);
+							if (bc == 3) {bc = get_outside_brick_class(outside.get_brick_ix((bx << VOXEL_BRICK_BITS), (by << VOXEL_BRICK_BITS), (bz << VOXEL_BRICK_BITS)));}
+							zc = ((zc == 3 || zc == bc) ? bc : 2);
+						}
+					}
+					zclass[bz] = zc;
+				}
+			}
 			for (unsigned z = 0; z < nz; z += step) {
+				unsigned char const zc(zclass[z >> VOXEL_BRICK_BITS]);
+				if (zc < 2 && zc == zclass[min(z+step, nz-1) >> VOXEL_BRICK_BITS]) continue; // all corners inside or all outside
 				count += add_triangles_for_voxel(tri_block, vix_cache, x, y, z, xbix*xblocks, ybix*yblocks, count_only, lod_level);
 			}
 		}
@@ -1183,8 +1548,7 @@ void voxel_model::calc_ao_dirs() {
 				if (x == 0 && y == 0 && z == 0) continue;
 				vector3d const delta(x*vsz.x, y*vsz.y, z*vsz.z);
 				unsigned const nsteps(max(1, int(params.ao_radius/delta.mag())));
-				int const dist(z + (x + y*(int)nx)*(int)nz);
-				ao_dirs.push_back(step_dir_t(x, y, z, nsteps, dist));
+				ao_dirs.push_back(step_dir_t(x, y, z, nsteps));
 			}
 		}
 	}
@@ -1227,12 +1591,11 @@ void voxel_model::calc_ao_lighting_for_block(unsigned block_ix, bool increase_on
 						unsigned max_steps(i->nsteps);
 						UNROLL_3X(if (i->dir[i_] > 0) cur[i_] += 1;);
 						UNROLL_3X(if (i->dir[i_]) max_steps = min(max_steps, (unsigned)max(0, ((i->dir[i_] < 0) ? (int)cur[i_] : (int)voxel_sz[i_]-(int)cur[i_]-1))););
-						int ix(outside.get_ix(cur[0], cur[1], cur[2]));
-
 						for (unsigned s = 0; s < max_steps; ++s) { // take steps in this direction
-							ix += i->dist_per_step; // increment first to skip the current voxel
+							UNROLL_3X(cur[i_] += i->dir[i_];) // increment first to skip the current voxel
+							unsigned char const step_val(outside.get(cur[0], cur[1], cur[2]));
 						
-							if (outside[ix] == 0 || (outside[ix] & end_ray_flags)) {
+							if (step_val == 0 || (step_val & end_ray_flags)) {
 								cur_val = s*i->nsteps_inv; // Note: ambient obscurance - uses actual distance to occluder
 								break; // voxel known to be inside the volume or under the mesh
 							}
@@ -1305,12 +1668,13 @@ bool voxel_model::update_voxel_sphere_region(point const &center, float radius,
 				float const dist(max(0.0f, (p2p_dist(center, pos) - dist_adjust)));
 				if (spherical && dist >= radius) continue; // too far
 				// update voxel values, linear falloff with distance from center (ending at 0.0 at radius)
-				float &val(get_ref(x, y, z));
-				float const prev_val(val);
-				val += val_at_center*pow(min(1.0f, (1.0f - dist/radius)), (float)falloff_exp);
+				float const prev_val(get(x, y, z));
+				float val(prev_val + val_at_center*pow(min(1.0f, (1.0f - dist/radius)), (float)falloff_exp));
 				if (params.normalize_to_1) val = CLIP_TO_pm1(val);
 				if (val == prev_val) continue; // no change
+				set(x, y, z, val);
 				calc_outside_val(x, y, z, ((outside.get(x, y, z) & UNDER_MESH_BIT) != 0));
+				dirty_bricks.insert(get_brick_ix(x, y, z)); // may be compacted later
 				was_updated = 1;
 				(val_is_outside(val,      params) ? saw_outside : saw_inside) = 1;
 				(val_is_outside(prev_val, params) ? saw_outside : saw_inside) = 1;
@@ -1368,8 +1732,19 @@ unsigned voxel_model::get_texture_at(point const &pos) const {
 }
 
 
+void voxel_model::compact_dirty_bricks() {
+
+	for (auto i = dirty_bricks.begin(); i != dirty_bricks.end(); ++i) {
+		compact_brick(*i);
+		outside.compact_brick(*i);
+	}
+	dirty_bricks.clear();
+}
+
+
 void voxel_model::proc_pending_updates(bool postproc_brushes_mode) {
 
+	compact_dirty_bricks(); // even if no blocks were modified
 	if (modified_blocks.empty()) return;
 	//RESET_TIME;
 
@@ -1534,7 +1909,13 @@ void voxel_model::build(bool verbose, bool do_ao_lighting) {
 	if (params.remove_unconnected > 0) {remove_unconnected_outside();}
 	if (params.remove_unconnected > 2) {remove_interior_holes();}
 	remove_excess_cap(temp_work);
-	if (verbose) {PRINT_TIME("  Remove Unconnected");}
+	remove_excess_cap(temp_brick_work);
+
+	if (verbose) {
+		PRINT_TIME("  Remove Unconnected");
+		cout << "Voxel dense bricks: " << get_num_dense_bricks() << ", outside: " << outside.get_num_dense_bricks() << " of " << get_num_bricks()
+			 << ", mem: " << (get_mem_usage() + outside.get_mem_usage()) << " (dense: " << size_t(size())*(sizeof(float) + sizeof(unsigned char)) << ")" << endl;
+	}
 	unsigned const tot_blocks(params.num_blocks*params.num_blocks);
 	assert(pt_to_ix[0].empty() && tri_data[0].empty());
 	for (unsigned i = 0; i < pt_to_ix.size(); ++i) {pt_to_ix[i].resize(tot_blocks);}
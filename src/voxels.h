@@ -113,29 +113,20 @@ public:
 };
 
 
-// stored internally in yxz order
-template<typename V> class voxel_grid : public vector<V> {
-	void init_grid(unsigned nx_, unsigned ny_, unsigned nz_, V default_val, unsigned num_blocks);
+// grid dimensions and conversions between voxel and world space, shared by dense and sparse voxel grids
+class voxel_grid_base {
+protected:
+	void init_dims(unsigned nx_, unsigned ny_, unsigned nz_, unsigned num_blocks);
+	void init_pos(vector3d const &vsz_, point const &center_);
+	void init_pos(cube_t const &bcube);
+	bool read_header(FILE *fp);
+	bool write_header(FILE *fp) const;
 public:
 	unsigned nx, ny, nz, xblocks, yblocks;
 	vector3d vsz; // size of a voxel in x,y,z
 	point center, lo_pos;
 
-	using vector<V>::clear;
-	using vector<V>::empty;
-	using vector<V>::size;
-	using vector<V>::at;
-	using vector<V>::operator[];
-	using vector<V>::resize;
-	using vector<V>::begin;
-	using vector<V>::end;
-	using vector<V>::front;
-
-	voxel_grid() : nx(0), ny(0), nz(0), xblocks(0), yblocks(0), vsz(zero_vector) {}
-	void init(unsigned nx_, unsigned ny_, unsigned nz_, vector3d const &vsz_, point const &center_, V const &default_val, unsigned num_blocks=1);
-	void init(unsigned nx_, unsigned ny_, unsigned nz_, cube_t const &bcube, V const &default_val, unsigned num_blocks=1);
-	void init_from_heightmap(float **height, unsigned mesh_nx, unsigned mesh_ny, unsigned zsteps, float mesh_xsize, float mesh_ysize, unsigned num_blocks=1, bool invert=0);
-	void downsample_2x();
+	voxel_grid_base() : nx(0), ny(0), nz(0), xblocks(0), yblocks(0), vsz(zero_vector) {}
 	bool is_valid_range(int i[3]) const {return (i[0] >= 0 && i[1] >= 0 && i[2] >= 0 && i[0] < (int)nx && i[1] < (int)ny && i[2] < (int)nz);}
 	float get_xv(int x) const {return (x*vsz.x + lo_pos.x);}
 	float get_yv(int y) const {return (y*vsz.y + lo_pos.y);}
@@ -155,17 +146,119 @@ public:
 		//assert(x < nx && y < ny && z < nz);
 		return (z + (x + y*nx)*nz);
 	}
+	void get_xyz_from_ix(unsigned ix, unsigned &x, unsigned &y, unsigned &z) const {
+		unsigned const nxnz(nx*nz);
+		y = ix/nxnz;
+		unsigned const xz(ix - y*nxnz);
+		x = xz/nz;
+		z = xz - x*nz;
+	}
 	void get_bcube_ix_bounds(cube_t const &bcube, int llc[3], int urc[3]) const;
 	point get_pt_at(unsigned x, unsigned y, unsigned z) const  {return (point(x, y, z)*vsz + lo_pos);}
+	cube_t get_raw_bbox() const {return cube_t(lo_pos, center + (center - lo_pos));}
+};
+
+
+// stored internally in yxz order
+template<typename V> class voxel_grid : public voxel_grid_base, public vector<V> {
+	void init_grid(unsigned nx_, unsigned ny_, unsigned nz_, V default_val, unsigned num_blocks);
+public:
+	using vector<V>::clear;
+	using vector<V>::empty;
+	using vector<V>::size;
+	using vector<V>::at;
+	using vector<V>::operator[];
+	using vector<V>::resize;
+	using vector<V>::begin;
+	using vector<V>::end;
+	using vector<V>::front;
+
+	void init(unsigned nx_, unsigned ny_, unsigned nz_, vector3d const &vsz_, point const &center_, V const &default_val, unsigned num_blocks=1);
+	void init(unsigned nx_, unsigned ny_, unsigned nz_, cube_t const &bcube, V const &default_val, unsigned num_blocks=1);
+	void init_from_heightmap(float **height, unsigned mesh_nx, unsigned mesh_ny, unsigned zsteps, float mesh_xsize, float mesh_ysize, unsigned num_blocks=1, bool invert=0);
+	void downsample_2x();
 	V const &get   (unsigned x, unsigned y, unsigned z) const  {return operator[](get_ix(x, y, z));}
 	V &get_ref     (unsigned x, unsigned y, unsigned z)        {return operator[](get_ix(x, y, z));}
 	void set       (unsigned x, unsigned y, unsigned z, V const &val) {operator[](get_ix(x, y, z)) = val;}
-	cube_t get_raw_bbox() const {return cube_t(lo_pos, center + (center - lo_pos));}
 	bool read(FILE *fp);
 	bool write(FILE *fp) const;
 };
 
-typedef voxel_grid<float> float_voxel_grid;
+
+unsigned const VOXEL_BRICK_BITS = 3; // bricks are 8x8x8 voxels
+unsigned const VOXEL_BRICK_SZ   = (1 << VOXEL_BRICK_BITS);
+unsigned const VOXEL_BRICK_MASK = (VOXEL_BRICK_SZ - 1);
+unsigned const VOXEL_BRICK_VOL  = (VOXEL_BRICK_SZ*VOXEL_BRICK_SZ*VOXEL_BRICK_SZ);
+
+// sparse voxel grid: voxels are grouped into bricks stored in yxz order, where each brick is either a single uniform value or dense;
+// writing a different value to a uniform brick makes it dense, and compaction converts dense bricks with all equal values back to uniform;
+// concurrent writes from different threads are only safe if they're to different bricks
+template<typename V> class sparse_voxel_grid : public voxel_grid_base {
+
+	struct brick_t {
+		V val; // value of every voxel in the brick when uniform
+		vector<V> vals; // dense values in yxz order; empty when uniform
+		brick_t(V const &val_=V()) : val(val_) {}
+	};
+	vector<brick_t> bricks;
+	unsigned bnx, bny, bnz; // number of bricks in x, y, z
+
+	static unsigned get_ix_in_brick(unsigned x, unsigned y, unsigned z) {
+		return ((z & VOXEL_BRICK_MASK) + ((x & VOXEL_BRICK_MASK) + (y & VOXEL_BRICK_MASK)*VOXEL_BRICK_SZ)*VOXEL_BRICK_SZ);
+	}
+	static void make_brick_dense(brick_t &b) {if (b.vals.empty()) {b.vals.resize(VOXEL_BRICK_VOL, b.val);}}
+	void alloc_bricks(V const &default_val);
+
+public:
+	sparse_voxel_grid() : bnx(0), bny(0), bnz(0) {}
+	void init(unsigned nx_, unsigned ny_, unsigned nz_, vector3d const &vsz_, point const &center_, V const &default_val, unsigned num_blocks=1);
+	void clear();
+	bool empty() const {return bricks.empty();}
+	unsigned size() const {return (empty() ? 0 : nx*ny*nz);}
+	unsigned get_num_bricks() const {return bricks.size();}
+	unsigned get_num_dense_bricks() const;
+	size_t get_mem_usage() const;
+
+	unsigned get_brick_ix(unsigned x, unsigned y, unsigned z) const {
+		return ((z >> VOXEL_BRICK_BITS) + ((x >> VOXEL_BRICK_BITS) + (y >> VOXEL_BRICK_BITS)*bnx)*bnz);
+	}
+	void get_brick_bounds(unsigned bix, unsigned lo[3], unsigned hi[3]) const; // hi is exclusive and clipped to the grid
+	bool brick_in_xy_range(unsigned bix, unsigned x1, unsigned y1, unsigned x2, unsigned y2) const;
+	void get_bricks_in_xy_range(unsigned x1, unsigned y1, unsigned x2, unsigned y2, vector<unsigned> &bixs) const;
+	bool is_brick_uniform(unsigned bix) const {assert(bix < bricks.size()); return bricks[bix].vals.empty();}
+	V const &get_brick_val(unsigned bix) const {assert(is_brick_uniform(bix)); return bricks[bix].val;}
+	vector<V> const &get_brick_vals(unsigned bix) const {assert(bix < bricks.size()); return bricks[bix].vals;} // empty if uniform
+	void set_brick_uniform(unsigned bix, V const &val);
+
+	V const &get(unsigned x, unsigned y, unsigned z) const {
+		brick_t const &b(bricks[get_brick_ix(x, y, z)]);
+		return (b.vals.empty() ? b.val : b.vals[get_ix_in_brick(x, y, z)]);
+	}
+	V &get_ref(unsigned x, unsigned y, unsigned z) { // Note: makes the brick dense
+		brick_t &b(bricks[get_brick_ix(x, y, z)]);
+		make_brick_dense(b);
+		return b.vals[get_ix_in_brick(x, y, z)];
+	}
+	void set(unsigned x, unsigned y, unsigned z, V const &val) {
+		brick_t &b(bricks[get_brick_ix(x, y, z)]);
+
+		if (b.vals.empty()) {
+			if (val == b.val) return; // no change
+			make_brick_dense(b);
+		}
+		b.vals[get_ix_in_brick(x, y, z)] = val;
+	}
+	V const &operator[](unsigned ix) const {unsigned x, y, z; get_xyz_from_ix(ix, x, y, z); return get(x, y, z);}
+	void set(unsigned ix, V const &val) {unsigned x, y, z; get_xyz_from_ix(ix, x, y, z); set(x, y, z, val);}
+	bool compact_brick(unsigned bix);
+	void compact_range(unsigned x1, unsigned y1, unsigned x2, unsigned y2); // all bricks overlapping this x/y range
+	void compact() {compact_range(0, 0, nx, ny);}
+	void import_dense(vector<V> const &vals);
+	bool read(FILE *fp);
+	bool write(FILE *fp) const;
+};
+
+typedef sparse_voxel_grid<float> float_voxel_grid;
 
 
 class voxel_manager : public float_voxel_grid {
@@ -173,8 +266,8 @@ class voxel_manager : public float_voxel_grid {
 protected:
 	bool use_mesh;
 	voxel_params_t params;
-	voxel_grid<unsigned char> outside;
-	vector<unsigned> temp_work; // used in remove_unconnected_outside_range()/flood_fill()
+	sparse_voxel_grid<unsigned char> outside;
+	vector<unsigned> temp_work, temp_brick_work; // used in remove_unconnected_outside_range()/flood_fill()
 	typedef vert_norm vertex_type_t;
 	typedef vntc_vect_block_t<vertex_type_t> tri_data_t;
 	typedef vertex_map_t<vertex_type_t> vertex_map_type_t;
@@ -194,14 +287,18 @@ protected:
 
 	point interpolate_pt(float isolevel, point const &pt1, point const &pt2, float const val1, float const val2) const;
 	void calc_outside_val(unsigned x, unsigned y, unsigned z, bool is_under_mesh);
+	void flood_fill_add(unsigned x, unsigned y, unsigned z, unsigned x1, unsigned y1, unsigned x2, unsigned y2, vector<unsigned> &work, unsigned char fill_val, unsigned char bit_mask);
 	void flood_fill_range(unsigned x1, unsigned y1, unsigned x2, unsigned y2, vector<unsigned> &work, unsigned char fill_val, unsigned char bit_mask);
 	void remove_unconnected_outside_range(bool keep_at_edge, unsigned x1, unsigned y1, unsigned x2, unsigned y2,
 		vector<unsigned> *xy_updated, vector<pt_ix_t> *updated_pts, bool mark_only=0);
 	unsigned add_triangles_for_voxel(tri_data_t::value_type &tri_verts, voxel_ix_cache &vix_cache,
 		unsigned x, unsigned y, unsigned z, unsigned block_x0, unsigned block_y0, bool count_only, unsigned lod_level) const;
 	void add_cobj_voxels(coll_obj &cobj, float filled_val);
-	void make_voxel_outside(unsigned ix);
-	void make_voxel_inside(unsigned ix);
+	void make_voxel_outside(unsigned x, unsigned y, unsigned z);
+	void make_voxel_inside (unsigned x, unsigned y, unsigned z);
+	void make_brick_outside(unsigned bix);
+	void make_brick_inside (unsigned bix);
+	void compact_voxel_range(unsigned x1, unsigned y1, unsigned x2, unsigned y2);
 
 public:
 	voxel_manager(bool use_mesh_=0) : use_mesh(use_mesh_) {}
@@ -216,6 +313,7 @@ public:
 	void remove_unconnected_outside();
 	void remove_interior_holes();
 	bool is_outside(unsigned ix) const {assert(ix < outside.size()); return((outside[ix]&3) != 0);}
+	bool is_outside(unsigned x, unsigned y, unsigned z) const {return((outside.get(x, y, z)&3) != 0);}
 	bool point_inside_volume(point const &pos) const;
 	bool point_intersect(point const &center, point *int_pt) const;
 	bool sphere_intersect(point const &center, float radius, point *int_pt) const;
@@ -248,13 +346,14 @@ protected:
 	vector<tri_data_t> tri_data; // one per LOD level
 	noise_texture_manager_t *noise_tex_gen;
 	std::set<unsigned> modified_blocks, next_frame_modified_blocks;
+	std::set<unsigned> dirty_bricks; // bricks written by edits that may be compacted
 	voxel_grid<unsigned char> ao_lighting;
 
 	struct step_dir_t {
 		unsigned nsteps;
 		float nsteps_inv;
-		int dir[3], dist_per_step;
-		step_dir_t(int x, int y, int z, unsigned n, int d) : nsteps(n), nsteps_inv(1.0/nsteps), dist_per_step(d) {dir[0] = x; dir[1] = y; dir[2] = z;}
+		int dir[3];
+		step_dir_t(int x, int y, int z, unsigned n) : nsteps(n), nsteps_inv(1.0/nsteps) {dir[0] = x; dir[1] = y; dir[2] = z;}
 	};
 	vector<step_dir_t> ao_dirs;
 	vector<vector<pt_ix_t> > pt_to_ix;
@@ -282,6 +381,8 @@ protected:
 
 	void remove_unconnected_outside_modified_blocks(bool postproc_brushes_mode);
 	unsigned get_block_ix(unsigned voxel_ix) const;
+	unsigned char get_outside_brick_class(unsigned bix) const;
+	void compact_dirty_bricks();
 	virtual bool clear_block(unsigned block_ix);
 	unsigned create_block(voxel_ix_cache &vix_cache, unsigned block_ix, bool first_create, bool count_only, unsigned lod_level);
 	unsigned create_block_all_lods(unsigned block_ix, bool first_create, bool count_only);
@@ -8,7 +8,7 @@
 #include "player_state.h"
 #include "draw_utils.h"
 #include "shaders.h"
-#include <queue>
+#include "profiler.h"
 
 
 int const WP_RESET_FRAMES      = 100; // Note: in frames, not ticks, fix?
@@ -74,7 +74,7 @@ bool waypt_used_set::is_valid(unsigned wp) { // called to determine whether or n
 
 waypoint_t::waypoint_t(point const &p, int cid, bool up, bool i, bool g, bool t)
 	: user_placed(up), placed_item(i), goal(g), temp(t), visited(0), disabled(0), next_valid(0),
-	came_from(-1), item_group(-1), item_ix(-1), coll_id(cid), connected_to(-1), g_score(0), h_score(0), f_score(0), pos(p)
+	item_group(-1), item_ix(-1), coll_id(cid), connected_to(-1), pos(p)
 {
 	clear();
 }
@@ -572,14 +572,58 @@ bool find_closest_waypoint(point const &pos, unsigned &closest, bool check_visib
 // ********** waypoint_search **********
 
 
+// per-thread A* search state, indexed by waypoint, so that searches don't write to waypoints and can run in parallel
 struct waypoint_cache {
 
-	vector<unsigned> open, closed; // tentative/already evaluated nodes
+	struct node_state_t {
+		unsigned open_ix, closed_ix; // call_ix of the last search that opened/closed this node
+		int came_from;
+		float g_score, f_score;
+		node_state_t() : open_ix(0), closed_ix(0), came_from(-1), g_score(0.0), f_score(0.0) {}
+	};
+	vector<node_state_t> nodes;
+	vector<pair<float, unsigned> > open_heap; // binary heap of {-f_score, wpt}, reused across calls
 	unsigned call_ix; // incremented each run_a_star() call
+
 	waypoint_cache() : call_ix(0) {}
+
+	void start_search(unsigned num_wpts) {
+		if (nodes.size() < num_wpts) {nodes.resize(num_wpts);}
+		open_heap.clear();
+
+		if (++call_ix == 0) { // wraparound - reset all stamps
+			for (auto i = nodes.begin(); i != nodes.end(); ++i) {i->open_ix = i->closed_ix = 0;}
+			call_ix = 1;
+		}
+	}
+	bool is_open  (unsigned ix) const {return (nodes[ix].open_ix   == call_ix);}
+	bool is_closed(unsigned ix) const {return (nodes[ix].closed_ix == call_ix);}
+
+	void push_open(unsigned ix) {
+		nodes[ix].open_ix = call_ix;
+		open_heap.push_back(make_pair(-nodes[ix].f_score, ix));
+		push_heap(open_heap.begin(), open_heap.end());
+	}
+	unsigned pop_open() {
+		assert(!open_heap.empty());
+		pop_heap(open_heap.begin(), open_heap.end());
+		unsigned const ix(open_heap.back().second);
+		open_heap.pop_back();
+		return ix;
+	}
 };
 
-waypoint_cache global_wpt_cache;
+vector<waypoint_cache> wpt_caches; // one per thread
+
+void alloc_wpt_caches() { // must be called outside of parallel regions
+	wpt_caches.resize(max(wpt_caches.size(), size_t(max(1, omp_get_max_threads_3dw()))));
+}
+
+waypoint_cache &get_wpt_cache() {
+	unsigned const tid(omp_get_thread_num_3dw());
+	assert(tid < wpt_caches.size());
+	return wpt_caches[tid];
+}
 
 
 class waypoint_search {
@@ -611,9 +655,11 @@ class waypoint_search {
 		return 0;
 	}
 	void reconstruct_path(unsigned cur, vector<unsigned> &path) {
-		assert(cur < waypoints.size());
-		if (waypoints[cur].came_from >= 0) {reconstruct_path(waypoints[cur].came_from, path);}
-		path.push_back(cur);
+		for (int ix = cur; ix >= 0; ix = wc.nodes[ix].came_from) {
+			assert((unsigned)ix < waypoints.size());
+			path.push_back(ix);
+		}
+		reverse(path.begin(), path.end());
 	}
 	void on_a_star_return(wpt_goal const &goal, bool orig_has_wpt_goal) {
 		if (goal.mode == 7) {
@@ -645,19 +691,16 @@ public:
 		if (goal.mode == 7) {has_wpt_goal = 1;}
 		//cout << "start: " << start.size() << ", goal: mode: " << goal.mode << ", pos: " << goal.pos.str() << ", wpt: " << goal.wpt << endl;
 		if (int(goal.wpt) < 0) return 0.0; // no current waypoint, maybe none visible (this code may be unreachable)
-		std::priority_queue<pair<float, unsigned> > open_queue;
-		wc.open.resize(waypoints.size(), 0); // already resized after the first call
-		wc.closed.resize(waypoints.size(), 0);
-		++wc.call_ix;
+		wc.start_search(waypoints.size());
 
 		for (vector<pair<unsigned, float> >::const_iterator i = start.begin(); i != start.end(); ++i) {
 			unsigned const ix(i->first);
 			assert(ix < waypoints.size());
-			waypoint_t &w(waypoints[ix]);
+			waypoint_cache::node_state_t &w(wc.nodes[ix]);
 			w.g_score   = i->second; // cost from start along best known path
-			w.h_score   = get_h_dist(ix);
-			//if (wps_penalty.find(ix) != wps_penalty.end()) {w.h_score *= 10.0;} // distance penalty for this waypoint
-			w.f_score   = w.h_score; // estimated total cost from start to goal through current
+			float const h_score(get_h_dist(ix));
+			//if (wps_penalty.find(ix) != wps_penalty.end()) {h_score *= 10.0;} // distance penalty for this waypoint
+			w.f_score   = h_score; // estimated total cost from start to goal through current
 			w.came_from = -1;
 
 			if (is_goal(ix)) { // already at the goal
@@ -665,8 +708,7 @@ public:
 				on_a_star_return(goal, orig_has_wpt_goal);
 				return w.f_score;
 			}
-			wc.open[ix] = wc.call_ix;
-			open_queue.push(make_pair(-w.f_score, ix));
+			wc.push_open(ix);
 		} // for i
 		if (goal.mode >= 4) {
 			assert(goal.wpt < waypoints.size());
@@ -674,34 +716,30 @@ public:
 		}
 		float min_dist(0.0);
 
-		while (!open_queue.empty()) {
-			unsigned const cur(open_queue.top().second);
-			open_queue.pop();
-			if (wc.closed[cur] == wc.call_ix) continue; // already closed (duplicate)
+		while (!wc.open_heap.empty()) {
+			unsigned const cur(wc.pop_open());
+			if (wc.is_closed(cur)) continue; // already closed (duplicate)
 			waypoint_t const &cw(waypoints[cur]);
+			waypoint_cache::node_state_t &cs(wc.nodes[cur]);
 
 			if (is_goal(cur)) {
 				reconstruct_path(cur, path);
-				min_dist = cw.f_score;
+				min_dist = cs.f_score;
 				break; // we're done
 			}
-			assert(wc.closed[cur] != wc.call_ix);
-			wc.closed[cur] = wc.call_ix;
-			wc.open[cur]   = 0;
+			cs.closed_ix = wc.call_ix;
 
 			for (waypt_adj_vect::const_iterator i = cw.next_wpts.begin(); i != cw.next_wpts.end(); ++i) {
 				assert(*i < waypoints.size());
-				if (wc.closed[*i] == wc.call_ix) continue; // already closed (duplicate)
-				waypoint_t &wn(waypoints[*i]);
+				if (wc.is_closed(*i)) continue; // already closed (duplicate)
+				waypoint_cache::node_state_t &wn(wc.nodes[*i]);
 				// if not connected by a teleporter, use distance between the waypoints; otherswise, use a small but nonzero value
-				float const new_g_score(cw.g_score + ((cw.connected_to == *i) ? CAMERA_RADIUS : p2p_dist(cw.pos, wn.pos)));
-				if (wc.open[*i] != wc.call_ix) {wc.open[*i] = wc.call_ix;}
-				else if (new_g_score >= wn.g_score) continue; // not better
+				float const new_g_score(cs.g_score + ((cw.connected_to == *i) ? CAMERA_RADIUS : p2p_dist(cw.pos, waypoints[*i].pos)));
+				if (wc.is_open(*i) && new_g_score >= wn.g_score) continue; // not better
 				wn.came_from = cur;
 				wn.g_score   = new_g_score;
-				wn.h_score   = get_h_dist(*i);
-				wn.f_score   = wn.g_score + wn.h_score;
-				open_queue.push(make_pair(-wn.f_score, *i));
+				wn.f_score   = wn.g_score + get_h_dist(*i);
+				wc.push_open(*i);
 			} // for i
 		} // end while()
 		on_a_star_return(goal, orig_has_wpt_goal);
@@ -739,13 +777,12 @@ void create_waypoints(vector<user_waypt_t> const &user_waypoints) {
 }
 
 
-// find the optimal next waypoint when already on a waypoint path
-int find_optimal_next_waypoint(unsigned cur, wpt_goal const &goal, set<unsigned> const &wps_penalty) {
+int find_optimal_next_waypoint_int(unsigned cur, wpt_goal const &goal, set<unsigned> const &wps_penalty) {
 
 	if (!goal.is_reachable()) return -1; // nothing to do
 	//RESET_TIME;
 	vector<unsigned> path;
-	waypoint_search ws(goal, global_wpt_cache);
+	waypoint_search ws(goal, get_wpt_cache());
 	vector<pair<unsigned, float> > start;
 	start.push_back(make_pair(cur, 0.0));
 	ws.run_a_star(start, path, wps_penalty);
@@ -756,6 +793,29 @@ int find_optimal_next_waypoint(unsigned cur, wpt_goal const &goal, set<unsigned>
 	return path[1];
 }
 
+// find the optimal next waypoint when already on a waypoint path
+int find_optimal_next_waypoint(unsigned cur, wpt_goal const &goal, set<unsigned> const &wps_penalty) {
+	alloc_wpt_caches();
+	return find_optimal_next_waypoint_int(cur, goal, wps_penalty);
+}
+
+// same as above for a batch of queries, run in parallel; goals must not add temp waypoints (mode 7)
+void find_optimal_next_waypoints(vector<wpt_path_query_t> &queries) {
+
+	if (queries.empty()) return;
+	PROFILE_ZONE("Waypoint Path Batch");
+	alloc_wpt_caches();
+	set<unsigned> const wps_penalty; // unused
+
+#pragma omp parallel for schedule(dynamic,1) if (queries.size() > 1)
+	for (int i = 0; i < (int)queries.size(); ++i) {
+		PROFILE_ZONE("Waypoint Path Query");
+		wpt_path_query_t &q(queries[i]);
+		assert(q.goal.mode != 7);
+		q.next_wpt = find_optimal_next_waypoint_int(q.cur, q.goal, wps_penalty);
+	}
+}
+
 
 // find the optimal next waypoint when not on a waypoint path (using visible waypoints as candidates)
 void find_optimal_waypoint(point const &pos, vector<od_data> &oddatav, wpt_goal const &goal) {
@@ -786,7 +846,8 @@ void find_optimal_waypoint(point const &pos, vector<od_data> &oddatav, wpt_goal
 			start.push_back(make_pair(id, dist));
 		}
 	}
-	waypoint_search ws(goal, global_wpt_cache);
+	alloc_wpt_caches();
+	waypoint_search ws(goal, get_wpt_cache());
 	vector<unsigned> path;
 	ws.run_a_star(start, path, set<unsigned>());
 	//PRINT_TIME("Find Optimal Waypoint");